@@ -30,6 +30,12 @@ cl  -FeendlessAsteroids.exe ^
 ..\code\GraphicsUtilities.cpp ^
 ..\code\MenuUtilities.cpp ^
 ..\code\GameUtilities.cpp ^
+..\code\WorkerPool.cpp ^
+..\code\SpanKernels.cpp ^
+..\code\RenderCommands.cpp ^
+..\code\Win32Present.cpp ^
+..\code\Win32Platform.cpp ^
+..\code\FrameCapture.cpp ^
 user32.lib ^
 gdi32.lib
 
@@ -0,0 +1,38 @@
+#!/bin/sh
+
+# This script builds the headless Linux version, the same way build.bat
+# builds the Windows one. There's no window, it plays a scripted game and
+# prints how long it took, see code/LinuxMain.cpp.
+
+# Stop at the first thing that fails
+set -e
+
+# Need to make sure this directory exists
+mkdir -p build
+
+# Go into the build directory
+cd build
+
+# The "-g" adds in debug info, so perf can find its way around
+# Link to pthread for the worker pool, the key event queue, and frame capture
+g++ -O2 -g -msse2 -o endlessAsteroids \
+../code/LinuxMain.cpp \
+../code/LinuxPlatform.cpp \
+../code/HeadlessPresent.cpp \
+../code/FrameCapture.cpp \
+../code/Game.cpp \
+../code/MathUtilities.cpp \
+../code/ColorUtilities.cpp \
+../code/String.cpp \
+../code/ScreenBuffer.cpp \
+../code/Point.cpp \
+../code/Vector.cpp \
+../code/Matrix.cpp \
+../code/Quaternion.cpp \
+../code/GraphicsUtilities.cpp \
+../code/MenuUtilities.cpp \
+../code/GameUtilities.cpp \
+../code/WorkerPool.cpp \
+../code/SpanKernels.cpp \
+../code/RenderCommands.cpp \
+-lpthread
@@ -10,6 +10,7 @@
    ========================================================================== */
 
 #pragma once
+#include <stddef.h>
 #include "ErrorCodes.h"
 
 template <class T>
@@ -31,6 +32,14 @@ public:
     -------------------------------------------------------------------------- */
 
     inline size_t size() const { return m_size; }
+    inline size_t capacity() const { return m_capacity; }
+
+    // Forget all the elements but keep the memory, so filling the array back
+    // up doesn't need to allocate anything.
+    inline void clear() { m_size = 0; }
+
+    // Forget every element from the given index on, keeping the memory.
+    inline void truncate(size_t size) { if (size < m_size) m_size = size; }
 
     // Compare each element in both arrays. Starting from index 0 in both,
     // if the lhs element is greater then the rhs element, return 1. If the
@@ -58,12 +67,12 @@ public:
 
     Array& operator=(const Array<T>& other);
 
-    inline bool operator==(const Array<T>& other) const { return compare(this, other) == 0; }
-    inline bool operator!=(const Array<T>& other) const { return compare(this, other) != 0; }
-    inline bool operator< (const Array<T>& other) const { return compare(this, other) < 0; }
-    inline bool operator> (const Array<T>& other) const { return compare(this, other) > 0; }
-    inline bool operator<=(const Array<T>& other) const { return compare(this, other) <= 0; }
-    inline bool operator>=(const Array<T>& other) const { return compare(this, other) >= 0; }
+    inline bool operator==(const Array<T>& other) const { return compare(*this, other) == 0; }
+    inline bool operator!=(const Array<T>& other) const { return compare(*this, other) != 0; }
+    inline bool operator< (const Array<T>& other) const { return compare(*this, other) < 0; }
+    inline bool operator> (const Array<T>& other) const { return compare(*this, other) > 0; }
+    inline bool operator<=(const Array<T>& other) const { return compare(*this, other) <= 0; }
+    inline bool operator>=(const Array<T>& other) const { return compare(*this, other) >= 0; }
 
     Array& operator+=(const Array& other);
     Array& operator+=(const T other);
@@ -162,7 +171,7 @@ template <class T>
 int Array<T>::compare(const Array<T>& lhs, const Array<T>& rhs) const
 {
 
-    for (unsigned i = 0; i < lhs->m_size && i < rhs->m_size; i++)
+    for (unsigned i = 0; i < lhs.m_size && i < rhs.m_size; i++)
     {
         if (lhs[i] > rhs[i])
         {
@@ -174,11 +183,11 @@ int Array<T>::compare(const Array<T>& lhs, const Array<T>& rhs) const
         }
     }
 
-    if (lhs->m_size == rhs->m_size)
+    if (lhs.m_size == rhs.m_size)
     {
         return 0;
     }
-    else if (lhs->m_size > rhs->m_size)
+    else if (lhs.m_size > rhs.m_size)
     {
         return 1;
     }
@@ -0,0 +1,95 @@
+/* ==========================================================================
+   >File: Atomics.h
+   >Date: 20180713
+   >Author: Vik Pandher
+   >Details: Atomic operations on longs that the worker threads share. The
+             MSVC intrinsics on Windows, the GCC builtins everywhere else.
+   ========================================================================== */
+
+#pragma once
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+
+
+// Every one of these is a full barrier, nothing gets moved across them by
+// the compiler or the CPU, same as the Interlocked functions.
+
+
+// atomicIncrement
+// ========================================================================== //
+// Add one to a value.
+//
+// @params
+// * volatile long * value, the value shared between threads
+//
+// @return
+// The value after it was incremented.
+inline long atomicIncrement(volatile long * value)
+{
+#if defined(_MSC_VER)
+    return _InterlockedIncrement(value);
+#else
+    return __atomic_add_fetch(value, 1, __ATOMIC_SEQ_CST);
+#endif
+}
+
+
+// atomicDecrement
+// ========================================================================== //
+// Take one away from a value.
+//
+// @params
+// * volatile long * value, the value shared between threads
+//
+// @return
+// The value after it was decremented.
+inline long atomicDecrement(volatile long * value)
+{
+#if defined(_MSC_VER)
+    return _InterlockedDecrement(value);
+#else
+    return __atomic_sub_fetch(value, 1, __ATOMIC_SEQ_CST);
+#endif
+}
+
+
+// atomicAdd
+// ========================================================================== //
+// Add an amount to a value.
+//
+// @params
+// * volatile long * value, the value shared between threads
+// * long amount, what's added to it
+//
+// @return
+// The value before the amount was added.
+inline long atomicAdd(volatile long * value, long amount)
+{
+#if defined(_MSC_VER)
+    return _InterlockedExchangeAdd(value, amount);
+#else
+    return __atomic_fetch_add(value, amount, __ATOMIC_SEQ_CST);
+#endif
+}
+
+
+// atomicExchange
+// ========================================================================== //
+// Replace a value.
+//
+// @params
+// * volatile long * value, the value shared between threads
+// * long newValue, what it's replaced with
+//
+// @return
+// The value before it was replaced.
+inline long atomicExchange(volatile long * value, long newValue)
+{
+#if defined(_MSC_VER)
+    return _InterlockedExchange(value, newValue);
+#else
+    return __atomic_exchange_n(value, newValue, __ATOMIC_SEQ_CST);
+#endif
+}
@@ -200,4 +200,16 @@ Color & Color::operator/=(const unsigned & other)
     this->b /= other;
 
     return *this;
+}
+
+
+bool Color::operator==(const Color & other) const
+{
+    return this->r == other.r && this->g == other.g && this->b == other.b;
+}
+
+
+bool Color::operator!=(const Color & other) const
+{
+    return !(*this == other);
 }
\ No newline at end of file
@@ -44,6 +44,9 @@ struct Color
     Color & operator*=(const unsigned & other);
     Color operator/(const unsigned & other) const;
     Color & operator/=(const unsigned & other);
+
+    bool operator==(const Color & other) const;
+    bool operator!=(const Color & other) const;
 };
 
 
@@ -15,4 +15,54 @@
 #define ERROR_OUTSIDE_BUFFER_BOUNDS                                  3
 #define ERROR_NEGATIVE_INPUT                                         4
 #define ERROR_INPUT_OUT_OF_BOUNDS                                    5
+#define ERROR_THREAD_UNAVAILABLE                                     6
+#define ERROR_FILE_UNAVAILABLE                                       7
 
+
+// getErrorString
+// ========================================================================== //
+// Debugging...
+//
+// @params
+// * int value, one of the errors above
+//
+// @return
+// The name of the error.
+inline const char * getErrorString(int value)
+{
+    switch (value)
+    {
+    case ERROR_OUTSIDE_ARRAY_BOUNDS:
+    {
+        return "ERROR_OUTSIDE_ARRAY_BOUNDS";
+    }
+    case ERROR_MEMORY_UNAVAILABLE:
+    {
+        return "ERROR_MEMORY_UNAVAILABLE";
+    }
+    case ERROR_OUTSIDE_BUFFER_BOUNDS:
+    {
+        return "ERROR_OUTSIDE_BUFFER_BOUNDS";
+    }
+    case ERROR_NEGATIVE_INPUT:
+    {
+        return "ERROR_NEGATIVE_INPUT";
+    }
+    case ERROR_INPUT_OUT_OF_BOUNDS:
+    {
+        return "ERROR_INPUT_OUT_OF_BOUNDS";
+    }
+    case ERROR_THREAD_UNAVAILABLE:
+    {
+        return "ERROR_THREAD_UNAVAILABLE";
+    }
+    case ERROR_FILE_UNAVAILABLE:
+    {
+        return "ERROR_FILE_UNAVAILABLE";
+    }
+    default:
+    {
+        return  "ERROR_???";
+    }
+    }
+}
@@ -0,0 +1,524 @@
+/* ==========================================================================
+   >File: FrameCapture.cpp
+   >Date: 20180713
+   >Author: Vik Pandher
+   >Details: Records frames to disk without slowing down drawing. Frames are
+             copied into recycled buffers and written out by a thread of
+             their own.
+   ========================================================================== */
+
+#include "FrameCapture.h"
+#if !defined(_WIN32)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#endif
+
+
+
+// QOI ops, see encodeQOI
+#define QOI_OP_INDEX 0x00 // 00xxxxxx, a color from the table
+#define QOI_OP_DIFF  0x40 // 01rrggbb, each channel off by -2 to 1
+#define QOI_OP_LUMA  0x80 // 10gggggg rrrrbbbb, green off by -32 to 31
+#define QOI_OP_RUN   0xC0 // 11xxxxxx, the last color 1 to 62 more times
+#define QOI_OP_RGB   0xFE // then red, green, blue
+
+// QOI_OP_RUN's biggest run, 63 and 64 would look like QOI_OP_RGB(A)
+#define QOI_MAX_RUN 62
+
+// Header, the pixels at most 4 bytes each, and the end marker
+#define QOI_HEADER_SIZE 14
+#define QOI_END_SIZE 8
+
+
+// writeBigEndian
+// ========================================================================== //
+// Write a 32 bit value most significant byte first, the way QOI wants it.
+//
+// @params
+// * uint8_t * bytes, where it's written
+// * uint32_t value, the value
+static inline void writeBigEndian(uint8_t * bytes, uint32_t value)
+{
+    bytes[0] = (uint8_t)(value >> 24);
+    bytes[1] = (uint8_t)(value >> 16);
+    bytes[2] = (uint8_t)(value >> 8);
+    bytes[3] = (uint8_t)value;
+}
+
+
+
+unsigned getPPMSize(int width, int height)
+{
+    int headerSize = snprintf(0, 0, "P6\n%d %d\n255\n", width, height);
+    return headerSize + width * height * 3;
+}
+
+
+unsigned encodePPM(const uint32_t * pixels, int width, int height, uint8_t * bytes)
+{
+    uint8_t * start = bytes;
+
+    char header[32];
+    int headerSize = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+    for (int i = 0; i < headerSize; i++)
+    {
+        *bytes++ = header[i];
+    }
+
+    // PPM goes top to bottom, the frame goes bottom to top
+    for (int y = height - 1; y >= 0; y--)
+    {
+        const uint32_t * row = pixels + y * width;
+        for (int x = 0; x < width; x++)
+        {
+            *bytes++ = (uint8_t)(row[x] >> 16);
+            *bytes++ = (uint8_t)(row[x] >> 8);
+            *bytes++ = (uint8_t)row[x];
+        }
+    }
+
+    return (unsigned)(bytes - start);
+}
+
+
+
+// public:
+
+FrameCapture::FrameCapture() :
+    m_filledWrite(0),
+    m_filledRead(0),
+    m_freeWrite(0),
+    m_freeRead(0),
+    m_capturing(false),
+    m_format(FRAME_CAPTURE_PPM),
+    m_path(0),
+    m_file(0),
+    m_encoded(0),
+    m_encodedCapacity(0),
+    m_writeFailed(false),
+    m_capturedCount(0),
+    m_droppedCount(0)
+{
+    for (int i = 0; i < FRAME_CAPTURE_BUFFERS; i++)
+    {
+        m_frames[i].pixels = 0;
+        m_frames[i].capacity = 0;
+        m_frames[i].width = 0;
+        m_frames[i].height = 0;
+        m_frames[i].number = 0;
+    }
+}
+
+
+FrameCapture::~FrameCapture()
+{
+    stop();
+
+    for (int i = 0; i < FRAME_CAPTURE_BUFFERS; i++)
+    {
+        delete[] m_frames[i].pixels;
+    }
+    delete[] m_encoded;
+}
+
+
+void FrameCapture::start(const char * path, FrameCaptureFormat format /*= FRAME_CAPTURE_PPM*/)
+{
+    if (m_capturing)
+    {
+        return;
+    }
+
+    if (format == FRAME_CAPTURE_PPM)
+    {
+        m_file = fopen(path, "wb");
+        if (!m_file)
+        {
+            throw ERROR_FILE_UNAVAILABLE;
+        }
+    }
+
+    int length = 0;
+    while (path[length])
+    {
+        length++;
+    }
+    m_path = new char[length + 1];
+    for (int i = 0; i <= length; i++)
+    {
+        m_path[i] = path[i];
+    }
+
+    m_format = format;
+    m_writeFailed = false;
+    m_capturedCount = 0;
+    m_droppedCount = 0;
+
+    // every buffer starts out free
+    m_filledWrite = 0;
+    m_filledRead = 0;
+    m_freeWrite = FRAME_CAPTURE_BUFFERS;
+    m_freeRead = 0;
+    for (int i = 0; i < FRAME_CAPTURE_BUFFERS; i++)
+    {
+        m_free[i] = i;
+    }
+
+#if defined(_WIN32)
+    m_filledSemaphore = CreateSemaphore(0, 0, FRAME_CAPTURE_BUFFERS + 1, 0);
+    m_freeSemaphore = CreateSemaphore(0, FRAME_CAPTURE_BUFFERS, FRAME_CAPTURE_BUFFERS, 0);
+    m_encoderThread = m_filledSemaphore && m_freeSemaphore ? CreateThread(0, 0, encoderMain, this, 0, 0) : 0;
+    bool started = m_encoderThread != 0;
+    if (started)
+    {
+        SetThreadPriority(m_encoderThread, THREAD_PRIORITY_BELOW_NORMAL);
+    }
+    else
+    {
+        if (m_filledSemaphore) CloseHandle(m_filledSemaphore);
+        if (m_freeSemaphore) CloseHandle(m_freeSemaphore);
+    }
+#else
+    bool started = false;
+    if (sem_init(&m_filledSemaphore, 0, 0) == 0)
+    {
+        if (sem_init(&m_freeSemaphore, 0, FRAME_CAPTURE_BUFFERS) == 0)
+        {
+            started = pthread_create(&m_encoderThread, 0, encoderMain, this) == 0;
+            if (!started) sem_destroy(&m_freeSemaphore);
+        }
+        if (!started) sem_destroy(&m_filledSemaphore);
+    }
+#endif
+    if (!started)
+    {
+        if (m_file)
+        {
+            fclose(m_file);
+            m_file = 0;
+        }
+        delete[] m_path;
+        m_path = 0;
+        throw ERROR_THREAD_UNAVAILABLE;
+    }
+
+    m_capturing = true;
+}
+
+
+bool FrameCapture::stop()
+{
+    if (!m_capturing)
+    {
+        return true;
+    }
+    m_capturing = false;
+
+    // FRAME_CAPTURE_BUFFERS isn't a buffer, it tells the encoder to quit once
+    // it's written everything before it
+    queueFilled(FRAME_CAPTURE_BUFFERS);
+
+#if defined(_WIN32)
+    WaitForSingleObject(m_encoderThread, INFINITE);
+    CloseHandle(m_encoderThread);
+    CloseHandle(m_filledSemaphore);
+    CloseHandle(m_freeSemaphore);
+#else
+    pthread_join(m_encoderThread, 0);
+    sem_destroy(&m_filledSemaphore);
+    sem_destroy(&m_freeSemaphore);
+#endif
+
+    if (m_file)
+    {
+        if (fclose(m_file) != 0)
+        {
+            m_writeFailed = true;
+        }
+        m_file = 0;
+    }
+    delete[] m_path;
+    m_path = 0;
+
+    return !m_writeFailed;
+}
+
+
+bool FrameCapture::capture(const ScreenBuffer & screenBuffer)
+{
+    if (!m_capturing)
+    {
+        return false;
+    }
+
+    // Backpressure, every buffer is still waiting on the encoder. Better to
+    // lose a frame from the recording than to hold up the game.
+    int index;
+    if (!takeFree(index))
+    {
+        m_droppedCount++;
+        return false;
+    }
+
+    // Buffers only grow, the frame only changes size when the screen buffer
+    // is resized
+    CapturedFrame & frame = m_frames[index];
+    frame.width = screenBuffer.getWidth();
+    frame.height = screenBuffer.getHeight();
+    unsigned count = frame.width * frame.height;
+    if (count > frame.capacity)
+    {
+        delete[] frame.pixels;
+        frame.pixels = new uint32_t[count];
+        frame.capacity = count;
+    }
+
+    const uint32_t * pixels = screenBuffer.getPixels();
+    for (unsigned i = 0; i < count; i++)
+    {
+        frame.pixels[i] = pixels[i];
+    }
+    frame.number = m_capturedCount + m_droppedCount;
+    m_capturedCount++;
+
+    queueFilled(index);
+    return true;
+}
+
+
+// private:
+
+#if defined(_WIN32)
+DWORD WINAPI FrameCapture::encoderMain(LPVOID parameter)
+{
+    ((FrameCapture *)parameter)->encoderLoop();
+    return 0;
+}
+#else
+void * FrameCapture::encoderMain(void * parameter)
+{
+    // Linux gives each thread its own nice value, this is the same as
+    // THREAD_PRIORITY_BELOW_NORMAL
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), 10);
+    ((FrameCapture *)parameter)->encoderLoop();
+    return 0;
+}
+#endif
+
+
+void FrameCapture::encoderLoop()
+{
+    while (true)
+    {
+        int index = takeFilled();
+        if (index == FRAME_CAPTURE_BUFFERS)
+        {
+            break;
+        }
+
+        const CapturedFrame & frame = m_frames[index];
+        if (m_format == FRAME_CAPTURE_PPM)
+        {
+            reserveEncoded(getPPMSize(frame.width, frame.height));
+            unsigned size = encodePPM(frame.pixels, frame.width, frame.height, m_encoded);
+            if (fwrite(m_encoded, 1, size, m_file) != size)
+            {
+                m_writeFailed = true;
+            }
+        }
+        else
+        {
+            unsigned size = encodeQOI(frame);
+
+            char fileName[1024];
+            snprintf(fileName, sizeof(fileName), "%s_%05u.qoi", m_path, frame.number);
+            FILE * file = fopen(fileName, "wb");
+            if (!file || fwrite(m_encoded, 1, size, file) != size)
+            {
+                m_writeFailed = true;
+            }
+            if (file && fclose(file) != 0)
+            {
+                m_writeFailed = true;
+            }
+        }
+
+        queueFree(index);
+    }
+}
+
+
+unsigned FrameCapture::encodeQOI(const CapturedFrame & frame)
+{
+    reserveEncoded(QOI_HEADER_SIZE + frame.width * frame.height * 4 + QOI_END_SIZE);
+
+    uint8_t * bytes = m_encoded;
+    bytes[0] = 'q';
+    bytes[1] = 'o';
+    bytes[2] = 'i';
+    bytes[3] = 'f';
+    writeBigEndian(bytes + 4, frame.width);
+    writeBigEndian(bytes + 8, frame.height);
+    bytes[12] = 3; // channels, RGB
+    bytes[13] = 0; // colorspace, sRGB
+    bytes += QOI_HEADER_SIZE;
+
+    // Colors seen so far, by hash. Alpha is always 255, so it's left out
+    // of the colors but still goes into the hash.
+    uint32_t table[64];
+    for (int i = 0; i < 64; i++)
+    {
+        table[i] = 0xFFFFFFFF; // matches nothing, empty entries are black with 0 alpha
+    }
+
+    uint32_t last = 0; // black, the color before the first pixel
+    int run = 0;
+
+    // QOI goes top to bottom, the frame goes bottom to top
+    for (int y = frame.height - 1; y >= 0; y--)
+    {
+        const uint32_t * pixels = frame.pixels + y * frame.width;
+        for (int x = 0; x < frame.width; x++)
+        {
+            uint32_t color = pixels[x] & 0x00FFFFFF;
+            if (color == last)
+            {
+                run++;
+                if (run == QOI_MAX_RUN)
+                {
+                    *bytes++ = QOI_OP_RUN | (run - 1);
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0)
+            {
+                *bytes++ = QOI_OP_RUN | (run - 1);
+                run = 0;
+            }
+
+            int r = (color >> 16) & 0xFF;
+            int g = (color >> 8) & 0xFF;
+            int b = color & 0xFF;
+            int hash = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64;
+
+            if (table[hash] == color)
+            {
+                *bytes++ = QOI_OP_INDEX | hash;
+            }
+            else
+            {
+                table[hash] = color;
+
+                // differences wrap around, same as the decoder's 8 bit math
+                int dr = (int8_t)(r - ((last >> 16) & 0xFF));
+                int dg = (int8_t)(g - ((last >> 8) & 0xFF));
+                int db = (int8_t)(b - (last & 0xFF));
+                int drg = dr - dg;
+                int dbg = db - dg;
+
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                {
+                    *bytes++ = QOI_OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2);
+                }
+                else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7)
+                {
+                    *bytes++ = QOI_OP_LUMA | (dg + 32);
+                    *bytes++ = ((drg + 8) << 4) | (dbg + 8);
+                }
+                else
+                {
+                    *bytes++ = QOI_OP_RGB;
+                    *bytes++ = (uint8_t)r;
+                    *bytes++ = (uint8_t)g;
+                    *bytes++ = (uint8_t)b;
+                }
+            }
+            last = color;
+        }
+    }
+    if (run > 0)
+    {
+        *bytes++ = QOI_OP_RUN | (run - 1);
+    }
+
+    // the end marker, seven 0s and a 1
+    for (int i = 0; i < QOI_END_SIZE - 1; i++)
+    {
+        *bytes++ = 0;
+    }
+    *bytes++ = 1;
+
+    return (unsigned)(bytes - m_encoded);
+}
+
+
+void FrameCapture::reserveEncoded(unsigned size)
+{
+    if (size > m_encodedCapacity)
+    {
+        delete[] m_encoded;
+        m_encoded = new uint8_t[size];
+        m_encodedCapacity = size;
+    }
+}
+
+
+void FrameCapture::queueFilled(int index)
+{
+    m_filled[m_filledWrite % (FRAME_CAPTURE_BUFFERS + 1)] = index;
+    m_filledWrite++;
+#if defined(_WIN32)
+    ReleaseSemaphore(m_filledSemaphore, 1, 0);
+#else
+    sem_post(&m_filledSemaphore);
+#endif
+}
+
+
+int FrameCapture::takeFilled()
+{
+#if defined(_WIN32)
+    WaitForSingleObject(m_filledSemaphore, INFINITE);
+#else
+    while (sem_wait(&m_filledSemaphore) != 0)
+    {
+        // interrupted by a signal, keep waiting
+    }
+#endif
+    int index = m_filled[m_filledRead % (FRAME_CAPTURE_BUFFERS + 1)];
+    m_filledRead++;
+    return index;
+}
+
+
+void FrameCapture::queueFree(int index)
+{
+    m_free[m_freeWrite % FRAME_CAPTURE_BUFFERS] = index;
+    m_freeWrite++;
+#if defined(_WIN32)
+    ReleaseSemaphore(m_freeSemaphore, 1, 0);
+#else
+    sem_post(&m_freeSemaphore);
+#endif
+}
+
+
+bool FrameCapture::takeFree(int & index)
+{
+#if defined(_WIN32)
+    if (WaitForSingleObject(m_freeSemaphore, 0) != WAIT_OBJECT_0)
+    {
+        return false;
+    }
+#else
+    if (sem_trywait(&m_freeSemaphore) != 0)
+    {
+        return false;
+    }
+#endif
+    index = m_free[m_freeRead % FRAME_CAPTURE_BUFFERS];
+    m_freeRead++;
+    return true;
+}
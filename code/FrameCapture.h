@@ -0,0 +1,254 @@
+/* ==========================================================================
+   >File: FrameCapture.h
+   >Date: 20180713
+   >Author: Vik Pandher
+   >Details: Records frames to disk without slowing down drawing. Frames are
+             copied into recycled buffers and written out by a thread of
+             their own.
+   ========================================================================== */
+
+#pragma once
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <semaphore.h>
+#endif
+#include <stdio.h>
+#include "ErrorCodes.h"
+#include "ScreenBuffer.h"
+
+
+
+// Buffers frames can be copied into. Once they're all waiting to be written,
+// new frames are dropped instead of waiting for one to free up.
+#define FRAME_CAPTURE_BUFFERS 4
+
+
+// How the frames are written
+enum FrameCaptureFormat
+{
+    FRAME_CAPTURE_PPM, // one file, binary PPMs one after the other
+    FRAME_CAPTURE_QOI  // a QOI file per frame, PATH_NNNNN.qoi, gaps where
+                       // frames were dropped
+};
+
+
+// A frame that's been copied, waiting to be written or being written
+struct CapturedFrame
+{
+    uint32_t * pixels; // bottom row first, like the screen buffer
+    unsigned capacity; // pixels there's room for
+    int width;
+    int height;
+    unsigned number;   // frames given to capture before it, dropped or not
+};
+
+
+// getPPMSize
+// ========================================================================== //
+// 
+// @params
+// * int width, frame width in pixels
+// * int height, frame height in pixels
+// 
+// @return
+// Bytes a binary PPM of a frame that size takes, header included.
+unsigned getPPMSize(int width, int height);
+
+
+// encodePPM
+// ========================================================================== //
+// Turn pixels laid out like the screen buffer, 0x 00 RR GG BB with the bottom
+// row first, into a binary PPM, which goes top row first. Shared by the PPM
+// capture and HeadlessPresent::saveFrame.
+// 
+// @params
+// * const uint32_t * pixels, first pixel of the bottom row
+// * int width, frame width in pixels, rows are this many pixels apart
+// * int height, frame height in pixels
+// * uint8_t * bytes, where the PPM goes, needs getPPMSize bytes
+// 
+// @return
+// Bytes written.
+unsigned encodePPM(const uint32_t * pixels, int width, int height, uint8_t * bytes);
+
+
+// Copies frames on the drawing thread and writes them on the encoder thread.
+//
+// Buffers go around in a circle. The drawing thread takes a free one, copies
+// a frame into it, and queues it. The encoder thread takes it off the queue,
+// writes it, and gives it back. Each queue is a ring with one thread adding
+// and the other taking, and its semaphore counts what's in it, so neither
+// thread ever needs a lock. When the encoder falls behind, capture sees there
+// are no free buffers and drops the frame, so the drawing thread never waits
+// on the disk. The encoder thread runs below normal priority, so it gets the
+// time left over instead of taking it from drawing.
+class FrameCapture
+{
+public:
+    // FrameCapture
+    // ====================================================================== //
+    // Nothing is captured until start is called.
+    FrameCapture();
+
+    // ~FrameCapture
+    // ====================================================================== //
+    // Stop if it's capturing and free the buffers.
+    ~FrameCapture();
+
+    // start
+    // ====================================================================== //
+    // Open the output and start the encoder thread. Does nothing if it's
+    // already capturing. Throws ERROR_FILE_UNAVAILABLE if the
+    // FRAME_CAPTURE_PPM file can't be opened, and ERROR_THREAD_UNAVAILABLE
+    // if the thread can't be started. Nothing is left open if it throws.
+    //
+    // @params
+    // * const char * path, the file for FRAME_CAPTURE_PPM, or what goes in
+    //                      front of the frame numbers for FRAME_CAPTURE_QOI
+    // * FrameCaptureFormat format = FRAME_CAPTURE_PPM, how they're written
+    void start(const char * path, FrameCaptureFormat format = FRAME_CAPTURE_PPM);
+
+    // stop
+    // ====================================================================== //
+    // Wait for the encoder thread to write every frame already captured,
+    // then close the output. Does nothing if it isn't capturing.
+    //
+    // @return
+    // False if any of the frames couldn't be written.
+    bool stop();
+
+    // capture
+    // ====================================================================== //
+    // Copy a finished frame and queue it to be written. Only call it from
+    // one thread, after the frame is drawn and before the next one starts.
+    //
+    // @params
+    // * const ScreenBuffer & screenBuffer, the frame
+    //
+    // @return
+    // False if it isn't capturing, or the frame was dropped because every
+    // buffer was still waiting to be written.
+    bool capture(const ScreenBuffer & screenBuffer);
+
+    // isCapturing
+    // ====================================================================== //
+    //
+    // @return
+    // True between start and stop.
+    inline bool isCapturing() const
+    {
+        return m_capturing;
+    }
+
+    // getCapturedCount
+    // ====================================================================== //
+    //
+    // @return
+    // Frames copied since start.
+    inline unsigned getCapturedCount() const
+    {
+        return m_capturedCount;
+    }
+
+    // getDroppedCount
+    // ====================================================================== //
+    //
+    // @return
+    // Frames dropped since start because the encoder was behind.
+    inline unsigned getDroppedCount() const
+    {
+        return m_droppedCount;
+    }
+
+private:
+    // encoderMain
+    // ====================================================================== //
+    // Where the encoder thread starts, it just calls encoderLoop.
+    //
+    // @params
+    // * parameter, pointer to the FrameCapture
+#if defined(_WIN32)
+    static DWORD WINAPI encoderMain(LPVOID parameter);
+#else
+    static void * encoderMain(void * parameter);
+#endif
+
+    // encoderLoop
+    // ====================================================================== //
+    // Where the encoder thread lives. Wait for a frame, write it, give its
+    // buffer back, repeat until stop queues FRAME_CAPTURE_BUFFERS.
+    void encoderLoop();
+
+    // encodeQOI
+    // ====================================================================== //
+    // Turn a frame into a QOI image, "The Quite OK Image Format", in
+    // m_encoded. Runs, a table of recent colors, and small differences from
+    // the pixel before keep it a fraction of the size of a PPM, and it's
+    // about as quick to write.
+    //
+    // @params
+    // * const CapturedFrame & frame, the frame
+    //
+    // @return
+    // Bytes of m_encoded used.
+    unsigned encodeQOI(const CapturedFrame & frame);
+
+    // reserveEncoded
+    // ====================================================================== //
+    // Make sure m_encoded can hold some number of bytes.
+    //
+    // @params
+    // * unsigned size, bytes needed
+    void reserveEncoded(unsigned size);
+
+    // queueFilled, takeFilled, queueFree, takeFree
+    // ====================================================================== //
+    // Add a buffer index to the back of a ring, or take one off the front.
+    // The queue functions post the ring's semaphore and the take functions
+    // wait on it, takeFree without waiting at all.
+    //
+    // @return (takeFree)
+    // False if there weren't any free buffers.
+    void queueFilled(int index);
+    int takeFilled();
+    void queueFree(int index);
+    bool takeFree(int & index);
+
+private:
+    CapturedFrame m_frames[FRAME_CAPTURE_BUFFERS];
+
+    // Rings of buffer indices. The filled ring has an extra spot for the
+    // FRAME_CAPTURE_BUFFERS stop queues to tell the encoder to quit. Each
+    // read and write position is only touched by one thread.
+    int m_filled[FRAME_CAPTURE_BUFFERS + 1];
+    unsigned m_filledWrite; // drawing thread
+    unsigned m_filledRead;  // encoder thread
+    int m_free[FRAME_CAPTURE_BUFFERS];
+    unsigned m_freeWrite;   // encoder thread
+    unsigned m_freeRead;    // drawing thread
+
+#if defined(_WIN32)
+    HANDLE m_encoderThread;
+    HANDLE m_filledSemaphore;
+    HANDLE m_freeSemaphore;
+#else
+    pthread_t m_encoderThread;
+    sem_t m_filledSemaphore;
+    sem_t m_freeSemaphore;
+#endif
+
+    bool m_capturing;
+    FrameCaptureFormat m_format;
+    char * m_path; // copy of what start was given
+    FILE * m_file; // only for FRAME_CAPTURE_PPM
+
+    // the encoder thread's, what frames get encoded into before writing
+    uint8_t * m_encoded;
+    unsigned m_encodedCapacity;
+    bool m_writeFailed;
+
+    unsigned m_capturedCount;
+    unsigned m_droppedCount;
+};
@@ -281,6 +281,12 @@ void deinitialize()
 
 void keyDown(const uint8_t k)
 {
+    if (k == RENDER_STATS_KEY)
+    {
+        s_showRenderStats = !s_showRenderStats;
+        s_frameStale = true;
+    }
+
     for (int i = 0; i < s_keyKeys.size(); i++)
     {
         if (k == s_keyKeys[i])
@@ -295,6 +301,7 @@ void keyDown(const uint8_t k)
         s_keyKeys[s_controlsCursor + 4] = k;
         s_controlsButtons[s_controlsCursor]->m_text = getKeyString(k);
         s_returnFromKeyChangeButton->press();
+        s_frameStale = true;
     }
 }
 
@@ -319,6 +326,8 @@ void keyUp(const uint8_t k)
 
 void update()
 {
+    GameState previousState = s_gameState;
+
     for (int i = 0; i < s_keyButtons.size(); i++)
     {
         s_keyButtons[i]->update();
@@ -333,11 +342,16 @@ void update()
             s_mainButtons[i]->update();
             s_mainButtons[i]->release();
         }
+
+        // the entity behind the menu is always turning
         s_mainEntity->update();
+        s_frameStale = true;
         break;
     }
     case GS_PLAY:
     {
+        s_frameStale = true;
+
         triggerEntitySpawner();
 
         if (!s_zoomed)
@@ -470,7 +484,10 @@ void update()
     {
         for (int i = 0; i < s_pauseButtons.size(); i++)
         {
-            s_pauseButtons[i]->update();
+            if (s_pauseButtons[i]->update())
+            {
+                s_frameStale = true;
+            }
             s_pauseButtons[i]->release();
         }
         break;
@@ -479,7 +496,10 @@ void update()
     {
         for (int i = 0; i < s_endButtons.size(); i++)
         {
-            s_endButtons[i]->update();
+            if (s_endButtons[i]->update())
+            {
+                s_frameStale = true;
+            }
             s_endButtons[i]->release();
         }
         break;
@@ -492,93 +512,224 @@ void update()
     {
         for (int i = 0; i < s_controlsButtons.size(); i++)
         {
-            s_controlsButtons[i]->update();
+            if (s_controlsButtons[i]->update())
+            {
+                s_frameStale = true;
+            }
             s_controlsButtons[i]->release();
         }
         break;
     }
     case GS_KEY_CHANGE:
     {
-        s_returnFromKeyChangeButton->update();
+        if (s_returnFromKeyChangeButton->update())
+        {
+            s_frameStale = true;
+        }
         s_returnFromKeyChangeButton->release();
         break;
     }
     }
+
+    if (s_gameState != previousState)
+    {
+        s_frameStale = true;
+    }
 }
 
 
-void draw()
+bool captureRenderSnapshot(RenderSnapshot & snapshot)
 {
-    g_screenBuffer->clear(COLOR_BLACK);
+    if (!s_frameStale)
+    {
+        return false;
+    }
+    s_frameStale = false;
+
+    snapshot.sequence = ++s_snapshotSequence;
+    snapshot.gameState = s_gameState;
+    snapshot.entityCount = 0;
+    snapshot.drawList.clear();
+    snapshot.score = s_score;
+    snapshot.shipHealth = s_playShip->health;
+    snapshot.controlsCursor = s_controlsCursor;
+    snapshot.showRenderStats = s_showRenderStats;
+    snapshot.textBoxes.clear();
+
     switch (s_gameState)
     {
     case GS_MAIN:
     {
-        g_screenBuffer->rasterize(*s_mainCamera, s_mainEntity);
-        
-        g_screenBuffer->drawTextBox(*s_mainTitle0);
-        g_screenBuffer->drawTextBox(*s_mainTitle1);
+        snapshot.camera = *s_mainCamera;
+        addSnapshotEntity(snapshot, s_mainEntity);
+        snapshot.drawList += snapshot.entities.getPointerTo(0);
+
+        snapshot.textBoxes += *s_mainTitle0;
+        snapshot.textBoxes += *s_mainTitle1;
         for (int i = 0; i < s_mainButtons.size(); i++)
         {
-            g_screenBuffer->drawTextBox(*(s_mainButtons[i]));
+            snapshot.textBoxes += *(s_mainButtons[i]);
+        }
+        break;
+    }
+    case GS_PLAY:
+    {
+        capturePlayEntities(snapshot);
+        break;
+    }
+    case GS_PAUSE:
+    {
+        capturePlayEntities(snapshot);
+        for (int i = 0; i < s_pauseButtons.size(); i++)
+        {
+            snapshot.textBoxes += *(s_pauseButtons[i]);
+        }
+        break;
+    }
+    case GS_END:
+    {
+        for (int i = 0; i < s_endButtons.size(); i++)
+        {
+            snapshot.textBoxes += *(s_endButtons[i]);
+        }
+        break;
+    }
+    ///case GS_SCORES:
+    ///{
+    ///    break;
+    ///}
+    case GS_CONTROLS:
+    case GS_KEY_CHANGE:
+    {
+        for (int i = 0; i < s_controlsButtons.size(); i++)
+        {
+            snapshot.textBoxes += *(s_controlsButtons[i]);
+        }
+        for (int i = 0; i < s_controlsBoxes.size(); i++)
+        {
+            snapshot.textBoxes += *(s_controlsBoxes[i]);
+        }
+        break;
+    }
+    }
+
+    return true;
+}
+
+
+void capturePlayEntities(RenderSnapshot & snapshot)
+{
+    snapshot.camera = *s_playCamera;
+
+    if (!s_zoomed) addSnapshotEntity(snapshot, s_playShip);
+    addSnapshotEntity(snapshot, s_playBorder);
+    for (int i = 0; i < s_playAsteroids.size(); i++)
+    {
+        addSnapshotEntity(snapshot, s_playAsteroids[i]);
+    }
+    for (int i = 0; i < s_playSaucers.size(); i++)
+    {
+        addSnapshotEntity(snapshot, s_playSaucers[i]);
+    }
+    for (int i = 0; i < s_playBullets.size(); i++)
+    {
+        addSnapshotEntity(snapshot, s_playBullets[i]);
+    }
+
+    // these frames change every update, so they're copied
+    addSnapshotEntity(snapshot, s_playTrailR, true);
+    addSnapshotEntity(snapshot, s_playTrailL, true);
+    addSnapshotEntity(snapshot, s_playLaser, true);
+    for (int i = 0; i < s_playFlowers.size(); i++)
+    {
+        addSnapshotEntity(snapshot, s_playFlowers[i], true);
+    }
+
+    // the entities array is done growing, so pointers into it stay put
+    for (int i = 0; i < snapshot.entityCount; i++)
+    {
+        snapshot.drawList += snapshot.entities.getPointerTo(i);
+    }
+}
+
+
+void addSnapshotEntity(RenderSnapshot & snapshot, Entity * entity, bool copyFrame /*= false*/)
+{
+    if (snapshot.entityCount == snapshot.entities.size())
+    {
+        snapshot.entities += Entity();
+    }
+    copyEntityForDrawing(*entity, snapshot.entities[snapshot.entityCount], copyFrame);
+    snapshot.entityCount++;
+}
+
+
+bool draw(const RenderSnapshot & snapshot)
+{
+    long width = g_screenBuffer->getWidth();
+    long height = g_screenBuffer->getHeight();
+    if (snapshot.sequence == 0 || (snapshot.sequence == s_frameSequence && width == s_frameWidth && height == s_frameHeight))
+    {
+        return false;
+    }
+    s_frameSequence = snapshot.sequence;
+    s_frameWidth = width;
+    s_frameHeight = height;
+
+    s_renderCommands.reset();
+    s_renderCommands.clear(COLOR_BLACK);
+    const Array<TextBox> & textBoxes = snapshot.textBoxes;
+    switch (snapshot.gameState)
+    {
+    case GS_MAIN:
+    {
+        s_renderCommands.rasterize(snapshot.camera, snapshot.drawList[0]);
+        
+        for (int i = 0; i < textBoxes.size(); i++)
+        {
+            s_renderCommands.drawTextBox(textBoxes[i]);
         }
         String note("Created By:");
-        g_screenBuffer->drawString(5, 5 + ASCII_HEIGHT + 1, note, COLOR_WHITE / 4);
-        g_screenBuffer->drawString(5, 5, AUTHOR_STRING, COLOR_WHITE / 4);
+        s_renderCommands.drawString(5, 5 + ASCII_HEIGHT + 1, note, COLOR_WHITE / 4);
+        s_renderCommands.drawString(5, 5, AUTHOR_STRING, COLOR_WHITE / 4);
         break;
     }
     case GS_PLAY:
     {
-        if(!s_zoomed) g_screenBuffer->rasterize(*s_playCamera, s_playShip);
-        g_screenBuffer->rasterize(*s_playCamera, s_playBorder);
-        g_screenBuffer->rasterizeGroup(*s_playCamera, s_playAsteroids);
-        g_screenBuffer->rasterizeGroup(*s_playCamera, s_playSaucers);
-        g_screenBuffer->rasterizeGroup(*s_playCamera, s_playBullets);
-        g_screenBuffer->rasterize(*s_playCamera, s_playTrailR);
-        g_screenBuffer->rasterize(*s_playCamera, s_playTrailL);
-        g_screenBuffer->rasterize(*s_playCamera, s_playLaser);
-        g_screenBuffer->rasterizeGroup(*s_playCamera, s_playFlowers);
+        s_renderCommands.rasterizeGroup(snapshot.camera, snapshot.drawList);
         int width = g_screenBuffer->getWidth();
         int height = g_screenBuffer->getHeight();
-        String scoreString = String::stringFromInt(s_score);
-        if (s_playShip->health > 0)
+        String scoreString = String::stringFromInt(snapshot.score);
+        if (snapshot.shipHealth > 0)
         {
-            g_screenBuffer->drawHearts(s_playShip->health, 6, height - ASCII_HEIGHT - 5, COLOR_RED);
+            s_renderCommands.drawHearts(snapshot.shipHealth, 6, height - ASCII_HEIGHT - 5, COLOR_RED);
         }
         else
         {
-            g_screenBuffer->drawHearts(ABS(s_playShip->health) - 1, 6, height - ASCII_HEIGHT - 5, COLOR_RED / 2);
+            s_renderCommands.drawHearts(ABS(snapshot.shipHealth) - 1, 6, height - ASCII_HEIGHT - 5, COLOR_RED / 2);
         }
-        g_screenBuffer->drawString(width - ScreenBuffer::getStringPixelWidth(scoreString) - 5, height - ASCII_HEIGHT - 5, scoreString, COLOR_WHITE);
+        s_renderCommands.drawString(width - ScreenBuffer::getStringPixelWidth(scoreString) - 5, height - ASCII_HEIGHT - 5, scoreString, COLOR_WHITE);
         break;
     }
     case GS_PAUSE:
     {
-        if (!s_zoomed) g_screenBuffer->rasterize(*s_playCamera, s_playShip);
-        g_screenBuffer->rasterize(*s_playCamera, s_playBorder);
-        g_screenBuffer->rasterizeGroup(*s_playCamera, s_playAsteroids);
-        g_screenBuffer->rasterizeGroup(*s_playCamera, s_playSaucers);
-        g_screenBuffer->rasterizeGroup(*s_playCamera, s_playBullets);
-        g_screenBuffer->rasterize(*s_playCamera, s_playTrailR);
-        g_screenBuffer->rasterize(*s_playCamera, s_playTrailL);
-        g_screenBuffer->rasterize(*s_playCamera, s_playLaser);
-        g_screenBuffer->rasterizeGroup(*s_playCamera, s_playFlowers);
+        s_renderCommands.rasterizeGroup(snapshot.camera, snapshot.drawList);
         int width = g_screenBuffer->getWidth();
         int height = g_screenBuffer->getHeight();
-        String scoreString = String::stringFromInt(s_score);
-        if (s_playShip->health > 0)
+        String scoreString = String::stringFromInt(snapshot.score);
+        if (snapshot.shipHealth > 0)
         {
-            g_screenBuffer->drawHearts(s_playShip->health, 6, height - ASCII_HEIGHT - 5, COLOR_RED);
+            s_renderCommands.drawHearts(snapshot.shipHealth, 6, height - ASCII_HEIGHT - 5, COLOR_RED);
         }
         else
         {
-            g_screenBuffer->drawHearts(ABS(s_playShip->health) - 1, 6, height - ASCII_HEIGHT - 5, COLOR_RED / 2);
+            s_renderCommands.drawHearts(ABS(snapshot.shipHealth) - 1, 6, height - ASCII_HEIGHT - 5, COLOR_RED / 2);
         }
-        g_screenBuffer->drawString(width - ScreenBuffer::getStringPixelWidth(scoreString) - 5, height - ASCII_HEIGHT - 5, scoreString, COLOR_WHITE);
-        g_screenBuffer->fade(2);
-        for (int i = 0; i < s_pauseButtons.size(); i++)
+        s_renderCommands.drawString(width - ScreenBuffer::getStringPixelWidth(scoreString) - 5, height - ASCII_HEIGHT - 5, scoreString, COLOR_WHITE);
+        s_renderCommands.fade(2);
+        for (int i = 0; i < textBoxes.size(); i++)
         {
-            g_screenBuffer->drawTextBox(*(s_pauseButtons[i]));
+            s_renderCommands.drawTextBox(textBoxes[i]);
         }
         break;
     }
@@ -587,12 +738,12 @@ void draw()
         int width = g_screenBuffer->getWidth();
         int height = g_screenBuffer->getHeight();
         String finalScore = String("FINAL SCORE:");
-        g_screenBuffer->drawString((width - ScreenBuffer::getStringPixelWidth(finalScore)) / 2, 3 * (height - ASCII_HEIGHT) / 4, finalScore, COLOR_WHITE);
-        String scoreString = String::stringFromInt(s_score);
-        g_screenBuffer->drawString((width - ScreenBuffer::getStringPixelWidth(scoreString)) / 2, (height - ASCII_HEIGHT) / 2, scoreString, COLOR_WHITE);
-        for (int i = 0; i < s_endButtons.size(); i++)
+        s_renderCommands.drawString((width - ScreenBuffer::getStringPixelWidth(finalScore)) / 2, 3 * (height - ASCII_HEIGHT) / 4, finalScore, COLOR_WHITE);
+        String scoreString = String::stringFromInt(snapshot.score);
+        s_renderCommands.drawString((width - ScreenBuffer::getStringPixelWidth(scoreString)) / 2, (height - ASCII_HEIGHT) / 2, scoreString, COLOR_WHITE);
+        for (int i = 0; i < textBoxes.size(); i++)
         {
-            g_screenBuffer->drawTextBox(*(s_endButtons[i]));
+            s_renderCommands.drawTextBox(textBoxes[i]);
         }
         break;
     }
@@ -602,31 +753,23 @@ void draw()
     ///}
     case GS_CONTROLS:
     {
-        for (int i = 0; i < s_controlsButtons.size(); i++)
+        for (int i = 0; i < textBoxes.size(); i++)
         {
-            g_screenBuffer->drawTextBox(*(s_controlsButtons[i]));
-        }
-        for (int i = 0; i < s_controlsBoxes.size(); i++)
-        {
-            g_screenBuffer->drawTextBox(*(s_controlsBoxes[i]));
+            s_renderCommands.drawTextBox(textBoxes[i]);
         }
         break;
     }
     case GS_KEY_CHANGE:
     {
-        for (int i = 0; i < s_controlsButtons.size(); i++)
-        {
-            g_screenBuffer->drawTextBox(*(s_controlsButtons[i]));
-        }
-        for (int i = 0; i < s_controlsBoxes.size(); i++)
+        for (int i = 0; i < textBoxes.size(); i++)
         {
-            g_screenBuffer->drawTextBox(*(s_controlsBoxes[i]));
+            s_renderCommands.drawTextBox(textBoxes[i]);
         }
-        g_screenBuffer->fade(16);
+        s_renderCommands.fade(16);
 
         String message("Enter new key for ");
 
-        switch (s_controlsCursor)
+        switch (snapshot.controlsCursor)
         {
         case CONTROLS_INDEX_ROLL_LEFT :
         {
@@ -671,12 +814,43 @@ void draw()
         }
         int xPos = (g_screenBuffer->getWidth() - ScreenBuffer::getStringPixelWidth(message)) / 2;
         int yPos = 3 * (g_screenBuffer->getHeight() - ScreenBuffer::getStringPixelHeight(message)) / 4;
-        g_screenBuffer->drawString(xPos, yPos, message, COLOR_WHITE);
+        s_renderCommands.drawString(xPos, yPos, message, COLOR_WHITE);
         break;
     }
     }
 
-    g_screenBuffer->drawString(g_screenBuffer->getWidth() - ScreenBuffer::getStringPixelWidth(VERSION_STRING) - 5, 5, VERSION_STRING, COLOR_WHITE / 4);
+    s_renderCommands.drawString(g_screenBuffer->getWidth() - ScreenBuffer::getStringPixelWidth(VERSION_STRING) - 5, 5, VERSION_STRING, COLOR_WHITE / 4);
+
+    if (snapshot.showRenderStats)
+    {
+        s_renderCommands.callback(&drawRenderStats, 0);
+    }
+
+    g_screenBuffer->resetRenderStats();
+    s_renderCommands.execute(*g_screenBuffer);
+
+    return true;
+}
+
+
+void drawRenderStats(ScreenBuffer & screenBuffer, void * data)
+{
+    const RenderStats & stats = screenBuffer.getRenderStats();
+
+    Array<String> lines;
+    lines += String("ENTITIES: ") + String::stringFromInt(stats.entities);
+    lines += String("CULLED: ") + String::stringFromInt(stats.entitiesCulled);
+    lines += String("UNCLIPPED: ") + String::stringFromInt(stats.entitiesInside);
+    lines += String("OCCLUDED TRIANGLES: ") + String::stringFromInt(stats.trianglesOccluded) + String("/") + String::stringFromInt(stats.triangles);
+    lines += String("OCCLUDED SPANS: ") + String::stringFromInt(stats.spansOccluded) + String("/") + String::stringFromInt(stats.spans);
+    lines += String("PIXEL WRITES: ") + String::stringFromInt(stats.pixelsWritten);
+
+    int y = screenBuffer.getHeight() - 2 * (ASCII_HEIGHT + 5);
+    for (int i = 0; i < lines.size(); i++)
+    {
+        screenBuffer.drawString(5, y, lines[i], COLOR_WHITE / 2);
+        y -= ASCII_HEIGHT + 2;
+    }
 }
 
 
@@ -724,22 +898,22 @@ void changeGameStateToEnd()
     }
     for (int i = 0; i < s_playAsteroids.size();)
     {
-        delete s_playAsteroids[i];
+        retireEntity(s_playAsteroids[i]);
         s_playAsteroids.remove(i);
     }
     for (int i = 0; i < s_playSaucers.size();)
     {
-        delete s_playSaucers[i];
+        retireEntity(s_playSaucers[i]);
         s_playSaucers.remove(i);
     }
     for (int i = 0; i < s_playBullets.size();)
     {
-        delete s_playBullets[i];
+        retireEntity(s_playBullets[i]);
         s_playBullets.remove(i);
     }
     for (int i = 0; i < s_playFlowers.size();)
     {
-        delete s_playFlowers[i];
+        retireEntity(s_playFlowers[i]);
         s_playFlowers.remove(i);
     }
 }
@@ -806,6 +980,7 @@ void arrowUpKeyAction()
             s_mainButtons[s_mainCursor]->m_selected = false;
             s_mainCursor--;
             s_mainButtons[s_mainCursor]->m_selected = true;
+            s_frameStale = true;
         }
         
         // change main entity rotation
@@ -826,6 +1001,7 @@ void arrowUpKeyAction()
             s_pauseButtons[s_pauseCursor]->m_selected = false;
             s_pauseCursor--;
             s_pauseButtons[s_pauseCursor]->m_selected = true;
+            s_frameStale = true;
         }
         break;
     }
@@ -836,6 +1012,7 @@ void arrowUpKeyAction()
             s_endButtons[s_endCursor]->m_selected = false;
             s_endCursor--;
             s_endButtons[s_endCursor]->m_selected = true;
+            s_frameStale = true;
         }
         break;
     }
@@ -850,6 +1027,7 @@ void arrowUpKeyAction()
             s_controlsButtons[s_controlsCursor]->m_selected = false;
             s_controlsCursor--;
             s_controlsButtons[s_controlsCursor]->m_selected = true;
+            s_frameStale = true;
         }
         break;
     }
@@ -908,6 +1086,7 @@ void arrowDownKeyAction()
             s_mainButtons[s_mainCursor]->m_selected = false;
             s_mainCursor++;
             s_mainButtons[s_mainCursor]->m_selected = true;
+            s_frameStale = true;
         }
 
         // change main entity rotation
@@ -928,6 +1107,7 @@ void arrowDownKeyAction()
             s_pauseButtons[s_pauseCursor]->m_selected = false;
             s_pauseCursor++;
             s_pauseButtons[s_pauseCursor]->m_selected = true;
+            s_frameStale = true;
         }
         break;
     }
@@ -938,6 +1118,7 @@ void arrowDownKeyAction()
             s_endButtons[s_endCursor]->m_selected = false;
             s_endCursor++;
             s_endButtons[s_endCursor]->m_selected = true;
+            s_frameStale = true;
         }
         break;
     }
@@ -952,6 +1133,7 @@ void arrowDownKeyAction()
             s_controlsButtons[s_controlsCursor]->m_selected = false;
             s_controlsCursor++;
             s_controlsButtons[s_controlsCursor]->m_selected = true;
+            s_frameStale = true;
         }
         break;
     }
@@ -1486,7 +1668,7 @@ void deleteFromLimbo(int limboIndex, Array<Entity*> & searchEntities)
         if (deadEntity == searchEntities[i])
         {
             searchEntities.remove(i);
-            delete deadEntity;
+            retireEntity(deadEntity);
             break;
         }
         else
@@ -1497,6 +1679,32 @@ void deleteFromLimbo(int limboIndex, Array<Entity*> & searchEntities)
 }
 
 
+void retireEntity(Entity * entity)
+{
+    // the next snapshot captured is the first one without it
+    s_retiredEntities += entity;
+    s_retiredSequences += s_snapshotSequence + 1;
+}
+
+
+void deleteRetiredEntities(unsigned drawingSequence)
+{
+    for (int i = 0; i < s_retiredEntities.size();)
+    {
+        if (s_retiredSequences[i] <= drawingSequence)
+        {
+            delete s_retiredEntities[i];
+            s_retiredEntities.remove(i);
+            s_retiredSequences.remove(i);
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+
 void calculateEntityCollisions(Array<Entity*> & entities)
 {
     struct Collision
@@ -1950,7 +2158,7 @@ void calculateBorderCollisions(Array<Entity*> & entities)
                     // Look's like the entity is moving into the border.
                     // If any of the entity's points are beyond the collision radius
                     // it's colliding!
-                    const Array<Point> & points = entities[i]->frame.points;
+                    const Array<Point> & points = entities[i]->getFrame().points;
                     for (int j = 0; j < points.size(); j++)
                     {
                         float pXDiff = xDiff - points[j].x;
@@ -7,7 +7,8 @@
 
 #pragma once
 
-#include "ScreenBuffer.h"
+#include "Platform.h"
+#include "RenderCommands.h"
 
 
 // ScreenBuffer from Win32Main.cpp
@@ -124,6 +125,12 @@ static const int SAUCER_FIRE_RATE = 40;
 static Array<Entity*> s_limboEntities;
 static Array<int> s_limboCounters;
 
+// Entities out of the game that a render snapshot might still point to. Each
+// one is deleted once the snapshot with the matching sequence number, the
+// first one it isn't in, has started being drawn. See retireEntity.
+static Array<Entity*> s_retiredEntities;
+static Array<unsigned> s_retiredSequences;
+
 static int s_score;
 static int s_scoreTillNectHeart;
 
@@ -170,6 +177,60 @@ static const unsigned CONTROLS_INDEX_DEFAULT = 10;
 // key change menu
 static Button * s_returnFromKeyChangeButton;
 
+// render stats overlay, toggled with a key that can't be rebound
+static bool s_showRenderStats;
+static const uint8_t RENDER_STATS_KEY = VK_F3;
+
+// Set when something on screen changes: entities moving, a menu cursor
+// moving, a menu button firing, the game state changing, or a key that
+// changes text. A new render snapshot is only captured after one of those
+// happens, so pause and the other menus stop redrawing while they sit still.
+static bool s_frameStale = true;
+static unsigned s_snapshotSequence;
+
+// What the last frame was drawn from, it's kept until there's a new snapshot
+// or the buffer changes size. Only used while drawing.
+static unsigned s_frameSequence;
+static long s_frameWidth;
+static long s_frameHeight;
+
+// draw records into this, then executes it all at once onto the screen
+// buffer
+static RenderCommandBuffer s_renderCommands;
+
+
+// Everything draw needs from the game, copied out after an update so the
+// game can go on updating while it's being drawn. The entities are drawing
+// copies, see copyEntityForDrawing, and the text boxes are copies of the
+// current menu's. Once captured, nothing in here changes until the snapshot
+// is captured over again.
+struct RenderSnapshot
+{
+    RenderSnapshot() : sequence(0), entityCount(0) {}
+
+    // counts up from 1 with every capture, 0 if never captured
+    unsigned sequence;
+
+    GameState gameState;
+    Camera camera;
+
+    // The drawing copies, only the first entityCount are used. The copies
+    // are kept around between captures so their memory gets reused.
+    Array<Entity> entities;
+    int entityCount;
+
+    // points into entities, in the order they'd be drawn
+    Array<Entity*> drawList;
+
+    int score;
+    int shipHealth;
+    int controlsCursor;
+    bool showRenderStats;
+
+    // in the order they're drawn
+    Array<TextBox> textBoxes;
+};
+
 
 // initialize
 // ========================================================================== //
@@ -185,7 +246,8 @@ void deinitialize();
 
 // keyDown
 // ========================================================================== //
-// Preform actions that pertain to the key going down.
+// Preform actions that pertain to the key going down. Called on the same
+// thread as update.
 //
 // @param
 // * uint8_t k, windows virtual key code
@@ -194,7 +256,8 @@ void keyDown(const uint8_t k);
 
 // keyUp
 // ========================================================================== //
-// Preform actions that pertain to the key going up.
+// Preform actions that pertain to the key going up. Called on the same
+// thread as update.
 //
 // @param
 // * uint8_t k, windows virtual key code
@@ -207,10 +270,66 @@ void keyUp(const uint8_t k);
 void update();
 
 
+// captureRenderSnapshot
+// ========================================================================== //
+// Copy what draw needs out of the game. Called on the same thread as update,
+// while draw can be drawing a different snapshot on another thread.
+// 
+// @params
+// * RenderSnapshot & snapshot, gets overwritten, can't be getting drawn
+// 
+// @return
+// True if the snapshot was captured, false if nothing's changed since the
+// last capture and the snapshot was left alone.
+bool captureRenderSnapshot(RenderSnapshot & snapshot);
+
+
+// capturePlayEntities
+// ========================================================================== //
+// Fill the snapshot's entities and draw list with the ship, border,
+// asteroids, and everything else in play, so the screen buffer can draw them
+// as one group, nearest first.
+// 
+// @params
+// * RenderSnapshot & snapshot, snapshot being captured
+void capturePlayEntities(RenderSnapshot & snapshot);
+
+
+// addSnapshotEntity
+// ========================================================================== //
+// Add a drawing copy of the given entity to the snapshot's entities.
+// 
+// @params
+// * RenderSnapshot & snapshot, snapshot being captured
+// * Entity * entity, entity being copied
+// * bool copyFrame = false, see copyEntityForDrawing
+void addSnapshotEntity(RenderSnapshot & snapshot, Entity * entity, bool copyFrame = false);
+
+
 // draw
 // ========================================================================== //
-// Draw everything to the screen buffer.
-void draw();
+// Draw a render snapshot to the screen buffer, by recording it into
+// s_renderCommands and executing them. Skipped if the frame already there
+// was drawn from the same snapshot.
+// 
+// @params
+// * const RenderSnapshot & snapshot, what to draw
+// 
+// @return
+// True if the screen buffer was drawn to, false if it's the same as before.
+bool draw(const RenderSnapshot & snapshot);
+
+
+// drawRenderStats
+// ========================================================================== //
+// Draw what the screen buffer's 3D draw functions did this frame, under the
+// hearts in the top left corner. It's a RenderCallback, so it's called after
+// the 3D commands have been executed.
+// 
+// @params
+// * ScreenBuffer & screenBuffer, the screen buffer being drawn to
+// * void * data, unused
+void drawRenderStats(ScreenBuffer & screenBuffer, void * data);
 
 
 // changeGameStateTo____
@@ -266,7 +385,7 @@ void addToLimbo(Entity * entity, int counter);
 // ========================================================================== //
 // Removes the entity pointer from the s_limboEntities, removes it's counter
 // from s_limboCounters, removes the entity pointer from its original array,
-// and deletes the entity proper with the "delete" call.
+// and retires the entity proper with retireEntity.
 // 
 // @params
 // * int limboIndex, the entity's index in s_limboEntities and s_limbCounters
@@ -274,6 +393,28 @@ void addToLimbo(Entity * entity, int counter);
 void deleteFromLimbo(int limboIndex, Array<Entity*> & searchEntities);
 
 
+// retireEntity
+// ========================================================================== //
+// Delete an entity that's been taken out of the game once no render snapshot
+// can point to it. It can still be in the snapshot being drawn, or in the
+// last one captured, which is next to be drawn.
+// 
+// @params
+// * Entity * entity, entity that's no longer in any of the game's arrays
+void retireEntity(Entity * entity);
+
+
+// deleteRetiredEntities
+// ========================================================================== //
+// Delete the retired entities that can't be in the given snapshot, or any
+// snapshot that could still be drawn after it.
+// 
+// @params
+// * unsigned drawingSequence, the sequence number of the snapshot being
+//                             drawn, nothing older will be drawn again
+void deleteRetiredEntities(unsigned drawingSequence);
+
+
 // calculateEntityCollisions
 // ========================================================================== //
 // Apply collision physics between the given entities. Physics is applied;
@@ -17,8 +17,18 @@ void Entity::update()
 }
 
 
+Matrix Entity::getWorldTransform() const
+{
+    Matrix locationMatrix;
+    locationMatrix.addTranslation(locationPoint.x, locationPoint.y, locationPoint.z);
+
+    return orientation.getMatrix() * locationMatrix;
+}
+
+
 Shape Entity::getShapeInWorldSpace() const
 {
+    const Frame & frame = getFrame();
     Shape shape = frame.getShape(drawProperties & DRAW_POINTS, drawProperties & DRAW_LINES, drawProperties & DRAW_TRIANGLES);
 
     if (drawProperties & DRAW_NORMALS)
@@ -35,12 +45,7 @@ Shape Entity::getShapeInWorldSpace() const
         }
     }
 
-    Matrix rotationMatrix = orientation.getMatrix();
-    shape *= rotationMatrix;
-
-    Matrix locationMatrix;
-    locationMatrix.addTranslation(locationPoint.x, locationPoint.y, locationPoint.z);
-    shape *= locationMatrix;
+    shape *= getWorldTransform();
 
     return shape;
 }
@@ -48,14 +53,18 @@ Shape Entity::getShapeInWorldSpace() const
 
 void Entity::updateWorldSpaceShape()
 {
-    worldSpaceShape = frame.getShape(false, true, true);
+    // the triangles don't change after the frame is built, so their planes
+    // only get worked out the first time. Meshes come with theirs.
+    if (!mesh && frame.normals.size() != frame.triangles.size())
+    {
+        frame.calculatePlanes();
+    }
 
-    Matrix rotationMatrix = orientation.getMatrix();
-    worldSpaceShape *= rotationMatrix;
+    worldSpaceShape = getFrame().getShape(false, true, true);
+    worldSpaceShape *= getWorldTransform();
 
-    Matrix locationMatrix;
-    locationMatrix.addTranslation(locationPoint.x, locationPoint.y, locationPoint.z);
-    worldSpaceShape *= locationMatrix;
+    // rotating doesn't change how far the points are from the center
+    drawRadius = mesh ? mesh->radius : frame.getRadius();
 }
 
 
@@ -462,7 +471,152 @@ void initializeLongBulletFrame(Frame & frame, Color color)
 }
 
 
-void initializeAsteroidFrame(Frame & frame, float r, float n, float d, Color color)
+void fixWrapAroundPoints(Array<FrameTriangle> & triangles, const Array<Point*> & zeros)
+{
+    for (int i = 0; i < triangles.size(); i++)
+    {
+        const Point* pointA = triangles[i].p0;
+        const Point* pointB = triangles[i].p1;
+        const Point* pointC = triangles[i].p2;
+
+        if (equalULP(pointA->z, 2 * _PI))
+        {
+            Point replacementPointA(pointA->x, pointA->y, 0);
+            for (int k = 0; k < zeros.size(); k++)
+            {
+                if (replacementPointA == *(zeros[k]))
+                {
+                    triangles[i].p0 = zeros[k];
+                    break;
+                }
+            }
+        }
+
+        if (equalULP(pointB->z, 2 * _PI))
+        {
+            Point replacementPointB(pointB->x, pointB->y, 0);
+            for (int k = 0; k < zeros.size(); k++)
+            {
+                if (replacementPointB == *(zeros[k]))
+                {
+                    triangles[i].p1 = zeros[k];
+                    break;
+                }
+            }
+        }
+
+        if (equalULP(pointC->z, 2 * _PI))
+        {
+            Point replacementPointC(pointC->x, pointC->y, 0);
+            for (int k = 0; k < zeros.size(); k++)
+            {
+                if (replacementPointC == *(zeros[k]))
+                {
+                    triangles[i].p2 = zeros[k];
+                    break;
+                }
+            }
+        }
+    }
+}
+
+
+void generateFrameLines(Frame & frame)
+{
+    const Array<FrameTriangle> & triangles = frame.triangles;
+    Array<FrameLine> & lines = frame.lines;
+
+    for (int i = 0; i < triangles.size(); i++)
+    {
+        FrameLine lineA(triangles[i].p0, triangles[i].p1);
+        FrameLine lineB(triangles[i].p1, triangles[i].p2);
+        FrameLine lineC(triangles[i].p2, triangles[i].p0);
+
+        bool hasLineA = false;
+        for (int j = 0; j < lines.size(); j++)
+        {
+            if (lineA == lines[j])
+            {
+                hasLineA = true;
+                break;
+            }
+        }
+        if (!hasLineA) lines += lineA;
+
+        bool hasLineB = false;
+        for (int j = 0; j < lines.size(); j++)
+        {
+            if (lineB == lines[j])
+            {
+                hasLineB = true;
+                break;
+            }
+        }
+        if (!hasLineB) lines += lineB;
+
+        bool hasLineC = false;
+        for (int j = 0; j < lines.size(); j++)
+        {
+            if (lineC == lines[j])
+            {
+                hasLineC = true;
+                break;
+            }
+        }
+        if (!hasLineC) lines += lineC;
+    }
+}
+
+
+void initializeDetailFrames(const Frame & frame, const Array<Array<FrameTriangle> > & levels, Array<Frame> & detailFrames)
+{
+    // The triangles point into frame.points. Subdividing only ever adds
+    // points to the end, so each level's points are the first few of the
+    // frame's, dents and all.
+    const Point * firstPoint = &frame.points[0];
+
+    detailFrames.clear();
+    detailFrames.setCapacity(levels.size());
+    for (int i = 0; i < levels.size(); i++)
+    {
+        detailFrames += Frame();
+        Frame & detailFrame = detailFrames[i];
+        const Array<FrameTriangle> & triangles = levels[i];
+
+        // one past the last point any triangle uses
+        int pointCount = 0;
+        for (int j = 0; j < triangles.size(); j++)
+        {
+            int p0 = triangles[j].p0 - firstPoint;
+            int p1 = triangles[j].p1 - firstPoint;
+            int p2 = triangles[j].p2 - firstPoint;
+            if (p0 >= pointCount) pointCount = p0 + 1;
+            if (p1 >= pointCount) pointCount = p1 + 1;
+            if (p2 >= pointCount) pointCount = p2 + 1;
+        }
+
+        // the triangles need the points to stay put
+        detailFrame.points.setCapacity(pointCount);
+        for (int j = 0; j < pointCount; j++)
+        {
+            detailFrame.points += frame.points[j];
+        }
+
+        for (int j = 0; j < triangles.size(); j++)
+        {
+            detailFrame.triangles += FrameTriangle(
+                detailFrame.points.getPointerTo(triangles[j].p0 - firstPoint),
+                detailFrame.points.getPointerTo(triangles[j].p1 - firstPoint),
+                detailFrame.points.getPointerTo(triangles[j].p2 - firstPoint));
+        }
+
+        generateFrameLines(detailFrame);
+        detailFrame.calculatePlanes();
+    }
+}
+
+
+void initializeAsteroidFrame(Frame & frame, float r, float n, float d, Color color, Array<Frame> * detailFrames /*= 0*/)
 {
     // These coordinates are in the Spherical Coordinate System
     // 
@@ -496,7 +650,9 @@ void initializeAsteroidFrame(Frame & frame, float r, float n, float d, Color col
     Array<Point> & points = frame.points;
     Array<Point*> zeros;
     Array<FrameTriangle> & triangles = frame.triangles;
-    Array<FrameLine> & lines = frame.lines;
+
+    // the triangles before each subdivision, for the detail frames
+    Array<Array<FrameTriangle> > levels;
 
     // First things first, since the array of triangles contains pointers to
     // points, we can't be having those points move around in memory. I'll have
@@ -629,96 +785,22 @@ void initializeAsteroidFrame(Frame & frame, float r, float n, float d, Color col
             newTriangles += FrameTriangle(pointAB, pointBC, pointAC);
         }
 
+        if (detailFrames)
+        {
+            levels += triangles;
+        }
         triangles = newTriangles;
     }
 
-    // Fix the wrap around points in triangles.
-    for (int i = 0; i < triangles.size(); i++)
+    // Fix the wrap around points in triangles, and in the coarser levels.
+    fixWrapAroundPoints(triangles, zeros);
+    for (int i = 0; i < levels.size(); i++)
     {
-        const Point* pointA = triangles[i].p0;
-        const Point* pointB = triangles[i].p1;
-        const Point* pointC = triangles[i].p2;
-
-        if (equalULP(pointA->z, 2 * _PI))
-        {
-            Point replacementPointA(pointA->x, pointA->y, 0);
-            for (int k = 0; k < zeros.size(); k++)
-            {
-                if (replacementPointA == *(zeros[k]))
-                {
-                    triangles[i].p0 = zeros[k];
-                    break;
-                }
-            }
-        }
-
-        if (equalULP(pointB->z, 2 * _PI))
-        {
-            Point replacementPointB(pointB->x, pointB->y, 0);
-            for (int k = 0; k < zeros.size(); k++)
-            {
-                if (replacementPointB == *(zeros[k]))
-                {
-                    triangles[i].p1 = zeros[k];
-                    break;
-                }
-            }
-        }
-
-        if (equalULP(pointC->z, 2 * _PI))
-        {
-            Point replacementPointC(pointC->x, pointC->y, 0);
-            for (int k = 0; k < zeros.size(); k++)
-            {
-                if (replacementPointC == *(zeros[k]))
-                {
-                    triangles[i].p2 = zeros[k];
-                    break;
-                }
-            }
-        }
+        fixWrapAroundPoints(levels[i], zeros);
     }
 
     // Generate line segments for the frame
-    for (int i = 0; i < triangles.size(); i++)
-    {
-        FrameLine lineA(triangles[i].p0, triangles[i].p1);
-        FrameLine lineB(triangles[i].p1, triangles[i].p2);
-        FrameLine lineC(triangles[i].p2, triangles[i].p0);
-
-        bool hasLineA = false;
-        for (int j = 0; j < lines.size(); j++)
-        {
-            if (lineA == lines[j])
-            {
-                hasLineA = true;
-                break;
-            }
-        }
-        if (!hasLineA) lines += lineA;
-
-        bool hasLineB = false;
-        for (int j = 0; j < lines.size(); j++)
-        {
-            if (lineB == lines[j])
-            {
-                hasLineB = true;
-                break;
-            }
-        }
-        if (!hasLineB) lines += lineB;
-
-        bool hasLineC = false;
-        for (int j = 0; j < lines.size(); j++)
-        {
-            if (lineC == lines[j])
-            {
-                hasLineC = true;
-                break;
-            }
-        }
-        if (!hasLineC) lines += lineC;
-    }
+    generateFrameLines(frame);
 
     // Add some dents to make it more assteroid-ish
     float dent = r / (d * (n + 1));
@@ -744,10 +826,15 @@ void initializeAsteroidFrame(Frame & frame, float r, float n, float d, Color col
         points[i].y = x * sin(y) * sin(z);
         points[i].z = x * cos(y);
     }
+
+    if (detailFrames)
+    {
+        initializeDetailFrames(frame, levels, *detailFrames);
+    }
 }
 
 
-void initializeBorderFrame(Frame & frame, float r, float n, Color color)
+void initializeBorderFrame(Frame & frame, float r, float n, Color color, Array<Frame> * detailFrames /*= 0*/)
 
 {
     // Similar to initializeAsteroidFrame, but no dents and the triangle
@@ -756,7 +843,9 @@ void initializeBorderFrame(Frame & frame, float r, float n, Color color)
     Array<Point> & points = frame.points;
     Array<Point*> zeros;
     Array<FrameTriangle> & triangles = frame.triangles;
-    Array<FrameLine> & lines = frame.lines;
+
+    // the triangles before each subdivision, for the detail frames
+    Array<Array<FrameTriangle> > levels;
 
     int pointCapacity = 0;
     int j = 1;
@@ -884,96 +973,22 @@ void initializeBorderFrame(Frame & frame, float r, float n, Color color)
             newTriangles += FrameTriangle(pointAB, pointBC, pointAC);
         }
 
+        if (detailFrames)
+        {
+            levels += triangles;
+        }
         triangles = newTriangles;
     }
 
-    // Fix the wrap around points in triangles.
-    for (int i = 0; i < triangles.size(); i++)
+    // Fix the wrap around points in triangles, and in the coarser levels.
+    fixWrapAroundPoints(triangles, zeros);
+    for (int i = 0; i < levels.size(); i++)
     {
-        const Point* pointA = triangles[i].p0;
-        const Point* pointB = triangles[i].p1;
-        const Point* pointC = triangles[i].p2;
-
-        if (equalULP(pointA->z, 2 * _PI))
-        {
-            Point replacementPointA(pointA->x, pointA->y, 0);
-            for (int k = 0; k < zeros.size(); k++)
-            {
-                if (replacementPointA == *(zeros[k]))
-                {
-                    triangles[i].p0 = zeros[k];
-                    break;
-                }
-            }
-        }
-
-        if (equalULP(pointB->z, 2 * _PI))
-        {
-            Point replacementPointB(pointB->x, pointB->y, 0);
-            for (int k = 0; k < zeros.size(); k++)
-            {
-                if (replacementPointB == *(zeros[k]))
-                {
-                    triangles[i].p1 = zeros[k];
-                    break;
-                }
-            }
-        }
-
-        if (equalULP(pointC->z, 2 * _PI))
-        {
-            Point replacementPointC(pointC->x, pointC->y, 0);
-            for (int k = 0; k < zeros.size(); k++)
-            {
-                if (replacementPointC == *(zeros[k]))
-                {
-                    triangles[i].p2 = zeros[k];
-                    break;
-                }
-            }
-        }
+        fixWrapAroundPoints(levels[i], zeros);
     }
 
     // Generate line segments for the frame
-    for (int i = 0; i < triangles.size(); i++)
-    {
-        FrameLine lineA(triangles[i].p0, triangles[i].p1);
-        FrameLine lineB(triangles[i].p1, triangles[i].p2);
-        FrameLine lineC(triangles[i].p2, triangles[i].p0);
-
-        bool hasLineA = false;
-        for (int j = 0; j < lines.size(); j++)
-        {
-            if (lineA == lines[j])
-            {
-                hasLineA = true;
-                break;
-            }
-        }
-        if (!hasLineA) lines += lineA;
-
-        bool hasLineB = false;
-        for (int j = 0; j < lines.size(); j++)
-        {
-            if (lineB == lines[j])
-            {
-                hasLineB = true;
-                break;
-            }
-        }
-        if (!hasLineB) lines += lineB;
-
-        bool hasLineC = false;
-        for (int j = 0; j < lines.size(); j++)
-        {
-            if (lineC == lines[j])
-            {
-                hasLineC = true;
-                break;
-            }
-        }
-        if (!hasLineC) lines += lineC;
-    }
+    generateFrameLines(frame);
 
     // Turn the points, into points in the Cartesian Coordinate System
     for (int i = 0; i < points.size(); i++)
@@ -985,6 +1000,67 @@ void initializeBorderFrame(Frame & frame, float r, float n, Color color)
         points[i].y = x * sin(y) * sin(z);
         points[i].z = x * cos(y);
     }
+
+    if (detailFrames)
+    {
+        initializeDetailFrames(frame, levels, *detailFrames);
+    }
+}
+
+
+// A mesh in getSharedMesh, with what it was built from
+struct SharedMesh
+{
+    MeshType type;
+    Color color0;
+    Color color1;
+    Mesh * mesh;
+};
+
+static Array<SharedMesh> s_sharedMeshes;
+
+
+const Mesh * getSharedMesh(MeshType type, Color color0, Color color1 /*= COLOR_BLACK*/)
+{
+    for (int i = 0; i < s_sharedMeshes.size(); i++)
+    {
+        const SharedMesh & shared = s_sharedMeshes[i];
+        if (shared.type == type && shared.color0 == color0 && shared.color1 == color1)
+        {
+            return shared.mesh;
+        }
+    }
+
+    Mesh * mesh = new Mesh();
+    switch (type)
+    {
+    case MESH_SAUCER:
+    {
+        initializeSaucerFrame(mesh->frame, 5, color0, color1);
+        break;
+    }
+    case MESH_BULLET:
+    {
+        initializeBulletFrame(mesh->frame, color0);
+        break;
+    }
+    default:
+    {
+        initializeLongBulletFrame(mesh->frame, color0);
+        break;
+    }
+    }
+    mesh->frame.calculatePlanes();
+    mesh->radius = mesh->frame.getRadius();
+
+    SharedMesh shared;
+    shared.type = type;
+    shared.color0 = color0;
+    shared.color1 = color1;
+    shared.mesh = mesh;
+    s_sharedMeshes += shared;
+
+    return mesh;
 }
 
 
@@ -1005,7 +1081,7 @@ Entity * createSaucer(Color color0, Color color1)
     Entity * saucer = new Entity();
     saucer->typeID = ENTITY_ID_SAUCER;
     saucer->boundingRadius = 5;
-    initializeSaucerFrame(saucer->frame, 5, color0, color1);
+    saucer->mesh = getSharedMesh(MESH_SAUCER, color0, color1);
     saucer->mass = 2;
     ///saucer->drawProperties |= DRAW_DISTANCE_SHADING_OFF;
     return saucer;
@@ -1017,7 +1093,7 @@ Entity* createBullet(Color color)
     Entity * bullet = new Entity();
     bullet->boundingRadius = 0.5;
     bullet->drawProperties |= DRAW_DISTANCE_SHADING_OFF;
-    initializeBulletFrame(bullet->frame, color);
+    bullet->mesh = getSharedMesh(MESH_BULLET, color);
     bullet->mass = 0.05;
     return bullet;
 }
@@ -1028,7 +1104,7 @@ Entity* createLongBullet(Color color)
     Entity * bullet = new Entity();
     bullet->boundingRadius = 1.55;
     bullet->drawProperties |= DRAW_DISTANCE_SHADING_OFF;
-    initializeLongBulletFrame(bullet->frame, color);
+    bullet->mesh = getSharedMesh(MESH_LONG_BULLET, color);
     bullet->mass = 0.25;
     return bullet;
 }
@@ -1072,7 +1148,7 @@ Entity* createAsteroid(unsigned size, Color color)
 
     asteroid->typeID = ENTITY_ID_ASTEROID;
     asteroid->boundingRadius = r + r / (2 * (d + 1));
-    initializeAsteroidFrame(asteroid->frame, r, n, d, color);
+    initializeAsteroidFrame(asteroid->frame, r, n, d, color, &asteroid->detailFrames);
 
     return asteroid;
 }
@@ -1088,7 +1164,7 @@ Entity* createBorder(float r, float n, Color color)
     // in this case mass is the inner bounding radius. It represents biggest
     // sphere that could fit in this border withought crossing outside.
     border->mass = cos(_PI / (4 * powerOf(2, n))) * r;
-    initializeBorderFrame(border->frame, r, n, color);
+    initializeBorderFrame(border->frame, r, n, color, &border->detailFrames);
 
     border->drawProperties = DRAW_LINES;
 
@@ -1374,6 +1450,36 @@ void updateFlowerFrame(Frame & frame)
 }
 
 
+void copyEntityForDrawing(Entity & entity, Entity & copy, bool copyFrame)
+{
+    copy.typeID = entity.typeID;
+    copy.mesh = entity.mesh;
+    copy.frameSource = 0;
+    if (!entity.mesh)
+    {
+        if (copyFrame)
+        {
+            copy.frame = entity.frame;
+            copy.detailFrames = entity.detailFrames;
+        }
+        else
+        {
+            // The frame can't change while the copy's being drawn, so its
+            // planes are worked out now instead of on the next update.
+            if (entity.frame.normals.size() != entity.frame.triangles.size())
+            {
+                entity.frame.calculatePlanes();
+            }
+            copy.frameSource = &entity;
+        }
+    }
+    copy.locationPoint = entity.locationPoint;
+    copy.orientation = entity.orientation;
+    copy.drawProperties = entity.drawProperties;
+    copy.drawRadius = entity.drawRadius;
+}
+
+
 // collision
 
 
@@ -1565,7 +1671,8 @@ bool pointInsideShapeCheck(const Point & point, const Shape & shape, float lengt
     for (int i = 0; i < shape.triangles.size(); i++)
     {
         Line temp = Line(point, Point(point.x + length, point.y, point.z));
-        if (fasterLineTriangleIntersect(temp, shape.triangles[i], Point()))
+        Point location;
+        if (fasterLineTriangleIntersect(temp, shape.triangles[i], location))
         {
             crossCount++;
         }
@@ -2273,7 +2380,7 @@ void calculateBorderCollisionsSimple(Array<Entity*> entities, Entity * border)
                     // Look's like the entity is moving into the border.
                     // If any of the entity's points are beyond the collision radius
                     // it's colliding!                
-                    const Array<Point> & points = entities[i]->frame.points;
+                    const Array<Point> & points = entities[i]->getFrame().points;
                     for (int j = 0; j < points.size(); j++)
                     {
                         float pXDiff = xDiff - points[j].x;
@@ -2382,7 +2489,7 @@ void calculateBorderCollisionsOld(Array<Entity*> entities, Entity * border)
     for (int i = 0; i < collisions.size(); i++)
     {
         Vector & oldVelocity = collisions[i].entity->velocity;
-        Vector & normal = border->locationPoint - collisions[i].collisionLocation;
+        Vector normal = border->locationPoint - collisions[i].collisionLocation;
         normal.normalize();
         Vector newVelocity = oldVelocity - normal * 2 * normal.dotProduct(oldVelocity);
 
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <stdlib.h> // rand
 #include "GraphicsUtilities.h"
 
 
@@ -29,9 +30,50 @@
 #define DRAW_TRIANGLE_FRAMES      (1 << 4)
 #define DRAW_DISTANCE_SHADING_OFF (1 << 5)
 
+// The kinds of shared meshes, see getSharedMesh
+enum MeshType
+{
+    MESH_SAUCER,
+    MESH_BULLET,
+    MESH_LONG_BULLET
+};
+
+// A frame shared by every entity that looks the same, like all of the saucer
+// bullets. Each entity only keeps its own location and orientation.
+struct Mesh
+{
+    Mesh() : radius(0) {}
+
+    // With its planes calculated, it never changes once it's built.
+    Frame frame;
+
+    // Coarser versions of frame, same as Entity::detailFrames.
+    Array<Frame> detailFrames;
+
+    // Every point of the frame is within this distance of its origin.
+    float radius;
+};
+
 struct Entity
 {    
-    Entity() : typeID(ENTITY_ID_NONE), collidable(true), mass(0), drawProperties(DRAW_TRIANGLES) {}
+    Entity() : typeID(ENTITY_ID_NONE), collidable(true), mesh(0), frameSource(0), mass(0), drawProperties(DRAW_TRIANGLES), drawRadius(-1) {}
+
+    // getFrame
+    // ====================================================================== //
+    // Get the frame this entity is drawn with and collides with.
+    // 
+    // @return
+    // The mesh's frame if the entity has a mesh, the frame source's frame if
+    // it has one of those, otherwise its own frame.
+    inline const Frame & getFrame() const { return mesh ? mesh->frame : frameSource ? frameSource->frame : frame; }
+
+    // getDetailFrames
+    // ====================================================================== //
+    // Get the coarser versions of the frame from getFrame.
+    // 
+    // @return
+    // The detail frames that go with getFrame.
+    inline const Array<Frame> & getDetailFrames() const { return mesh ? mesh->detailFrames : frameSource ? frameSource->detailFrames : detailFrames; }
 
     // update
     // ====================================================================== //
@@ -39,6 +81,12 @@ struct Entity
     // its velocity and angular velcity.
     void update();
 
+    // getWorldTransform
+    // ====================================================================== //
+    // Get the matrix that rotates and translates this entity's frame into
+    // world space.
+    Matrix getWorldTransform() const;
+
     // getShapeInWorldSpace
     // ====================================================================== //
     // Get the shape of this entity after applying the translation and
@@ -71,9 +119,18 @@ struct Entity
     float boundingRadius;
 
     // The frame holds the points, lines, and triangles that represent this
-    // Entity.
+    // Entity. It's left empty when the entity has a mesh, see getFrame.
     Frame frame;
 
+    // The shared mesh this entity is drawn with, 0 if it has its own frame.
+    // Meshes belong to getSharedMesh, not to the entities using them.
+    const Mesh * mesh;
+
+    // The entity this one is a drawing copy of, 0 for every other entity.
+    // A copy uses the source's frame instead of copying it, so the source has
+    // to outlive the copy, see copyEntityForDrawing.
+    const Entity * frameSource;
+
     // The location of this Entity in world space. (default is 0, 0, 0)
     Point locationPoint;
 
@@ -103,6 +160,18 @@ struct Entity
 
     // Shape generated in world space, ready to calcualte collision.
     Shape worldSpaceShape;
+
+    // Every point of the frame is within this distance of locationPoint.
+    // Unlike boundingRadius it's worked out from the points, so it's safe to
+    // skip drawing the entity if this sphere is off screen. It's updated with
+    // worldSpaceShape and is negative until then.
+    float drawRadius;
+
+    // Coarser versions of frame, for drawing the entity when it's small on
+    // screen. detailFrames[i] has been subdivided i times, and frame more
+    // than any of them. Collisions always use frame. Empty for most
+    // entities.
+    Array<Frame> detailFrames;
 };
 
 
@@ -179,6 +248,42 @@ void initializeBulletFrame(Frame & frame, Color color);
 void initializeLongBulletFrame(Frame & frame, Color color);
 
 
+// fixWrapAroundPoints
+// ========================================================================== //
+// Point triangles at the azimouth angle 0 points instead of the ones in the
+// same spot at 2 * PI, while the points are still in the Spherical
+// Coordinate System. Used by initializeAsteroidFrame and
+// initializeBorderFrame.
+// 
+// @params
+// * Array<FrameTriangle> & triangles, triangles being fixed
+// * const Array<Point*> & zeros, every point with an azimouth angle of 0
+void fixWrapAroundPoints(Array<FrameTriangle> & triangles, const Array<Point*> & zeros);
+
+
+// generateFrameLines
+// ========================================================================== //
+// Fill a frame's lines with the edges of its triangles, each edge once.
+// 
+// @params
+// * Frame & frame, frame being modified
+void generateFrameLines(Frame & frame);
+
+
+// initializeDetailFrames
+// ========================================================================== //
+// Build a frame for each level of subdivision that a subdivided frame went
+// through, sharing the frame's finished points.
+// 
+// @params
+// * const Frame & frame, the finished frame
+// * const Array<Array<FrameTriangle> > & levels, the frame's triangles
+//                                               before each subdivision,
+//                                               pointing into frame.points
+// * Array<Frame> & detailFrames, gets one frame per level
+void initializeDetailFrames(const Frame & frame, const Array<Array<FrameTriangle> > & levels, Array<Frame> & detailFrames);
+
+
 // initializeAsteroidFrame
 // ========================================================================== //
 // Turn a given frame into an asteroid frame. Parameters determine the radius
@@ -192,7 +297,9 @@ void initializeLongBulletFrame(Frame & frame, Color color);
 // * float d, determens the depth of dents. ex: 2 would mean half the radius
 //            and 4 would be a quarter of the radius
 // * Color color, color of the frame
-void initializeAsteroidFrame(Frame & frame, float r, float n, float d, Color color);
+// * Array<Frame> * detailFrames = 0, if not 0 gets the asteroid at every
+//                                    level of subdivision below n
+void initializeAsteroidFrame(Frame & frame, float r, float n, float d, Color color, Array<Frame> * detailFrames = 0);
 
 
 // initializeBorderFrame
@@ -207,7 +314,25 @@ void initializeAsteroidFrame(Frame & frame, float r, float n, float d, Color col
 // * float n, number of times triangles get subdivided to make this it more
 //            spherical
 // * Color color, color of the frame
-void initializeBorderFrame(Frame & frame, float r, float n, Color color);
+// * Array<Frame> * detailFrames = 0, if not 0 gets the border at every level
+//                                    of subdivision below n
+void initializeBorderFrame(Frame & frame, float r, float n, Color color, Array<Frame> * detailFrames = 0);
+
+
+// getSharedMesh
+// ========================================================================== //
+// Get the mesh shared by every entity of a type and color, building it the
+// first time it's asked for. Meshes are never freed, there's only a few
+// of them.
+// 
+// @params
+// * MeshType type, what the mesh is of
+// * Color color0, first color given to the frame's initialize function
+// * Color color1 = COLOR_BLACK, second color, for the saucer
+// 
+// @return
+// The shared mesh, with its planes calculated.
+const Mesh * getSharedMesh(MeshType type, Color color0, Color color1 = COLOR_BLACK);
 
 
 // createShip
@@ -439,6 +564,23 @@ void updateLaserFrame(Frame & frame, float nGap, const Entity * entity);
 void updateFlowerFrame(Frame & frame);
 
 
+// copyEntityForDrawing
+// ========================================================================== //
+// Copy what the rasterizer needs out of an entity, so the copy can be drawn
+// while the entity keeps getting updated. Frames that never change after
+// they're built are pointed to instead of copied, through frameSource, so
+// the entity can't be deleted until the copy is done being drawn. Those
+// frames get their planes calculated here if they haven't been yet.
+// 
+// @param
+// * Entity & entity, the entity being copied
+// * Entity & copy, gets the entity's location, orientation, and drawing
+//                  properties, any old frame it had is ignored
+// * bool copyFrame, copy the frame too, for frames that change every update
+//                   like the trails and flowers
+void copyEntityForDrawing(Entity & entity, Entity & copy, bool copyFrame);
+
+
 // ************************************************************************** //
 // vvv                             COLLISION                              vvv //
 // ************************************************************************** //
@@ -175,26 +175,27 @@ Frame & Frame::operator=(const Frame& other)
     points = other.points;
     if (points.size() > 0)
     {
-        // calculate the difference to correct the new pointers
-        int oldFirstAddress = (int)&other.points[0];
-        int newFirstAddress = (int)&points[0];
-        int difference = oldFirstAddress - newFirstAddress;
+        // the pointers keep their index into the points
+        const Point * oldFirstPoint = &other.points[0];
+        Point * newFirstPoint = &points[0];
 
         lines = other.lines;
         for (int i = 0; i < lines.size(); i++)
         {
-            lines[i].p0 -= difference;
-            lines[i].p1 -= difference;
+            lines[i].p0 = newFirstPoint + (lines[i].p0 - oldFirstPoint);
+            lines[i].p1 = newFirstPoint + (lines[i].p1 - oldFirstPoint);
         }
 
         triangles = other.triangles;
         for (int i = 0; i < triangles.size(); i++)
         {
-            triangles[i].p0 -= difference;
-            triangles[i].p1 -= difference;
-            triangles[i].p2 -= difference;
+            triangles[i].p0 = newFirstPoint + (triangles[i].p0 - oldFirstPoint);
+            triangles[i].p1 = newFirstPoint + (triangles[i].p1 - oldFirstPoint);
+            triangles[i].p2 = newFirstPoint + (triangles[i].p2 - oldFirstPoint);
         }
     }
+    normals = other.normals;
+    planeDistances = other.planeDistances;
     return *this;
 }
 
@@ -229,5 +230,88 @@ Frame & Frame::operator*=(const Matrix & other)
         points[i] *= other;
     }
 
+    // the points moved, so the planes might have too
+    if (normals.size() > 0)
+    {
+        calculatePlanes();
+    }
+
     return *this;
-}
\ No newline at end of file
+}
+
+
+float Frame::getRadius() const
+{
+    float furthest = 0;
+    for (int i = 0; i < points.size(); i++)
+    {
+        const Point & p = points[i];
+        float distance = p.x * p.x + p.y * p.y + p.z * p.z;
+        if (distance > furthest)
+        {
+            furthest = distance;
+        }
+    }
+    return sqrt(furthest);
+}
+
+
+void Frame::calculatePlanes()
+{
+    normals.clear();
+    planeDistances.clear();
+    if (normals.capacity() < triangles.size())
+    {
+        normals.setCapacity(triangles.size());
+        planeDistances.setCapacity(triangles.size());
+    }
+    for (int i = 0; i < triangles.size(); i++)
+    {
+        Vector normal = triangles[i].getNormal();
+        const Point & p0 = *triangles[i].p0;
+        normals += normal;
+        planeDistances += normal.x * p0.x + normal.y * p0.y + normal.z * p0.z;
+    }
+}
+
+
+Frustum::Frustum(const Matrix & transform)
+{
+    // A point gets to clip space as (x, y, z, 1) * transform, so each clip
+    // coordinate is the point dotted with a column. Every plane is w plus or
+    // minus one of the others, e.g. the left plane is w + x >= 0.
+    for (int plane = 0; plane < 6; plane++)
+    {
+        int column = plane / 2;
+        float sign = (plane % 2 == 0) ? 1.0f : -1.0f;
+        for (int row = 0; row < 4; row++)
+        {
+            planes[plane][row] = transform.m_data[row][3] + sign * transform.m_data[row][column];
+        }
+
+        float length = sqrt(planes[plane][0] * planes[plane][0] + planes[plane][1] * planes[plane][1] + planes[plane][2] * planes[plane][2]);
+        for (int row = 0; row < 4; row++)
+        {
+            planes[plane][row] /= length;
+        }
+    }
+}
+
+
+FrustumTest Frustum::testSphere(const Point & center, float radius) const
+{
+    FrustumTest result = FT_INSIDE;
+    for (int plane = 0; plane < 6; plane++)
+    {
+        float distance = planes[plane][0] * center.x + planes[plane][1] * center.y + planes[plane][2] * center.z + planes[plane][3];
+        if (distance < -radius)
+        {
+            return FT_OUTSIDE;
+        }
+        if (distance < radius)
+        {
+            result = FT_INTERSECTING;
+        }
+    }
+    return result;
+}
@@ -45,6 +45,41 @@ struct Camera
 };
 
 
+// Where a bounding sphere is compared to a Frustum
+enum FrustumTest
+{
+    FT_OUTSIDE,      // completely outside, nothing to draw
+    FT_INTERSECTING, // partly inside, needs clipping
+    FT_INSIDE        // completely inside, no clipping needed
+};
+
+
+// The six planes of a viewing frustum, pulled out of the matrix that takes
+// a point to clip space. If that's the camera transform times the viewing
+// transform, the planes are in world space.
+struct Frustum
+{
+    Frustum() {}
+    Frustum(const Matrix & transform);
+
+    // testSphere
+    // ====================================================================== //
+    // 
+    // @params
+    // * const Point & center, center of the sphere
+    // * float radius, radius of the sphere
+    // 
+    // @return
+    // Whether the sphere is outside, partly inside, or inside the frustum.
+    FrustumTest testSphere(const Point & center, float radius) const;
+
+    // a, b, c, d for each plane, in the order left, right, bottom, top, far,
+    // near. A point is inside a plane if a*x + b*y + c*z + d >= 0. They're
+    // normalized, so that's also the distance to the plane.
+    float planes[6][4];
+};
+
+
 // Represents a line in 3D space. Holds two points.
 struct Line
 {
@@ -159,7 +194,23 @@ struct Frame
     Frame operator*(const Matrix & other) const;
     Frame & operator*=(const Matrix & other);
 
+    // Get the distance from the frame's origin to its furthest point.
+    float getRadius() const;
+
+    // Fill normals and planeDistances with the plane equation of every
+    // triangle. The triangles never change once the frame is built, so this
+    // only needs doing once.
+    void calculatePlanes();
+
     Array<Point> points;
     Array<FrameLine> lines;
     Array<FrameTriangle> triangles;
+
+    // Unit normals of the triangles, in the frame's own space, one for each
+    // triangle. Empty until calculatePlanes is called.
+    Array<Vector> normals;
+
+    // The normal dotted with any point on its triangle, so a point p is in
+    // front of triangle i when normals[i] dot p > planeDistances[i].
+    Array<float> planeDistances;
 };
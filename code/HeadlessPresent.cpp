@@ -0,0 +1,75 @@
+/* ==========================================================================
+   >File: HeadlessPresent.cpp
+   >Date: 20180713
+   >Author: Vik Pandher
+   >Details: A present backend without a window. Frames are copied into
+             memory, where they can be looked at or saved to a file.
+   ========================================================================== */
+
+#include <stdio.h>
+#include "HeadlessPresent.h"
+#include "FrameCapture.h"
+
+
+
+// public:
+
+HeadlessPresent::HeadlessPresent() :
+    m_frame(0),
+    m_capacity(0),
+    m_width(0),
+    m_height(0),
+    m_frameCount(0)
+{
+}
+
+
+HeadlessPresent::~HeadlessPresent()
+{
+    delete[] m_frame;
+}
+
+
+void HeadlessPresent::present(const ScreenBuffer & screenBuffer)
+{
+    m_width = screenBuffer.getWidth();
+    m_height = screenBuffer.getHeight();
+    unsigned count = m_width * m_height;
+
+    if (count > m_capacity)
+    {
+        delete[] m_frame;
+        m_frame = new uint32_t[count];
+        m_capacity = count;
+    }
+
+    const uint32_t * pixels = screenBuffer.getPixels();
+    for (unsigned i = 0; i < count; i++)
+    {
+        m_frame[i] = pixels[i];
+    }
+    m_frameCount++;
+}
+
+
+bool HeadlessPresent::saveFrame(const char * fileName) const
+{
+    if (!m_frame)
+    {
+        return false;
+    }
+
+    FILE * file = fopen(fileName, "wb");
+    if (!file)
+    {
+        return false;
+    }
+
+    unsigned size = getPPMSize(m_width, m_height);
+    uint8_t * bytes = new uint8_t[size];
+    encodePPM(m_frame, m_width, m_height, bytes);
+    bool written = fwrite(bytes, 1, size, file) == size;
+    delete[] bytes;
+
+    return fclose(file) == 0 && written;
+}
@@ -0,0 +1,99 @@
+/* ==========================================================================
+   >File: HeadlessPresent.h
+   >Date: 20180713
+   >Author: Vik Pandher
+   >Details: A present backend without a window. Frames are copied into
+             memory, where they can be looked at or saved to a file.
+   ========================================================================== */
+
+#pragma once
+#include "ScreenBuffer.h"
+
+
+
+// The headless present backend, for running the renderer where there's no
+// window to draw on, like benchmarks and profiling on Linux. Every present
+// copies the screen buffer's pixels, so the screen buffer can go on to the
+// next frame while the last one is still around.
+class HeadlessPresent
+{
+public:
+    // HeadlessPresent
+    // ====================================================================== //
+    // No memory is taken until the first frame is presented.
+    HeadlessPresent();
+
+    // ~HeadlessPresent
+    // ====================================================================== //
+    // Free the frame.
+    ~HeadlessPresent();
+
+    // present
+    // ====================================================================== //
+    // Copy the screen buffer's pixels, growing the frame if it has to.
+    //
+    // @params
+    // * const ScreenBuffer & screenBuffer, what's presented
+    void present(const ScreenBuffer & screenBuffer);
+
+    // getFrameCount
+    // ====================================================================== //
+    //
+    // @return
+    // How many frames have been presented.
+    inline unsigned getFrameCount() const
+    {
+        return m_frameCount;
+    }
+
+    // getWidth
+    // ====================================================================== //
+    //
+    // @return
+    // The width of the last frame presented in pixels.
+    inline int getWidth() const
+    {
+        return m_width;
+    }
+
+    // getHeight
+    // ====================================================================== //
+    //
+    // @return
+    // The height of the last frame presented in pixels.
+    inline int getHeight() const
+    {
+        return m_height;
+    }
+
+    // getFrame
+    // ====================================================================== //
+    // Laid out like the screen buffer, rows getWidth pixels apart with the
+    // bottom one first.
+    //
+    // @return
+    // The first pixel of the last frame presented, 0x 00 RR GG BB, or 0 if
+    // nothing's been presented.
+    inline const uint32_t * getFrame() const
+    {
+        return m_frame;
+    }
+
+    // saveFrame
+    // ====================================================================== //
+    // Write the last frame presented to a binary PPM file, top row first.
+    //
+    // @params
+    // * const char * fileName, the file written, replaced if it's there
+    //
+    // @return
+    // False if nothing's been presented or the file couldn't be written.
+    bool saveFrame(const char * fileName) const;
+
+private:
+    uint32_t * m_frame;
+    unsigned m_capacity; // pixels the frame has room for
+    int m_width;
+    int m_height;
+    unsigned m_frameCount;
+};
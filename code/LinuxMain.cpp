@@ -0,0 +1,309 @@
+/* ==========================================================================
+   >File: LinuxMain.cpp
+   >Date: 20180713
+   >Author: Vik Pandher
+   >Details: Headless entry point for Linux. Plays the game with a script of
+             key presses as fast as it can, without a window, and prints
+             how long updating and drawing took. For load and performance
+             testing.
+   ========================================================================== */
+
+#include <stdio.h>
+#include <string.h>
+#include "Game.h"
+// ^ includes "ScreenBuffer.h" and "Platform.h"
+#include "HeadlessPresent.h"
+#include "FrameCapture.h"
+
+
+
+// function delarations
+// -------------------------------------------------------------------------- //
+int main(int argc, char ** argv);
+void queueScriptedKeys(unsigned frame);
+
+
+/* --------------------------------------------------------------------------
+   NOTE:
+   static global variables are translation unit specific.
+   -------------------------------------------------------------------------- */
+
+// The ScreenBuffer, holds the pixels and the z buffer
+ScreenBuffer * g_screenBuffer;
+
+// Defaults for the command line options, see main
+static const unsigned DEFAULT_FRAMES = 1000;
+static const int DEFAULT_WIDTH = 960;
+static const int DEFAULT_HEIGHT = 640;
+static const unsigned DEFAULT_DUMP_EVERY = 100;
+
+// A key pressed or let go on some frame of the script
+struct ScriptedKey
+{
+    unsigned frame;
+    uint8_t key;
+    bool down;
+};
+
+// Every SCRIPT_FRAMES frames: start a game from the menu, or restart it from
+// the end screen, then fly around shooting, turning every which way
+static const unsigned SCRIPT_FRAMES = 300;
+static const ScriptedKey SCRIPT[] =
+{
+    { 10,  VK_RETURN,          true  },
+    { 12,  VK_RETURN,          false },
+    { 20,  DEFAULT_SHOOT,      true  },
+    { 20,  DEFAULT_ACCELERATE, true  },
+    { 20,  DEFAULT_YAW_LEFT,   true  },
+    { 100, DEFAULT_ZOOM,       true  },
+    { 130, DEFAULT_ZOOM,       false },
+    { 140, DEFAULT_YAW_LEFT,   false },
+    { 140, DEFAULT_PITCH_UP,   true  },
+    { 200, DEFAULT_PITCH_UP,   false },
+    { 200, DEFAULT_ROLL_RIGHT, true  },
+    { 260, DEFAULT_ROLL_RIGHT, false },
+    { 290, DEFAULT_SHOOT,      false },
+    { 290, DEFAULT_ACCELERATE, false },
+};
+
+
+
+// main
+// ========================================================================== //
+// Run the game for a number of frames, updating and drawing once per frame.
+//
+// Options:
+// * -frames N, how many frames to run, DEFAULT_FRAMES if not given
+// * -size WIDTH HEIGHT, screen buffer size, DEFAULT_WIDTH by DEFAULT_HEIGHT
+//   if not given
+// * -binned, split the 3D drawing up between threads
+// * -scale S, draw the 3D at S times the size, 0 < S <= 1, with dynamic
+//   resolution pinned there. The menus and HUD are still full size.
+// * -dump PREFIX, save a frame to PREFIX_NNNNN.ppm every so often
+// * -every N, frames between dumps, DEFAULT_DUMP_EVERY if not given
+// * -stats, show the render stats, which get drawn and dumped too
+// * -capture PATH, record every frame drawn to PATH with a FrameCapture,
+//   one PPM after another
+// * -qoi, record PATH_NNNNN.qoi files instead
+//
+// @params
+// * int argc, number of command line arguments
+// * char ** argv, the command line arguments
+//
+// @return
+// 0 if everything went fine, 1 if the options were bad or something threw
+int main(int argc, char ** argv)
+{
+    unsigned frames = DEFAULT_FRAMES;
+    int width = DEFAULT_WIDTH;
+    int height = DEFAULT_HEIGHT;
+    bool binned = false;
+    float scale = 1;
+    const char * dumpPrefix = 0;
+    unsigned dumpEvery = DEFAULT_DUMP_EVERY;
+    bool stats = false;
+    const char * capturePath = 0;
+    FrameCaptureFormat captureFormat = FRAME_CAPTURE_PPM;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-frames") && i + 1 < argc)
+        {
+            frames = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-size") && i + 2 < argc)
+        {
+            width = atoi(argv[++i]);
+            height = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-binned"))
+        {
+            binned = true;
+        }
+        else if (!strcmp(argv[i], "-scale") && i + 1 < argc)
+        {
+            scale = (float)atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-dump") && i + 1 < argc)
+        {
+            dumpPrefix = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-every") && i + 1 < argc)
+        {
+            dumpEvery = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-stats"))
+        {
+            stats = true;
+        }
+        else if (!strcmp(argv[i], "-capture") && i + 1 < argc)
+        {
+            capturePath = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-qoi"))
+        {
+            captureFormat = FRAME_CAPTURE_QOI;
+        }
+        else
+        {
+            printf("usage: %s [-frames N] [-size WIDTH HEIGHT] [-binned] [-scale S] [-dump PREFIX] [-every N] [-stats] [-capture PATH] [-qoi]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (width <= 0 || height <= 0 || dumpEvery == 0)
+    {
+        printf("the size and -every have to be positive\n");
+        return 1;
+    }
+    if (scale <= 0 || scale > 1)
+    {
+        printf("-scale has to be over 0 and at most 1\n");
+        return 1;
+    }
+
+    // Same as Win32Main, except it all happens on this thread. The snapshot
+    // is drawn right after it's captured, so nothing waits to be deleted.
+    static RenderSnapshot snapshot;
+    int64_t updateTime = 0;
+    int64_t drawTime = 0;
+    unsigned drawnFrames = 0;
+
+    // What capture costs the drawing thread, copying the frame or dropping it
+    static FrameCapture frameCapture;
+    int64_t captureTime = 0;
+    int64_t maxCaptureTime = 0;
+    bool captureWritten = true;
+
+    try
+    {
+        initializePlatform();
+
+        g_screenBuffer = new ScreenBuffer(width, height);
+        g_screenBuffer->setBinnedRasterization(binned);
+        if (scale < 1)
+        {
+            g_screenBuffer->setDynamicResolution(true, 8, scale, scale);
+        }
+
+        if (capturePath)
+        {
+            try
+            {
+                frameCapture.start(capturePath, captureFormat);
+            }
+            catch (int x)
+            {
+                printf("couldn't start capturing to %s: %s\n", capturePath, getErrorString(x));
+                return 1;
+            }
+        }
+
+        initialize();
+        if (stats)
+        {
+            queueKeyEvent(RENDER_STATS_KEY, true);
+            queueKeyEvent(RENDER_STATS_KEY, false);
+        }
+
+        Array<KeyEvent> keyEvents;
+        for (unsigned frame = 0; frame < frames; frame++)
+        {
+            queueScriptedKeys(frame);
+            takeKeyEvents(keyEvents);
+            for (int i = 0; i < keyEvents.size(); i++)
+            {
+                if (keyEvents[i].down)
+                {
+                    keyDown(keyEvents[i].key);
+                }
+                else
+                {
+                    keyUp(keyEvents[i].key);
+                }
+            }
+
+            int64_t startTime = getPlatformMicroseconds();
+            update();
+            int64_t updateEndTime = getPlatformMicroseconds();
+            captureRenderSnapshot(snapshot);
+            bool drawn = draw(snapshot);
+            int64_t drawEndTime = getPlatformMicroseconds();
+
+            updateTime += updateEndTime - startTime;
+            if (drawn)
+            {
+                drawTime += drawEndTime - updateEndTime;
+                drawnFrames++;
+                presentFrame(*g_screenBuffer);
+
+                int64_t captureStartTime = getPlatformMicroseconds();
+                frameCapture.capture(*g_screenBuffer);
+                int64_t captureEndTime = getPlatformMicroseconds();
+                captureTime += captureEndTime - captureStartTime;
+                if (captureEndTime - captureStartTime > maxCaptureTime)
+                {
+                    maxCaptureTime = captureEndTime - captureStartTime;
+                }
+            }
+            deleteRetiredEntities(snapshot.sequence);
+
+            if (dumpPrefix && frame % dumpEvery == 0)
+            {
+                char fileName[1024];
+                snprintf(fileName, sizeof(fileName), "%s_%05u.ppm", dumpPrefix, frame);
+                if (!getHeadlessPresent().saveFrame(fileName))
+                {
+                    printf("couldn't save %s\n", fileName);
+                }
+            }
+        }
+
+        deinitialize();
+        captureWritten = frameCapture.stop();
+    }
+    catch (int x)
+    {
+        printf("exception: %s\n", getErrorString(x));
+        return 1;
+    }
+
+    printf("%u frames at %dx%d%s", frames, width, height, g_screenBuffer->getBinnedRasterization() ? ", binned" : "");
+    if (scale < 1)
+    {
+        printf(", 3D at %dx%d", (int)(width * scale), (int)(height * scale));
+    }
+    printf("\n");
+    printf("update: %8.3f ms per frame\n", frames ? updateTime / 1000.0 / frames : 0.0);
+    printf("draw:   %8.3f ms per frame drawn, %u drawn\n", drawnFrames ? drawTime / 1000.0 / drawnFrames : 0.0, drawnFrames);
+    if (capturePath)
+    {
+        printf("capture: %7.1f us per frame drawn, %lld us at most, %u captured, %u dropped%s\n",
+            drawnFrames ? (double)captureTime / drawnFrames : 0.0, (long long)maxCaptureTime,
+            frameCapture.getCapturedCount(), frameCapture.getDroppedCount(),
+            captureWritten ? "" : ", couldn't write them all");
+    }
+
+    delete g_screenBuffer;
+    shutdownPlatform();
+    return 0;
+} // main
+
+
+// queueScriptedKeys
+// ========================================================================== //
+// Queue the script's keys for a frame, the same way a window would queue
+// the keys it gets.
+//
+// @params
+// * unsigned frame, the frame about to be updated
+void queueScriptedKeys(unsigned frame)
+{
+    unsigned scriptFrame = frame % SCRIPT_FRAMES;
+    for (unsigned i = 0; i < sizeof(SCRIPT) / sizeof(SCRIPT[0]); i++)
+    {
+        if (SCRIPT[i].frame == scriptFrame)
+        {
+            queueKeyEvent(SCRIPT[i].key, SCRIPT[i].down);
+        }
+    }
+} // queueScriptedKeys
@@ -0,0 +1,149 @@
+/* ==========================================================================
+   >File: LinuxPlatform.cpp
+   >Date: 20180713
+   >Author: Vik Pandher
+   >Details: A headless Linux version of Platform.h. There's no window, so
+             frames go to a HeadlessPresent and the keys are whatever gets
+             queued by the program itself.
+   ========================================================================== */
+
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "Platform.h"
+#include "HeadlessPresent.h"
+
+
+
+// Key events waiting to be taken, signaled whenever one is queued. The
+// condition variable waits on CLOCK_MONOTONIC, same as the timer.
+static Array<KeyEvent> s_keyEvents;
+static pthread_mutex_t s_keyEventLock;
+static pthread_cond_t s_keyQueuedCondition;
+static bool s_keyQueued;
+
+// Where presentFrame copies to
+static HeadlessPresent s_present;
+
+
+void initializePlatform()
+{
+    pthread_condattr_t conditionAttributes;
+    pthread_condattr_init(&conditionAttributes);
+    pthread_condattr_setclock(&conditionAttributes, CLOCK_MONOTONIC);
+
+    if (pthread_mutex_init(&s_keyEventLock, 0) != 0 ||
+        pthread_cond_init(&s_keyQueuedCondition, &conditionAttributes) != 0)
+    {
+        throw ERROR_THREAD_UNAVAILABLE;
+    }
+    pthread_condattr_destroy(&conditionAttributes);
+    s_keyQueued = false;
+}
+
+
+void shutdownPlatform()
+{
+    pthread_cond_destroy(&s_keyQueuedCondition);
+    pthread_mutex_destroy(&s_keyEventLock);
+}
+
+
+int64_t getPlatformMicroseconds()
+{
+    timespec currentTime;
+    clock_gettime(CLOCK_MONOTONIC, &currentTime);
+    return (int64_t)currentTime.tv_sec * 1000000 + currentTime.tv_nsec / 1000;
+}
+
+
+void queueKeyEvent(uint8_t key, bool down)
+{
+    KeyEvent keyEvent;
+    keyEvent.key = key;
+    keyEvent.down = down;
+
+    pthread_mutex_lock(&s_keyEventLock);
+    s_keyEvents += keyEvent;
+    s_keyQueued = true;
+    pthread_cond_signal(&s_keyQueuedCondition);
+    pthread_mutex_unlock(&s_keyEventLock);
+}
+
+
+void takeKeyEvents(Array<KeyEvent> & keyEvents)
+{
+    pthread_mutex_lock(&s_keyEventLock);
+    keyEvents = s_keyEvents;
+    s_keyEvents.clear();
+    pthread_mutex_unlock(&s_keyEventLock);
+}
+
+
+void waitForKeyEvent(int64_t microseconds)
+{
+    if (microseconds <= 0)
+    {
+        return;
+    }
+
+    int64_t wakeTime = getPlatformMicroseconds() + microseconds;
+    timespec wakeSpec;
+    wakeSpec.tv_sec = wakeTime / 1000000;
+    wakeSpec.tv_nsec = (wakeTime % 1000000) * 1000;
+
+    // Works like the auto-reset event on Windows, one wake per queue, and a
+    // queue from before the wait still counts
+    pthread_mutex_lock(&s_keyEventLock);
+    while (!s_keyQueued)
+    {
+        if (pthread_cond_timedwait(&s_keyQueuedCondition, &s_keyEventLock, &wakeSpec) != 0)
+        {
+            break;
+        }
+    }
+    s_keyQueued = false;
+    pthread_mutex_unlock(&s_keyEventLock);
+}
+
+
+void wakeKeyEventWaiters()
+{
+    pthread_mutex_lock(&s_keyEventLock);
+    s_keyQueued = true;
+    pthread_cond_broadcast(&s_keyQueuedCondition);
+    pthread_mutex_unlock(&s_keyEventLock);
+}
+
+
+void * allocatePages(size_t size)
+{
+    // anonymous mappings are whole pages, already zeroed
+    void * memory = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+    {
+        throw ERROR_MEMORY_UNAVAILABLE;
+    }
+    return memory;
+}
+
+
+void freePages(void * memory, size_t size)
+{
+    if (memory)
+    {
+        munmap(memory, size);
+    }
+}
+
+
+void presentFrame(const ScreenBuffer & screenBuffer)
+{
+    s_present.present(screenBuffer);
+}
+
+
+HeadlessPresent & getHeadlessPresent()
+{
+    return s_present;
+}
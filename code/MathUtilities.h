@@ -70,6 +70,7 @@ bool equalULP(float a, float b, float maxDiff = MAX_FLOAT_DIFF, int ulpsLimit =
 float powerOf(float x, float y);
 int factorial(int x);
 float sqrt(float x);
+float inverseSqrt(float x);
 float logMaclaurinExpansion(float x, float n = TAYLOR_SERIES_DEGREE);
 float cosMaclaurinExpansion(float x, float n = TAYLOR_SERIES_DEGREE);
 float sinMaclaurinExpansion(float x, float n = TAYLOR_SERIES_DEGREE);
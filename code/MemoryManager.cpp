@@ -14,12 +14,8 @@ MemoryManager::MemoryManager(unsigned long size /* = STARTING_MEMEORY_SIZE*/)
 {
     // Grab memory
     // Note: HeapAlloc allocated out of the pages for you so, the allocated memory isn't movable.
-    // VirtualAlloc must give you back pages, so you get multiples of 4096 bytes.
-    m_headBlock = (Block*)VirtualAlloc(
-        0,                          // lpAddress, we don't care where the memory is
-        size + sizeof(Block),       // dwSize, size of the region in bytes
-        MEM_COMMIT,                 // flAllocationType
-        PAGE_READWRITE);            // flProtect
+    // allocatePages must give you back pages, so you get multiples of 4096 bytes.
+    m_headBlock = (Block*)allocatePages(size + sizeof(Block));
     m_headBlock->size = size;
     m_headBlock->info = INFO_AVAILALBE;
     m_headBlock->next = NULL;
@@ -30,7 +26,7 @@ MemoryManager::MemoryManager(unsigned long size /* = STARTING_MEMEORY_SIZE*/)
 MemoryManager::~MemoryManager()
 {
     // Free memory
-    VirtualFree(m_headBlock, 0, MEM_RELEASE);
+    freePages(m_headBlock, m_totalMemory);
 }
 
 
@@ -47,7 +43,7 @@ void* MemoryManager::allocate(unsigned int size, unsigned char info /* = 1*/)
             // the block is big enough to split
             if (block->size > size + sizeof(Block))
             {
-                unsigned int blockPointer = (unsigned int)block;
+                uintptr_t blockPointer = (uintptr_t)block;
                 Block* leftoverBlock = (Block*)(blockPointer + sizeof(Block) + size);
                 leftoverBlock->size = block->size - sizeof(Block) - size;
                 leftoverBlock->info = INFO_AVAILALBE;
@@ -7,7 +7,7 @@
    ========================================================================== */
 
 #pragma once
-#include <windows.h>
+#include "Platform.h"
 #include "ErrorCodes.h"
 
 
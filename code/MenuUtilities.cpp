@@ -5,6 +5,7 @@
    >Details: Stuff used in the menus.
    ========================================================================== */
 
+#include "Platform.h" // virtual key codes
 #include "MenuUtilities.h"
 
 
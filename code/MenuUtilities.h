@@ -81,6 +81,25 @@ public:
 
     // is this text box selected (will be drawn different if it is)
     bool m_selected;
+
+    // looksLike
+    // ====================================================================== //
+    // Checks if this text box would be drawn the same as another one. Every
+    // member that changes how it's drawn has to match.
+    // 
+    // @params
+    // * const TextBox & other, the text box being compared to
+    // 
+    // @return
+    // True if the two text boxes draw the exact same pixels.
+    inline bool looksLike(const TextBox & other) const
+    {
+        return m_x == other.m_x && m_y == other.m_y &&
+            m_xScale == other.m_xScale && m_yScale == other.m_yScale &&
+            m_color0 == other.m_color0 && m_color1 == other.m_color1 && m_color2 == other.m_color2 &&
+            m_hasBorder == other.m_hasBorder && m_hasBackground == other.m_hasBackground &&
+            m_selected == other.m_selected && m_text == other.m_text;
+    }
 };
 
 
@@ -118,8 +137,12 @@ public:
     // ====================================================================== //
     // Triggers this button's given action, if it has been pressed and it's
     // not asleep. If it is, decrement the sleep timer.
-    inline void update()
+    // 
+    // @return
+    // True if the action was triggered.
+    inline bool update()
     {
+        bool triggered = false;
         if (m_pressed)
         {
             if (m_sleepTimer == 0 && m_dreamTimer == 0)
@@ -127,6 +150,7 @@ public:
                 m_action();
                 m_sleepTimer = m_sleepTimerStart;
                 m_dreamTimer = m_dreamTimerStart;
+                triggered = true;
             }
         }
 
@@ -139,6 +163,8 @@ public:
         {
             m_dreamTimer--;
         }
+
+        return triggered;
     }
 
     // setSleepTimer
@@ -0,0 +1,157 @@
+/* ==========================================================================
+   >File: Platform.h
+   >Date: 20180713
+   >Author: Vik Pandher
+   >Details: Everything the game needs from the operating system: a timer,
+             key events, pages of memory, and somewhere to show frames.
+             Win32Platform.cpp has the Windows version, LinuxPlatform.cpp
+             has a headless one for Linux.
+   ========================================================================== */
+
+#pragma once
+#if defined(_WIN32)
+#include <windows.h> // virtual key codes
+#else
+#include "VirtualKeyCodes.h"
+#endif
+#include <stddef.h>
+#include "SizedIntegers.h"
+#include "ErrorCodes.h"
+#include "Array.h"
+
+
+
+class ScreenBuffer;
+
+
+// A key going down or coming up. Keys are Windows virtual key codes on every
+// platform, see VirtualKeyCodes.h.
+struct KeyEvent
+{
+    uint8_t key;
+    bool down;
+};
+
+
+// initializePlatform
+// ========================================================================== //
+// Set up the key event queue and anything else the platform needs. Call it
+// once, before any of the others.
+void initializePlatform();
+
+// shutdownPlatform
+// ========================================================================== //
+// Free what initializePlatform set up. Nothing else can be using the
+// platform by now.
+void shutdownPlatform();
+
+
+// Timer
+// -------------------------------------------------------------------------- //
+
+// getPlatformMicroseconds
+// ========================================================================== //
+// A high resolution clock that never goes backwards. Only the difference
+// between two readings means anything.
+//
+// @return
+// Microseconds since some point in the past.
+int64_t getPlatformMicroseconds();
+
+
+// Input events
+// -------------------------------------------------------------------------- //
+
+// queueKeyEvent
+// ========================================================================== //
+// Add a key event to the back of the queue and wake up anything waiting in
+// waitForKeyEvent. Safe to call from any thread.
+//
+// @params
+// * uint8_t key, virtual key code
+// * bool down, true if the key went down, false if it came up
+void queueKeyEvent(uint8_t key, bool down);
+
+// takeKeyEvents
+// ========================================================================== //
+// Move every queued key event into keyEvents, oldest first, and empty the
+// queue. Safe to call from any thread.
+//
+// @params
+// * Array<KeyEvent> & keyEvents, replaced with the queued events
+void takeKeyEvents(Array<KeyEvent> & keyEvents);
+
+// waitForKeyEvent
+// ========================================================================== //
+// Sleep until a key event is queued, wakeKeyEventWaiters is called, or the
+// time runs out, whichever comes first.
+//
+// @params
+// * int64_t microseconds, longest to sleep
+void waitForKeyEvent(int64_t microseconds);
+
+// wakeKeyEventWaiters
+// ========================================================================== //
+// Wake up anything in waitForKeyEvent without queueing a key, like when
+// shutting down.
+void wakeKeyEventWaiters();
+
+
+// Page allocation
+// -------------------------------------------------------------------------- //
+
+// allocatePages
+// ========================================================================== //
+// Get memory straight from the operating system, in whole pages. It starts
+// on a page boundary and is zeroed. Throws ERROR_MEMORY_UNAVAILABLE if there
+// isn't any.
+//
+// @params
+// * size_t size, bytes needed, rounded up to a whole page
+//
+// @return
+// The first byte of the pages.
+void * allocatePages(size_t size);
+
+// freePages
+// ========================================================================== //
+// Give pages from allocatePages back. Does nothing if memory is 0.
+//
+// @params
+// * void * memory, what allocatePages returned
+// * size_t size, the size given to allocatePages
+void freePages(void * memory, size_t size);
+
+
+// Present
+// -------------------------------------------------------------------------- //
+
+// presentFrame
+// ========================================================================== //
+// Show what's been drawn to the screen buffer. On Windows it's stretched
+// over the window's client area, headless it's copied into memory.
+//
+// @params
+// * const ScreenBuffer & screenBuffer, the frame
+void presentFrame(const ScreenBuffer & screenBuffer);
+
+
+#if defined(_WIN32)
+// setPresentWindow
+// ========================================================================== //
+// Pick the window presentFrame draws on.
+//
+// @params
+// * HWND window, the window
+void setPresentWindow(HWND window);
+#else
+class HeadlessPresent;
+
+// getHeadlessPresent
+// ========================================================================== //
+//
+// @return
+// The present backend presentFrame copies into, for looking at or saving
+// the last frame.
+HeadlessPresent & getHeadlessPresent();
+#endif
@@ -0,0 +1,273 @@
+/* ==========================================================================
+   >File: RenderCommands.cpp
+   >Date: 20180713
+   >Author: Vik Pandher
+   >Details: Draw calls written into a buffer instead of being drawn right
+             away. Once a frame is recorded, the 3D draws get merged so the
+             screen buffer can sort them and split them between threads.
+   ========================================================================== */
+
+#include "RenderCommands.h"
+
+
+
+// public:
+
+RenderCommandBuffer::RenderCommandBuffer() :
+    m_memory(0),
+    m_capacity(0),
+    m_used(0),
+    m_commandCount(0),
+    m_groupCount(0)
+{
+}
+
+
+RenderCommandBuffer::~RenderCommandBuffer()
+{
+    delete[] m_memory;
+}
+
+
+void RenderCommandBuffer::clear(const Color & color /*= COLOR_BLACK*/)
+{
+    ClearCommand * command = (ClearCommand *)push(RENDER_COMMAND_CLEAR, sizeof(ClearCommand));
+    command->color = color;
+}
+
+
+void RenderCommandBuffer::fade(unsigned f)
+{
+    FadeCommand * command = (FadeCommand *)push(RENDER_COMMAND_FADE, sizeof(FadeCommand));
+    command->f = f;
+}
+
+
+void RenderCommandBuffer::rasterize(const Camera & camera, const Entity * entity)
+{
+    RasterizeCommand * command = (RasterizeCommand *)push(RENDER_COMMAND_RASTERIZE, sizeof(RasterizeCommand) + sizeof(Entity*));
+    command->camera = &camera;
+    command->entityCount = 1;
+
+    const Entity ** entities = (const Entity **)(command + 1);
+    entities[0] = entity;
+}
+
+
+void RenderCommandBuffer::rasterizeGroup(const Camera & camera, const Array<Entity*> & entities)
+{
+    unsigned count = entities.size();
+    RasterizeCommand * command = (RasterizeCommand *)push(RENDER_COMMAND_RASTERIZE, sizeof(RasterizeCommand) + count * sizeof(Entity*));
+    command->camera = &camera;
+    command->entityCount = count;
+
+    Entity ** commandEntities = (Entity **)(command + 1);
+    for (unsigned i = 0; i < count; i++)
+    {
+        commandEntities[i] = entities[i];
+    }
+}
+
+
+void RenderCommandBuffer::drawString(int x, int y, const String & string, const Color & color, int xScale /*= 1*/, int yScale /*= 1*/)
+{
+    unsigned length = string.size();
+    StringCommand * command = (StringCommand *)push(RENDER_COMMAND_STRING, sizeof(StringCommand) + length + 1);
+    command->x = x;
+    command->y = y;
+    command->color = color;
+    command->xScale = xScale;
+    command->yScale = yScale;
+
+    char * characters = (char *)(command + 1);
+    for (unsigned i = 0; i < length; i++)
+    {
+        characters[i] = string[i];
+    }
+    characters[length] = '\0';
+}
+
+
+void RenderCommandBuffer::drawTextBox(const TextBox & textBox)
+{
+    TextBoxCommand * command = (TextBoxCommand *)push(RENDER_COMMAND_TEXT_BOX, sizeof(TextBoxCommand));
+    command->textBox = &textBox;
+}
+
+
+void RenderCommandBuffer::drawHearts(int n, int x, int y, const Color & color)
+{
+    HeartsCommand * command = (HeartsCommand *)push(RENDER_COMMAND_HEARTS, sizeof(HeartsCommand));
+    command->n = n;
+    command->x = x;
+    command->y = y;
+    command->color = color;
+}
+
+
+void RenderCommandBuffer::callback(RenderCallback callback, void * data)
+{
+    CallbackCommand * command = (CallbackCommand *)push(RENDER_COMMAND_CALLBACK, sizeof(CallbackCommand));
+    command->callback = callback;
+    command->data = data;
+}
+
+
+void RenderCommandBuffer::execute(ScreenBuffer & screenBuffer)
+{
+    m_groupCount = 0;
+    m_overlays.clear();
+
+    unsigned offset = 0;
+    while (offset < m_used)
+    {
+        const RenderCommandHeader * header = (const RenderCommandHeader *)(m_memory + offset);
+        switch (header->type)
+        {
+        case RENDER_COMMAND_CLEAR:
+        {
+            // Touches every pixel, so everything before it has to be drawn
+            // first. It clears the scene, the 3D after it draws over that,
+            // and the scene covers the whole frame once it's stretched.
+            drawPass(screenBuffer);
+            const ClearCommand * command = (const ClearCommand *)header;
+            screenBuffer.beginScene();
+            screenBuffer.clear(command->color);
+            break;
+        }
+        case RENDER_COMMAND_FADE:
+        {
+            drawPass(screenBuffer);
+            const FadeCommand * command = (const FadeCommand *)header;
+            screenBuffer.fade(command->f);
+            break;
+        }
+        case RENDER_COMMAND_RASTERIZE:
+        {
+            // Merge it into the group with the same camera
+            const RasterizeCommand * command = (const RasterizeCommand *)header;
+            int group = 0;
+            while (group < m_groupCount && m_groupCameras[group] != command->camera)
+            {
+                group++;
+            }
+            if (group == m_groupCount)
+            {
+                if (m_groupCount == m_groupEntities.size())
+                {
+                    m_groupCameras += command->camera;
+                    m_groupEntities += Array<Entity*>();
+                }
+                m_groupCameras[group] = command->camera;
+                m_groupEntities[group].clear();
+                m_groupCount++;
+            }
+
+            Array<Entity*> & entities = m_groupEntities[group];
+            Entity * const * commandEntities = (Entity * const *)(command + 1);
+            for (unsigned i = 0; i < command->entityCount; i++)
+            {
+                entities += commandEntities[i];
+            }
+            break;
+        }
+        default:
+        {
+            m_overlays += offset;
+            break;
+        }
+        }
+
+        offset += header->size;
+    }
+
+    drawPass(screenBuffer);
+}
+
+
+// private:
+
+void * RenderCommandBuffer::push(RenderCommandType type, unsigned size)
+{
+    // keep every command lined up for its pointers
+    size = (size + sizeof(void*) - 1) & ~(unsigned)(sizeof(void*) - 1);
+
+    if (m_used + size > m_capacity)
+    {
+        unsigned capacity = m_capacity ? m_capacity : RENDER_COMMAND_BUFFER_SIZE;
+        while (m_used + size > capacity)
+        {
+            capacity *= 2;
+        }
+
+        uint8_t * memory = new uint8_t[capacity];
+        for (unsigned i = 0; i < m_used; i++)
+        {
+            memory[i] = m_memory[i];
+        }
+        delete[] m_memory;
+        m_memory = memory;
+        m_capacity = capacity;
+    }
+
+    RenderCommandHeader * header = (RenderCommandHeader *)(m_memory + m_used);
+    header->type = type;
+    header->size = size;
+    m_used += size;
+    m_commandCount++;
+    return header;
+}
+
+
+void RenderCommandBuffer::drawPass(ScreenBuffer & screenBuffer)
+{
+    for (int i = 0; i < m_groupCount; i++)
+    {
+        screenBuffer.rasterizeGroup(*m_groupCameras[i], m_groupEntities[i]);
+    }
+    m_groupCount = 0;
+
+    // the 2D is drawn at full size, over the stretched scene
+    screenBuffer.endScene();
+
+    for (int i = 0; i < m_overlays.size(); i++)
+    {
+        drawOverlay(screenBuffer, (const RenderCommandHeader *)(m_memory + m_overlays[i]));
+    }
+    m_overlays.clear();
+}
+
+
+void RenderCommandBuffer::drawOverlay(ScreenBuffer & screenBuffer, const RenderCommandHeader * header)
+{
+    switch (header->type)
+    {
+    case RENDER_COMMAND_STRING:
+    {
+        const StringCommand * command = (const StringCommand *)header;
+        String string((const char *)(command + 1));
+        screenBuffer.drawString(command->x, command->y, string, command->color, command->xScale, command->yScale);
+        break;
+    }
+    case RENDER_COMMAND_TEXT_BOX:
+    {
+        const TextBoxCommand * command = (const TextBoxCommand *)header;
+        screenBuffer.drawTextBox(*command->textBox);
+        break;
+    }
+    case RENDER_COMMAND_HEARTS:
+    {
+        const HeartsCommand * command = (const HeartsCommand *)header;
+        screenBuffer.drawHearts(command->n, command->x, command->y, command->color);
+        break;
+    }
+    case RENDER_COMMAND_CALLBACK:
+    {
+        const CallbackCommand * command = (const CallbackCommand *)header;
+        command->callback(screenBuffer, command->data);
+        break;
+    }
+    default: // ??? Shouldn't be here
+        break;
+    }
+}
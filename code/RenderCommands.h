@@ -0,0 +1,275 @@
+/* ==========================================================================
+   >File: RenderCommands.h
+   >Date: 20180713
+   >Author: Vik Pandher
+   >Details: Draw calls written into a buffer instead of being drawn right
+             away. Once a frame is recorded, the 3D draws get merged so the
+             screen buffer can sort them and split them between threads.
+   ========================================================================== */
+
+#pragma once
+#include "ScreenBuffer.h"
+
+
+
+// Memory the buffer starts with the first time something is recorded. It
+// doubles whenever it runs out.
+#define RENDER_COMMAND_BUFFER_SIZE (16 * 1024)
+
+
+// For drawing something that depends on the commands before it, like the
+// render stats. Gets called when the commands are executed.
+typedef void(*RenderCallback)(ScreenBuffer & screenBuffer, void * data);
+
+
+enum RenderCommandType
+{
+    RENDER_COMMAND_CLEAR,
+    RENDER_COMMAND_FADE,
+    RENDER_COMMAND_RASTERIZE,
+    RENDER_COMMAND_STRING,
+    RENDER_COMMAND_TEXT_BOX,
+    RENDER_COMMAND_HEARTS,
+    RENDER_COMMAND_CALLBACK
+};
+
+
+// Every command starts with one of these. The size counts the header and
+// anything stored after the command, so it's how far away the next one is.
+struct RenderCommandHeader
+{
+    RenderCommandType type;
+    unsigned size;
+};
+
+struct ClearCommand
+{
+    RenderCommandHeader header;
+    Color color;
+};
+
+struct FadeCommand
+{
+    RenderCommandHeader header;
+    unsigned f;
+};
+
+// followed by entityCount Entity pointers
+struct RasterizeCommand
+{
+    RenderCommandHeader header;
+    const Camera * camera;
+    unsigned entityCount;
+};
+
+// followed by the string's characters and a '\0'
+struct StringCommand
+{
+    RenderCommandHeader header;
+    int x, y;
+    Color color;
+    int xScale, yScale;
+};
+
+struct TextBoxCommand
+{
+    RenderCommandHeader header;
+    const TextBox * textBox;
+};
+
+struct HeartsCommand
+{
+    RenderCommandHeader header;
+    int n, x, y;
+    Color color;
+};
+
+struct CallbackCommand
+{
+    RenderCommandHeader header;
+    RenderCallback callback;
+    void * data;
+};
+
+
+// Records draw calls with the same names as the ScreenBuffer ones, one after
+// the other in a single block of memory, and draws them all with execute.
+//
+// Strings are copied, but cameras, entities, and text boxes are only pointed
+// to, so they can't change until the commands are executed. The commands can
+// be executed as many times as needed, which is handy for timing a frame.
+//
+// Between each clear and fade, execute draws the 3D commands before the 2D
+// ones. 3D commands using the same camera are merged into one rasterizeGroup
+// call, so the screen buffer can sort them together nearest first and bin
+// them for its worker threads. The 2D commands are drawn in recorded order.
+//
+// Clears and 3D commands draw into the screen buffer's scene, which is what
+// dynamic resolution scales, and the scene is stretched over the frame before
+// the 2D commands and fades. So menus, text, and fades are always drawn at
+// the full size.
+class RenderCommandBuffer
+{
+public:
+    // RenderCommandBuffer
+    // ====================================================================== //
+    // No memory is taken until the first command is recorded.
+    RenderCommandBuffer();
+
+    // ~RenderCommandBuffer
+    // ====================================================================== //
+    // Free the buffer.
+    ~RenderCommandBuffer();
+
+    // reset
+    // ====================================================================== //
+    // Forget every command recorded, keeping the memory for the next frame.
+    inline void reset()
+    {
+        m_used = 0;
+        m_commandCount = 0;
+    }
+
+    // getCommandCount
+    // ====================================================================== //
+    //
+    // @return
+    // How many commands have been recorded since the last reset.
+    inline unsigned getCommandCount() const
+    {
+        return m_commandCount;
+    }
+
+    // getBytesUsed
+    // ====================================================================== //
+    //
+    // @return
+    // How much of the buffer the recorded commands take up.
+    inline unsigned getBytesUsed() const
+    {
+        return m_used;
+    }
+
+    // clear
+    // ====================================================================== //
+    // Record a ScreenBuffer::clear. Everything recorded before it is drawn
+    // before it.
+    //
+    // @params
+    // * const Color & color = COLOR_BLACK, the color cleared to
+    void clear(const Color & color = COLOR_BLACK);
+
+    // fade
+    // ====================================================================== //
+    // Record a ScreenBuffer::fade. Everything recorded before it is drawn
+    // before it.
+    //
+    // @params
+    // * unsigned f, see ScreenBuffer::fade
+    void fade(unsigned f);
+
+    // rasterize
+    // ====================================================================== //
+    // Record a ScreenBuffer::rasterize.
+    //
+    // @params
+    // * const Camera & camera, the camera, has to stay put until executed
+    // * const Entity * entity, the entity, has to stay put until executed
+    void rasterize(const Camera & camera, const Entity * entity);
+
+    // rasterizeGroup
+    // ====================================================================== //
+    // Record a ScreenBuffer::rasterizeGroup. The pointers are copied, so the
+    // array itself can change after this.
+    //
+    // @params
+    // * const Camera & camera, the camera, has to stay put until executed
+    // * const Array<Entity*> & entities, the entities, have to stay put until
+    //                                    executed
+    void rasterizeGroup(const Camera & camera, const Array<Entity*> & entities);
+
+    // drawString
+    // ====================================================================== //
+    // Record a ScreenBuffer::drawString. The string is copied.
+    void drawString(int x, int y, const String & string, const Color & color, int xScale = 1, int yScale = 1);
+
+    // drawTextBox
+    // ====================================================================== //
+    // Record a ScreenBuffer::drawTextBox.
+    //
+    // @params
+    // * const TextBox & textBox, the text box, has to stay put until
+    //                            executed. The screen buffer keeps its
+    //                            drawn text boxes by address.
+    void drawTextBox(const TextBox & textBox);
+
+    // drawHearts
+    // ====================================================================== //
+    // Record a ScreenBuffer::drawHearts.
+    void drawHearts(int n, int x, int y, const Color & color);
+
+    // callback
+    // ====================================================================== //
+    // Record a function to be called when the commands are executed. It's
+    // drawn with the 2D commands.
+    //
+    // @params
+    // * RenderCallback callback, function called with the screen buffer
+    // * void * data, passed into the callback
+    void callback(RenderCallback callback, void * data);
+
+    // execute
+    // ====================================================================== //
+    // Draw every command recorded since the last reset onto a screen buffer.
+    // The commands are kept, so they can be executed again.
+    //
+    // @params
+    // * ScreenBuffer & screenBuffer, the screen buffer drawn to
+    void execute(ScreenBuffer & screenBuffer);
+
+private:
+    // push
+    // ====================================================================== //
+    // Make room for a command at the end of the buffer, growing it if it has
+    // to. Anything pointing into the buffer is no good after this.
+    //
+    // @params
+    // * RenderCommandType type, the type of command
+    // * unsigned size, size of the command and anything stored after it
+    //
+    // @return
+    // The command's memory, with the header filled in.
+    void * push(RenderCommandType type, unsigned size);
+
+    // drawPass
+    // ====================================================================== //
+    // Draw the merged 3D commands, then the 2D commands in m_overlays, and
+    // empty them out for the next pass.
+    //
+    // @params
+    // * ScreenBuffer & screenBuffer, the screen buffer drawn to
+    void drawPass(ScreenBuffer & screenBuffer);
+
+    // drawOverlay
+    // ====================================================================== //
+    // Draw a single 2D command.
+    //
+    // @params
+    // * ScreenBuffer & screenBuffer, the screen buffer drawn to
+    // * const RenderCommandHeader * header, the command
+    void drawOverlay(ScreenBuffer & screenBuffer, const RenderCommandHeader * header);
+
+private:
+    uint8_t * m_memory;
+    unsigned m_capacity;
+    unsigned m_used;
+    unsigned m_commandCount;
+
+    // Filled while executing. The 3D commands of the pass so far, one list
+    // per camera, and the offsets of its 2D commands. Only the first
+    // m_groupCount groups are used, the rest are kept for their memory.
+    Array<const Camera*> m_groupCameras;
+    Array<Array<Entity*> > m_groupEntities;
+    int m_groupCount;
+    Array<unsigned> m_overlays;
+};
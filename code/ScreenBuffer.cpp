@@ -7,193 +7,370 @@
    ========================================================================== */
 
 #include "ScreenBuffer.h"
+#include "Platform.h"
 
 
 
-// public:
+// setStripPixel
+// ========================================================================== //
+// Sets a pixel of a text box strip, pixels outside it are skipped.
+// 
+// @params
+// * TextBoxStrip & strip, strip being drawn
+// * int x, y, buffer coordinates of the pixel
+// * const Color & color, struct containing the rgb color values
+static inline void setStripPixel(TextBoxStrip & strip, int x, int y, const Color & color)
+{
+    x -= strip.x;
+    y -= strip.y;
+    if (x >= 0 && x < strip.width && y >= 0 && y < strip.height)
+    {
+        strip.pixels[x + y * strip.width] = GET_RGB(color.r, color.g, color.b);
+    }
+}
+
 
-ScreenBuffer::ScreenBuffer(int width, int height) : borderOffset(0)
+// The masks in AsciiCharacterDefines.h in ASCII order, see getGlyphIndex
+static const uint32_t s_asciiGlyphs[GLYPH_COUNT] =
 {
-    m_info.bmiHeader.biSize = sizeof(m_info.bmiHeader);
-    m_info.bmiHeader.biWidth = width;
+    ASCII_SPACE,
+    ASCII_EXCLAMATION_MARK,
+    ASCII_DOUBLE_QUOTES,
+    ASCII_NUMBER_SIGN,
+    ASCII_DOLLAR_SIGN,
+    ASCII_PRECENT_SIGN,
+    ASCII_AMPERSAND,
+    ASCII_APOSTROPHE,
+    ASCII_LEFT_ROUND_BRACKET,
+    ASCII_RIGHT_ROUND_BRACKET,
+    ASCII_ASTERISK,
+    ASCII_PLUS_SIGN,
+    ASCII_COMMA,
+    ASCII_MINUS_SIGN,
+    ASCII_PERIOD,
+    ASCII_FORWARD_SLASH,
+    ASCII_ZERO,
+    ASCII_ONE,
+    ASCII_TWO,
+    ASCII_THREE,
+    ASCII_FOUR,
+    ASCII_FIVE,
+    ASCII_SIX,
+    ASCII_SEVEN,
+    ASCII_EIGHT,
+    ASCII_NINE,
+    ASCII_COLON,
+    ASCII_SEMICOLON,
+    ASCII_LESS_THAN_SIGN,
+    ASCII_EQUALS_SIGN,
+    ASCII_GREATER_THAN_SIGN,
+    ASCII_QUESTION_MARK,
+    ASCII_AT_SIGN,
+    ASCII_CAPITAL_A,
+    ASCII_CAPITAL_B,
+    ASCII_CAPITAL_C,
+    ASCII_CAPITAL_D,
+    ASCII_CAPITAL_E,
+    ASCII_CAPITAL_F,
+    ASCII_CAPITAL_G,
+    ASCII_CAPITAL_H,
+    ASCII_CAPITAL_I,
+    ASCII_CAPITAL_J,
+    ASCII_CAPITAL_K,
+    ASCII_CAPITAL_L,
+    ASCII_CAPITAL_M,
+    ASCII_CAPITAL_N,
+    ASCII_CAPITAL_O,
+    ASCII_CAPITAL_P,
+    ASCII_CAPITAL_Q,
+    ASCII_CAPITAL_R,
+    ASCII_CAPITAL_S,
+    ASCII_CAPITAL_T,
+    ASCII_CAPITAL_U,
+    ASCII_CAPITAL_V,
+    ASCII_CAPITAL_W,
+    ASCII_CAPITAL_X,
+    ASCII_CAPITAL_Y,
+    ASCII_CAPITAL_Z,
+    ASCII_LEFT_SQUARE_BRACKET,
+    ASCII_BACK_SLASH,
+    ASCII_RIGHT_SQUARE_BRACKET,
+    ASCII_CARET,
+    ASCII_UNDERSCORE,
+    ASCII_ACUTE,
+    ASCII_LOWER_CASE_A,
+    ASCII_LOWER_CASE_B,
+    ASCII_LOWER_CASE_C,
+    ASCII_LOWER_CASE_D,
+    ASCII_LOWER_CASE_E,
+    ASCII_LOWER_CASE_F,
+    ASCII_LOWER_CASE_G,
+    ASCII_LOWER_CASE_H,
+    ASCII_LOWER_CASE_I,
+    ASCII_LOWER_CASE_J,
+    ASCII_LOWER_CASE_K,
+    ASCII_LOWER_CASE_L,
+    ASCII_LOWER_CASE_M,
+    ASCII_LOWER_CASE_N,
+    ASCII_LOWER_CASE_O,
+    ASCII_LOWER_CASE_P,
+    ASCII_LOWER_CASE_Q,
+    ASCII_LOWER_CASE_R,
+    ASCII_LOWER_CASE_S,
+    ASCII_LOWER_CASE_T,
+    ASCII_LOWER_CASE_U,
+    ASCII_LOWER_CASE_V,
+    ASCII_LOWER_CASE_W,
+    ASCII_LOWER_CASE_X,
+    ASCII_LOWER_CASE_Y,
+    ASCII_LOWER_CASE_Z,
+    ASCII_LEFT_CURLY_BRACKET,
+    ASCII_VERTICAL_BAR,
+    ASCII_RIGHT_CURLY_BRACKET,
+    ASCII_TILDE,
+    ASCII_UNDEFINED
+};
 
-    // make height negative to make this a top-down DIB
-    m_info.bmiHeader.biHeight = height;
-    m_info.bmiHeader.biPlanes = 1;
 
-    // 8 bits red, 8 green, 8 blue, and a padding byte.
-    // Why the padding byte? To avoid unaligned accessing penalties.
-    m_info.bmiHeader.biBitCount = 32;
-    m_info.bmiHeader.biCompression = BI_RGB;
 
-    // 4 bytes per pixel
-    int bitmapMemprySize = width * height * 4;
-    ///m_memory = (uint32_t *)g_memoryManager.allocate(bitmapMemprySize);
-    m_memory = (uint32_t*)VirtualAlloc(
-        0,                // lpAddress, we don't care where the memory is
-        bitmapMemprySize, // dwSize, size of the region in bytes
-        MEM_COMMIT,       // flAllocationType
-        PAGE_READWRITE);  // flProtect
-    
-    // a float for each pixel
-    int zBufferSize = width * height * sizeof(float);
-    ///m_zBuffer = (float *)g_memoryManager.allocate(zBufferSize);
-    m_zBuffer = (float*)VirtualAlloc(
-        0,                // lpAddress, we don't care where the memory is
-        zBufferSize,      // dwSize, size of the region in bytes
-        MEM_COMMIT,       // flAllocationType
-        PAGE_READWRITE);  // flProtect
+// public:
+
+ScreenBuffer::ScreenBuffer(int width, int height) :
+    borderOffset(0),
+    m_triangleRasterizer(TR_EDGE_FUNCTION),
+    m_frontToBack(true),
+    m_hierarchicalZ(true),
+    m_hiZBlockColumns(0),
+    m_hiZBlockRows(0),
+    m_hiZBlocks(0),
+    m_hiZTileColumns(0),
+    m_hiZTileRows(0),
+    m_hiZTiles(0),
+    m_hiZTileChanged(0),
+    m_dirtyTileClear(true),
+    m_dirtyTileColumns(0),
+    m_dirtyTileRows(0),
+    m_dirtyTiles(0),
+    m_sceneDirtyTiles(0),
+    m_frameDirtyTiles(0),
+    m_clearEverything(true),
+    m_clearColor(0),
+    m_clearDepth(0),
+    m_epochDepth(true),
+    m_depthEpochs(0),
+    m_depthEpoch(0),
+    m_dynamicResolution(false),
+    m_fullWidth(width),
+    m_fullHeight(height),
+    m_sceneWidth(width),
+    m_sceneHeight(height),
+    m_drawingScene(false),
+    m_resolutionScale(1),
+    m_minResolutionScale(1),
+    m_maxResolutionScale(1),
+    m_targetFrameTime(0),
+    m_frameTimeTotal(0),
+    m_frameTimeCount(0),
+    m_retainedUI(true),
+    m_nextTextBoxStrip(0),
+    m_binnedRasterization(false),
+    m_workerPool(0),
+    m_tileColumns(0),
+    m_tileRows(0),
+    m_tileBins(0),
+    m_workerVertexCaches(0),
+    m_groupEntities(0),
+    m_groupShapes(0),
+    m_groupInsideFrustum(0)
+{
+    setSpanKernel(getBestSpanKernel());
+    for (int i = 0; i <= GLYPH_ATLAS_MAX_SCALE; i++)
+    {
+        m_glyphAtlases[i] = 0;
+    }
+
+    allocateFrame(width, height);
+
+    resizeHierarchicalZ();
+    resizeDirtyTiles();
 }
 
 
 ScreenBuffer::~ScreenBuffer()
 {
-    ///g_memoryManager.free(m_memory);
-    ///g_memoryManager.free(m_zBuffer);
-    
-    LONG & width = m_info.bmiHeader.biWidth;
-    LONG & height = m_info.bmiHeader.biHeight;
-
-    int bitmapMemprySize = width * height * 4;
-    VirtualFree(
-        m_memory,
-        bitmapMemprySize,
-        MEM_DECOMMIT
-    );
-
-    int zBufferSize = width * height * sizeof(float);
-    VirtualFree(
-        m_zBuffer,
-        zBufferSize,
-        MEM_DECOMMIT
-    );
-}
-
-
-void ScreenBuffer::resizeDIBSection(int width, int height)
-{
-    // Free the old memory if it exists
-    if (m_memory)
-    {
-        ///g_memoryManager.free(m_memory);
-        ///g_memoryManager.free(m_zBuffer);
-
-        LONG & width = m_info.bmiHeader.biWidth;
-        LONG & height = m_info.bmiHeader.biHeight;
-
-        int bitmapMemprySize = width * height * 4;
-        VirtualFree(
-            m_memory,
-            bitmapMemprySize,
-            MEM_DECOMMIT
-        );
-
-        int zBufferSize = width * height * sizeof(float);
-        VirtualFree(
-            m_zBuffer,
-            zBufferSize,
-            MEM_DECOMMIT
-        );
-    }
-
-    m_info.bmiHeader.biSize = sizeof(m_info.bmiHeader);
-    m_info.bmiHeader.biWidth = width;
-    m_info.bmiHeader.biHeight = height;
-    m_info.bmiHeader.biPlanes = 1;
-    m_info.bmiHeader.biBitCount = 32;
-    m_info.bmiHeader.biCompression = BI_RGB;
-
-    int bitmapMemprySize = width * height * 4;
-    ///m_memory = (uint32_t *)g_memoryManager.allocate(bitmapMemprySize);
-    m_memory = (uint32_t*)VirtualAlloc(
-        0,                // lpAddress, we don't care where the memory is
-        bitmapMemprySize, // dwSize, size of the region in bytes
-        MEM_COMMIT,       // flAllocationType
-        PAGE_READWRITE);  // flProtect
-
-                          // a float for each pixel
-    int zBufferSize = width * height * sizeof(float);
-    ///m_zBuffer = (float *)g_memoryManager.allocate(zBufferSize);
-    m_zBuffer = (float*)VirtualAlloc(
-        0,                // lpAddress, we don't care where the memory is
-        zBufferSize,      // dwSize, size of the region in bytes
-        MEM_COMMIT,       // flAllocationType
-        PAGE_READWRITE);  // flProtect
-}
-
-
-void ScreenBuffer::paintWindow(HDC deviceContext, RECT destRect, float aspectRatio /*= 0*/)
-{
-    // This function copies the color data for a rectangle of pixels in a DIB,
-    // JPEG, or PNG image to the specified destination rectangle. Scaling it 
-    // if need be.
-    // NOTE: The origin of a bottom-up DIB is the lower-left corner;
-    //       the origin of a top-down DIB is the upper-left corner.
-    int destWidth = destRect.right - destRect.left;
-    int destHeight = destRect.bottom - destRect.top;
-    int srcWidth = m_info.bmiHeader.biWidth;
-    int srcHeight = m_info.bmiHeader.biHeight;
-    int destX = 0;
-    int destY = 0;
-
-    if (aspectRatio != 0)
-    {
-        int newDestWidth = destHeight * aspectRatio;
-        int newDestHeight = destWidth / aspectRatio;
-        if (newDestWidth > destWidth) newDestWidth = destWidth;
-        if (newDestHeight > destHeight) newDestHeight = destHeight;
-        if (newDestWidth < destWidth) destX = (destWidth - newDestWidth) / 2;
-        if (newDestHeight < destHeight) destY = (destHeight - newDestHeight) / 2;
-        destWidth = newDestWidth;
-        destHeight = newDestHeight;
-    }
-
-    StretchDIBits(
-        deviceContext,       // hdc
-        destX,               // destX
-        destY,               // destY
-        destWidth,           // destWidth
-        destHeight,          // destHeight
-        0,                   // srcX
-        0,                   // srcY
-        srcWidth,            // srcWidth
-        srcHeight,           // srcHeight
-        m_memory,            // *lpBits
-        &m_info,             // *lpBitsInfo
-        DIB_RGB_COLORS,      // iUsage
-        SRCCOPY);            // dwRop
+    freeFrame();
+
+    delete m_workerPool;
+    delete[] m_tileBins;
+    delete[] m_workerVertexCaches;
+    delete[] m_hiZBlocks;
+    delete[] m_hiZTiles;
+    delete[] m_hiZTileChanged;
+    delete[] m_sceneDirtyTiles;
+    delete[] m_frameDirtyTiles;
+    delete[] m_depthEpochs;
+    for (int i = 0; i <= GLYPH_ATLAS_MAX_SCALE; i++)
+    {
+        delete[] m_glyphAtlases[i];
+    }
+    for (int i = 0; i < m_textBoxStrips.size(); i++)
+    {
+        delete[] m_textBoxStrips[i]->pixels;
+        delete m_textBoxStrips[i];
+    }
 }
 
 
-void ScreenBuffer::fill(const Color & color)
+void ScreenBuffer::resize(int width, int height)
 {
-    int height = m_info.bmiHeader.biHeight;
-    int width = m_info.bmiHeader.biWidth;
-    for (int y = 0; y < height; y++)
+    freeFrame();
+    allocateFrame(width, height);
+    m_drawingScene = false;
+
+    // the next clear makes new epochs to go with the new z buffer
+    delete[] m_depthEpochs;
+    m_depthEpochs = 0;
+
+    resizeHierarchicalZ();
+    resizeDirtyTiles();
+
+    if (m_resolutionScale < 1)
     {
-        for (int x = 0; x < width; x++)
-        {
+        setResolutionScale(m_resolutionScale);
+    }
+}
 
-            *(m_memory + x + y * width) = GET_RGB(color.r, color.g, color.b);
-        }
+
+void ScreenBuffer::setDynamicResolution(bool dynamicResolution, float targetFrameTime /*= 8*/, float minScale /*= 0.5*/, float maxScale /*= 1*/)
+{
+    m_dynamicResolution = dynamicResolution;
+    m_targetFrameTime = targetFrameTime;
+    m_maxResolutionScale = MIN(maxScale, 1);
+    m_minResolutionScale = MIN(minScale, m_maxResolutionScale);
+    m_frameTimeTotal = 0;
+    m_frameTimeCount = 0;
+
+    float scale = dynamicResolution ? m_maxResolutionScale : 1;
+    if (scale != m_resolutionScale)
+    {
+        setResolutionScale(scale);
     }
 }
 
 
-void ScreenBuffer::fade(unsigned f)
+bool ScreenBuffer::addFrameTime(float milliseconds)
 {
-    int height = m_info.bmiHeader.biHeight;
-    int width = m_info.bmiHeader.biWidth;
-    for (int y = 0; y < height; y++)
+    if (!m_dynamicResolution)
     {
-        for (int x = 0; x < width; x++)
-        {
+        return false;
+    }
 
-            Color newC = Color(*(m_memory + x + y * width)) / f;
-            *(m_memory + x + y * width) = GET_RGB(newC.r, newC.g, newC.b);
+    m_frameTimeTotal += milliseconds;
+    m_frameTimeCount++;
+    if (m_frameTimeCount < DYNAMIC_RESOLUTION_FRAMES)
+    {
+        return false;
+    }
 
-        }
+    float average = m_frameTimeTotal / m_frameTimeCount;
+    m_frameTimeTotal = 0;
+    m_frameTimeCount = 0;
+
+    // close enough, changing it would just make it bounce around
+    if (average > m_targetFrameTime * 0.9f && average < m_targetFrameTime * 1.1f)
+    {
+        return false;
+    }
+
+    // Drawing takes about as long as there are pixels, the square of the
+    // scale. Small steps, so one slow stretch doesn't send it to the bottom.
+    float scale = m_resolutionScale * sqrt(m_targetFrameTime / MAX(average, 0.01f));
+    scale = MIN(MAX(scale, m_resolutionScale * 0.8f), m_resolutionScale * 1.1f);
+    scale = MIN(MAX(scale, m_minResolutionScale), m_maxResolutionScale);
+
+    if (ABS(scale - m_resolutionScale) < 0.02f)
+    {
+        return false;
+    }
+
+    setResolutionScale(scale);
+    return true;
+}
+
+
+void ScreenBuffer::beginScene()
+{
+    if (!m_drawingScene)
+    {
+        setDrawTarget(true);
+    }
+}
+
+
+void ScreenBuffer::endScene()
+{
+    if (!m_drawingScene)
+    {
+        return;
+    }
+
+    if (m_memory == m_sceneMemory)
+    {
+        stretchScene();
+    }
+    setDrawTarget(false);
+}
+
+
+void ScreenBuffer::setResolutionScale(float scale)
+{
+    m_resolutionScale = scale;
+
+    int width = (int)(m_fullWidth * scale);
+    int height = (int)(m_fullHeight * scale);
+    m_sceneWidth = MAX(width, 1);
+    m_sceneHeight = MAX(height, 1);
+
+    // it's never bigger than the frame, so it gets the frame's size once
+    // and keeps it
+    if ((m_sceneWidth != m_fullWidth || m_sceneHeight != m_fullHeight) && !m_sceneMemory)
+    {
+        m_sceneMemory = (uint32_t *)allocatePages(m_fullWidth * m_fullHeight * sizeof(uint32_t));
+    }
+
+    // the next clear makes new epochs to go with the new size
+    delete[] m_depthEpochs;
+    m_depthEpochs = 0;
+
+    resizeHierarchicalZ();
+    resizeDirtyTiles();
+}
+
+
+void ScreenBuffer::fill(const Color & color)
+{
+    // the rows are back to back, so it's all one row
+    int height = m_height;
+    int width = m_width;
+    fillRow(m_memory, GET_RGB(color.r, color.g, color.b), width * height, true);
+    m_clearEverything = true;
+}
+
+
+void ScreenBuffer::fade(unsigned f)
+{
+    // the rows are back to back, so it's all one row
+    int height = m_height;
+    int width = m_width;
+    if (m_spanKernel == SK_SCALAR)
+    {
+        fadeRowScalar(m_memory, width * height, f);
+    }
+    else
+    {
+        fadeRowSSE2(m_memory, width * height, f);
     }
+    m_clearEverything = true;
 }
 
 
@@ -399,8 +576,14 @@ void ScreenBuffer::drawString(int x, int y, const String & string, const Color &
 }
 
 
-void ScreenBuffer::drawTextBox(const TextBox textBox)
+void ScreenBuffer::drawTextBox(const TextBox & textBox)
 {
+    if (m_retainedUI)
+    {
+        compositeTextBoxStrip(getTextBoxStrip(textBox));
+        return;
+    }
+
     const String & text = textBox.m_text;
     const unsigned & bottomLeftX = textBox.m_x;
     const unsigned & bottomLeftY = textBox.m_y;
@@ -458,140 +641,125 @@ void ScreenBuffer::drawHearts(int n, int x, int y, const Color & color)
 
 void ScreenBuffer::clear(const Color & color /*= COLOR_BLACK*/, float w /*= -1000000*/)
 {
-    int height = m_info.bmiHeader.biHeight;
-    int width = m_info.bmiHeader.biWidth;
-
-    for (int y = borderOffset; y < height - borderOffset; y++)
-    {
-        for (int x = borderOffset; x < width - borderOffset; x++)
-        {
+    int height = m_height;
+    int width = m_width;
 
-            *(m_memory + x + y * width) = GET_RGB(color.r, color.g, color.b);
-            *(m_zBuffer + x + y * width) = w;
-        }
-    }
-
-    drawRectangle(borderOffset, borderOffset, width - borderOffset, height - borderOffset, COLOR_WHITE);
-}
-
-
-void ScreenBuffer::drawPoint3D(const Point & point)
-{
-    int borderHeight = m_info.bmiHeader.biHeight - borderOffset * 2;
-    int borderWidth = m_info.bmiHeader.biWidth - borderOffset * 2;
+    // the z buffer gets filled with the float's bits
+    union { float f; uint32_t bits; } depth;
+    depth.f = w;
+    uint32_t clearColor = GET_RGB(color.r, color.g, color.b);
 
-    int viewX = borderOffset;
-    int viewY = borderOffset;
-    if (borderWidth >= borderHeight)
+    // Epoch depth starts with every epoch stale, so the z buffer doesn't
+    // need clearing. Without it the z buffer might be full of stale values.
+    if (m_epochDepth && !m_depthEpochs)
     {
-        viewX += (long long)((point.x + 1) / 2 * borderWidth);
-        viewY += (long long)((point.y + 1) / 2 * borderWidth) - (borderWidth - borderHeight) / 2;
+        m_depthEpochs = new uint8_t[m_fullWidth * m_fullHeight];
+        resetDepthEpochs();
     }
-    else
+    else if (!m_epochDepth && m_depthEpochs)
     {
-        viewX += (long long)((point.x + 1) / 2 * borderHeight) - (borderHeight - borderWidth) / 2;
-        viewY += (long long)((point.y + 1) / 2 * borderHeight);
+        delete[] m_depthEpochs;
+        m_depthEpochs = 0;
+        m_clearEverything = true;
     }
 
-    drawPointWithZCheck(viewX, viewY, point.z, point.m_color);
-}
-
-
-void ScreenBuffer::drawLine3D(const Point & p0, const Point & p1)
-{
-    drawLine3DEx(p0, p1);
-    drawPointWithZCheck(p1.x, p1.y, p1.z, p1.m_color); // draw end point
-}
-
-
-void ScreenBuffer::drawTriangleOutline3D(const Point & p0, const Point & p1, const Point & p2)
-{
-    drawLine3DEx(p0, p1);
-    drawLine3DEx(p1, p2);
-    drawLine3DEx(p0, p2);
-}
-
-
-void ScreenBuffer::drawTriangle3D(const Point & p0, const Point & p1, const Point & p2)
-{
-    int borderHeight = m_info.bmiHeader.biHeight - borderOffset * 2;
-    int borderWidth = m_info.bmiHeader.biWidth - borderOffset * 2;
-
-    int x0, y0, x1, y1, x2, y2;
-    if (borderWidth >= borderHeight)
+    if (!m_dirtyTileClear || m_clearEverything || clearColor != m_clearColor || w != m_clearDepth)
     {
-        x0 = borderOffset + (long long)((p0.x + 1) / 2 * borderWidth);
-        y0 = borderOffset + (long long)((p0.y + 1) / 2 * borderWidth) - (borderWidth - borderHeight) / 2;
-        x1 = borderOffset + (long long)((p1.x + 1) / 2 * borderWidth);
-        y1 = borderOffset + (long long)((p1.y + 1) / 2 * borderWidth) - (borderWidth - borderHeight) / 2;
-        x2 = borderOffset + (long long)((p2.x + 1) / 2 * borderWidth);
-        y2 = borderOffset + (long long)((p2.y + 1) / 2 * borderWidth) - (borderWidth - borderHeight) / 2;
+        // Both buffers are written and not read again until the next draw,
+        // so there's no point in pulling them through the cache
+        int count = width - borderOffset * 2;
+        for (int y = borderOffset; y < height - borderOffset; y++)
+        {
+            fillRow(m_memory + borderOffset + y * width, clearColor, count, true);
+            if (!m_depthEpochs)
+            {
+                fillRow((uint32_t *)m_zBuffer + borderOffset + y * width, depth.bits, count, true);
+            }
+        }
     }
     else
     {
-        x0 = borderOffset + (long long)((p0.x + 1) / 2 * borderHeight) - (borderHeight - borderWidth) / 2;
-        y0 = borderOffset + (long long)((p0.y + 1) / 2 * borderHeight);
-        x1 = borderOffset + (long long)((p1.x + 1) / 2 * borderHeight) - (borderHeight - borderWidth) / 2;
-        y1 = borderOffset + (long long)((p1.y + 1) / 2 * borderHeight);
-        x2 = borderOffset + (long long)((p2.x + 1) / 2 * borderHeight) - (borderHeight - borderWidth) / 2;
-        y2 = borderOffset + (long long)((p2.y + 1) / 2 * borderHeight);
-    }
+        // Everything that isn't cleared yet is in a dirty tile, or is the
+        // border rectangle, which gets drawn again below. Dirty tiles next
+        // to each other are cleared a row at a time together.
+        for (int tileRow = 0; tileRow < m_dirtyTileRows; tileRow++)
+        {
+            bool * dirty = m_dirtyTiles + tileRow * m_dirtyTileColumns;
+            int minY = MAX(tileRow * TILE_SIZE, (int)borderOffset);
+            int maxY = MIN((tileRow + 1) * TILE_SIZE, height - (int)borderOffset);
 
-    int minX = MIN(x0, MIN(x1, x2));
-    int maxX = MAX(x0, MAX(x1, x2));
-    int minY = MIN(y0, MIN(y1, y2));
-    int maxY = MAX(y0, MAX(y1, y2));
+            int first = 0;
+            while (first < m_dirtyTileColumns)
+            {
+                if (!dirty[first])
+                {
+                    first++;
+                    continue;
+                }
 
-    float triangleArea = getTriangleArea(x0, y0, x1, y1, x2, y2);
+                int last = first;
+                while (last + 1 < m_dirtyTileColumns && dirty[last + 1])
+                {
+                    last++;
+                }
 
-    // Pair representing a spanning vector on the edge (v0, v1)
-    int x01 = x1 - x0;
-    int y01 = y1 - y0;
+                int minX = MAX(first * TILE_SIZE, (int)borderOffset);
+                int maxX = MIN((last + 1) * TILE_SIZE, width - (int)borderOffset);
+                for (int y = minY; y < maxY; y++)
+                {
+                    fillRow(m_memory + minX + y * width, clearColor, maxX - minX, false);
+                    if (!m_depthEpochs)
+                    {
+                        fillRow((uint32_t *)m_zBuffer + minX + y * width, depth.bits, maxX - minX, false);
+                    }
+                }
 
-    // Pair representing a spanning vector on the edge (v0, v2)
-    int x02 = x2 - x0;
-    int y02 = y2 - y0;
-    
-    // iterate over all points possibly in the triangle
-    for (int xP = minX; xP <= maxX; xP++)
+                first = last + 1;
+            }
+        }
+    }
+    clearHierarchicalZ(w);
+
+    // everything in the z buffer is from an older epoch now, unless the
+    // epoch wrapped back around to values that are still in there
+    if (m_depthEpochs)
     {
-        for (int yP = minY; yP <= maxY; yP++)
+        m_depthEpoch++;
+        if (m_depthEpoch == 0)
         {
-            // Pair representing the spanning vector (v0, vP)
-            int x0P = xP - x0;
-            int y0P = yP - y0;
+            resetDepthEpochs();
+            m_depthEpoch = 1;
+        }
+    }
 
-            // cross product of v01 and v02
-            int c0102 = x01 * y02 - y01 * x02;
+    drawRectangle(borderOffset, borderOffset, width - borderOffset, height - borderOffset, COLOR_WHITE);
 
-            // cross product of v0P and v02
-            int c0P02 = x0P * y02 - y0P * x02;
+    // the rectangle is part of what a clear looks like, so it's not dirty
+    for (int i = 0; i < m_dirtyTileColumns * m_dirtyTileRows; i++)
+    {
+        m_dirtyTiles[i] = false;
+    }
+    m_clearEverything = false;
+    m_clearColor = clearColor;
+    m_clearDepth = w;
+}
 
-            // cross product of v01 and v0P
-            int c010P = x01 * y0P - y01 * x0P;
 
-            float a = (float)c0P02 / c0102;
-            float b = (float)c010P / c0102;
+void ScreenBuffer::drawPoint3D(const Point & point)
+{
+    drawPoint3D(point, getDrawableTile());
+}
 
-            // draw the point if it's inside the triangle
-            if (a >= 0 && b >= 0 && a + b <= 1)
-            {
-                // figure out the z value at this point
-                float area12P = getTriangleArea(x1, y1, x2, y2, xP, yP);
-                float area20P = getTriangleArea(x2, y2, x0, y0, xP, yP);
-                float area01P = getTriangleArea(x0, y0, x1, y1, xP, yP);
 
-                float lambda0 = area12P / triangleArea;
-                float lambda1 = area20P / triangleArea;
-                float lambda2 = area01P / triangleArea;
+void ScreenBuffer::drawLine3D(const Point & p0, const Point & p1)
+{
+    drawLine3D(p0, p1, getDrawableTile());
+}
 
-                float zP = lambda0 * p0.z + lambda1 * p1.z + lambda2 * p2.z;
-                Color cP = p0.m_color.getFade(lambda0) + p1.m_color.getFade(lambda1) + p2.m_color.getFade(lambda2);
-                drawPointWithZCheck(xP, yP, zP, cP);
-            }
 
-        }
-    }
+void ScreenBuffer::drawTriangleOutline3D(const Point & p0, const Point & p1, const Point & p2)
+{
+    drawTriangleOutline3D(p0, p1, p2, getDrawableTile());
 }
 
 
@@ -633,19 +801,7 @@ void ScreenBuffer::drawTriangleOutlines3D(const Array<Triangle> & triangles)
 
 void ScreenBuffer::rasterize(const Camera & camera, const Entity * entity)
 {
-    Shape localShape;
-
-    // If drawing points or normals, need to regenerate the world space shape
-    // with points and normals. Else just copy the one generated for collision
-    // detection.
-    if (entity->drawProperties & DRAW_POINTS || entity->drawProperties & DRAW_NORMALS)
-    {
-        localShape = entity->getShapeInWorldSpace();
-    }
-    else
-    {
-        localShape = entity->worldSpaceShape;
-    }
+    beginScene();
 
     // Set up the Camera Transform
     Matrix cameraTransform;
@@ -656,65 +812,24 @@ void ScreenBuffer::rasterize(const Camera & camera, const Entity * entity)
     Matrix viewingTransform;
     viewingTransform.addViewingTransform(camera.viewingAngle, camera.nearPlane, camera.farPlane);
 
-    localShape *= cameraTransform; // maybe apply this transform to the frame structure?
-    cullBackfaces(localShape);
-    clipBehindCamera(localShape);
-    applySimpleLighting(Point(), 0.2, 0.8, localShape);
-    if (!(entity->drawProperties & DRAW_DISTANCE_SHADING_OFF))
+    // Don't bother with the shape if none of it is on screen
+    Frustum frustum(cameraTransform * viewingTransform);
+    FrustumTest test = cullEntity(frustum, entity);
+    if (test == FT_OUTSIDE)
     {
-        applySimpleDistanceShading(localShape);
+        return;
     }
-    moveOffCameraLocation(localShape);
-    localShape *= viewingTransform;
-    localShape.to3D();
-    clipLeft(localShape);
-    clipRight(localShape);
-    clipBottom(localShape);
-    clipTop(localShape);
-    clipFar(localShape);
-    clipNear(localShape);
 
-    if (entity->drawProperties & DRAW_POINTS)
-    {
-        drawPoints3D(localShape.points);
-    }
-    if ((entity->drawProperties & DRAW_LINES) || entity->drawProperties & DRAW_NORMALS)
-    {
-        drawLines3D(localShape.lines);
-    }
-    if (entity->drawProperties & DRAW_TRIANGLES)
-    {
-        if (entity->drawProperties & DRAW_TRIANGLE_FRAMES)
-        {
-            drawTriangleOutlines3D(localShape.triangles);
-        }
-        else
-        {
-            drawTriangles3D(localShape.triangles);
-        }
-    }
+    Shape localShape;
+    prepareEntity(entity, test == FT_INSIDE, cameraTransform, viewingTransform, m_vertexCache, localShape);
+    drawShape(localShape, entity->drawProperties, getDrawableTile());
 }
 
 
 void ScreenBuffer::rasterizeGroup(const Camera & camera, const Array<Entity*> & entities)
 {
-    // Create an array to hold shapes for all entities and their respective properties 
-    Array<Shape> localShapes;
-    Array<uint8_t> localShapeDrawProperties;
+    beginScene();
 
-    for (int i = 0; i < entities.size(); i++)
-    {
-        localShapeDrawProperties += entities[i]->drawProperties;
-        if (localShapeDrawProperties[i] & DRAW_POINTS || localShapeDrawProperties[i] & DRAW_NORMALS)
-        {
-            localShapes += entities[i]->getShapeInWorldSpace();
-        }
-        else
-        {
-            localShapes += entities[i]->worldSpaceShape;
-        }
-    }
-    
     // Set up the Camera Transform
     Matrix cameraTransform;
     Vector viewingVector = camera.centerOfAttention - camera.cameraLocation;
@@ -724,55 +839,148 @@ void ScreenBuffer::rasterizeGroup(const Camera & camera, const Array<Entity*> &
     Matrix viewingTransform;
     viewingTransform.addViewingTransform(camera.viewingAngle, camera.nearPlane, camera.farPlane);
 
-    for (int i = 0; i < localShapes.size(); i++)
+    Frustum frustum(cameraTransform * viewingTransform);
+
+    // Only the entities on screen get a shape
+    Array<Entity*> visibleEntities;
+    Array<bool> insideFrustum;
+    for (int i = 0; i < entities.size(); i++)
     {
-        localShapes[i] *= cameraTransform; // maybe apply this transform to the frame structure?
-        cullBackfaces(localShapes[i]);
-        clipBehindCamera(localShapes[i]);
-        applySimpleLighting(Point(), 0.2, 0.8, localShapes[i]);
-        if (!(localShapeDrawProperties[i] & DRAW_DISTANCE_SHADING_OFF))
+        FrustumTest test = cullEntity(frustum, entities[i]);
+        if (test != FT_OUTSIDE)
         {
-            applySimpleDistanceShading(localShapes[i]);
+            visibleEntities += entities[i];
+            insideFrustum += (test == FT_INSIDE);
         }
-        moveOffCameraLocation(localShapes[i]);
-        localShapes[i] *= viewingTransform;
-        localShapes[i].to3D();
-        clipLeft(localShapes[i]);
-        clipRight(localShapes[i]);
-        clipBottom(localShapes[i]);
-        clipTop(localShapes[i]);
-        clipFar(localShapes[i]);
-        clipNear(localShapes[i]);
     }
 
-    for (int i = 0; i < localShapes.size(); i++)
+    // Nearest first, so the z test throws away more of what's behind
+    if (m_frontToBack && visibleEntities.size() > 1)
     {
-        if (localShapeDrawProperties[i] & DRAW_POINTS)
-        {
-            drawPoints3D(localShapes[i].points);
-        }
-        if ((localShapeDrawProperties[i] & DRAW_LINES) || localShapeDrawProperties[i] & DRAW_NORMALS)
+        Array<DepthSortKey> keys;
+        keys.setCapacity(visibleEntities.size());
+        for (int i = 0; i < visibleEntities.size(); i++)
         {
-            drawLines3D(localShapes[i].lines);
+            keys += getDepthSortKey(visibleEntities[i], i, camera, cameraTransform);
         }
-        if (localShapeDrawProperties[i] & DRAW_TRIANGLES)
+        sortByDepth(keys);
+
+        Array<Entity*> sortedEntities;
+        Array<bool> sortedInsideFrustum;
+        sortedEntities.setCapacity(keys.size());
+        sortedInsideFrustum.setCapacity(keys.size());
+        for (int i = 0; i < keys.size(); i++)
         {
-            if (localShapeDrawProperties[i] & DRAW_TRIANGLE_FRAMES)
-            {
-                drawTriangleOutlines3D(localShapes[i].triangles);
-            }
-            else
-            {
-                drawTriangles3D(localShapes[i].triangles);
-            }
+            sortedEntities += visibleEntities[keys[i].index];
+            sortedInsideFrustum += insideFrustum[keys[i].index];
         }
+        visibleEntities = sortedEntities;
+        insideFrustum = sortedInsideFrustum;
+    }
 
+    // The shapes are empty until they're prepared. Setting the capacity
+    // first means they never get copied around as the array grows.
+    Array<Shape> localShapes;
+    localShapes.setCapacity(visibleEntities.size());
+    for (int i = 0; i < visibleEntities.size(); i++)
+    {
+        localShapes += Shape();
     }
-}
+
+    if (m_binnedRasterization)
+    {
+        m_groupEntities = &visibleEntities;
+        m_groupShapes = &localShapes;
+        m_groupInsideFrustum = &insideFrustum;
+        m_groupCameraTransform = cameraTransform;
+        m_groupViewingTransform = viewingTransform;
+
+        // every shape can be prepared on its own
+        m_workerPool->run(prepareShapeJob, this, localShapes.size());
+
+        // sort everything into bins, in draw order
+        updateTileGrid();
+        for (int i = 0; i < localShapes.size(); i++)
+        {
+            binShape(i, localShapes[i], visibleEntities[i]->drawProperties);
+        }
+
+        // every tile can be drawn on its own
+        m_workerPool->run(rasterizeTileJob, this, m_tileColumns * m_tileRows);
+
+        m_groupEntities = 0;
+        m_groupShapes = 0;
+        m_groupInsideFrustum = 0;
+        return;
+    }
+
+    for (int i = 0; i < localShapes.size(); i++)
+    {
+        prepareEntity(visibleEntities[i], insideFrustum[i], cameraTransform, viewingTransform, m_vertexCache, localShapes[i]);
+    }
+
+    Tile drawable = getDrawableTile();
+    for (int i = 0; i < localShapes.size(); i++)
+    {
+        drawShape(localShapes[i], visibleEntities[i]->drawProperties, drawable);
+    }
+}
+
+
+void ScreenBuffer::setSpanKernel(SpanKernel kernel)
+{
+    SpanKernel best = getBestSpanKernel();
+    if (kernel > best)
+    {
+        kernel = best;
+    }
+    m_spanKernel = kernel;
+    m_fillSpan = getSpanKernelFunction(kernel);
+}
+
+
+void ScreenBuffer::setBinnedRasterization(bool binned)
+{
+    if (binned && !m_workerPool)
+    {
+        m_workerPool = new WorkerPool();
+        m_workerVertexCaches = new Array<TransformedVertex>[m_workerPool->getThreadCount()];
+    }
+    // without worker threads there's nothing to gain from the bins
+    m_binnedRasterization = binned && m_workerPool->getThreadCount() > 1;
+}
 
 
 // private:
 
+void ScreenBuffer::allocateFrame(int width, int height)
+{
+    m_fullWidth = width;
+    m_fullHeight = height;
+    m_sceneWidth = width;
+    m_sceneHeight = height;
+    m_width = width;
+    m_height = height;
+
+    // 4 bytes per pixel, 0x00RRGGBB
+    m_frameMemory = (uint32_t *)allocatePages(width * height * sizeof(uint32_t));
+    m_sceneMemory = 0;
+    m_memory = m_frameMemory;
+
+    // a float for each pixel
+    m_zBuffer = (float *)allocatePages(width * height * sizeof(float));
+}
+
+
+void ScreenBuffer::freeFrame()
+{
+    // the memory's the full size, whatever the resolution scale is
+    freePages(m_frameMemory, m_fullWidth * m_fullHeight * sizeof(uint32_t));
+    freePages(m_sceneMemory, m_fullWidth * m_fullHeight * sizeof(uint32_t));
+    freePages(m_zBuffer, m_fullWidth * m_fullHeight * sizeof(float));
+}
+
+
 void ScreenBuffer::drawLineEx(int x0, int y0, int x1, int y1, const Color & color)
 {
     float deltaX = x1 - x0; // positive if line drawn from x0 to x1
@@ -865,2560 +1073,1720 @@ void ScreenBuffer::drawCharacter(int x, int y, uint32_t character, const Color &
 }
 
 
-void ScreenBuffer::selectCharacter(int initialX, int& currX, int& currY, char c, const Color & color, int xScale, int yScale)
+void ScreenBuffer::blitCharacter(int x, int y, int glyph, const Color & color, int xScale, int yScale)
 {
-    switch (c)
-    {
-    case ' ':
-    {
-        drawCharacter(currX, currY, ASCII_SPACE, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
-    }
+    int width = m_width;
+    int height = m_height;
+    int glyphWidth = ASCII_WIDTH * xScale;
 
-    case '!':
+    // same bounds as drawPointSafely, every bit outside them is dropped
+    uint64_t keep = ~(uint64_t)0;
+    if (glyphWidth < 64)
     {
-        drawCharacter(currX, currY, ASCII_EXCLAMATION_MARK, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
+        keep = ((uint64_t)1 << glyphWidth) - 1;
     }
-
-    case '"':
+    int left = x;
+    if (left < 1)
     {
-        drawCharacter(currX, currY, ASCII_DOUBLE_QUOTES, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
+        keep = (1 - x) < 64 ? keep & (~(uint64_t)0 << (1 - x)) : 0;
+        left = 1;
     }
-
-    case '#':
+    if (x + glyphWidth > width)
     {
-        drawCharacter(currX, currY, ASCII_NUMBER_SIGN, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
+        keep = (width - x) > 0 ? keep & (((uint64_t)1 << (width - x)) - 1) : 0;
     }
-
-    case '$':
+    int right = MIN(x + glyphWidth, width) - 1;
+    if (!keep || left > right)
     {
-        drawCharacter(currX, currY, ASCII_DOLLAR_SIGN, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
+        return;
     }
 
-    case '%':
+    uint32_t value = GET_RGB(color.r, color.g, color.b);
+    const uint64_t * rows = getGlyphAtlas(xScale) + glyph * ASCII_HEIGHT;
+    for (int row = 0; row < ASCII_HEIGHT; row++)
     {
-        drawCharacter(currX, currY, ASCII_PRECENT_SIGN, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
-    }
+        uint64_t bits = rows[row] & keep;
+        if (!bits)
+        {
+            continue;
+        }
 
-    case '&':
-    {
-        drawCharacter(currX, currY, ASCII_AMPERSAND, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
-    }
+        // the runs of set bits are the same for every pixel row
+        int runStarts[ASCII_WIDTH];
+        int runEnds[ASCII_WIDTH];
+        int runs = 0;
+        int col = 0;
+        while (bits)
+        {
+            while (!(bits & 1))
+            {
+                bits >>= 1;
+                col++;
+            }
+            runStarts[runs] = col;
+            while (bits & 1)
+            {
+                bits >>= 1;
+                col++;
+            }
+            runEnds[runs++] = col;
+        }
 
-    case '\'':
-    {
-        drawCharacter(currX, currY, ASCII_APOSTROPHE, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
-    }
+        for (int pRow = 0; pRow < yScale; pRow++)
+        {
+            int pixelY = y + row * yScale + pRow;
+            if (pixelY < 1 || pixelY >= height)
+            {
+                continue;
+            }
 
-    case '(':
-    {
-        drawCharacter(currX, currY, ASCII_LEFT_ROUND_BRACKET, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
-    }
+            uint32_t * pixels = m_memory + x + pixelY * width;
+            for (int run = 0; run < runs; run++)
+            {
+                for (int i = runStarts[run]; i < runEnds[run]; i++)
+                {
+                    pixels[i] = value;
+                }
+            }
 
-    case ')':
-    {
-        drawCharacter(currX, currY, ASCII_RIGHT_ROUND_BRACKET, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
+            for (int tile = left / TILE_SIZE; tile <= right / TILE_SIZE; tile++)
+            {
+                m_dirtyTiles[tile + (pixelY / TILE_SIZE) * m_dirtyTileColumns] = true;
+            }
+        }
     }
+}
 
-    case '*':
-    {
-        drawCharacter(currX, currY, ASCII_ASTERISK, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
-    }
 
-    case '+':
+const TextBoxStrip & ScreenBuffer::getTextBoxStrip(const TextBox & textBox)
+{
+    for (int i = 0; i < m_textBoxStrips.size(); i++)
     {
-        drawCharacter(currX, currY, ASCII_PLUS_SIGN, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
+        TextBoxStrip & strip = *m_textBoxStrips[i];
+        if (strip.owner == &textBox)
+        {
+            if (!strip.drawn.looksLike(textBox))
+            {
+                drawTextBoxStrip(strip, textBox);
+            }
+            return strip;
+        }
     }
 
-    case ',':
+    TextBoxStrip * strip;
+    if (m_textBoxStrips.size() < TEXT_BOX_STRIP_CACHE_SIZE)
     {
-        drawCharacter(currX, currY, ASCII_COMMA, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
+        strip = new TextBoxStrip;
+        strip->width = 0;
+        strip->height = 0;
+        strip->pixels = 0;
+        m_textBoxStrips += strip;
     }
-
-    case '-':
+    else
     {
-        drawCharacter(currX, currY, ASCII_MINUS_SIGN, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
+        strip = m_textBoxStrips[m_nextTextBoxStrip];
+        m_nextTextBoxStrip = (m_nextTextBoxStrip + 1) % TEXT_BOX_STRIP_CACHE_SIZE;
     }
 
-    case '.':
-    {
-        drawCharacter(currX, currY, ASCII_PERIOD, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
-    }
+    strip->owner = &textBox;
+    drawTextBoxStrip(*strip, textBox);
+    return *strip;
+}
 
-    case '/':
-    {
-        drawCharacter(currX, currY, ASCII_FORWARD_SLASH, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
-    }
 
-    case '0':
-    {
-        drawCharacter(currX, currY, ASCII_ZERO, color, xScale, yScale);
+void ScreenBuffer::drawTextBoxStrip(TextBoxStrip & strip, const TextBox & textBox)
+{
+    // the same corners drawTextBox works out
+    int xScale = textBox.m_xScale;
+    int yScale = textBox.m_yScale;
+    int left = textBox.m_x;
+    int bottom = textBox.m_y;
+    int right = left + getTextBoxPixelWidth(textBox) - 1;
+    int top = bottom + getTextBoxPixelHeight(textBox) - 1;
+    int textLeft = left + xScale * 2;
+    int textBottom = bottom + yScale * 2;
+
+    // The strip has to hold the box and every character, new lines can put
+    // characters below the box
+    int minX = MIN(left, right);
+    int maxX = MAX(left, right);
+    int minY = MIN(bottom, top);
+    int maxY = MAX(bottom, top);
+    int currX = textLeft;
+    int currY = textBottom;
+    for (int i = 0; i < textBox.m_text.size(); i++)
+    {
+        if (textBox.m_text[i] == '\n')
+        {
+            currX = textLeft;
+            currY -= (ASCII_HEIGHT + 1) * yScale;
+            continue;
+        }
+        if (xScale > 0 && yScale > 0)
+        {
+            minX = MIN(minX, currX);
+            maxX = MAX(maxX, currX + ASCII_WIDTH * xScale - 1);
+            minY = MIN(minY, currY);
+            maxY = MAX(maxY, currY + ASCII_HEIGHT * yScale - 1);
+        }
         currX += (ASCII_WIDTH + 1) * xScale;
-        break;
     }
 
-    case '1':
+    int width = maxX - minX + 1;
+    int height = maxY - minY + 1;
+    if (width * height != strip.width * strip.height)
     {
-        drawCharacter(currX, currY, ASCII_ONE, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
+        delete[] strip.pixels;
+        strip.pixels = new uint32_t[width * height];
     }
-
-    case '2':
+    strip.x = minX;
+    strip.y = minY;
+    strip.width = width;
+    strip.height = height;
+    strip.drawn = textBox;
+    for (int i = 0; i < width * height; i++)
     {
-        drawCharacter(currX, currY, ASCII_TWO, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
+        strip.pixels[i] = STRIP_EMPTY;
     }
 
-    case '3':
+    // drawTextBox's border, background, and then text, in the same order
+    Color textColor = textBox.m_color0;
+    if (!textBox.m_selected && textBox.m_hasBorder)
     {
-        drawCharacter(currX, currY, ASCII_THREE, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
+        // drawRectangle's lines leave off their last pixel
+        for (int x = left; x != right; x += SIGN(right - left))
+        {
+            setStripPixel(strip, x, bottom, textBox.m_color1);
+        }
+        for (int y = bottom; y != top; y += SIGN(top - bottom))
+        {
+            setStripPixel(strip, right, y, textBox.m_color1);
+        }
+        for (int x = right; x != left; x += SIGN(left - right))
+        {
+            setStripPixel(strip, x, top, textBox.m_color1);
+        }
+        for (int y = top; y != bottom; y += SIGN(bottom - top))
+        {
+            setStripPixel(strip, left, y, textBox.m_color1);
+        }
     }
-
-    case '4':
+    if (textBox.m_selected || textBox.m_hasBackground)
     {
-        drawCharacter(currX, currY, ASCII_FOUR, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
+        Color fillColor = textBox.m_selected ? textBox.m_color0 : textBox.m_color2;
+        int x0 = left + 1;
+        int x1 = right - 1;
+        int y0 = bottom + 1;
+        int y1 = top - 1;
+        if (y0 > y1) SWAP(y0, y1);
+        if (x0 > x1) SWAP(x0, x1);
+        for (int y = y0; y <= y1; y++)
+        {
+            for (int x = x0; x <= x1; x++)
+            {
+                setStripPixel(strip, x, y, fillColor);
+            }
+        }
+        if (textBox.m_selected)
+        {
+            textColor = textBox.m_color2;
+        }
     }
 
-    case '5':
+    currX = textLeft;
+    currY = textBottom;
+    for (int i = 0; i < textBox.m_text.size(); i++)
     {
-        drawCharacter(currX, currY, ASCII_FIVE, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
-    }
+        char c = textBox.m_text[i];
+        if (c == '\n')
+        {
+            currX = textLeft;
+            currY -= (ASCII_HEIGHT + 1) * yScale;
+            continue;
+        }
 
-    case '6':
-    {
-        drawCharacter(currX, currY, ASCII_SIX, color, xScale, yScale);
+        // the same bit order drawCharacter reads them in
+        uint32_t mask = 0b00100000000000000000000000000000;
+        uint32_t character = s_asciiGlyphs[getGlyphIndex(c)];
+        for (int row = 0; row < ASCII_HEIGHT * yScale; row += yScale)
+        {
+            for (int col = 0; col < ASCII_WIDTH * xScale; col += xScale)
+            {
+                if (character & mask)
+                {
+                    for (int pRow = 0; pRow < yScale; pRow++)
+                    {
+                        for (int pCol = 0; pCol < xScale; pCol++)
+                        {
+                            setStripPixel(strip, currX + col + pCol, currY + row + pRow, textColor);
+                        }
+                    }
+                }
+                mask = mask >> 1;
+            }
+        }
         currX += (ASCII_WIDTH + 1) * xScale;
-        break;
     }
+}
 
-    case '7':
-    {
-        drawCharacter(currX, currY, ASCII_SEVEN, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
-    }
 
-    case '8':
-    {
-        drawCharacter(currX, currY, ASCII_EIGHT, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
-    }
+void ScreenBuffer::compositeTextBoxStrip(const TextBoxStrip & strip)
+{
+    int width = m_width;
+    int height = m_height;
 
-    case '9':
+    // same bounds as drawPointSafely
+    int minX = MAX(strip.x, 1);
+    int maxX = MIN(strip.x + strip.width, width) - 1;
+    if (minX > maxX)
     {
-        drawCharacter(currX, currY, ASCII_NINE, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
+        return;
     }
 
-    case ':':
+    for (int row = 0; row < strip.height; row++)
     {
-        drawCharacter(currX, currY, ASCII_COLON, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
-    }
+        int y = strip.y + row;
+        if (y < 1 || y >= height)
+        {
+            continue;
+        }
 
-    case ';':
-    {
-        drawCharacter(currX, currY, ASCII_SEMICOLON, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
-    }
+        const uint32_t * source = strip.pixels + row * strip.width;
+        uint32_t * destination = m_memory + y * width;
+        bool drawn = false;
+        for (int x = minX; x <= maxX; x++)
+        {
+            uint32_t pixel = source[x - strip.x];
+            if (pixel != STRIP_EMPTY)
+            {
+                destination[x] = pixel;
+                drawn = true;
+            }
+        }
 
-    case '<':
-    {
-        drawCharacter(currX, currY, ASCII_LESS_THAN_SIGN, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
+        if (drawn)
+        {
+            for (int tile = minX / TILE_SIZE; tile <= maxX / TILE_SIZE; tile++)
+            {
+                m_dirtyTiles[tile + (y / TILE_SIZE) * m_dirtyTileColumns] = true;
+            }
+        }
     }
+}
 
-    case '=':
-    {
-        drawCharacter(currX, currY, ASCII_EQUALS_SIGN, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
-    }
 
-    case '>':
+const uint64_t * ScreenBuffer::getGlyphAtlas(int xScale)
+{
+    if (!m_glyphAtlases[xScale])
     {
-        drawCharacter(currX, currY, ASCII_GREATER_THAN_SIGN, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
+        uint64_t * atlas = new uint64_t[GLYPH_COUNT * ASCII_HEIGHT];
+        uint64_t column = ((uint64_t)1 << xScale) - 1;
+        for (int glyph = 0; glyph < GLYPH_COUNT; glyph++)
+        {
+            // same bit order drawCharacter reads them in
+            uint32_t mask = 0b00100000000000000000000000000000;
+            for (int row = 0; row < ASCII_HEIGHT; row++)
+            {
+                uint64_t bits = 0;
+                for (int col = 0; col < ASCII_WIDTH; col++)
+                {
+                    if (s_asciiGlyphs[glyph] & mask)
+                    {
+                        bits |= column << (col * xScale);
+                    }
+                    mask = mask >> 1;
+                }
+                atlas[row + glyph * ASCII_HEIGHT] = bits;
+            }
+        }
+        m_glyphAtlases[xScale] = atlas;
     }
 
-    case '?':
-    {
-        drawCharacter(currX, currY, ASCII_QUESTION_MARK, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
-    }
+    return m_glyphAtlases[xScale];
+}
 
-    case '@':
-    {
-        drawCharacter(currX, currY, ASCII_AT_SIGN, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
-    }
 
-    case 'A':
+void ScreenBuffer::selectCharacter(int initialX, int& currX, int& currY, char c, const Color & color, int xScale, int yScale)
+{
+    if (c == '\n')
     {
-        drawCharacter(currX, currY, ASCII_CAPITAL_A, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
+        currX = initialX;
+        currY -= (ASCII_HEIGHT + 1)  * yScale;
+        return;
     }
 
-    case 'B':
+    if (xScale >= 1 && xScale <= GLYPH_ATLAS_MAX_SCALE && yScale >= 1)
     {
-        drawCharacter(currX, currY, ASCII_CAPITAL_B, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
+        blitCharacter(currX, currY, getGlyphIndex(c), color, xScale, yScale);
     }
-
-    case 'C':
+    else
     {
-        drawCharacter(currX, currY, ASCII_CAPITAL_C, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
+        drawCharacter(currX, currY, s_asciiGlyphs[getGlyphIndex(c)], color, xScale, yScale);
     }
+    currX += (ASCII_WIDTH + 1) * xScale;
+}
 
-    case 'D':
-    {
-        drawCharacter(currX, currY, ASCII_CAPITAL_D, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
-    }
 
-    case 'E':
-    {
-        drawCharacter(currX, currY, ASCII_CAPITAL_E, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1) * xScale;
-        break;
-    }
+void ScreenBuffer::drawPoint3D(const Point & point, const Tile & tile)
+{
+    int viewX, viewY;
+    getPixelCoordinates(point, viewX, viewY);
+    drawPointWithZCheck(viewX, viewY, point.z, point.m_color, tile);
+}
 
-    case 'F':
-    {
-        drawCharacter(currX, currY, ASCII_CAPITAL_F, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
 
-    case 'G':
-    {
-        drawCharacter(currX, currY, ASCII_CAPITAL_G, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+void ScreenBuffer::drawLine3D(const Point & p0, const Point & p1, const Tile & tile)
+{
+    drawLine3DEx(p0, p1, tile);
 
-    case 'H':
-    {
-        drawCharacter(currX, currY, ASCII_CAPITAL_H, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+    // draw end point
+    int x1, y1;
+    getPixelCoordinates(p1, x1, y1);
+    drawPointWithZCheck(x1, y1, p1.z, p1.m_color, tile);
+}
 
-    case 'I':
-    {
-        drawCharacter(currX, currY, ASCII_CAPITAL_I, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
 
-    case 'J':
-    {
-        drawCharacter(currX, currY, ASCII_CAPITAL_J, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+void ScreenBuffer::drawTriangleOutline3D(const Point & p0, const Point & p1, const Point & p2, const Tile & tile)
+{
+    drawLine3DEx(p0, p1, tile);
+    drawLine3DEx(p1, p2, tile);
+    drawLine3DEx(p0, p2, tile);
+}
 
-    case 'K':
-    {
-        drawCharacter(currX, currY, ASCII_CAPITAL_K, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
 
-    case 'L':
-    {
-        drawCharacter(currX, currY, ASCII_CAPITAL_L, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+void ScreenBuffer::drawLine3DEx(const Point & p0, const Point & p1, const Tile & tile)
+{
+    int borderHeight = m_height - borderOffset * 2;
+    int borderWidth = m_width - borderOffset * 2;
 
-    case 'M':
+    int x0, y0, x1, y1;
+    if (borderWidth >= borderHeight)
     {
-        drawCharacter(currX, currY, ASCII_CAPITAL_M, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
+        x0 = borderOffset + (long long)((p0.x + 1) / 2 * borderWidth);
+        y0 = borderOffset + (long long)((p0.y + 1) / 2 * borderWidth) - (borderWidth - borderHeight) / 2;
+        x1 = borderOffset + (long long)((p1.x + 1) / 2 * borderWidth);
+        y1 = borderOffset + (long long)((p1.y + 1) / 2 * borderWidth) - (borderWidth - borderHeight) / 2;
     }
-
-    case 'N':
+    else
     {
-        drawCharacter(currX, currY, ASCII_CAPITAL_N, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
+        x0 = borderOffset + (long long)((p0.x + 1) / 2 * borderHeight) - (borderHeight - borderWidth) / 2;
+        y0 = borderOffset + (long long)((p0.y + 1) / 2 * borderHeight);
+        x1 = borderOffset + (long long)((p1.x + 1) / 2 * borderHeight) - (borderHeight - borderWidth) / 2;
+        y1 = borderOffset + (long long)((p1.y + 1) / 2 * borderHeight);
     }
 
-    case 'O':
-    {
-        drawCharacter(currX, currY, ASCII_CAPITAL_O, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
+    // One pixel per step along the longer axis. Every step moves the other
+    // axis, the depth, and the color by the same amount, so there's no
+    // square root or fade per pixel.
+    int deltaX = x1 - x0;
+    int deltaY = y1 - y0;
+    int steps = MAX(ABS(deltaX), ABS(deltaY));
+    if (steps == 0)
+    {
+        return;
+    }
+
+    // x and y in 16.16 fixed point, starting half a pixel in so the
+    // shift rounds to the nearest pixel. The deltas and coordinates can be
+    // negative, so they're multiplied up instead of shifted.
+    long long xStep = (long long)deltaX * 65536 / steps;
+    long long yStep = (long long)deltaY * 65536 / steps;
+    float zStep = (p1.z - p0.z) / steps;
+    float rStep = (float)(p1.m_color.r - p0.m_color.r) / steps;
+    float gStep = (float)(p1.m_color.g - p0.m_color.g) / steps;
+    float bStep = (float)(p1.m_color.b - p0.m_color.b) / steps;
+
+    // Only walk the steps where the longer axis is inside the tile. Lines
+    // get drawn once for every tile they're binned to, so this keeps each
+    // tile to its own part of the line.
+    int first = 0;
+    int last = steps - 1;
+    bool xMajor = ABS(deltaX) >= ABS(deltaY);
+    int major0 = xMajor ? x0 : y0;
+    int majorIncrement = xMajor ? SIGN(deltaX) : SIGN(deltaY);
+    int majorMin = xMajor ? tile.minX : tile.minY;
+    int majorMax = xMajor ? tile.maxX : tile.maxY;
+    if (majorIncrement > 0)
+    {
+        first = MAX(first, majorMin - major0);
+        last = MIN(last, majorMax - major0);
     }
-
-    case 'P':
+    else
     {
-        drawCharacter(currX, currY, ASCII_CAPITAL_P, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
+        first = MAX(first, major0 - majorMax);
+        last = MIN(last, major0 - majorMin);
     }
 
-    case 'Q':
+    int width = m_width;
+    long long xFixed = (long long)x0 * 65536 + (1 << 15) + first * xStep;
+    long long yFixed = (long long)y0 * 65536 + (1 << 15) + first * yStep;
+    for (int i = first; i <= last; i++, xFixed += xStep, yFixed += yStep)
     {
-        drawCharacter(currX, currY, ASCII_CAPITAL_Q, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+        int x = (int)(xFixed >> 16);
+        int y = (int)(yFixed >> 16);
+        if (x < tile.minX || x > tile.maxX ||
+            y < tile.minY || y > tile.maxY)
+        {
+            continue;
+        }
 
-    case 'R':
-    {
-        drawCharacter(currX, currY, ASCII_CAPITAL_R, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+        float z = p0.z + i * zStep;
+        int index = x + y * width;
+        float oldZ = m_zBuffer[index];
+        if (m_depthEpochs && m_depthEpochs[index] != m_depthEpoch)
+        {
+            oldZ = m_clearDepth;
+        }
 
-    case 'S':
-    {
-        drawCharacter(currX, currY, ASCII_CAPITAL_S, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
+        if (z >= oldZ)
+        {
+            uint8_t r = (uint8_t)(p0.m_color.r + i * rStep);
+            uint8_t g = (uint8_t)(p0.m_color.g + i * gStep);
+            uint8_t b = (uint8_t)(p0.m_color.b + i * bStep);
+            m_memory[index] = GET_RGB(r, g, b);
+            m_zBuffer[index] = z;
+            if (m_depthEpochs)
+            {
+                m_depthEpochs[index] = m_depthEpoch;
+            }
+            markDirty(x, y);
+        }
     }
+}
 
-    case 'T':
-    {
-        drawCharacter(currX, currY, ASCII_CAPITAL_T, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
 
-    case 'U':
-    {
-        drawCharacter(currX, currY, ASCII_CAPITAL_U, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+void ScreenBuffer::drawTriangle3DBarycentric(const Point & p0, const Point & p1, const Point & p2, const Tile & tile)
+{
+    int borderHeight = m_height - borderOffset * 2;
+    int borderWidth = m_width - borderOffset * 2;
 
-    case 'V':
-    {
-        drawCharacter(currX, currY, ASCII_CAPITAL_V, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
-
-    case 'W':
+    int x0, y0, x1, y1, x2, y2;
+    if (borderWidth >= borderHeight)
     {
-        drawCharacter(currX, currY, ASCII_CAPITAL_W, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
+        x0 = borderOffset + (long long)((p0.x + 1) / 2 * borderWidth);
+        y0 = borderOffset + (long long)((p0.y + 1) / 2 * borderWidth) - (borderWidth - borderHeight) / 2;
+        x1 = borderOffset + (long long)((p1.x + 1) / 2 * borderWidth);
+        y1 = borderOffset + (long long)((p1.y + 1) / 2 * borderWidth) - (borderWidth - borderHeight) / 2;
+        x2 = borderOffset + (long long)((p2.x + 1) / 2 * borderWidth);
+        y2 = borderOffset + (long long)((p2.y + 1) / 2 * borderWidth) - (borderWidth - borderHeight) / 2;
     }
-
-    case 'X':
+    else
     {
-        drawCharacter(currX, currY, ASCII_CAPITAL_X, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
+        x0 = borderOffset + (long long)((p0.x + 1) / 2 * borderHeight) - (borderHeight - borderWidth) / 2;
+        y0 = borderOffset + (long long)((p0.y + 1) / 2 * borderHeight);
+        x1 = borderOffset + (long long)((p1.x + 1) / 2 * borderHeight) - (borderHeight - borderWidth) / 2;
+        y1 = borderOffset + (long long)((p1.y + 1) / 2 * borderHeight);
+        x2 = borderOffset + (long long)((p2.x + 1) / 2 * borderHeight) - (borderHeight - borderWidth) / 2;
+        y2 = borderOffset + (long long)((p2.y + 1) / 2 * borderHeight);
     }
 
-    case 'Y':
-    {
-        drawCharacter(currX, currY, ASCII_CAPITAL_Y, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+    // nothing outside the tile gets drawn, so don't bother looking there
+    int minX = MAX(MIN(x0, MIN(x1, x2)), tile.minX);
+    int maxX = MIN(MAX(x0, MAX(x1, x2)), tile.maxX);
+    int minY = MAX(MIN(y0, MIN(y1, y2)), tile.minY);
+    int maxY = MIN(MAX(y0, MAX(y1, y2)), tile.maxY);
 
-    case 'Z':
-    {
-        drawCharacter(currX, currY, ASCII_CAPITAL_Z, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+    float triangleArea = getTriangleArea(x0, y0, x1, y1, x2, y2);
 
-    case '[':
-    {
-        drawCharacter(currX, currY, ASCII_LEFT_SQUARE_BRACKET, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+    // Pair representing a spanning vector on the edge (v0, v1)
+    int x01 = x1 - x0;
+    int y01 = y1 - y0;
 
-    case '\\':
+    // Pair representing a spanning vector on the edge (v0, v2)
+    int x02 = x2 - x0;
+    int y02 = y2 - y0;
+    
+    // iterate over all points possibly in the triangle
+    for (int xP = minX; xP <= maxX; xP++)
     {
-        drawCharacter(currX, currY, ASCII_BACK_SLASH, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+        for (int yP = minY; yP <= maxY; yP++)
+        {
+            // Pair representing the spanning vector (v0, vP)
+            int x0P = xP - x0;
+            int y0P = yP - y0;
 
-    case ']':
-    {
-        drawCharacter(currX, currY, ASCII_RIGHT_SQUARE_BRACKET, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+            // cross product of v01 and v02
+            int c0102 = x01 * y02 - y01 * x02;
 
-    case '^':
-    {
-        drawCharacter(currX, currY, ASCII_CARET, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+            // cross product of v0P and v02
+            int c0P02 = x0P * y02 - y0P * x02;
 
-    case '_':
-    {
-        drawCharacter(currX, currY, ASCII_UNDERSCORE, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+            // cross product of v01 and v0P
+            int c010P = x01 * y0P - y01 * x0P;
 
-    case '`':
-    {
-        drawCharacter(currX, currY, ASCII_ACUTE, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+            float a = (float)c0P02 / c0102;
+            float b = (float)c010P / c0102;
 
-    case 'a':
-    {
-        drawCharacter(currX, currY, ASCII_LOWER_CASE_A, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+            // draw the point if it's inside the triangle
+            if (a >= 0 && b >= 0 && a + b <= 1)
+            {
+                // figure out the z value at this point
+                float area12P = getTriangleArea(x1, y1, x2, y2, xP, yP);
+                float area20P = getTriangleArea(x2, y2, x0, y0, xP, yP);
+                float area01P = getTriangleArea(x0, y0, x1, y1, xP, yP);
 
-    case 'b':
-    {
-        drawCharacter(currX, currY, ASCII_LOWER_CASE_B, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+                float lambda0 = area12P / triangleArea;
+                float lambda1 = area20P / triangleArea;
+                float lambda2 = area01P / triangleArea;
 
-    case 'c':
-    {
-        drawCharacter(currX, currY, ASCII_LOWER_CASE_C, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+                float zP = lambda0 * p0.z + lambda1 * p1.z + lambda2 * p2.z;
+                Color cP = p0.m_color.getFade(lambda0) + p1.m_color.getFade(lambda1) + p2.m_color.getFade(lambda2);
+                drawPointWithZCheck(xP, yP, zP, cP, tile);
+            }
 
-    case 'd':
-    {
-        drawCharacter(currX, currY, ASCII_LOWER_CASE_D, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
+        }
     }
+}
 
-    case 'e':
-    {
-        drawCharacter(currX, currY, ASCII_LOWER_CASE_E, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
 
-    case 'f':
-    {
-        drawCharacter(currX, currY, ASCII_LOWER_CASE_F, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+void ScreenBuffer::drawTriangle3DEdgeFunction(const Point & p0, const Point & p1, const Point & p2, const Tile & tile)
+{
+    // vertices in subpixels
+    int x0, y0, x1, y1, x2, y2;
+    getSubpixelCoordinates(p0, x0, y0);
+    getSubpixelCoordinates(p1, x1, y1);
+    getSubpixelCoordinates(p2, x2, y2);
 
-    case 'g':
-    {
-        drawCharacter(currX, currY, ASCII_LOWER_CASE_G, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+    // Pair representing a spanning vector on the edge (v0, v1)
+    int x01 = x1 - x0;
+    int y01 = y1 - y0;
 
-    case 'h':
-    {
-        drawCharacter(currX, currY, ASCII_LOWER_CASE_H, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+    // Pair representing a spanning vector on the edge (v0, v2)
+    int x02 = x2 - x0;
+    int y02 = y2 - y0;
 
-    case 'i':
-    {
-        drawCharacter(currX, currY, ASCII_LOWER_CASE_I, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+    // cross product of v01 and v02 (twice the signed area). Subpixel
+    // products can overflow 32 bits on big buffers.
+    int64_t area = (int64_t)x01 * y02 - (int64_t)y01 * x02;
+
+    // a flat triangle doesn't cover anything
+    if (area == 0)
+    {
+        return;
+    }
 
-    case 'j':
-    {
-        drawCharacter(currX, currY, ASCII_LOWER_CASE_J, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+    // only walk the part of the bounding box inside the tile
+    int minX = MAX(MIN(x0, MIN(x1, x2)) >> SUBPIXEL_BITS, tile.minX);
+    int maxX = MIN(MAX(x0, MAX(x1, x2)) >> SUBPIXEL_BITS, tile.maxX);
+    int minY = MAX(MIN(y0, MIN(y1, y2)) >> SUBPIXEL_BITS, tile.minY);
+    int maxY = MIN(MAX(y0, MAX(y1, y2)) >> SUBPIXEL_BITS, tile.maxY);
+
+    if (minX > maxX || minY > maxY)
+    {
+        return;
+    }
+
+    // z is linear across the triangle, so it's nearest at one of the corners
+    if (m_hierarchicalZ)
+    {
+        atomicIncrement(&m_renderStats.triangles);
+        if (isOccluded(minX, minY, maxX, maxY, MAX(p0.z, MAX(p1.z, p2.z))))
+        {
+            atomicIncrement(&m_renderStats.trianglesOccluded);
+            return;
+        }
+    }
+
+    // Edge functions at the center of pixel (minX, minY). e1 is the cross
+    // product of v0P and v02 and e2 is the cross product of v01 and v0P.
+    // Divided by the area, they are the barycentric weights of p1 and p2.
+    // They step by a whole pixel at a time.
+    int xP = (minX << SUBPIXEL_BITS) + SUBPIXEL_SCALE / 2;
+    int yP = (minY << SUBPIXEL_BITS) + SUBPIXEL_SCALE / 2;
+    int64_t e1Row = (int64_t)(xP - x0) * y02 - (int64_t)(yP - y0) * x02;
+    int64_t e2Row = (int64_t)x01 * (yP - y0) - (int64_t)y01 * (xP - x0);
+    int64_t e1StepX = (int64_t)y02 * SUBPIXEL_SCALE;
+    int64_t e1StepY = -(int64_t)x02 * SUBPIXEL_SCALE;
+    int64_t e2StepX = -(int64_t)y01 * SUBPIXEL_SCALE;
+    int64_t e2StepY = (int64_t)x01 * SUBPIXEL_SCALE;
+
+    // flip everything for clockwise triangles so the inside test is the same
+    int winding = 1;
+    if (area < 0)
+    {
+        winding = -1;
+        area = -area;
+        e1Row = -e1Row;
+        e2Row = -e2Row;
+        e1StepX = -e1StepX;
+        e1StepY = -e1StepY;
+        e2StepX = -e2StepX;
+        e2StepY = -e2StepY;
+    }
+
+    // Going counterclockwise, e2 is the edge from p0 to p1, e0 from p1 to p2
+    // and e1 from p2 to p0. Edge functions are whole numbers, so taking one
+    // off the edges that aren't top or left leaves centers right on them out.
+    int e0Bias = isTopLeftEdge(winding * (x2 - x1), winding * (y2 - y1)) ? 0 : -1;
+    int e1Bias = isTopLeftEdge(winding * -x02, winding * -y02) ? 0 : -1;
+    int e2Bias = isTopLeftEdge(winding * x01, winding * y01) ? 0 : -1;
+
+    // z and color are linear in the weights, so they change by a constant
+    // amount per pixel and per row. They're evaluated from p0 rather than
+    // summed up across the bounding box, so a pixel gets the same value no
+    // matter which tile it's drawn from.
+    float lambda1StepX = (float)e1StepX / area;
+    float lambda1StepY = (float)e1StepY / area;
+    float lambda2StepX = (float)e2StepX / area;
+    float lambda2StepY = (float)e2StepY / area;
+
+    float dz1 = p1.z - p0.z;
+    float dz2 = p2.z - p0.z;
+    float dr1 = (float)p1.r - p0.r;
+    float dr2 = (float)p2.r - p0.r;
+    float dg1 = (float)p1.g - p0.g;
+    float dg2 = (float)p2.g - p0.g;
+    float db1 = (float)p1.b - p0.b;
+    float db2 = (float)p2.b - p0.b;
+
+    float zStepX = dz1 * lambda1StepX + dz2 * lambda2StepX;
+    float rStepX = dr1 * lambda1StepX + dr2 * lambda2StepX;
+    float gStepX = dg1 * lambda1StepX + dg2 * lambda2StepX;
+    float bStepX = db1 * lambda1StepX + db2 * lambda2StepX;
+
+    float zStepY = dz1 * lambda1StepY + dz2 * lambda2StepY;
+    float rStepY = dr1 * lambda1StepY + dr2 * lambda2StepY;
+    float gStepY = dg1 * lambda1StepY + dg2 * lambda2StepY;
+    float bStepY = db1 * lambda1StepY + db2 * lambda2StepY;
+
+    // how far the first pixel center is from p0, in pixels
+    float columnsFromP0 = (float)(xP - x0) / SUBPIXEL_SCALE;
+    float rowsFromP0 = (float)(yP - y0) / SUBPIXEL_SCALE;
+
+    // kept for updating the hierarchical z buffer at the end
+    int64_t e1Start = e1Row;
+    int64_t e2Start = e2Row;
+    float rowsFromP0Start = rowsFromP0;
+
+    long spans = 0;
+    long spansOccluded = 0;
+    long pixelsWritten = 0;
+
+    int width = m_width;
+    for (int row = minY; row <= maxY; row++)
+    {
+        float zRow = p0.z + rowsFromP0 * zStepY;
+        float rRow = p0.r + rowsFromP0 * rStepY;
+        float gRow = p0.g + rowsFromP0 * gStepY;
+        float bRow = p0.b + rowsFromP0 * bStepY;
+
+        // Work out which columns of this row are inside all three edges
+        // straight from the edge functions, so the span kernel only has to
+        // do the z test.
+        int first = 0;
+        int last = maxX - minX;
+        narrowSpan(e1Row + e1Bias, e1StepX, first, last);
+        narrowSpan(e2Row + e2Bias, e2StepX, first, last);
+        narrowSpan(area - e1Row - e2Row + e0Bias, -(e1StepX + e2StepX), first, last);
+
+        // Drop the blocks at either end of the span that the row is behind.
+        // z is worked out the same way the span kernels do it, and it's
+        // linear, so the ends of the span in a block bound the rest.
+        if (m_hierarchicalZ && first <= last)
+        {
+            spans++;
+            const float * blocks = m_hiZBlocks + (row >> HIZ_BLOCK_BITS) * m_hiZBlockColumns;
+            while (first <= last)
+            {
+                int blockLast = MIN(((minX + first) | (HIZ_BLOCK_SIZE - 1)) - minX, last);
+                float z0 = zRow + (columnsFromP0 + first) * zStepX;
+                float z1 = zRow + (columnsFromP0 + blockLast) * zStepX;
+                if (MAX(z0, z1) >= blocks[(minX + first) >> HIZ_BLOCK_BITS])
+                {
+                    break;
+                }
+                first = blockLast + 1;
+            }
+            while (first <= last)
+            {
+                int blockFirst = MAX(((minX + last) & ~(HIZ_BLOCK_SIZE - 1)) - minX, first);
+                float z0 = zRow + (columnsFromP0 + blockFirst) * zStepX;
+                float z1 = zRow + (columnsFromP0 + last) * zStepX;
+                if (MAX(z0, z1) >= blocks[(minX + last) >> HIZ_BLOCK_BITS])
+                {
+                    break;
+                }
+                last = blockFirst - 1;
+            }
+            if (first > last)
+            {
+                spansOccluded++;
+            }
+        }
 
-    case 'k':
-    {
-        drawCharacter(currX, currY, ASCII_LOWER_CASE_K, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+        if (first <= last)
+        {
+            Span span;
+            span.pixel = m_memory + minX + first + row * width;
+            span.depth = m_zBuffer + minX + first + row * width;
+            span.epoch = m_depthEpochs ? m_depthEpochs + minX + first + row * width : 0;
+            span.currentEpoch = m_depthEpoch;
+            span.clearDepth = m_clearDepth;
+            span.count = last - first + 1;
+            span.column = columnsFromP0 + first;
+            span.z = zRow;
+            span.r = rRow;
+            span.g = gRow;
+            span.b = bRow;
+            span.zStep = zStepX;
+            span.rStep = rStepX;
+            span.gStep = gStepX;
+            span.bStep = bStepX;
+            int written = m_fillSpan(span);
+            if (written > 0)
+            {
+                pixelsWritten += written;
+                for (int tile = (minX + first) / TILE_SIZE; tile <= (minX + last) / TILE_SIZE; tile++)
+                {
+                    m_dirtyTiles[tile + (row / TILE_SIZE) * m_dirtyTileColumns] = true;
+                }
+            }
+        }
 
-    case 'l':
-    {
-        drawCharacter(currX, currY, ASCII_LOWER_CASE_L, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
+        e1Row += e1StepY;
+        e2Row += e2StepY;
+        rowsFromP0 += 1;
     }
 
-    case 'm':
+    atomicAdd(&m_renderStats.pixelsWritten, pixelsWritten);
+    if (!m_hierarchicalZ)
     {
-        drawCharacter(currX, currY, ASCII_LOWER_CASE_M, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
+        return;
     }
+    atomicAdd(&m_renderStats.spans, spans);
+    atomicAdd(&m_renderStats.spansOccluded, spansOccluded);
 
-    case 'n':
+    // Every pixel of a block the triangle covers ends up at least as near
+    // as the triangle, so the block's depth can go up to the triangle's
+    // farthest depth in it. Blocks are only covered if all four corner
+    // pixels are, since the triangle is convex. Only whole blocks inside
+    // the bounding box, which is already inside the tile, are looked at.
+    int blocksPerTile = TILE_SIZE / HIZ_BLOCK_SIZE;
+    int minBlockX = (minX + HIZ_BLOCK_SIZE - 1) >> HIZ_BLOCK_BITS;
+    int minBlockY = (minY + HIZ_BLOCK_SIZE - 1) >> HIZ_BLOCK_BITS;
+    int maxBlockX = ((maxX + 1) >> HIZ_BLOCK_BITS) - 1;
+    int maxBlockY = ((maxY + 1) >> HIZ_BLOCK_BITS) - 1;
+    for (int blockY = minBlockY; blockY <= maxBlockY; blockY++)
     {
-        drawCharacter(currX, currY, ASCII_LOWER_CASE_N, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+        for (int blockX = minBlockX; blockX <= maxBlockX; blockX++)
+        {
+            bool covered = true;
+            float farthest = 0;
+            for (int corner = 0; corner < 4 && covered; corner++)
+            {
+                int column = (blockX << HIZ_BLOCK_BITS) + (corner & 1) * (HIZ_BLOCK_SIZE - 1) - minX;
+                int row = (blockY << HIZ_BLOCK_BITS) + (corner >> 1) * (HIZ_BLOCK_SIZE - 1) - minY;
 
-    case 'o':
-    {
-        drawCharacter(currX, currY, ASCII_LOWER_CASE_O, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+                int64_t e1 = e1Start + column * e1StepX + row * e1StepY;
+                int64_t e2 = e2Start + column * e2StepX + row * e2StepY;
+                covered = e1 + e1Bias >= 0 && e2 + e2Bias >= 0 && area - e1 - e2 + e0Bias >= 0;
 
-    case 'p':
-    {
-        drawCharacter(currX, currY, ASCII_LOWER_CASE_P, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+                float z = (p0.z + (rowsFromP0Start + row) * zStepY) + (columnsFromP0 + column) * zStepX;
+                farthest = corner == 0 ? z : MIN(farthest, z);
+            }
 
-    case 'q':
-    {
-        drawCharacter(currX, currY, ASCII_LOWER_CASE_Q, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
+            float & block = m_hiZBlocks[blockX + blockY * m_hiZBlockColumns];
+            if (covered && farthest > block)
+            {
+                block = farthest;
+                m_hiZTileChanged[blockX / blocksPerTile + (blockY / blocksPerTile) * m_hiZTileColumns] = true;
+            }
+        }
     }
+}
 
-    case 'r':
-    {
-        drawCharacter(currX, currY, ASCII_LOWER_CASE_R, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
 
-    case 's':
+FrustumTest ScreenBuffer::cullEntity(const Frustum & frustum, const Entity * entity)
+{
+    FrustumTest test = FT_INTERSECTING;
+    if (entity->drawRadius >= 0 && !(entity->drawProperties & DRAW_NORMALS))
     {
-        drawCharacter(currX, currY, ASCII_LOWER_CASE_S, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
+        test = frustum.testSphere(entity->locationPoint, entity->drawRadius);
     }
 
-    case 't':
+    m_renderStats.entities++;
+    if (test == FT_OUTSIDE)
     {
-        drawCharacter(currX, currY, ASCII_LOWER_CASE_T, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
+        m_renderStats.entitiesCulled++;
     }
-
-    case 'u':
+    else if (test == FT_INSIDE)
     {
-        drawCharacter(currX, currY, ASCII_LOWER_CASE_U, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
+        m_renderStats.entitiesInside++;
     }
+    return test;
+}
 
-    case 'v':
-    {
-        drawCharacter(currX, currY, ASCII_LOWER_CASE_V, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
 
-    case 'w':
-    {
-        drawCharacter(currX, currY, ASCII_LOWER_CASE_W, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+void ScreenBuffer::prepareEntity(const Entity * entity, bool insideFrustum, const Matrix & cameraTransform, const Matrix & viewingTransform, Array<TransformedVertex> & vertices, Shape & shape) const
+{
+    const Frame & frame = getDetailFrame(entity, cameraTransform);
+    uint8_t drawProperties = entity->drawProperties;
+    bool distanceShading = !(drawProperties & DRAW_DISTANCE_SHADING_OFF);
 
-    case 'x':
-    {
-        drawCharacter(currX, currY, ASCII_LOWER_CASE_X, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+    // entity space to world space to camera space to clip space, all in one
+    // matrix
+    Matrix objectToCamera = entity->getWorldTransform() * cameraTransform;
+    Matrix objectToClip = objectToCamera * viewingTransform;
 
-    case 'y':
-    {
-        drawCharacter(currX, currY, ASCII_LOWER_CASE_Y, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+    // Anything but triangles uses every point. Frames without their planes
+    // worked out have their backfaces found in camera space, which also
+    // needs the points first.
+    bool objectSpaceCulling = frame.normals.size() == frame.triangles.size();
+    bool everyPoint = (drawProperties & (DRAW_POINTS | DRAW_LINES)) || !objectSpaceCulling;
 
-    case 'z':
+    // every point gets transformed at most once
+    vertices.clear();
+    if (vertices.capacity() < frame.points.size())
     {
-        drawCharacter(currX, currY, ASCII_LOWER_CASE_Z, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
+        vertices.setCapacity(frame.points.size());
     }
-
-    case '{':
+    if (everyPoint)
     {
-        drawCharacter(currX, currY, ASCII_LEFT_CURLY_BRACKET, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
+        for (int i = 0; i < frame.points.size(); i++)
+        {
+            vertices += transformVertex(frame.points[i], objectToClip, distanceShading);
+        }
     }
-
-    case '|':
+    else
     {
-        drawCharacter(currX, currY, ASCII_VERTICAL_BAR, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
+        TransformedVertex untransformed;
+        untransformed.transformed = false;
+        for (int i = 0; i < frame.points.size(); i++)
+        {
+            vertices += untransformed;
+        }
     }
 
-    case '}':
-    {
-        drawCharacter(currX, currY, ASCII_RIGHT_CURLY_BRACKET, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+    // The frame lines and triangles point into frame.points, so the
+    // difference between the pointers is the index into the vertex cache.
+    // A frame without points has nothing pointing into it, and draws as
+    // nothing.
+    const Point * firstPoint = frame.points.size() ? &frame.points[0] : 0;
 
-    case '~':
+    if (drawProperties & DRAW_POINTS)
     {
-        drawCharacter(currX, currY, ASCII_TILDE, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
+        for (int i = 0; i < vertices.size(); i++)
+        {
+            Point p = vertices[i].clip;
+            p.m_color = p.m_color.getFade(vertices[i].distanceFade);
+            shape.points += p;
+        }
     }
 
-    case '\n':
+    if (drawProperties & DRAW_LINES)
     {
-        currX = initialX;
-        currY -= (ASCII_HEIGHT + 1)  * yScale;
-        break;
-    }
+        for (int i = 0; i < frame.lines.size(); i++)
+        {
+            const TransformedVertex & v0 = vertices[frame.lines[i].p0 - firstPoint];
+            const TransformedVertex & v1 = vertices[frame.lines[i].p1 - firstPoint];
 
-    default:
-    {
-        drawCharacter(currX, currY, ASCII_UNDEFINED, color, xScale, yScale);
-        currX += (ASCII_WIDTH + 1)  * xScale;
-        break;
-    }
+            Line line(v0.clip, v1.clip);
+            line.p0.m_color = line.p0.m_color.getFade(v0.distanceFade);
+            line.p1.m_color = line.p1.m_color.getFade(v1.distanceFade);
+            shape.lines += line;
+        }
     }
-}
 
-
-void ScreenBuffer::drawLine3DEx(const Point & p0, const Point & p1)
-{
-    int borderHeight = m_info.bmiHeader.biHeight - borderOffset * 2;
-    int borderWidth = m_info.bmiHeader.biWidth - borderOffset * 2;
-
-    int x0, y0, x1, y1;
-    if (borderWidth >= borderHeight)
-    {
-        x0 = borderOffset + (long long)((p0.x + 1) / 2 * borderWidth);
-        y0 = borderOffset + (long long)((p0.y + 1) / 2 * borderWidth) - (borderWidth - borderHeight) / 2;
-        x1 = borderOffset + (long long)((p1.x + 1) / 2 * borderWidth);
-        y1 = borderOffset + (long long)((p1.y + 1) / 2 * borderWidth) - (borderWidth - borderHeight) / 2;
-    }
-    else
+    if (drawProperties & DRAW_NORMALS)
     {
-        x0 = borderOffset + (long long)((p0.x + 1) / 2 * borderHeight) - (borderHeight - borderWidth) / 2;
-        y0 = borderOffset + (long long)((p0.y + 1) / 2 * borderHeight);
-        x1 = borderOffset + (long long)((p1.x + 1) / 2 * borderHeight) - (borderHeight - borderWidth) / 2;
-        y1 = borderOffset + (long long)((p1.y + 1) / 2 * borderHeight);
-    }
+        // a line from the middle of each triangle, the length of its normal
+        for (int i = 0; i < frame.triangles.size(); i++)
+        {
+            const FrameTriangle & t = frame.triangles[i];
+            float x = (t.p0->x + t.p1->x + t.p2->x) / 3;
+            float y = (t.p0->y + t.p1->y + t.p2->y) / 3;
+            float z = (t.p0->z + t.p1->z + t.p2->z) / 3;
+            Point c = Point(x, y, z);
+            Vector n = t.getNormal();
 
-    // NOTE!!!
-    // When things are going towards the camera and off to the sides, they end
-    // up with huge x and y values. This can be avoided with propper clipping
-    // prior to drawing. Without clipping, the range of x and y values that
-    // need to be covered is huge, and this method takes forever!!!
+            TransformedVertex v0 = transformVertex(c, objectToClip, distanceShading);
+            TransformedVertex v1 = transformVertex(c + n, objectToClip, distanceShading);
 
-    int lineLength = sqrt((float)(x1 - x0) * (x1 - x0) + (float)(y1 - y0) * (y1 - y0));
-    float deltaZ = p1.z - p0.z;
-    float deltaX = x1 - x0; // positive if line drawn from x0 to x1
-    float deltaY = y1 - y0; // positive if line drawn from y0 to y1
-    int xIncrement = SIGN(x1 - x0);
-    int yIncrement = SIGN(y1 - y0);
-
-    if (equalULP(deltaY, 0))
-    {
-        for (int x = x0; x != x1; x += xIncrement)
-        {
-            // NOTE: Convert to float early because these values will overflow
-            //       the integer cap and you'll end up trying to take the square
-            //       root of a negative.
-            float currentLength = sqrt((float)(x - x0) * (x - x0));
-            float currentZ = p0.z + deltaZ * currentLength / lineLength;
-            Color currentColor = p0.m_color.getFade(1 - currentLength / lineLength) + p1.m_color.getFade(currentLength / lineLength);
-            drawPointWithZCheck(x, y0, currentZ, currentColor);
+            Line line(v0.clip, v1.clip);
+            line.p0.m_color = line.p0.m_color.getFade(v0.distanceFade);
+            line.p1.m_color = line.p1.m_color.getFade(v1.distanceFade);
+            shape.lines += line;
         }
     }
-    else if (equalULP(deltaX, 0))
+
+    if (drawProperties & DRAW_TRIANGLES)
     {
-        for (int y = y0; y != y1; y += yIncrement)
+        // The camera's at the origin of camera space. Taking it back into
+        // the entity's space lets the frame's planes do the culling. The
+        // transforms don't scale, so the distance from a plane to the camera
+        // is the same in either space.
+        Point camera;
+        if (objectSpaceCulling)
         {
-            float currentLength = sqrt((float)(y - y0) * (y - y0));
-            float currentZ = p0.z + deltaZ * currentLength / lineLength;
-            Color currentColor = p0.m_color.getFade(1 - currentLength / lineLength) + p1.m_color.getFade(currentLength / lineLength);
-            drawPointWithZCheck(x0, y, currentZ, currentColor);
+            Matrix cameraToObject = objectToCamera;
+            cameraToObject.invert();
+            camera = camera * cameraToObject;
         }
-    }
-    else
-    {
-        float xError = 0;
-        float yError = 0;
-        int x = x0;
-        int y = y0;
-        while (x != x1 || y != y1)
+
+        for (int i = 0; i < frame.triangles.size(); i++)
         {
-            // error will grow faster for whichever is delta is bigger
-            xError += ABS(deltaX / deltaY);
-            yError += ABS(deltaY / deltaX);
-            if (xError >= 0.5 && yError >= 0.5)
+            const FrameTriangle & t = frame.triangles[i];
+
+            float facing;
+            if (objectSpaceCulling)
             {
-                float currentLength = sqrt((float)(x - x0) * (x - x0) + (float)(y - y0) * (y - y0));
-                float currentZ = p0.z + deltaZ * currentLength / lineLength;
-                Color currentColor = p0.m_color.getFade(1 - currentLength / lineLength) + p1.m_color.getFade(currentLength / lineLength);
-                drawPointWithZCheck(x, y, currentZ, currentColor);
-                x += xIncrement;
-                xError--;
-                y += yIncrement;
-                yError--;
+                const Vector & normal = frame.normals[i];
+                facing = normal.x * camera.x + normal.y * camera.y + normal.z * camera.z - frame.planeDistances[i];
             }
-            else if (xError >= 0.5)
+            else
             {
-                float currentLength = sqrt((float)(x - x0) * (x - x0) + (float)(y - y0) * (y - y0));
-                float currentZ = p0.z + deltaZ * currentLength / lineLength;
-                Color currentColor = p0.m_color.getFade(1 - currentLength / lineLength) + p1.m_color.getFade(currentLength / lineLength);
-                drawPointWithZCheck(x, y, currentZ, currentColor);
-                x += xIncrement;
-                xError--;
+                const Point & p0 = vertices[t.p0 - firstPoint].camera;
+                Vector normal = getCameraSpaceNormal(p0, vertices[t.p1 - firstPoint].camera, vertices[t.p2 - firstPoint].camera);
+                facing = getFacing(normal, p0);
             }
-            else if (yError >= 0.5)
+
+            if (facing <= 0)
             {
-                float currentLength = sqrt((float)(x - x0) * (x - x0) + (float)(y - y0) * (y - y0));
-                float currentZ = p0.z + deltaZ * currentLength / lineLength;
-                Color currentColor = p0.m_color.getFade(1 - currentLength / lineLength) + p1.m_color.getFade(currentLength / lineLength);
-                drawPointWithZCheck(x, y, currentZ, currentColor);
-                y += yIncrement;
-                yError--;
+                continue;
             }
+
+            const TransformedVertex & v0 = getTransformedVertex(t.p0, firstPoint, objectToClip, distanceShading, vertices);
+            const TransformedVertex & v1 = getTransformedVertex(t.p1, firstPoint, objectToClip, distanceShading, vertices);
+            const TransformedVertex & v2 = getTransformedVertex(t.p2, firstPoint, objectToClip, distanceShading, vertices);
+
+            // the light is at the camera
+            Triangle triangle(v0.clip, v1.clip, v2.clip);
+            triangle.p0.m_color = applySimpleLighting(0.2, 0.8, facing, v0).getFade(v0.distanceFade);
+            triangle.p1.m_color = applySimpleLighting(0.2, 0.8, facing, v1).getFade(v1.distanceFade);
+            triangle.p2.m_color = applySimpleLighting(0.2, 0.8, facing, v2).getFade(v2.distanceFade);
+            shape.triangles += triangle;
         }
     }
-}
-
 
-void ScreenBuffer::applySimpleLighting(const Point & source, float ambiant, float diffuse, Shape & shape) const
-{
-    for (int i = 0; i < shape.triangles.size(); i++)
+    if (!insideFrustum)
     {
-        Vector n = shape.triangles[i].getNormal();
-        Point & p0 = shape.triangles[i].p0;
-        Point & p1 = shape.triangles[i].p1;
-        Point & p2 = shape.triangles[i].p2;
-
-        Vector l0 = source - p0;
-        Vector l1 = source - p1;
-        Vector l2 = source - p2;
-
-        l0.normalize();
-        l1.normalize();
-        l2.normalize();
-
-        float nDotL0 = n.dotProduct(l0);
-        float nDotL1 = n.dotProduct(l1);
-        float nDotL2 = n.dotProduct(l2);
-
-        if (nDotL0 < 0) nDotL0 = 0;
-        if (nDotL1 < 0) nDotL1 = 0;
-        if (nDotL2 < 0) nDotL2 = 0;
-
-        p0.m_color = p0.m_color.getFade(ambiant + diffuse * nDotL0);
-        p1.m_color = p1.m_color.getFade(ambiant + diffuse * nDotL1);
-        p2.m_color = p2.m_color.getFade(ambiant + diffuse * nDotL2);
+        clipToFrustum(shape);
     }
+    shape.to3D();
 }
 
 
-void ScreenBuffer::applySimpleDistanceShading(Shape & shape) const
+const Frame & ScreenBuffer::getDetailFrame(const Entity * entity, const Matrix & cameraTransform) const
 {
-    Array<Point> & points = shape.points;
-    Array<Line> & lines = shape.lines;
-    Array<Triangle> & triangles = shape.triangles;
-
-    for (int i = 0; i < points.size(); i++)
+    const Array<Frame> & detailFrames = entity->getDetailFrames();
+    if (detailFrames.size() == 0 || entity->drawRadius < 0)
     {
-        Point & p = points[i];
-        p.m_color = p.m_color.getFade(-12.0 / p.z);
+        return entity->getFrame();
     }
 
-    for (int i = 0; i < lines.size(); i++)
-    {
-        Point & p0 = lines[i].p0;
-        p0.m_color = p0.m_color.getFade(-12.0 / p0.z);
+    // the camera looks down -z
+    Point center = entity->locationPoint;
+    center *= cameraTransform;
+    float depth = -center.z;
 
-        Point & p1 = lines[i].p1;
-        p1.m_color = p1.m_color.getFade(-12.0 / p1.z);
-    }
-
-    for (int i = 0; i < triangles.size(); i++)
+    // Up close, like inside the border, the whole thing is never small
+    if (depth <= entity->drawRadius)
     {
-        Point & p0 = triangles[i].p0;
-        p0.m_color = p0.m_color.getFade(-12.0 / p0.z);
-
-        Point & p1 = triangles[i].p1;
-        p1.m_color = p1.m_color.getFade(-12.0 / p1.z);
-
-        Point & p2 = triangles[i].p2;
-        p2.m_color = p2.m_color.getFade(-12.0 / p2.z);
+        return entity->getFrame();
     }
-}
 
+    // Image space goes from -1 to 1 across the longer side of the buffer,
+    // see getPixelCoordinates
+    int borderHeight = m_height - borderOffset * 2;
+    int borderWidth = m_width - borderOffset * 2;
+    int longerSide = borderWidth >= borderHeight ? borderWidth : borderHeight;
+    float radius = entity->drawRadius / depth * longerSide / 2;
 
-void ScreenBuffer::cullBackfaces(Shape & shape) const
-{
-    for (int i = 0; i < shape.triangles.size();)
+    float edge = radius * 1.41421356f;
+    for (int i = 0; i < detailFrames.size(); i++)
     {
-        Vector n = shape.triangles[i].getNormal();
-
-        Vector l = Point(0, 0, 0) - shape.triangles[i].p0;
-
-        if (n.dotProduct(l) <= 0)
+        if (edge <= DETAIL_EDGE_PIXELS)
         {
-            shape.triangles.remove(i);
-        }
-        else
-        {
-            i++;
+            return detailFrames[i];
         }
+        edge /= 2;
     }
+
+    return entity->getFrame();
 }
 
 
-void ScreenBuffer::moveOffCameraLocation(Shape & shape) const
+TransformedVertex ScreenBuffer::transformVertex(const Point & point, const Matrix & objectToClip, bool distanceShading)
 {
-    for (int i = 0; i < shape.triangles.size(); i++)
-    {
-
-        if (equalULP(shape.triangles[i].p0.z, 0)) shape.triangles[i].p0.z = -0.001;
-        if (equalULP(shape.triangles[i].p1.z, 0)) shape.triangles[i].p1.z = -0.001;
-        if (equalULP(shape.triangles[i].p2.z, 0)) shape.triangles[i].p2.z = -0.001;
-    }
-
-    for (int i = 0; i < shape.lines.size(); i++)
-    {
-        if (equalULP(shape.lines[i].p0.z, 0)) shape.lines[i].p0.z = -0.001;
-        if (equalULP(shape.lines[i].p1.z, 0)) shape.lines[i].p1.z = -0.001;
-    }
-
-    for (int i = 0; i < shape.points.size(); i++)
-    {
-        if (equalULP(shape.points[i].z, 0)) shape.points[i].z = -0.001;
-    }
+    // *= keeps the point's color, * doesn't
+    TransformedVertex vertex;
+    vertex.clip = point;
+    vertex.clip *= objectToClip;
+
+    // undo the viewing transform, see Matrix::addViewingTransform
+    vertex.camera = Point(vertex.clip.x, vertex.clip.y, -vertex.clip.w);
+    vertex.camera.m_color = vertex.clip.m_color;
+
+    // farther from the camera is darker, a fade of 1 leaves the color alone
+    vertex.distanceFade = distanceShading ? -12.0 / vertex.camera.z : 1;
+
+    const Point & c = vertex.camera;
+    vertex.inverseDistance = inverseSqrt(c.x * c.x + c.y * c.y + c.z * c.z);
+    vertex.transformed = true;
+    return vertex;
 }
 
 
-void ScreenBuffer::clipBehindCamera(Shape & shape) const
+void ScreenBuffer::drawShape(const Shape & shape, uint8_t drawProperties, const Tile & tile)
 {
-    int triangleCount = shape.triangles.size();
-    for (int i = 0; i < triangleCount;)
-    {
-        // clip triangles
-        Point & p0 = shape.triangles[i].p0;
-        Point & p1 = shape.triangles[i].p1;
-        Point & p2 = shape.triangles[i].p2;
-
-        if (p0.z > 0)
-        {
-            if (p1.z > 0)
-            {
-                if (p2.z > 0)
-                {
-                    // all vertices need to be clipped
-                    shape.triangles.remove(i);
-                    triangleCount--;
-                }
-                else
-                {
-                    // p0 and p1 need to be clipped
-
-                    // calculating a new point between p0 and p2
-                    // pNew0.x = p0.x + t * (p2.x - p0.x)
-                    // pNew0.y = p0.y + t * (p2.y - p0.y)
-                    // pNew0.z = p0.z + t * (p2.z - p0.z)
-                    // pNew0.z = 0;
-                    // t is positive because p0.z > 0 && p2.z <= 0
-                    float t02 = p0.z / (p0.z - p2.z);
-                    float x02 = p0.x + t02 * (p2.x - p0.x);
-                    float y02 = p0.y + t02 * (p2.y - p0.y);
-                    Color c02 = p0.m_color.getFade(1 - t02) + p2.m_color.getFade(t02);
-
-                    // calculating a new point between p1 and p2
-                    // t is positive because p1.z > 0 && p2.z <= 0
-                    float t12 = p1.z / (p1.z - p2.z);
-                    float x12 = p1.x + t12 * (p2.x - p1.x);
-                    float y12 = p1.y + t12 * (p2.y - p1.y);
-                    Color c12 = p1.m_color.getFade(1 - t12) + p2.m_color.getFade(t12);
-
-                    Triangle newT(Point(x02, y02, 0, c02), Point(x12, y12, 0, c12), p2);
-                    shape.triangles[i] = newT;
-                    i++;
-                }
-            }
-            else if (p2.z > 0)
-            {
-                // p0 and p2 need to be clipped
-
-                // calculating a new point between p0 and p1
-                // t is positive because p0.z > 0 && p1.z <= 0
-                float t01 = p0.z / (p0.z - p1.z);
-                float x01 = p0.x + t01 * (p1.x - p0.x);
-                float y01 = p0.y + t01 * (p1.y - p0.y);
-                Color c01 = p0.m_color.getFade(1 - t01) + p1.m_color.getFade(t01);
-
-                // calculating a new point between p2 and p1
-                // t is positive because p2.z > 0 && p1.z <= 0
-                float t21 = p2.z / (p2.z - p1.z);
-                float x21 = p2.x + t21 * (p1.x - p2.x);
-                float y21 = p2.y + t21 * (p1.y - p2.y);
-                Color c21 = p2.m_color.getFade(1 - t21) + p1.m_color.getFade(t21);
-
-                Triangle newT(Point(x01, y01, 0, c01), p1, Point(x21, y21, 0, c21));
-                shape.triangles[i] = newT;
-                i++;
-            }
-            else
-            {
-                // just p0 needs to be clipped
-
-                // calculating a new point between p0 and p1
-                // t is positive because p0.z > 0 && p1.z <= 0
-                float t01 = p0.z / (p0.z - p1.z);
-                float x01 = p0.x + t01 * (p1.x - p0.x);
-                float y01 = p0.y + t01 * (p1.y - p0.y);
-                Color c01 = p0.m_color.getFade(1 - t01) + p1.m_color.getFade(t01);
-
-                // calculating a new point between p0 and p2
-                // t is positive because p0.z > 0 && p2.z <= 0
-                float t02 = p0.z / (p0.z - p2.z);
-                float x02 = p0.x + t02 * (p2.x - p0.x);
-                float y02 = p0.y + t02 * (p2.y - p0.y);
-                Color c02 = p0.m_color.getFade(1 - t02) + p2.m_color.getFade(t02);
-
-                Triangle newTb(p1, p2, Point(x02, y02, 0, c02));
-                shape.triangles += newTb;
-                Triangle newTa(p1, Point(x02, y02, 0, c02), Point(x01, y01, 0, c01));
-                shape.triangles[i] = newTa;
-                i++;
-            }
-        }
-        else if (p1.z > 0)
-        {
-            if (p2.z > 0)
-            {
-                // p1 and p2 need to be clipped
-
-                // calculating a new point between p1 and p0
-                // t is positive because p1.z > 0 && p0.z <= 0
-                float t10 = p1.z / (p1.z - p0.z);
-                float x10 = p1.x + t10 * (p0.x - p1.x);
-                float y10 = p1.y + t10 * (p0.y - p1.y);
-                Color c10 = p1.m_color.getFade(1 - t10) + p0.m_color.getFade(t10);
-
-                // calculating a new point between p2 and p0
-                // t is positive because p2.z > 0 && p0.z <= 0
-                float t20 = p2.z / (p2.z - p0.z);
-                float x20 = p2.x + t20 * (p0.x - p2.x);
-                float y20 = p2.y + t20 * (p0.y - p2.y);
-                Color c20 = p2.m_color.getFade(1 - t20) + p0.m_color.getFade(t20);
-
-                Triangle newT(p0, Point(x10, y10, 0, c10), Point(x20, y20, 0, c20));
-                shape.triangles[i] = newT;
-                i++;
-            }
-            else
-            {
-                // just p1 needs to be clipped
-
-                // calculating a new point between p1 and p0
-                // t is positive because p1.z > 0 && p0.z <= 0
-                float t10 = p1.z / (p1.z - p0.z);
-                float x10 = p1.x + t10 * (p0.x - p1.x);
-                float y10 = p1.y + t10 * (p0.y - p1.y);
-                Color c10 = p1.m_color.getFade(1 - t10) + p0.m_color.getFade(t10);
-
-                // calculating a new point between p1 and p1
-                // t is positive because p1.z > 0 && p2.z <= 0
-                float t12 = p1.z / (p1.z - p2.z);
-                float x12 = p1.x + t12 * (p2.x - p1.x);
-                float y12 = p1.y + t12 * (p2.y - p1.y);
-                Color c12 = p1.m_color.getFade(1 - t12) + p2.m_color.getFade(t12);
-
-                Triangle newTb(p2, p0, Point(x12, y12, 0, c12));
-                shape.triangles += newTb;
-                Triangle newTa(p0, Point(x10, y10, 0, c10), Point(x12, y12, 0, c12));
-                shape.triangles[i] = newTa;
-                i++;
-            }
-        }
-        else if (p2.z > 0)
-        {
-            // just p2 needs to be clipped
-
-            // calculating a new point between p2 and p0
-            // t is positive because p2.z > 0 && p0.z <= 0
-            float t20 = p2.z / (p2.z - p0.z);
-            float x20 = p2.x + t20 * (p0.x - p2.x);
-            float y20 = p2.y + t20 * (p0.y - p2.y);
-            Color c20 = p2.m_color.getFade(1 - t20) + p0.m_color.getFade(t20);
-
-            // calculating a new point between p2 and p1
-            // t is positive because p2.z > 0 && p1.z <= 0
-            float t21 = p2.z / (p2.z - p1.z);
-            float x21 = p2.x + t21 * (p1.x - p2.x);
-            float y21 = p2.y + t21 * (p1.y - p2.y);
-            Color c21 = p2.m_color.getFade(1 - t21) + p1.m_color.getFade(t21);
-
-            Triangle newTb(p0, p1, Point(x21, y21, 0, c21));
-            shape.triangles += newTb;
-            Triangle newTa(p0, Point(x21, y21, 0, c21), Point(x20, y20, 0, c20));
-            shape.triangles[i] = newTa;
-            i++;
-        }
-        else
-        {
-            // triangle doesn't need to be clipped
-            i++;
-        }
-    }
-
-    for (int i = 0; i < shape.lines.size();)
+    if (drawProperties & DRAW_POINTS)
     {
-        Point & p0 = shape.lines[i].p0;
-        Point & p1 = shape.lines[i].p1;
-
-        // clip lines
-        if (p0.z > 0)
+        for (int i = 0; i < shape.points.size(); i++)
         {
-            if (p1.z > 0)
-            {
-                // both ends of the line need to be clipped
-                shape.lines.remove(i);
-            }
-            else
-            {
-                // p0 end of the line needs to be clipped
-                // 
-                // pNew.x = p0.x + t * (p1.x - p0.x)
-                // pNew.y = p0.y + t * (p1.y - p0.y)
-                // pNew.z = p0.z + t * (p1.z - p0.z)
-                // pNew.z = 0
-                // t is positive because p0.z > 0 && p1.z <= 0
-                float t = p0.z / (p0.z - p1.z);
-                float nX = p0.x + t * (p1.x - p0.x);
-                float nY = p0.y + t * (p1.y - p0.y);
-                Color nC = p0.m_color.getFade(1 - t) + p1.m_color.getFade(t);
-
-                Line newL(Point(nX, nY, 0, nC), p1);
-                shape.lines[i] = newL;
-                i++;
-            }
-        }
-        else if (p1.z > 0)
-        {
-            // p1 end of the line needs to be clipped
-            float t = p1.z / (p1.z - p0.z);
-            float nX = p1.x + t * (p0.x - p1.x);
-            float nY = p1.y + t * (p0.y - p1.y);
-            Color nC = p1.m_color.getFade(1 - t) + p0.m_color.getFade(t);
-
-            Line newL(p0, Point(nX, nY, 0, nC));
-            shape.lines[i] = newL;
-            i++;
-        }
-        else
-        {
-            // line doesn't need to be clipped
-            i++;
+            drawPoint3D(shape.points[i], tile);
         }
     }
-
-    for (int i = 0; i < shape.points.size();)
+    if ((drawProperties & DRAW_LINES) || drawProperties & DRAW_NORMALS)
     {
-        // clip near points
-        if (shape.points[i].z > 0)/// || equalULP(object.m_points[i].z, 0))
+        for (int i = 0; i < shape.lines.size(); i++)
         {
-            shape.points.remove(i);
-        }
-        else
-        {
-            i++;
+            drawLine3D(shape.lines[i].p0, shape.lines[i].p1, tile);
         }
     }
-}
-
-
-void ScreenBuffer::clipLeft(Shape & shape) const
-{
-    int triangleCount = shape.triangles.size();
-    for (int i = 0; i < triangleCount;)
+    if (drawProperties & DRAW_TRIANGLES)
     {
-        // clip triangles
-        Point & p0 = shape.triangles[i].p0;
-        Point & p1 = shape.triangles[i].p1;
-        Point & p2 = shape.triangles[i].p2;
-
-        if (p0.x < -1)
+        if (drawProperties & DRAW_TRIANGLE_FRAMES)
         {
-            if (p1.x < -1)
-            {
-                if (p2.x < -1)
-                {
-                    // all vertices need to be clipped
-                    shape.triangles.remove(i);
-                    triangleCount--;
-                }
-                else
-                {
-                    // p0 and p1 need to be clipped
-
-                    // calculating a new point between p0 and p2;
-                    // t is positive because p0.x < -1 && p2.x >= -1
-                    float t02 = (p0.x + 1) / (p0.x - p2.x);
-                    float y02 = p0.y + t02 * (p2.y - p0.y);
-                    float z02 = p0.z + t02 * (p2.z - p0.z);
-                    Color c02 = p0.m_color.getFade(1 - t02) + p2.m_color.getFade(t02);
-
-                    // calculating a new point between p1 and p2
-                    // t is positive because p1.x < -1 && p2.x >= -1
-                    float t12 = (p1.x + 1) / (p1.x - p2.x);
-                    float y12 = p1.y + t12 * (p2.y - p1.y);
-                    float z12 = p1.z + t12 * (p2.z - p1.z);
-                    Color c12 = p1.m_color.getFade(1 - t12) + p2.m_color.getFade(t12);
-
-                    Triangle newT(Point(-1, y02, z02, c02), Point(-1, y12, z12, c12), p2);
-                    shape.triangles[i] = newT;
-                    i++;
-                }
-            }
-            else if (p2.x < -1)
-            {
-                // p0 and p2 need to be clipped
-
-                // calculating a new point between p0 and p1
-                // t is positive because p0.x < -1 && p1.x >= -1
-                float t01 = (p0.x + 1) / (p0.x - p1.x);
-                float y01 = p0.y + t01 * (p1.y - p0.y);
-                float z01 = p0.z + t01 * (p1.z - p0.z);
-                Color c01 = p0.m_color.getFade(1 - t01) + p1.m_color.getFade(t01);
-
-                // calculating a new point between p2 and p1
-                // t is positive because p2.x < -1 && p1.x >= -1
-                float t21 = (p2.x + 1) / (p2.x - p1.x);
-                float y21 = p2.y + t21 * (p1.y - p2.y);
-                float z21 = p2.z + t21 * (p1.z - p2.z);
-                Color c21 = p2.m_color.getFade(1 - t21) + p1.m_color.getFade(t21);
-
-                Triangle newT(Point(-1, y01, z01, c01), p1, Point(-1, y21, z21, c21));
-                shape.triangles[i] = newT;
-                i++;
-            }
-            else
-            {
-                // just p0 needs to be clipped
-
-                // calculating a new point between p0 and p1
-                // t is positive because p0.x < -1 && p1.x >= -1
-                float t01 = (p0.x + 1) / (p0.x - p1.x);
-                float y01 = p0.y + t01 * (p1.y - p0.y);
-                float z01 = p0.z + t01 * (p1.z - p0.z);
-                Color c01 = p0.m_color.getFade(1 - t01) + p1.m_color.getFade(t01);
-
-                // calculating a new point between p0 and p2;
-                // t is positive because p0.x < -1 && p2.x >= -1
-                float t02 = (p0.x + 1) / (p0.x - p2.x);
-                float y02 = p0.y + t02 * (p2.y - p0.y);
-                float z02 = p0.z + t02 * (p2.z - p0.z);
-                Color c02 = p0.m_color.getFade(1 - t02) + p2.m_color.getFade(t02);
-
-                Triangle newTb(p1, p2, Point(-1, y02, z02, c02));
-                shape.triangles += newTb;
-                Triangle newTa(p1, Point(-1, y02, z02, c02), Point(-1, y01, z01, c01));
-                shape.triangles[i] = newTa;
-                i++;
-            }
-        }
-        else if (p1.x < -1)
-        {
-            if (p2.x < -1)
-            {
-                // p1 and p2 need to be clipped
-
-                // calculating a new point between p1 and p0
-                // t is positive because p1.x < -1 && p0.x >= -1
-                float t10 = (p1.x + 1) / (p1.x - p0.x);
-                float y10 = p1.y + t10 * (p0.y - p1.y);
-                float z10 = p1.z + t10 * (p0.z - p1.z);
-                Color c10 = p1.m_color.getFade(1 - t10) + p0.m_color.getFade(t10);
-
-                // calculating a new point between p2 and p0
-                // t is positive because p2.x < -1 && p0.x >= -1
-                float t20 = (p2.x + 1) / (p2.x - p0.x);
-                float y20 = p2.y + t20 * (p0.y - p2.y);
-                float z20 = p2.z + t20 * (p0.z - p2.z);
-                Color c20 = p2.m_color.getFade(1 - t20) + p0.m_color.getFade(t20);
-
-                Triangle newT(p0, Point(-1, y10, z10, c10), Point(-1, y20, z20, c20));
-                shape.triangles[i] = newT;
-                i++;
-            }
-            else
+            for (int i = 0; i < shape.triangles.size(); i++)
             {
-                // just p1 needs to be clipped
-
-                // calculating a new point between p1 and p0
-                // t is positive because p1.x < -1 && p0.x >= -1
-                float t10 = (p1.x + 1) / (p1.x - p0.x);
-                float y10 = p1.y + t10 * (p0.y - p1.y);
-                float z10 = p1.z + t10 * (p0.z - p1.z);
-                Color c10 = p1.m_color.getFade(1 - t10) + p0.m_color.getFade(t10);
-
-                // calculating a new point between p1 and p2
-                // t is positive because p1.x < -1 && p2.x >= -1
-                float t12 = (p1.x + 1) / (p1.x - p2.x);
-                float y12 = p1.y + t12 * (p2.y - p1.y);
-                float z12 = p1.z + t12 * (p2.z - p1.z);
-                Color c12 = p1.m_color.getFade(1 - t12) + p2.m_color.getFade(t12);
-
-                Triangle newTb(p2, p0, Point(-1, y12, z12, c12));
-                shape.triangles += newTb;
-                Triangle newTa(p0, Point(-1, y10, z10, c10), Point(-1, y12, z12, c12));
-                shape.triangles[i] = newTa;
-                i++;
+                const Triangle & t = shape.triangles[i];
+                drawTriangleOutline3D(t.p0, t.p1, t.p2, tile);
             }
         }
-        else if (p2.x < -1)
-        {
-            // just p2 needs to be clipped
-
-            // calculating a new point between p2 and p0
-            // t is positive because p2.x < -1 && p0.x >= -1
-            float t20 = (p2.x + 1) / (p2.x - p0.x);
-            float y20 = p2.y + t20 * (p0.y - p2.y);
-            float z20 = p2.z + t20 * (p0.z - p2.z);
-            Color c20 = p2.m_color.getFade(1 - t20) + p0.m_color.getFade(t20);
-
-            // calculating a new point between p2 and p1
-            // t is positive because p2.x < -1 && p1.x >= -1
-            float t21 = (p2.x + 1) / (p2.x - p1.x);
-            float y21 = p2.y + t21 * (p1.y - p2.y);
-            float z21 = p2.z + t21 * (p1.z - p2.z);
-            Color c21 = p2.m_color.getFade(1 - t21) + p1.m_color.getFade(t21);
-
-            Triangle newTb(p0, p1, Point(-1, y21, z21, c21));
-            shape.triangles += newTb;
-            Triangle newTa(p0, Point(-1, y21, z21, c21), Point(-1, y20, z20, c20));
-            shape.triangles[i] = newTa;
-            i++;
-        }
         else
         {
-            // triangle doesn't need to be clipped
-            i++;
-        }
-    }
-
-    for (int i = 0; i < shape.lines.size();)
-    {
-        Point & p0 = shape.lines[i].p0;
-        Point & p1 = shape.lines[i].p1;
-
-        // clip lines
-        if (p0.x < -1)
-        {
-            if (p1.x < -1)
+            for (int i = 0; i < shape.triangles.size(); i++)
             {
-                // both ends of the line need to be clipped
-                shape.lines.remove(i);
+                const Triangle & t = shape.triangles[i];
+                drawTriangle3D(t.p0, t.p1, t.p2, tile);
             }
-            else
-            {
-                // p0 end of the line needs to be clipped
-                // 
-                // pNew.x = p0.x + t * (p1.x - p0.x)
-                // pNew.y = p0.y + t * (p1.y - p0.y)
-                // pNew.z = p0.z + t * (p1.z - p0.z)
-                // pNew.x = -1
-                // t is positive because p0.x < -1 && p1.x >= -1
-                float t = (-1 - p0.x) / (p1.x - p0.x);
-                float nY = p0.y + t * (p1.y - p0.y);
-                float nZ = p0.z + t * (p1.z - p0.z);
-                Color nC = p0.m_color.getFade(1 - t) + p1.m_color.getFade(t);
-
-                Line newL(Point(-1, nY, nZ, nC), p1);
-                shape.lines[i] = newL;
-                i++;
-            }
-        }
-        else if (p1.x < -1)
-        {
-            // p1 end of the line needs to be clipped
-            float t = (-1 - p1.x) / (p0.x - p1.x);
-            float nY = p1.y + t * (p0.y - p1.y);
-            float nZ = p1.z + t * (p0.z - p1.z);
-            Color nC = p1.m_color.getFade(1 - t) + p0.m_color.getFade(t);
-
-            Line newL(p0, Point(-1, nY, nZ, nC));
-            shape.lines[i] = newL;
-            i++;
-        }
-        else
-        {
-            // line doesn't need to be clipped
-            i++;
-        }
-    }
-
-    for (int i = 0; i < shape.points.size();)
-    {
-        // clip near points
-        if (shape.points[i].x < -1)
-        {
-            shape.points.remove(i);
-        }
-        else
-        {
-            i++;
         }
     }
 }
 
 
-void ScreenBuffer::clipRight(Shape & shape) const
-{
-    int triangleCount = shape.triangles.size();
-    for (int i = 0; i < triangleCount;)
-    {
-        // clip triangles
-        Point & p0 = shape.triangles[i].p0;
-        Point & p1 = shape.triangles[i].p1;
-        Point & p2 = shape.triangles[i].p2;
-
-        if (p0.x > 1)
-        {
-            if (p1.x > 1)
-            {
-                if (p2.x > 1)
-                {
-                    // all vertices need to be clipped
-                    shape.triangles.remove(i);
-                    triangleCount--;
-                }
-                else
-                {
-                    // p0 and p1 need to be clipped
-
-                    // calculating a new point between p0 and p2;
-                    // t is positive because p0.x > 1 && p2.x <= 1
-                    float t02 = (p0.x - 1) / (p0.x - p2.x);
-                    float y02 = p0.y + t02 * (p2.y - p0.y);
-                    float z02 = p0.z + t02 * (p2.z - p0.z);
-                    Color c02 = p0.m_color.getFade(1 - t02) + p2.m_color.getFade(t02);
-
-                    // calculating a new point between p1 and p2
-                    // t is positive because p1.x > 1 && p2.x <= 1
-                    float t12 = (p1.x - 1) / (p1.x - p2.x);
-                    float y12 = p1.y + t12 * (p2.y - p1.y);
-                    float z12 = p1.z + t12 * (p2.z - p1.z);
-                    Color c12 = p1.m_color.getFade(1 - t12) + p2.m_color.getFade(t12);
-
-                    Triangle newT(Point(1, y02, z02, c02), Point(1, y12, z12, c12), p2);
-                    shape.triangles[i] = newT;
-                    i++;
-                }
-            }
-            else if (p2.x > 1)
-            {
-                // p0 and p2 need to be clipped
-
-                // calculating a new point between p0 and p1
-                // t is positive because p0.x > 1 && p1.x <= 1
-                float t01 = (p0.x - 1) / (p0.x - p1.x);
-                float y01 = p0.y + t01 * (p1.y - p0.y);
-                float z01 = p0.z + t01 * (p1.z - p0.z);
-                Color c01 = p0.m_color.getFade(1 - t01) + p1.m_color.getFade(t01);
-
-                // calculating a new point between p2 and p1
-                // t is positive because p2.x > 1 && p1.x <= 1
-                float t21 = (p2.x - 1) / (p2.x - p1.x);
-                float y21 = p2.y + t21 * (p1.y - p2.y);
-                float z21 = p2.z + t21 * (p1.z - p2.z);
-                Color c21 = p2.m_color.getFade(1 - t21) + p1.m_color.getFade(t21);
-
-                Triangle newT(Point(1, y01, z01, c01), p1, Point(1, y21, z21, c21));
-                shape.triangles[i] = newT;
-                i++;
-            }
-            else
-            {
-                // just p0 needs to be clipped
-
-                // calculating a new point between p0 and p1
-                // t is positive because p0.x > 1 && p1.x <= 1
-                float t01 = (p0.x - 1) / (p0.x - p1.x);
-                float y01 = p0.y + t01 * (p1.y - p0.y);
-                float z01 = p0.z + t01 * (p1.z - p0.z);
-                Color c01 = p0.m_color.getFade(1 - t01) + p1.m_color.getFade(t01);
-
-                // calculating a new point between p0 and p2;
-                // t is positive because p0.x > 1 && p2.x <= 1
-                float t02 = (p0.x - 1) / (p0.x - p2.x);
-                float y02 = p0.y + t02 * (p2.y - p0.y);
-                float z02 = p0.z + t02 * (p2.z - p0.z);
-                Color c02 = p0.m_color.getFade(1 - t02) + p2.m_color.getFade(t02);
-
-                Triangle newTb(p1, p2, Point(1, y02, z02, c02));
-                shape.triangles += newTb;
-                Triangle newTa(p1, Point(1, y02, z02, c02), Point(1, y01, z01, c01));
-                shape.triangles[i] = newTa;
-                i++;
-            }
-        }
-        else if (p1.x > 1)
-        {
-            if (p2.x > 1)
-            {
-                // p1 and p2 need to be clipped
-
-                // calculating a new point between p1 and p0
-                // t is positive because p1.x > 1 && p0.x <= 1
-                float t10 = (p1.x - 1) / (p1.x - p0.x);
-                float y10 = p1.y + t10 * (p0.y - p1.y);
-                float z10 = p1.z + t10 * (p0.z - p1.z);
-                Color c10 = p1.m_color.getFade(1 - t10) + p0.m_color.getFade(t10);
-
-                // calculating a new point between p2 and p0
-                // t is positive because p2.x > 1 && p0.x <= 1
-                float t20 = (p2.x - 1) / (p2.x - p0.x);
-                float y20 = p2.y + t20 * (p0.y - p2.y);
-                float z20 = p2.z + t20 * (p0.z - p2.z);
-                Color c20 = p2.m_color.getFade(1 - t20) + p0.m_color.getFade(t20);
-
-                Triangle newT(p0, Point(1, y10, z10, c10), Point(1, y20, z20, c20));
-                shape.triangles[i] = newT;
-                i++;
-            }
-            else
-            {
-                // just p1 needs to be clipped
-
-                // calculating a new point between p1 and p0
-                // t is positive because p1.x > 1 && p0.x <= 1
-                float t10 = (p1.x - 1) / (p1.x - p0.x);
-                float y10 = p1.y + t10 * (p0.y - p1.y);
-                float z10 = p1.z + t10 * (p0.z - p1.z);
-                Color c10 = p1.m_color.getFade(1 - t10) + p0.m_color.getFade(t10);
-
-                // calculating a new point between p1 and p2
-                // t is positive because p1.x > 1 && p2.x <= 1
-                float t12 = (p1.x - 1) / (p1.x - p2.x);
-                float y12 = p1.y + t12 * (p2.y - p1.y);
-                float z12 = p1.z + t12 * (p2.z - p1.z);
-                Color c12 = p1.m_color.getFade(1 - t12) + p2.m_color.getFade(t12);
-
-                Triangle newTb(p2, p0, Point(1, y12, z12, c12));
-                shape.triangles += newTb;
-                Triangle newTa(p0, Point(1, y10, z10, c10), Point(1, y12, z12, c12));
-                shape.triangles[i] = newTa;
-                i++;
-            }
-        }
-        else if (p2.x > 1)
-        {
-            // just p2 needs to be clipped
-
-            // calculating a new point between p2 and p0
-            // t is positive because p2.x > 1 && p0.x <= 1
-            float t20 = (p2.x - 1) / (p2.x - p0.x);
-            float y20 = p2.y + t20 * (p0.y - p2.y);
-            float z20 = p2.z + t20 * (p0.z - p2.z);
-            Color c20 = p2.m_color.getFade(1 - t20) + p0.m_color.getFade(t20);
-
-            // calculating a new point between p2 and p1
-            // t is positive because p2.x > 1 && p1.x <= 1
-            float t21 = (p2.x - 1) / (p2.x - p1.x);
-            float y21 = p2.y + t21 * (p1.y - p2.y);
-            float z21 = p2.z + t21 * (p1.z - p2.z);
-            Color c21 = p2.m_color.getFade(1 - t21) + p1.m_color.getFade(t21);
-
-            Triangle newTb(p0, p1, Point(1, y21, z21, c21));
-            shape.triangles += newTb;
-            Triangle newTa(p0, Point(1, y21, z21, c21), Point(1, y20, z20, c20));
-            shape.triangles[i] = newTa;
-            i++;
-        }
-        else
-        {
-            // triangle doesn't need to be clipped
-            i++;
-        }
-    }
-
-    for (int i = 0; i < shape.lines.size();)
-    {
-        Point & p0 = shape.lines[i].p0;
-        Point & p1 = shape.lines[i].p1;
-
-        // clip lines
-        if (p0.x > 1)
-        {
-            if (p1.x > 1)
-            {
-                // both ends of the line need to be clipped
-                shape.lines.remove(i);
-            }
-            else
-            {
-                // p0 end of the line needs to be clipped
-                // 
-                // pNew.x = p0.x + t * (p1.x - p0.x)
-                // pNew.y = p0.y + t * (p1.y - p0.y)
-                // pNew.z = p0.z + t * (p1.z - p0.z)
-                // pNew.x = 1
-                // t is positive because p0.x > 1 && p1.x <= 1
-                float t = (p0.x - 1) / (p0.x - p1.x);
-                float nY = p0.y + t * (p1.y - p0.y);
-                float nZ = p0.z + t * (p1.z - p0.z);
-                Color nC = p0.m_color.getFade(1 - t) + p1.m_color.getFade(t);
-
-                Line newL(Point(1, nY, nZ, nC), p1);
-                shape.lines[i] = newL;
-                i++;
-            }
-        }
-        else if (p1.x > 1)
-        {
-            // p1 end of the line needs to be clipped
-            float t = (p1.x - 1) / (p1.x - p0.x);
-            float nY = p1.y + t * (p0.y - p1.y);
-            float nZ = p1.z + t * (p0.z - p1.z);
-            Color nC = p1.m_color.getFade(1 - t) + p0.m_color.getFade(t);
-
-            Line newL(p0, Point(1, nY, nZ, nC));
-            shape.lines[i] = newL;
-            i++;
-        }
-        else
+void ScreenBuffer::binShape(unsigned shapeIndex, const Shape & shape, uint8_t drawProperties)
+{
+    int x0, y0, x1, y1, x2, y2;
+
+    if (drawProperties & DRAW_POINTS)
+    {
+        for (int i = 0; i < shape.points.size(); i++)
         {
-            // line doesn't need to be clipped
-            i++;
+            getPixelCoordinates(shape.points[i], x0, y0);
+            binPrimitive(BinnedPrimitive(shapeIndex, i, PT_POINT), x0, y0, x0, y0);
         }
     }
-
-    for (int i = 0; i < shape.points.size();)
+    if ((drawProperties & DRAW_LINES) || drawProperties & DRAW_NORMALS)
     {
-        // clip near points
-        if (shape.points[i].x > 1)
+        for (int i = 0; i < shape.lines.size(); i++)
         {
-            shape.points.remove(i);
+            getPixelCoordinates(shape.lines[i].p0, x0, y0);
+            getPixelCoordinates(shape.lines[i].p1, x1, y1);
+            binPrimitive(BinnedPrimitive(shapeIndex, i, PT_LINE), MIN(x0, x1), MIN(y0, y1), MAX(x0, x1), MAX(y0, y1));
         }
-        else
+    }
+    if (drawProperties & DRAW_TRIANGLES)
+    {
+        PrimitiveType type = (drawProperties & DRAW_TRIANGLE_FRAMES) ? PT_TRIANGLE_OUTLINE : PT_TRIANGLE;
+        for (int i = 0; i < shape.triangles.size(); i++)
         {
-            i++;
+            getPixelCoordinates(shape.triangles[i].p0, x0, y0);
+            getPixelCoordinates(shape.triangles[i].p1, x1, y1);
+            getPixelCoordinates(shape.triangles[i].p2, x2, y2);
+            binPrimitive(BinnedPrimitive(shapeIndex, i, type),
+                MIN(x0, MIN(x1, x2)), MIN(y0, MIN(y1, y2)),
+                MAX(x0, MAX(x1, x2)), MAX(y0, MAX(y1, y2)));
         }
     }
 }
 
 
-void ScreenBuffer::clipBottom(Shape & shape) const
+void ScreenBuffer::binPrimitive(const BinnedPrimitive & primitive, int minX, int minY, int maxX, int maxY)
 {
-    int triangleCount = shape.triangles.size();
-    for (int i = 0; i < triangleCount;)
+    Tile drawable = getDrawableTile();
+    minX = MAX(minX, drawable.minX);
+    minY = MAX(minY, drawable.minY);
+    maxX = MIN(maxX, drawable.maxX);
+    maxY = MIN(maxY, drawable.maxY);
+
+    // completely off screen
+    if (minX > maxX || minY > maxY)
     {
-        // clip triangles
-        Point & p0 = shape.triangles[i].p0;
-        Point & p1 = shape.triangles[i].p1;
-        Point & p2 = shape.triangles[i].p2;
+        return;
+    }
 
-        if (p0.y < -1)
-        {
-            if (p1.y < -1)
-            {
-                if (p2.y < -1)
-                {
-                    // all vertices need to be clipped
-                    shape.triangles.remove(i);
-                    triangleCount--;
-                }
-                else
-                {
-                    // p0 and p1 need to be clipped
-
-                    // calculating a new point between p0 and p2;
-                    // t is positive because p0.y < -1 && p2.y >= -1
-                    float t02 = (p0.y + 1) / (p0.y - p2.y);
-                    float x02 = p0.x + t02 * (p2.x - p0.x);
-                    float z02 = p0.z + t02 * (p2.z - p0.z);
-                    Color c02 = p0.m_color.getFade(1 - t02) + p2.m_color.getFade(t02);
-
-                    // calculating a new point between p1 and p2
-                    // t is positive because p1.y < -1 && p2.y >= -1
-                    float t12 = (p1.y + 1) / (p1.y - p2.y);
-                    float x12 = p1.x + t12 * (p2.x - p1.x);
-                    float z12 = p1.z + t12 * (p2.z - p1.z);
-                    Color c12 = p1.m_color.getFade(1 - t12) + p2.m_color.getFade(t12);
-
-                    Triangle newT(Point(x02, -1, z02, c02), Point(x12, -1, z12, c12), p2);
-                    shape.triangles[i] = newT;
-                    i++;
-                }
-            }
-            else if (p2.y < -1)
-            {
-                // p0 and p2 need to be clipped
-
-                // calculating a new point between p0 and p1
-                // t is positive because p0.y < -1 && p1.y >= -1
-                float t01 = (p0.y + 1) / (p0.y - p1.y);
-                float x01 = p0.x + t01 * (p1.x - p0.x);
-                float z01 = p0.z + t01 * (p1.z - p0.z);
-                Color c01 = p0.m_color.getFade(1 - t01) + p1.m_color.getFade(t01);
-
-                // calculating a new point between p2 and p1
-                // t is positive because p2.y < -1 && p1.y >= -1
-                float t21 = (p2.y + 1) / (p2.y - p1.y);
-                float x21 = p2.x + t21 * (p1.x - p2.x);
-                float z21 = p2.z + t21 * (p1.z - p2.z);
-                Color c21 = p2.m_color.getFade(1 - t21) + p1.m_color.getFade(t21);
-
-                Triangle newT(Point(x01, -1, z01, c01), p1, Point(x21, -1, z21, c21));
-                shape.triangles[i] = newT;
-                i++;
-            }
-            else
-            {
-                // just p0 needs to be clipped
-
-                // calculating a new point between p0 and p1
-                // t is positive because p0.y < -1 && p1.y >= -1
-                float t01 = (p0.y + 1) / (p0.y - p1.y);
-                float x01 = p0.x + t01 * (p1.x - p0.x);
-                float z01 = p0.z + t01 * (p1.z - p0.z);
-                Color c01 = p0.m_color.getFade(1 - t01) + p1.m_color.getFade(t01);
-
-                // calculating a new point between p0 and p2;
-                // t is positive because p0.y < -1 && p2.y >= -1
-                float t02 = (p0.y + 1) / (p0.y - p2.y);
-                float x02 = p0.x + t02 * (p2.x - p0.x);
-                float z02 = p0.z + t02 * (p2.z - p0.z);
-                Color c02 = p0.m_color.getFade(1 - t02) + p2.m_color.getFade(t02);
-
-                Triangle newTb(p1, p2, Point(x02, -1, z02, c02));
-                shape.triangles += newTb;
-                Triangle newTa(p1, Point(x02, -1, z02, c02), Point(x01, -1, z01, c01));
-                shape.triangles[i] = newTa;
-                i++;
-            }
-        }
-        else if (p1.y < -1)
+    for (int row = minY / TILE_SIZE; row <= maxY / TILE_SIZE; row++)
+    {
+        for (int column = minX / TILE_SIZE; column <= maxX / TILE_SIZE; column++)
         {
-            if (p2.y < -1)
-            {
-                // p1 and p2 need to be clipped
-
-                // calculating a new point between p1 and p0
-                // t is positive because p1.y < -1 && p0.y >= -1
-                float t10 = (p1.y + 1) / (p1.y - p0.y);
-                float x10 = p1.x + t10 * (p0.x - p1.x);
-                float z10 = p1.z + t10 * (p0.z - p1.z);
-                Color c10 = p1.m_color.getFade(1 - t10) + p0.m_color.getFade(t10);
-
-                // calculating a new point between p2 and p0
-                // t is positive because p2.y < -1 && p0.y >= -1
-                float t20 = (p2.y + 1) / (p2.y - p0.y);
-                float x20 = p2.x + t20 * (p0.x - p2.x);
-                float z20 = p2.z + t20 * (p0.z - p2.z);
-                Color c20 = p2.m_color.getFade(1 - t20) + p0.m_color.getFade(t20);
-
-                Triangle newT(p0, Point(x10, -1, z10, c10), Point(x20, -1, z20, c20));
-                shape.triangles[i] = newT;
-                i++;
-            }
-            else
-            {
-                // just p1 needs to be clipped
-
-                // calculating a new point between p1 and p0
-                // t is positive because p1.y < -1 && p0.y >= -1
-                float t10 = (p1.y + 1) / (p1.y - p0.y);
-                float x10 = p1.x + t10 * (p0.x - p1.x);
-                float z10 = p1.z + t10 * (p0.z - p1.z);
-                Color c10 = p1.m_color.getFade(1 - t10) + p0.m_color.getFade(t10);
-
-                // calculating a new point between p1 and p2
-                // t is positive because p1.y < -1 && p2.y >= -1
-                float t12 = (p1.y + 1) / (p1.y - p2.y);
-                float x12 = p1.x + t12 * (p2.x - p1.x);
-                float z12 = p1.z + t12 * (p2.z - p1.z);
-                Color c12 = p1.m_color.getFade(1 - t12) + p2.m_color.getFade(t12);
-
-                Triangle newTb(p2, p0, Point(x12, -1, z12, c12));
-                shape.triangles += newTb;
-                Triangle newTa(p0, Point(x10, -1, z10, c10), Point(x12, -1, z12, c12));
-                shape.triangles[i] = newTa;
-                i++;
-            }
+            m_tileBins[column + row * m_tileColumns] += primitive;
         }
-        else if (p2.y < -1)
-        {
-            // just p2 needs to be clipped
+    }
+}
 
-            // calculating a new point between p2 and p0
-            // t is positive because p2.y < -1 && p0.y >= -1
-            float t20 = (p2.y + 1) / (p2.y - p0.y);
-            float x20 = p2.x + t20 * (p0.x - p2.x);
-            float z20 = p2.z + t20 * (p0.z - p2.z);
-            Color c20 = p2.m_color.getFade(1 - t20) + p0.m_color.getFade(t20);
 
-            // calculating a new point between p2 and p1
-            // t is positive because p2.y < -1 && p1.y >= -1
-            float t21 = (p2.y + 1) / (p2.y - p1.y);
-            float x21 = p2.x + t21 * (p1.x - p2.x);
-            float z21 = p2.z + t21 * (p1.z - p2.z);
-            Color c21 = p2.m_color.getFade(1 - t21) + p1.m_color.getFade(t21);
+void ScreenBuffer::updateTileGrid()
+{
+    int tileColumns = (m_width + TILE_SIZE - 1) / TILE_SIZE;
+    int tileRows = (m_height + TILE_SIZE - 1) / TILE_SIZE;
 
-            Triangle newTb(p0, p1, Point(x21, -1, z21, c21));
-            shape.triangles += newTb;
-            Triangle newTa(p0, Point(x21, -1, z21, c21), Point(x20, -1, z20, c20));
-            shape.triangles[i] = newTa;
-            i++;
-        }
-        else
-        {
-            // triangle doesn't need to be clipped
-            i++;
-        }
+    if (tileColumns != m_tileColumns || tileRows != m_tileRows)
+    {
+        delete[] m_tileBins;
+        m_tileColumns = tileColumns;
+        m_tileRows = tileRows;
+        m_tileBins = new Array<BinnedPrimitive>[m_tileColumns * m_tileRows];
     }
 
-    for (int i = 0; i < shape.lines.size();)
+    for (int i = 0; i < m_tileColumns * m_tileRows; i++)
     {
-        Point & p0 = shape.lines[i].p0;
-        Point & p1 = shape.lines[i].p1;
+        m_tileBins[i].clear();
+    }
+}
 
-        // clip lines
-        if (p0.y < -1)
-        {
-            if (p1.y < -1)
-            {
-                // both ends of the line need to be clipped
-                shape.lines.remove(i);
-            }
-            else
-            {
-                // p0 end of the line needs to be clipped
-                // 
-                // pNew.x = p0.x + t * (p1.x - p0.x)
-                // pNew.y = p0.y + t * (p1.y - p0.y)
-                // pNew.z = p0.z + t * (p1.z - p0.z)
-                // pNew.y = -1
-                // t is positive because p0.y < -1 && p1.y >= -1
-                float t = (-1 - p0.y) / (p1.y - p0.y);
-                float nX = p0.x + t * (p1.x - p0.x);
-                float nZ = p0.z + t * (p1.z - p0.z);
-                Color nC = p0.m_color.getFade(1 - t) + p1.m_color.getFade(t);
-
-                Line newL(Point(nX, -1, nZ, nC), p1);
-                shape.lines[i] = newL;
-                i++;
-            }
-        }
-        else if (p1.y < -1)
-        {
-            // p1 end of the line needs to be clipped
-            float t = (-1 - p1.y) / (p0.y - p1.y);
-            float nX = p1.x + t * (p0.x - p1.x);
-            float nZ = p1.z + t * (p0.z - p1.z);
-            Color nC = p1.m_color.getFade(1 - t) + p0.m_color.getFade(t);
 
-            Line newL(p0, Point(nX, -1, nZ, nC));
-            shape.lines[i] = newL;
-            i++;
-        }
-        else
-        {
-            // line doesn't need to be clipped
-            i++;
-        }
-    }
+DepthSortKey ScreenBuffer::getDepthSortKey(const Entity * entity, unsigned index, const Camera & camera, const Matrix & cameraTransform)
+{
+    // the camera looks down -z
+    Point center = entity->locationPoint;
+    center *= cameraTransform;
 
-    for (int i = 0; i < shape.points.size();)
+    DepthSortKey key;
+    key.depth = -center.z;
+    key.index = index;
+
+    // Something the camera is inside of, like the border, is seen from the
+    // inside, so it's behind everything else in it.
+    if (entity->drawRadius >= 0)
     {
-        // clip near points
-        if (shape.points[i].y < -1)
-        {
-            shape.points.remove(i);
-        }
-        else
+        Vector toCamera = camera.cameraLocation - entity->locationPoint;
+        if (toCamera.dotProduct(toCamera) < entity->drawRadius * entity->drawRadius)
         {
-            i++;
+            key.depth += entity->drawRadius;
         }
     }
+
+    return key;
 }
 
 
-void ScreenBuffer::clipTop(Shape & shape) const
+void ScreenBuffer::sortByDepth(Array<DepthSortKey> & keys)
 {
-    int triangleCount = shape.triangles.size();
-    for (int i = 0; i < triangleCount;)
-    {
-        // clip triangles
-        Point & p0 = shape.triangles[i].p0;
-        Point & p1 = shape.triangles[i].p1;
-        Point & p2 = shape.triangles[i].p2;
+    // bottom up, merging runs back and forth between the two arrays
+    Array<DepthSortKey> other = keys;
+    Array<DepthSortKey> * from = &keys;
+    Array<DepthSortKey> * to = &other;
 
-        if (p0.y > 1)
+    int count = keys.size();
+    for (int width = 1; width < count; width *= 2)
+    {
+        for (int start = 0; start < count; start += 2 * width)
         {
-            if (p1.y > 1)
+            int middle = MIN(start + width, count);
+            int end = MIN(start + 2 * width, count);
+
+            int left = start;
+            int right = middle;
+            for (int i = start; i < end; i++)
             {
-                if (p2.y > 1)
+                // <= keeps entities at the same depth in order
+                if (left < middle && (right >= end || (*from)[left].depth <= (*from)[right].depth))
                 {
-                    // all vertices need to be clipped
-                    shape.triangles.remove(i);
-                    triangleCount--;
+                    (*to)[i] = (*from)[left++];
                 }
                 else
                 {
-                    // p0 and p1 need to be clipped
-
-                    // calculating a new point between p0 and p2;
-                    // t is positive because p0.y > 1 && p2.y <= 1
-                    float t02 = (p0.y - 1) / (p0.y - p2.y);
-                    float x02 = p0.x + t02 * (p2.x - p0.x);
-                    float z02 = p0.z + t02 * (p2.z - p0.z);
-                    Color c02 = p0.m_color.getFade(1 - t02) + p2.m_color.getFade(t02);
-
-                    // calculating a new point between p1 and p2
-                    // t is positive because p1.y > 1 && p2.y <= 1
-                    float t12 = (p1.y - 1) / (p1.y - p2.y);
-                    float x12 = p1.x + t12 * (p2.x - p1.x);
-                    float z12 = p1.z + t12 * (p2.z - p1.z);
-                    Color c12 = p1.m_color.getFade(1 - t12) + p2.m_color.getFade(t12);
-
-                    Triangle newT(Point(x02, 1, z02, c02), Point(x12, 1, z12, c12), p2);
-                    shape.triangles[i] = newT;
-                    i++;
+                    (*to)[i] = (*from)[right++];
                 }
             }
-            else if (p2.y > 1)
-            {
-                // p0 and p2 need to be clipped
-
-                // calculating a new point between p0 and p1
-                // t is positive because p0.y > 1 && p1.y <= 1
-                float t01 = (p0.y - 1) / (p0.y - p1.y);
-                float x01 = p0.x + t01 * (p1.x - p0.x);
-                float z01 = p0.z + t01 * (p1.z - p0.z);
-                Color c01 = p0.m_color.getFade(1 - t01) + p1.m_color.getFade(t01);
-
-                // calculating a new point between p2 and p1
-                // t is positive because p2.y > 1 && p1.y <= 1
-                float t21 = (p2.y - 1) / (p2.y - p1.y);
-                float x21 = p2.x + t21 * (p1.x - p2.x);
-                float z21 = p2.z + t21 * (p1.z - p2.z);
-                Color c21 = p2.m_color.getFade(1 - t21) + p1.m_color.getFade(t21);
-
-                Triangle newT(Point(x01, 1, z01, c01), p1, Point(x21, 1, z21, c21));
-                shape.triangles[i] = newT;
-                i++;
-            }
-            else
-            {
-                // just p0 needs to be clipped
-
-                // calculating a new point between p0 and p1
-                // t is positive because p0.y > 1 && p1.y <= 1
-                float t01 = (p0.y - 1) / (p0.y - p1.y);
-                float x01 = p0.x + t01 * (p1.x - p0.x);
-                float z01 = p0.z + t01 * (p1.z - p0.z);
-                Color c01 = p0.m_color.getFade(1 - t01) + p1.m_color.getFade(t01);
-
-                // calculating a new point between p0 and p2;
-                // t is positive because p0.y > 1 && p2.y <= 1
-                float t02 = (p0.y - 1) / (p0.y - p2.y);
-                float x02 = p0.x + t02 * (p2.x - p0.x);
-                float z02 = p0.z + t02 * (p2.z - p0.z);
-                Color c02 = p0.m_color.getFade(1 - t02) + p2.m_color.getFade(t02);
-
-                Triangle newTb(p1, p2, Point(x02, 1, z02, c02));
-                shape.triangles += newTb;
-                Triangle newTa(p1, Point(x02, 1, z02, c02), Point(x01, 1, z01, c01));
-                shape.triangles[i] = newTa;
-                i++;
-            }
         }
-        else if (p1.y > 1)
-        {
-            if (p2.y > 1)
-            {
-                // p1 and p2 need to be clipped
-
-                // calculating a new point between p1 and p0
-                // t is positive because p1.y > 1 && p0.y <= 1
-                float t10 = (p1.y - 1) / (p1.y - p0.y);
-                float x10 = p1.x + t10 * (p0.x - p1.x);
-                float z10 = p1.z + t10 * (p0.z - p1.z);
-                Color c10 = p1.m_color.getFade(1 - t10) + p0.m_color.getFade(t10);
-
-                // calculating a new point between p2 and p0
-                // t is positive because p2.y > 1 && p0.y <= 1
-                float t20 = (p2.y - 1) / (p2.y - p0.y);
-                float x20 = p2.x + t20 * (p0.x - p2.x);
-                float z20 = p2.z + t20 * (p0.z - p2.z);
-                Color c20 = p2.m_color.getFade(1 - t20) + p0.m_color.getFade(t20);
-
-                Triangle newT(p0, Point(x10, 1, z10, c10), Point(x20, 1, z20, c20));
-                shape.triangles[i] = newT;
-                i++;
-            }
-            else
-            {
-                // just p1 needs to be clipped
-
-                // calculating a new point between p1 and p0
-                // t is positive because p1.y > 1 && p0.y <= 1
-                float t10 = (p1.y - 1) / (p1.y - p0.y);
-                float x10 = p1.x + t10 * (p0.x - p1.x);
-                float z10 = p1.z + t10 * (p0.z - p1.z);
-                Color c10 = p1.m_color.getFade(1 - t10) + p0.m_color.getFade(t10);
-
-                // calculating a new point between p1 and p2
-                // t is positive because p1.y > 1 && p2.y <= 1
-                float t12 = (p1.y - 1) / (p1.y - p2.y);
-                float x12 = p1.x + t12 * (p2.x - p1.x);
-                float z12 = p1.z + t12 * (p2.z - p1.z);
-                Color c12 = p1.m_color.getFade(1 - t12) + p2.m_color.getFade(t12);
-
-                Triangle newTb(p2, p0, Point(x12, 1, z12, c12));
-                shape.triangles += newTb;
-                Triangle newTa(p0, Point(x10, 1, z10, c10), Point(x12, 1, z12, c12));
-                shape.triangles[i] = newTa;
-                i++;
-            }
-        }
-        else if (p2.y > 1)
-        {
-            // just p2 needs to be clipped
 
-            // calculating a new point between p2 and p0
-            // t is positive because p2.y > 1 && p0.y <= 1
-            float t20 = (p2.y - 1) / (p2.y - p0.y);
-            float x20 = p2.x + t20 * (p0.x - p2.x);
-            float z20 = p2.z + t20 * (p0.z - p2.z);
-            Color c20 = p2.m_color.getFade(1 - t20) + p0.m_color.getFade(t20);
+        Array<DepthSortKey> * swap = from;
+        from = to;
+        to = swap;
+    }
+
+    if (from != &keys)
+    {
+        keys = *from;
+    }
+}
 
-            // calculating a new point between p2 and p1
-            // t is positive because p2.y > 1 && p1.y <= 1
-            float t21 = (p2.y - 1) / (p2.y - p1.y);
-            float x21 = p2.x + t21 * (p1.x - p2.x);
-            float z21 = p2.z + t21 * (p1.z - p2.z);
-            Color c21 = p2.m_color.getFade(1 - t21) + p1.m_color.getFade(t21);
 
-            Triangle newTb(p0, p1, Point(x21, 1, z21, c21));
-            shape.triangles += newTb;
-            Triangle newTa(p0, Point(x21, 1, z21, c21), Point(x20, 1, z20, c20));
-            shape.triangles[i] = newTa;
-            i++;
-        }
-        else
+void ScreenBuffer::resizeDirtyTiles()
+{
+    delete[] m_sceneDirtyTiles;
+    delete[] m_frameDirtyTiles;
+
+    int sceneTiles = ((m_sceneWidth + TILE_SIZE - 1) / TILE_SIZE) * ((m_sceneHeight + TILE_SIZE - 1) / TILE_SIZE);
+    m_sceneDirtyTiles = new bool[sceneTiles];
+    for (int i = 0; i < sceneTiles; i++)
+    {
+        m_sceneDirtyTiles[i] = false;
+    }
+
+    m_frameDirtyTiles = 0;
+    if (m_sceneWidth != m_fullWidth || m_sceneHeight != m_fullHeight)
+    {
+        int frameTiles = ((m_fullWidth + TILE_SIZE - 1) / TILE_SIZE) * ((m_fullHeight + TILE_SIZE - 1) / TILE_SIZE);
+        m_frameDirtyTiles = new bool[frameTiles];
+        for (int i = 0; i < frameTiles; i++)
         {
-            // triangle doesn't need to be clipped
-            i++;
+            m_frameDirtyTiles[i] = false;
         }
     }
 
-    for (int i = 0; i < shape.lines.size();)
+    setDrawTarget(m_drawingScene);
+
+    // the new buffers haven't been cleared at all
+    m_clearEverything = true;
+}
+
+
+void ScreenBuffer::setDrawTarget(bool scene)
+{
+    // a scene at the full size is drawn right on the frame
+    bool scaled = m_sceneWidth != m_fullWidth || m_sceneHeight != m_fullHeight;
+    m_drawingScene = scene;
+    if (scene && scaled)
+    {
+        m_memory = m_sceneMemory;
+        m_width = m_sceneWidth;
+        m_height = m_sceneHeight;
+        m_dirtyTiles = m_sceneDirtyTiles;
+    }
+    else
     {
-        Point & p0 = shape.lines[i].p0;
-        Point & p1 = shape.lines[i].p1;
+        m_memory = m_frameMemory;
+        m_width = m_fullWidth;
+        m_height = m_fullHeight;
+        m_dirtyTiles = scaled ? m_frameDirtyTiles : m_sceneDirtyTiles;
+    }
+    m_dirtyTileColumns = (m_width + TILE_SIZE - 1) / TILE_SIZE;
+    m_dirtyTileRows = (m_height + TILE_SIZE - 1) / TILE_SIZE;
+}
+
 
-        // clip lines
-        if (p0.y > 1)
+void ScreenBuffer::stretchScene()
+{
+    int width = m_fullWidth;
+    int height = m_fullHeight;
+    int sceneWidth = m_sceneWidth;
+
+    // 16.16 fixed point steps through the scene for every frame pixel
+    unsigned xStep = (m_sceneWidth << 16) / width;
+    unsigned yStep = (m_sceneHeight << 16) / height;
+
+    int lastSceneY = -1;
+    for (int y = 0; y < height; y++)
+    {
+        uint32_t * destination = m_frameMemory + y * width;
+        int sceneY = (y * yStep) >> 16;
+        if (sceneY == lastSceneY)
         {
-            if (p1.y > 1)
-            {
-                // both ends of the line need to be clipped
-                shape.lines.remove(i);
-            }
-            else
+            // same scene row as the frame row before it
+            const uint32_t * source = destination - width;
+            for (int x = 0; x < width; x++)
             {
-                // p0 end of the line needs to be clipped
-                // 
-                // pNew.x = p0.x + t * (p1.x - p0.x)
-                // pNew.y = p0.y + t * (p1.y - p0.y)
-                // pNew.z = p0.z + t * (p1.z - p0.z)
-                // pNew.y = 1
-                // t is positive because p0.y > 1 && p1.y <= 1
-                float t = (p0.y - 1) / (p0.y - p1.y);
-                float nX = p0.x + t * (p1.x - p0.x);
-                float nZ = p0.z + t * (p1.z - p0.z);
-                Color nC = p0.m_color.getFade(1 - t) + p1.m_color.getFade(t);
-
-                Line newL(Point(nX, 1, nZ, nC), p1);
-                shape.lines[i] = newL;
-                i++;
+                destination[x] = source[x];
             }
+            continue;
         }
-        else if (p1.y > 1)
-        {
-            // p1 end of the line needs to be clipped
-            float t = (p1.y - 1) / (p1.y - p0.y);
-            float nX = p1.x + t * (p0.x - p1.x);
-            float nZ = p1.z + t * (p0.z - p1.z);
-            Color nC = p1.m_color.getFade(1 - t) + p0.m_color.getFade(t);
+        lastSceneY = sceneY;
 
-            Line newL(p0, Point(nX, 1, nZ, nC));
-            shape.lines[i] = newL;
-            i++;
-        }
-        else
+        const uint32_t * source = m_sceneMemory + sceneY * sceneWidth;
+        unsigned sceneX = 0;
+        for (int x = 0; x < width; x++)
         {
-            // line doesn't need to be clipped
-            i++;
+            destination[x] = source[sceneX >> 16];
+            sceneX += xStep;
         }
     }
+}
+
 
-    for (int i = 0; i < shape.points.size();)
+void ScreenBuffer::resetDepthEpochs()
+{
+    // epoch 0 is never current, clear moves on to 1 after this. There's
+    // room for the full size, whatever's being drawn to.
+    int count = m_fullWidth * m_fullHeight;
+    fillRow((uint32_t *)m_depthEpochs, 0, count / 4, true);
+    for (int i = count & ~3; i < count; i++)
     {
-        // clip near points
-        if (shape.points[i].y > 1)
-        {
-            shape.points.remove(i);
-        }
-        else
+        m_depthEpochs[i] = 0;
+    }
+    m_depthEpoch = 0;
+}
+
+
+void ScreenBuffer::resizeHierarchicalZ()
+{
+    delete[] m_hiZBlocks;
+    delete[] m_hiZTiles;
+    delete[] m_hiZTileChanged;
+
+    // only the scene is drawn in 3D
+    m_hiZBlockColumns = (m_sceneWidth + HIZ_BLOCK_SIZE - 1) / HIZ_BLOCK_SIZE;
+    m_hiZBlockRows = (m_sceneHeight + HIZ_BLOCK_SIZE - 1) / HIZ_BLOCK_SIZE;
+    m_hiZBlocks = new float[m_hiZBlockColumns * m_hiZBlockRows];
+
+    m_hiZTileColumns = (m_sceneWidth + TILE_SIZE - 1) / TILE_SIZE;
+    m_hiZTileRows = (m_sceneHeight + TILE_SIZE - 1) / TILE_SIZE;
+    m_hiZTiles = new float[m_hiZTileColumns * m_hiZTileRows];
+    m_hiZTileChanged = new bool[m_hiZTileColumns * m_hiZTileRows];
+
+    // same as clear's default, the new z buffer hasn't been cleared yet
+    clearHierarchicalZ(-1000000);
+}
+
+
+void ScreenBuffer::clearHierarchicalZ(float w)
+{
+    for (int i = 0; i < m_hiZBlockColumns * m_hiZBlockRows; i++)
+    {
+        m_hiZBlocks[i] = w;
+    }
+
+    for (int i = 0; i < m_hiZTileColumns * m_hiZTileRows; i++)
+    {
+        m_hiZTiles[i] = w;
+        m_hiZTileChanged[i] = false;
+    }
+}
+
+
+float ScreenBuffer::getHiZTile(int column, int row)
+{
+    int index = column + row * m_hiZTileColumns;
+    if (m_hiZTileChanged[index])
+    {
+        int blocksPerTile = TILE_SIZE / HIZ_BLOCK_SIZE;
+        int minColumn = column * blocksPerTile;
+        int minRow = row * blocksPerTile;
+        int maxColumn = MIN(minColumn + blocksPerTile, m_hiZBlockColumns) - 1;
+        int maxRow = MIN(minRow + blocksPerTile, m_hiZBlockRows) - 1;
+
+        float lowest = m_hiZBlocks[minColumn + minRow * m_hiZBlockColumns];
+        for (int y = minRow; y <= maxRow; y++)
         {
-            i++;
+            for (int x = minColumn; x <= maxColumn; x++)
+            {
+                lowest = MIN(lowest, m_hiZBlocks[x + y * m_hiZBlockColumns]);
+            }
         }
+
+        m_hiZTiles[index] = lowest;
+        m_hiZTileChanged[index] = false;
     }
+
+    return m_hiZTiles[index];
 }
 
 
-void ScreenBuffer::clipFar(Shape & shape) const
+bool ScreenBuffer::isOccluded(int minX, int minY, int maxX, int maxY, float z)
 {
-    for (int i = 0; i < shape.triangles.size(); i++)
+    for (int tileY = minY / TILE_SIZE; tileY <= maxY / TILE_SIZE; tileY++)
     {
-        int triangleCount = shape.triangles.size();
-        for (int i = 0; i < triangleCount;)
+        for (int tileX = minX / TILE_SIZE; tileX <= maxX / TILE_SIZE; tileX++)
         {
-            // clip triangles
-            Point & p0 = shape.triangles[i].p0;
-            Point & p1 = shape.triangles[i].p1;
-            Point & p2 = shape.triangles[i].p2;
+            if (z < getHiZTile(tileX, tileY))
+            {
+                continue;
+            }
 
-            if (p0.z < -1)
+            // the tile didn't settle it, so try its blocks in the rectangle
+            int minBlockX = MAX(minX, tileX * TILE_SIZE) >> HIZ_BLOCK_BITS;
+            int minBlockY = MAX(minY, tileY * TILE_SIZE) >> HIZ_BLOCK_BITS;
+            int maxBlockX = MIN(maxX, (tileX + 1) * TILE_SIZE - 1) >> HIZ_BLOCK_BITS;
+            int maxBlockY = MIN(maxY, (tileY + 1) * TILE_SIZE - 1) >> HIZ_BLOCK_BITS;
+            for (int blockY = minBlockY; blockY <= maxBlockY; blockY++)
             {
-                if (p1.z < -1)
+                for (int blockX = minBlockX; blockX <= maxBlockX; blockX++)
                 {
-                    if (p2.z < -1)
+                    if (z >= m_hiZBlocks[blockX + blockY * m_hiZBlockColumns])
                     {
-                        // all vertices need to be clipped
-                        shape.triangles.remove(i);
-                        triangleCount--;
+                        return false;
                     }
-                    else
-                    {
-                        // p0 and p1 need to be clipped
-
-                        // calculating a new point between p0 and p2;
-                        // t is positive because p0.z < -1 && p2.z >= -1
-                        float t02 = (p0.z + 1) / (p0.z - p2.z);
-                        float x02 = p0.x + t02 * (p2.x - p0.x);
-                        float y02 = p0.y + t02 * (p2.y - p0.y);
-                        Color c02 = p0.m_color.getFade(1 - t02) + p2.m_color.getFade(t02);
-
-                        // calculating a new point between p1 and p2
-                        // t is positive because p1.z < -1 && p2.z >= -1
-                        float t12 = (p1.z + 1) / (p1.z - p2.z);
-                        float x12 = p1.x + t12 * (p2.x - p1.x);
-                        float y12 = p1.y + t12 * (p2.y - p1.y);
-                        Color c12 = p1.m_color.getFade(1 - t12) + p2.m_color.getFade(t12);
-
-                        Triangle newT(Point(x02, y02, -1, c02), Point(x12, y12, -1, c12), p2);
-                        shape.triangles[i] = newT;
-                        i++;
-                    }
-                }
-                else if (p2.z < -1)
-                {
-                    // p0 and p2 need to be clipped
-
-                    // calculating a new point between p0 and p1
-                    // t is positive because p0.z < -1 && p1.z >= -1
-                    float t01 = (p0.z + 1) / (p0.z - p1.z);
-                    float x01 = p0.x + t01 * (p1.x - p0.x);
-                    float y01 = p0.y + t01 * (p1.y - p0.y);
-                    Color c01 = p0.m_color.getFade(1 - t01) + p1.m_color.getFade(t01);
-
-                    // calculating a new point between p2 and p1
-                    // t is positive because p2.z < -1 && p1.z >= -1
-                    float t21 = (p2.z + 1) / (p2.z - p1.z);
-                    float x21 = p2.x + t21 * (p1.x - p2.x);
-                    float y21 = p2.y + t21 * (p1.y - p2.y);
-                    Color c21 = p2.m_color.getFade(1 - t21) + p1.m_color.getFade(t21);
-
-                    Triangle newT(Point(x01, y01, -1, c01), p1, Point(x21, y21, -1, c21));
-                    shape.triangles[i] = newT;
-                    i++;
-                }
-                else
-                {
-                    // just p0 needs to be clipped
-
-                    // calculating a new point between p0 and p1
-                    // t is positive because p0.z < -1 && p1.z >= -1
-                    float t01 = (p0.z + 1) / (p0.z - p1.z);
-                    float x01 = p0.x + t01 * (p1.x - p0.x);
-                    float y01 = p0.y + t01 * (p1.y - p0.y);
-                    Color c01 = p0.m_color.getFade(1 - t01) + p1.m_color.getFade(t01);
-
-                    // calculating a new point between p0 and p2;
-                    // t is positive because p0.z < -1 && p2.z >= -1
-                    float t02 = (p0.z + 1) / (p0.z - p2.z);
-                    float x02 = p0.x + t02 * (p2.x - p0.x);
-                    float y02 = p0.y + t02 * (p2.y - p0.y);
-                    Color c02 = p0.m_color.getFade(1 - t02) + p2.m_color.getFade(t02);
-
-                    Triangle newTb(p1, p2, Point(x02, y02, -1, c02));
-                    shape.triangles += newTb;
-                    Triangle newTa(p1, Point(x02, y02, -1, c02), Point(x01, y01, -1, c01));
-                    shape.triangles[i] = newTa;
-                    i++;
-                }
-            }
-            else if (p1.z < -1)
-            {
-                if (p2.z < -1)
-                {
-                    // p1 and p2 need to be clipped
-
-                    // calculating a new point between p1 and p0
-                    // t is positive because p1.z < -1 && p0.z >= -1
-                    float t10 = (p1.z + 1) / (p1.z - p0.z);
-                    float x10 = p1.x + t10 * (p0.x - p1.x);
-                    float y10 = p1.y + t10 * (p0.y - p1.y);
-                    Color c10 = p1.m_color.getFade(1 - t10) + p0.m_color.getFade(t10);
-
-                    // calculating a new point between p2 and p0
-                    // t is positive because p2.z < -1 && p0.z >= -1
-                    float t20 = (p2.z + 1) / (p2.z - p0.z);
-                    float x20 = p2.x + t20 * (p0.x - p2.x);
-                    float y20 = p2.y + t20 * (p0.y - p2.y);
-                    Color c20 = p2.m_color.getFade(1 - t20) + p0.m_color.getFade(t20);
-
-                    Triangle newT(p0, Point(x10, y10, -1, c10), Point(x20, y20, -1, c20));
-                    shape.triangles[i] = newT;
-                    i++;
-                }
-                else
-                {
-                    // just p1 needs to be clipped
-
-                    // calculating a new point between p1 and p0
-                    // t is positive because p1.z < -1 && p0.z >= -1
-                    float t10 = (p1.z + 1) / (p1.z - p0.z);
-                    float x10 = p1.x + t10 * (p0.x - p1.x);
-                    float y10 = p1.y + t10 * (p0.y - p1.y);
-                    Color c10 = p1.m_color.getFade(1 - t10) + p0.m_color.getFade(t10);
-
-                    // calculating a new point between p1 and p2
-                    // t is positive because p1.z < -1 && p2.z >= -1
-                    float t12 = (p1.z + 1) / (p1.z - p2.z);
-                    float x12 = p1.x + t12 * (p2.x - p1.x);
-                    float y12 = p1.y + t12 * (p2.y - p1.y);
-                    Color c12 = p1.m_color.getFade(1 - t12) + p2.m_color.getFade(t12);
-
-                    Triangle newTb(p2, p0, Point(x12, y12, -1, c12));
-                    shape.triangles += newTb;
-                    Triangle newTa(p0, Point(x10, y10, -1, c10), Point(x12, y12, -1, c12));
-                    shape.triangles[i] = newTa;
-                    i++;
                 }
             }
-            else if (p2.y < -1)
-            {
-                // just p2 needs to be clipped
-
-                // calculating a new point between p2 and p0
-                // t is positive because p2.z < -1 && p0.z >= -1
-                float t20 = (p2.z + 1) / (p2.z - p0.z);
-                float x20 = p2.x + t20 * (p0.x - p2.x);
-                float y20 = p2.y + t20 * (p0.y - p2.y);
-                Color c20 = p2.m_color.getFade(1 - t20) + p0.m_color.getFade(t20);
-
-                // calculating a new point between p2 and p1
-                // t is positive because p2.z < -1 && p1.z >= -1
-                float t21 = (p2.z + 1) / (p2.z - p1.z);
-                float x21 = p2.x + t21 * (p1.x - p2.x);
-                float y21 = p2.y + t21 * (p1.y - p2.y);
-                Color c21 = p2.m_color.getFade(1 - t21) + p1.m_color.getFade(t21);
-
-                Triangle newTb(p0, p1, Point(x21, y21, -1, c21));
-                shape.triangles += newTb;
-                Triangle newTa(p0, Point(x21, y21, -1, c21), Point(x20, y20, -1, c20));
-                shape.triangles[i] = newTa;
-                i++;
-            }
-            else
-            {
-                // triangle doesn't need to be clipped
-                i++;
-            }
         }
     }
 
-    for (int i = 0; i < shape.lines.size();)
+    return true;
+}
+
+
+void ScreenBuffer::prepareShapeJob(void * data, unsigned index, unsigned thread)
+{
+    ScreenBuffer * screenBuffer = (ScreenBuffer *)data;
+    // jobs on the same thread never overlap, so they can share a cache
+    Array<TransformedVertex> & vertices = screenBuffer->m_workerVertexCaches[thread];
+    screenBuffer->prepareEntity(
+        (*screenBuffer->m_groupEntities)[index],
+        (*screenBuffer->m_groupInsideFrustum)[index],
+        screenBuffer->m_groupCameraTransform,
+        screenBuffer->m_groupViewingTransform,
+        vertices,
+        (*screenBuffer->m_groupShapes)[index]);
+}
+
+
+void ScreenBuffer::rasterizeTileJob(void * data, unsigned index, unsigned thread)
+{
+    ScreenBuffer * screenBuffer = (ScreenBuffer *)data;
+    Tile tile = screenBuffer->getTile(index);
+    const Array<BinnedPrimitive> & bin = screenBuffer->m_tileBins[index];
+    const Array<Shape> & shapes = *screenBuffer->m_groupShapes;
+
+    for (int i = 0; i < bin.size(); i++)
     {
-        Point & p0 = shape.lines[i].p0;
-        Point & p1 = shape.lines[i].p1;
+        const BinnedPrimitive & primitive = bin[i];
+        const Shape & shape = shapes[primitive.shapeIndex];
 
-        // clip lines
-        if (p0.z < -1)
+        switch (primitive.type)
         {
-            if (p1.z < -1)
-            {
-                // both ends of the line need to be clipped
-                shape.lines.remove(i);
-            }
-            else
-            {
-                // p0 end of the line needs to be clipped
-                // 
-                // pNew.x = p0.x + t * (p1.x - p0.x)
-                // pNew.y = p0.y + t * (p1.y - p0.y)
-                // pNew.z = p0.z + t * (p1.z - p0.z)
-                // pNew.z = -1
-                // t is positive because p0.z < -1 && p1.z >= -1
-                float t = (-1 - p0.z) / (p1.z - p0.z);
-                float nX = p0.x + t * (p1.x - p0.x);
-                float nY = p0.y + t * (p1.y - p0.y);
-                Color nC = p0.m_color.getFade(1 - t) + p1.m_color.getFade(t);
-
-                Line newL(Point(nX, nY, -1, nC), p1);
-                shape.lines[i] = newL;
-                i++;
-            }
-        }
-        else if (p1.z < -1)
+        case PT_POINT:
         {
-            // p1 end of the line needs to be clipped
-            float t = (-1 - p1.z) / (p0.z - p1.z);
-            float nX = p1.x + t * (p0.x - p1.x);
-            float nY = p1.y + t * (p0.y - p1.y);
-            Color nC = p1.m_color.getFade(1 - t) + p0.m_color.getFade(t);
-
-            Line newL(p0, Point(nX, nY, -1, nC));
-            shape.lines[i] = newL;
-            i++;
+            screenBuffer->drawPoint3D(shape.points[primitive.primitiveIndex], tile);
+            break;
         }
-        else
+        case PT_LINE:
         {
-            // line doesn't need to be clipped
-            i++;
+            const Line & l = shape.lines[primitive.primitiveIndex];
+            screenBuffer->drawLine3D(l.p0, l.p1, tile);
+            break;
         }
-    }
-
-    for (int i = 0; i < shape.points.size();)
-    {
-        // clip near points
-        if (shape.points[i].z < -1)
+        case PT_TRIANGLE:
         {
-            shape.points.remove(i);
+            const Triangle & t = shape.triangles[primitive.primitiveIndex];
+            screenBuffer->drawTriangle3D(t.p0, t.p1, t.p2, tile);
+            break;
         }
-        else
+        case PT_TRIANGLE_OUTLINE:
         {
-            i++;
+            const Triangle & t = shape.triangles[primitive.primitiveIndex];
+            screenBuffer->drawTriangleOutline3D(t.p0, t.p1, t.p2, tile);
+            break;
+        }
         }
     }
 }
 
 
-void ScreenBuffer::clipNear(Shape & shape) const
+Color ScreenBuffer::applySimpleLighting(float ambiant, float diffuse, float facing, const TransformedVertex & vertex)
+{
+    float nDotL = facing * vertex.inverseDistance;
+    if (nDotL < 0) nDotL = 0;
+
+    return vertex.camera.m_color.getFade(ambiant + diffuse * nDotL);
+}
+
+
+Vector ScreenBuffer::getCameraSpaceNormal(const Point & p0, const Point & p1, const Point & p2)
+{
+    // same normal as Triangle::getNormal
+    Vector v0 = p1 - p0;
+    Vector v1 = p2 - p1;
+    Vector normal = v0.crossProduct(v1);
+    normal.normalize();
+    return normal;
+}
+
+
+void ScreenBuffer::clipToFrustum(Shape & shape) const
 {
+    // Triangles that are kept get moved down to fill the holes left by the
+    // ones that are removed. Triangles that clipping cuts into more than one
+    // piece have the extra pieces added to the end of the array, and are
+    // moved down after.
     int triangleCount = shape.triangles.size();
-    for (int i = 0; i < triangleCount;)
+    int kept = 0;
+    for (int i = 0; i < triangleCount; i++)
     {
-        // clip triangles
-        Point & p0 = shape.triangles[i].p0;
-        Point & p1 = shape.triangles[i].p1;
-        Point & p2 = shape.triangles[i].p2;
+        const Triangle & t = shape.triangles[i];
+        uint8_t outcode0 = getOutcode(t.p0);
+        uint8_t outcode1 = getOutcode(t.p1);
+        uint8_t outcode2 = getOutcode(t.p2);
 
-        if (p0.z > 1)
+        if (!(outcode0 | outcode1 | outcode2))
+        {
+            // fully inside, doesn't need to be clipped
+            if (kept != i)
+            {
+                shape.triangles[kept] = t;
+            }
+            kept++;
+        }
+        else if (!(outcode0 & outcode1 & outcode2))
         {
-            if (p1.z > 1)
+            Point polygon[CLIP_POLYGON_SIZE];
+            polygon[0] = t.p0;
+            polygon[1] = t.p1;
+            polygon[2] = t.p2;
+            int count = clipPolygon(polygon, 3, outcode0 | outcode1 | outcode2);
+
+            // turn the polygon back into triangles, fanning out from the
+            // first vertex
+            for (int j = 1; j + 1 < count; j++)
             {
-                if (p2.z > 1)
+                Triangle newT(polygon[0], polygon[j], polygon[j + 1]);
+                if (j == 1)
                 {
-                    // all vertices need to be clipped
-                    shape.triangles.remove(i);
-                    triangleCount--;
+                    shape.triangles[kept] = newT;
+                    kept++;
                 }
                 else
                 {
-                    // p0 and p1 need to be clipped
-
-                    // calculating a new point between p0 and p2;
-                    // t is positive because p0.z > 1 && p2.z <= 1
-                    float t02 = (p0.z - 1) / (p0.z - p2.z);
-                    float x02 = p0.x + t02 * (p2.x - p0.x);
-                    float y02 = p0.y + t02 * (p2.y - p0.y);
-                    Color c02 = p0.m_color.getFade(1 - t02) + p2.m_color.getFade(t02);
-
-                    // calculating a new point between p1 and p2
-                    // t is positive because p1.z > 1 && p2.z <= 1
-                    float t12 = (p1.z - 1) / (p1.z - p2.z);
-                    float x12 = p1.x + t12 * (p2.x - p1.x);
-                    float y12 = p1.y + t12 * (p2.y - p1.y);
-                    Color c12 = p1.m_color.getFade(1 - t12) + p2.m_color.getFade(t12);
-
-                    Triangle newT(Point(x02, y02, 1, c02), Point(x12, y12, 1, c12), p2);
-                    shape.triangles[i] = newT;
-                    i++;
+                    shape.triangles += newT;
                 }
             }
-            else if (p2.z > 1)
+        }
+        // else all the vertices are outside the same plane, remove it
+    }
+    for (int i = triangleCount; i < shape.triangles.size(); i++)
+    {
+        shape.triangles[kept] = shape.triangles[i];
+        kept++;
+    }
+    shape.triangles.truncate(kept);
+
+    kept = 0;
+    for (int i = 0; i < shape.lines.size(); i++)
+    {
+        Point p0 = shape.lines[i].p0;
+        Point p1 = shape.lines[i].p1;
+        uint8_t outcode0 = getOutcode(p0);
+        uint8_t outcode1 = getOutcode(p1);
+
+        if (outcode0 & outcode1)
+        {
+            // both ends are outside the same plane
+            continue;
+        }
+
+        // move the end outside each plane onto the plane
+        bool visible = true;
+        uint8_t outcode = outcode0 | outcode1;
+        for (int plane = 0; plane < CLIP_PLANE_COUNT && visible; plane++)
+        {
+            if (!(outcode & (1 << plane)))
             {
-                // p0 and p2 need to be clipped
-
-                // calculating a new point between p0 and p1
-                // t is positive because p0.z > 1 && p1.z <= 1
-                float t01 = (p0.z - 1) / (p0.z - p1.z);
-                float x01 = p0.x + t01 * (p1.x - p0.x);
-                float y01 = p0.y + t01 * (p1.y - p0.y);
-                Color c01 = p0.m_color.getFade(1 - t01) + p1.m_color.getFade(t01);
-
-                // calculating a new point between p2 and p1
-                // t is positive because p2.z > 1 && p1.z <= 1
-                float t21 = (p2.z - 1) / (p2.z - p1.z);
-                float x21 = p2.x + t21 * (p1.x - p2.x);
-                float y21 = p2.y + t21 * (p1.y - p2.y);
-                Color c21 = p2.m_color.getFade(1 - t21) + p1.m_color.getFade(t21);
-
-                Triangle newT(Point(x01, y01, 1, c01), p1, Point(x21, y21, 1, c21));
-                shape.triangles[i] = newT;
-                i++;
+                continue;
             }
-            else
+
+            float d0 = getClipDistance(p0, plane);
+            float d1 = getClipDistance(p1, plane);
+            if (d0 < 0 && d1 < 0)
             {
-                // just p0 needs to be clipped
-
-                // calculating a new point between p0 and p1
-                // t is positive because p0.z > 1 && p1.z <= 1
-                float t01 = (p0.z - 1) / (p0.z - p1.z);
-                float x01 = p0.x + t01 * (p1.x - p0.x);
-                float y01 = p0.y + t01 * (p1.y - p0.y);
-                Color c01 = p0.m_color.getFade(1 - t01) + p1.m_color.getFade(t01);
-
-                // calculating a new point between p0 and p2;
-                // t is positive because p0.z > 1 && p2.z <= 1
-                float t02 = (p0.z - 1) / (p0.z - p2.z);
-                float x02 = p0.x + t02 * (p2.x - p0.x);
-                float y02 = p0.y + t02 * (p2.y - p0.y);
-                Color c02 = p0.m_color.getFade(1 - t02) + p2.m_color.getFade(t02);
-
-                Triangle newTb(p1, p2, Point(x02, y02, 1, c02));
-                shape.triangles += newTb;
-                Triangle newTa(p1, Point(x02, y02, 1, c02), Point(x01, y01, 1, c01));
-                shape.triangles[i] = newTa;
-                i++;
+                visible = false;
             }
-        }
-        else if (p1.z > 1)
-        {
-            if (p2.z > 1)
+            else if (d0 < 0)
             {
-                // p1 and p2 need to be clipped
-
-                // calculating a new point between p1 and p0
-                // t is positive because p1.z > 1 && p0.z <= 1
-                float t10 = (p1.z - 1) / (p1.z - p0.z);
-                float x10 = p1.x + t10 * (p0.x - p1.x);
-                float y10 = p1.y + t10 * (p0.y - p1.y);
-                Color c10 = p1.m_color.getFade(1 - t10) + p0.m_color.getFade(t10);
-
-                // calculating a new point between p2 and p0
-                // t is positive because p2.z > 1 && p0.z <= 1
-                float t20 = (p2.z - 1) / (p2.z - p0.z);
-                float x20 = p2.x + t20 * (p0.x - p2.x);
-                float y20 = p2.y + t20 * (p0.y - p2.y);
-                Color c20 = p2.m_color.getFade(1 - t20) + p0.m_color.getFade(t20);
-
-                Triangle newT(p0, Point(x10, y10, 1, c10), Point(x20, y20, 1, c20));
-                shape.triangles[i] = newT;
-                i++;
+                p0 = getClipIntersection(p1, p0, d1, d0);
             }
-            else
+            else if (d1 < 0)
             {
-                // just p1 needs to be clipped
-
-                // calculating a new point between p1 and p0
-                // t is positive because p1.z > 1 && p0.z <= 1
-                float t10 = (p1.z - 1) / (p1.z - p0.z);
-                float x10 = p1.x + t10 * (p0.x - p1.x);
-                float y10 = p1.y + t10 * (p0.y - p1.y);
-                Color c10 = p1.m_color.getFade(1 - t10) + p0.m_color.getFade(t10);
-
-                // calculating a new point between p1 and p2
-                // t is positive because p1.z > 1 && p2.z <= 1
-                float t12 = (p1.z - 1) / (p1.z - p2.z);
-                float x12 = p1.x + t12 * (p2.x - p1.x);
-                float y12 = p1.y + t12 * (p2.y - p1.y);
-                Color c12 = p1.m_color.getFade(1 - t12) + p2.m_color.getFade(t12);
-
-                Triangle newTb(p2, p0, Point(x12, y12, 1, c12));
-                shape.triangles += newTb;
-                Triangle newTa(p0, Point(x10, y10, 1, c10), Point(x12, y12, 1, c12));
-                shape.triangles[i] = newTa;
-                i++;
+                p1 = getClipIntersection(p0, p1, d0, d1);
             }
         }
-        else if (p2.z > 1)
-        {
-            // just p2 needs to be clipped
-
-            // calculating a new point between p2 and p0
-            // t is positive because p2.z > 1 && p0.z <= 1
-            float t20 = (p2.z - 1) / (p2.z - p0.z);
-            float x20 = p2.x + t20 * (p0.x - p2.x);
-            float y20 = p2.y + t20 * (p0.y - p2.y);
-            Color c20 = p2.m_color.getFade(1 - t20) + p0.m_color.getFade(t20);
 
-            // calculating a new point between p2 and p1
-            // t is positive because p2.z > 1 && p1.z <= 1
-            float t21 = (p2.z - 1) / (p2.z - p1.z);
-            float x21 = p2.x + t21 * (p1.x - p2.x);
-            float y21 = p2.y + t21 * (p1.y - p2.y);
-            Color c21 = p2.m_color.getFade(1 - t21) + p1.m_color.getFade(t21);
-
-            Triangle newTb(p0, p1, Point(x21, y21, 1, c21));
-            shape.triangles += newTb;
-            Triangle newTa(p0, Point(x21, y21, 1, c21), Point(x20, y20, 1, c20));
-            shape.triangles[i] = newTa;
-            i++;
-        }
-        else
+        if (visible)
         {
-            // triangle doesn't need to be clipped
-            i++;
+            shape.lines[kept] = Line(p0, p1);
+            kept++;
         }
     }
+    shape.lines.truncate(kept);
 
-    for (int i = 0; i < shape.lines.size();)
+    kept = 0;
+    for (int i = 0; i < shape.points.size(); i++)
     {
-        Point & p0 = shape.lines[i].p0;
-        Point & p1 = shape.lines[i].p1;
-
-        // clip lines
-        if (p0.z > 1)
+        if (!getOutcode(shape.points[i]))
         {
-            if (p1.z > 1)
-            {
-                // both ends of the line need to be clipped
-                shape.lines.remove(i);
-            }
-            else
+            if (kept != i)
             {
-                // p0 end of the line needs to be clipped
-                // 
-                // pNew.x = p0.x + t * (p1.x - p0.x)
-                // pNew.y = p0.y + t * (p1.y - p0.y)
-                // pNew.z = p0.z + t * (p1.z - p0.z)
-                // pNew.z = 1
-                // t is positive because p0.z > 1 && p1.z <= 1
-                float t = (p0.z - 1) / (p0.z - p1.z);
-                float nX = p0.x + t * (p1.x - p0.x);
-                float nY = p0.y + t * (p1.y - p0.y);
-                Color nC = p0.m_color.getFade(1 - t) + p1.m_color.getFade(t);
-
-                Line newL(Point(nX, nY, 1, nC), p1);
-                shape.lines[i] = newL;
-                i++;
+                shape.points[kept] = shape.points[i];
             }
+            kept++;
         }
-        else if (p1.z > 1)
-        {
-            // p1 end of the line needs to be clipped
-            float t = (p1.z - 1) / (p1.z - p0.z);
-            float nX = p1.x + t * (p0.x - p1.x);
-            float nY = p1.y + t * (p0.y - p1.y);
-            Color nC = p1.m_color.getFade(1 - t) + p0.m_color.getFade(t);
+    }
+    shape.points.truncate(kept);
+}
 
-            Line newL(p0, Point(nX, nY, 1, nC));
-            shape.lines[i] = newL;
-            i++;
-        }
-        else
+
+int ScreenBuffer::clipPolygon(Point * polygon, int count, uint8_t outcode)
+{
+    Point clipped[CLIP_POLYGON_SIZE];
+
+    for (int plane = 0; plane < CLIP_PLANE_COUNT && count >= 3; plane++)
+    {
+        if (!(outcode & (1 << plane)))
         {
-            // line doesn't need to be clipped
-            i++;
+            continue;
         }
-    }
 
-    for (int i = 0; i < shape.points.size();)
-    {
-        // clip near points
-        if (shape.points[i].z > 1)
+        // Sutherland-Hodgman: walk the edges, keeping the inside vertices and
+        // adding a vertex wherever an edge crosses the plane
+        int clippedCount = 0;
+        const Point * previous = &polygon[count - 1];
+        float previousDistance = getClipDistance(*previous, plane);
+        for (int i = 0; i < count; i++)
         {
-            shape.points.remove(i);
+            const Point * current = &polygon[i];
+            float currentDistance = getClipDistance(*current, plane);
+
+            if (currentDistance >= 0)
+            {
+                if (previousDistance < 0)
+                {
+                    clipped[clippedCount] = getClipIntersection(*current, *previous, currentDistance, previousDistance);
+                    clippedCount++;
+                }
+                clipped[clippedCount] = *current;
+                clippedCount++;
+            }
+            else if (previousDistance >= 0)
+            {
+                clipped[clippedCount] = getClipIntersection(*previous, *current, previousDistance, currentDistance);
+                clippedCount++;
+            }
+
+            previous = current;
+            previousDistance = currentDistance;
         }
-        else
+
+        for (int i = 0; i < clippedCount; i++)
         {
-            i++;
+            polygon[i] = clipped[i];
         }
+        count = clippedCount;
     }
+
+    return count;
+}
+
+
+Point ScreenBuffer::getClipIntersection(const Point & inside, const Point & outside, float insideDistance, float outsideDistance)
+{
+    // t is between 0 and 1 because insideDistance >= 0 > outsideDistance
+    float t = insideDistance / (insideDistance - outsideDistance);
+    float w = inside.w + t * (outside.w - inside.w);
+
+    // The triangles get their colors interpolated across the screen, not in
+    // clip space, so the color has to come from how far along the edge the
+    // new point is on the screen. Otherwise a triangle's shading would jump
+    // as soon as it touched the edge of the frustum.
+    float tScreen = t * outside.w / w;
+    Color c = inside.m_color.getFade(1 - tScreen) + outside.m_color.getFade(tScreen);
+
+    Point p(
+        inside.x + t * (outside.x - inside.x),
+        inside.y + t * (outside.y - inside.y),
+        inside.z + t * (outside.z - inside.z),
+        c);
+    p.w = w;
+    return p;
 }
 
 
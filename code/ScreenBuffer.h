@@ -7,8 +7,8 @@
    ========================================================================== */
 
 #pragma once
-#include <Windows.h>
 #include "SizedIntegers.h"
+#include "Atomics.h"
 #include "ColorUtilities.h"
 #include "MathUtilities.h"
 #include "GraphicsUtilities.h"
@@ -16,6 +16,163 @@
 #include "GameUtilities.h"
 #include "AsciiCharacterDefines.h"
 #include "String.h"
+#include "WorkerPool.h"
+#include "SpanKernels.h"
+
+
+// Algorithms drawTriangle3D can use to fill in a triangle. They can be
+// swapped to compare them.
+enum TriangleRasterizer
+{
+    TR_BARYCENTRIC,   // per pixel cross products and areas (the original)
+    TR_EDGE_FUNCTION  // subpixel edge functions set up once, stepped per pixel
+};
+
+
+// Side length of the square tiles the screen is split into for binned
+// rasterization
+#define TILE_SIZE 32
+
+// The edge function rasterizer snaps vertices to 1/16th of a pixel (28.4
+// fixed point) instead of to whole pixels
+#define SUBPIXEL_BITS 4
+#define SUBPIXEL_SCALE (1 << SUBPIXEL_BITS)
+
+// Side length of the square blocks of pixels the hierarchical z buffer keeps
+// a depth for. TILE_SIZE is a multiple of it, so no block is ever drawn by
+// two threads at once.
+#define HIZ_BLOCK_BITS 3
+#define HIZ_BLOCK_SIZE (1 << HIZ_BLOCK_BITS)
+
+// Printable ASCII glyphs, ' ' through '~', plus ASCII_UNDEFINED at the end
+// for everything else
+#define GLYPH_COUNT 96
+#define GLYPH_UNDEFINED 95
+
+// Biggest xScale with a glyph atlas, a glyph row that wide still fits in 64
+// bits. Wider text goes through drawCharacter.
+#define GLYPH_ATLAS_MAX_SCALE 12
+
+// A text box strip pixel the text box didn't draw on. Real colors never set
+// the top byte.
+#define STRIP_EMPTY 0xFF000000
+
+// Most text box strips kept at once, more than any menu has text boxes
+#define TEXT_BOX_STRIP_CACHE_SIZE 64
+
+// Frames averaged together before dynamic resolution changes the scale
+#define DYNAMIC_RESOLUTION_FRAMES 8
+
+// Longest a detail frame's edges can get on screen, in pixels, before the
+// next level of detail is used instead
+#define DETAIL_EDGE_PIXELS 12
+
+// Outcode bits, one for each plane of the viewing frustum. A point gets the
+// bit set if it's on the outside of that plane. Planes are in clip space,
+// after the viewing transform but before dividing by w.
+#define OUTCODE_LEFT   (1 << 0) // x < -w
+#define OUTCODE_RIGHT  (1 << 1) // x > w
+#define OUTCODE_BOTTOM (1 << 2) // y < -w
+#define OUTCODE_TOP    (1 << 3) // y > w
+#define OUTCODE_FAR    (1 << 4) // z < -w
+#define OUTCODE_NEAR   (1 << 5) // z > w
+#define CLIP_PLANE_COUNT 6
+
+// Most vertices a triangle can have after being clipped by every plane
+#define CLIP_POLYGON_SIZE (3 + CLIP_PLANE_COUNT)
+
+// A rectangle of pixels, bounds are inclusive. The 3D draw functions only
+// touch pixels inside the tile they're given, so different threads can draw
+// different tiles without stepping on each other.
+struct Tile
+{
+    Tile() {}
+    Tile(int _minX, int _minY, int _maxX, int _maxY) : minX(_minX), minY(_minY), maxX(_maxX), maxY(_maxY) {}
+
+    int minX, minY;
+    int maxX, maxY;
+};
+
+// What kind of primitive a BinnedPrimitive is
+enum PrimitiveType
+{
+    PT_POINT,
+    PT_LINE,
+    PT_TRIANGLE,
+    PT_TRIANGLE_OUTLINE
+};
+
+// An entity's place in the front to back draw order of rasterizeGroup
+struct DepthSortKey
+{
+    float depth;    // how far in front of the camera the entity is
+    unsigned index; // index of the entity being sorted
+};
+
+// A primitive sorted into the bin of a tile it touches. The indices point
+// into the shapes being rasterized.
+struct BinnedPrimitive
+{
+    BinnedPrimitive() {}
+    BinnedPrimitive(unsigned shapeIndex, unsigned primitiveIndex, PrimitiveType type) :
+        shapeIndex(shapeIndex),
+        primitiveIndex(primitiveIndex),
+        type(type) {}
+
+    unsigned shapeIndex;
+    unsigned primitiveIndex;
+    PrimitiveType type;
+};
+
+
+// A frame point after it's been through the transforms, done once per point
+// per frame no matter how many lines and triangles share it.
+struct TransformedVertex
+{
+    Point camera;          // camera space, keeps the frame point's color
+    Point clip;            // clip space, after the viewing transform
+    float distanceFade;    // how much distance shading fades the color
+    float inverseDistance; // 1 over the distance to the camera, for lighting
+    bool transformed;      // false until the point's been through the transforms
+};
+
+
+// A text box drawn into its own pixels. drawTextBox copies them onto the
+// buffer, and only draws the text box again once it looks different.
+struct TextBoxStrip
+{
+    const TextBox * owner; // the text box being drawn
+    TextBox drawn;         // what the text box looked like when drawn
+    int x, y;              // buffer coordinates of the bottom left pixel
+    int width, height;
+    uint32_t * pixels;     // bottom row first, STRIP_EMPTY where not drawn
+};
+
+
+// Counts of what the 3D draw functions did since resetRenderStats was last
+// called. Meant to be shown on screen while tuning.
+struct RenderStats
+{
+    RenderStats() :
+        entities(0), entitiesCulled(0), entitiesInside(0),
+        triangles(0), trianglesOccluded(0), spans(0), spansOccluded(0),
+        pixelsWritten(0) {}
+
+    unsigned entities;       // entities given to rasterize or rasterizeGroup
+    unsigned entitiesCulled; // outside the view frustum, skipped entirely
+    unsigned entitiesInside; // inside the view frustum, clipping skipped
+
+    // The worker threads add to these, so they're longs for the atomic
+    // functions. Only counted while the hierarchical z buffer is on.
+    long triangles;         // triangles given to the edge function rasterizer
+    long trianglesOccluded; // behind everything already drawn, skipped
+    long spans;             // rows of the triangles that weren't skipped
+    long spansOccluded;     // behind everything already drawn, skipped
+
+    // pixels the edge function rasterizer wrote, the ones that passed the z
+    // test. Anything above the number of pixels on screen is overdraw.
+    long pixelsWritten;
+};
 
 
 // -------------------------------------------------------------------------- //
@@ -24,7 +181,9 @@ class ScreenBuffer
 public:
     // ScreenBuffer
     // ====================================================================== //
-    // Iniitialize the Device Independent Bitmap stored in m_memory.
+    // Allocate the color and z buffers in memory. Nothing here knows about
+    // the window, a present backend like Win32Present or HeadlessPresent
+    // takes the pixels from getPixels and shows or keeps them.
     //
     // @params
     // * int width, new width of the buffer
@@ -33,31 +192,88 @@ public:
 
     // ~ScreenBuffer
     // ====================================================================== //
-    // Free the DIB, a.k.a. the Device Independent Bitmap, a.k.a. m_memory.
+    // Free the color and z buffers, a.k.a. m_memory and m_zBuffer.
     ~ScreenBuffer();
 
-    // resizeDIBSection
+    // resize
     // ====================================================================== //
-    // Ressizes the Device Independent Bitmap stored in m_memory;
+    // Reallocate the color and z buffers at a new size. What was drawn is
+    // lost.
     //
     // @params
     // * int width, new width of the buffer
     // * int height, new height of the buffer
-    void resizeDIBSection(int width, int height);
+    void resize(int width, int height);
 
-    // paintWindow
+    // setDynamicResolution
     // ====================================================================== //
-    // Apply the back buffer onto the given device context.
-    // The back buffer is bottom-up and the origin is the lower-left corner.
-    //
-    // If an aspectRatio is provided, StretchDIBits will print to an area
-    // that conforms to it.
-    //
+    // Turn dynamic resolution on or off. While it's on, addFrameTime draws
+    // the scene, the 3D between beginScene and endScene, at a fraction of
+    // the size given to resize when frames take longer than the target,
+    // and goes back up when they're quicker. endScene stretches the scene
+    // over the frame, so the menus and HUD drawn after it are always at
+    // the full size. Turning it off goes back to the full size.
+    // 
+    // The scale never goes over 1, the memory is only as big as the full
+    // size. The scene gets memory of its own the first time the scale
+    // goes under 1.
+    // 
     // @params
-    // * HDC deviceContext, pretty self explanitory
-    // * RECT destRect, rect containing the destination width and height
-    // * float aspectRatio = 0, the destination aspect ratio (width / height)
-    void paintWindow(HDC deviceContext, RECT destRect, float aspectRatio = 0);
+    // * bool dynamicResolution, true to turn it on
+    // * float targetFrameTime = 8, milliseconds a frame should take to draw
+    // * float minScale = 0.5, smallest fraction of the full width and height
+    // * float maxScale = 1, biggest fraction of the full width and height
+    void setDynamicResolution(bool dynamicResolution, float targetFrameTime = 8, float minScale = 0.5, float maxScale = 1);
+
+    // getDynamicResolution
+    // ====================================================================== //
+    // 
+    // @return
+    // True if dynamic resolution is on.
+    inline bool getDynamicResolution() const
+    {
+        return m_dynamicResolution;
+    }
+
+    // getResolutionScale
+    // ====================================================================== //
+    // 
+    // @return
+    // The fraction of the full width and height being drawn at.
+    inline float getResolutionScale() const
+    {
+        return m_resolutionScale;
+    }
+
+    // addFrameTime
+    // ====================================================================== //
+    // Tell dynamic resolution how long a frame took to draw. Every
+    // DYNAMIC_RESOLUTION_FRAMES frames the average is compared to the target,
+    // and the scale moves toward whatever would hit it. Call it between
+    // frames, the buffer might change size.
+    // 
+    // @params
+    // * float milliseconds, how long the frame took to draw
+    // 
+    // @return
+    // True if the buffer changed size.
+    bool addFrameTime(float milliseconds);
+
+    // beginScene
+    // ====================================================================== //
+    // Start drawing the 3D part of a frame, clear included. Below a
+    // resolution scale of 1, everything until endScene is drawn at the
+    // scaled size, in memory of its own, and getWidth and getHeight give
+    // the scaled size. At full size it does nothing. rasterize and
+    // rasterizeGroup call it themselves.
+    void beginScene();
+
+    // endScene
+    // ====================================================================== //
+    // Finish the 3D part of a frame. A scaled scene gets stretched over the
+    // whole frame, and drawing goes back to the frame at the full size.
+    // Does nothing if beginScene wasn't called.
+    void endScene();
 
     // getWidth
     // ====================================================================== //
@@ -66,7 +282,7 @@ public:
     // The width of this buffer in pixels.
     inline long getWidth() const
     {
-        return m_info.bmiHeader.biWidth;
+        return m_width;
     }
     
     // getHeight
@@ -76,7 +292,20 @@ public:
     // The height of this buffer in pixels.
     inline long getHeight() const
     {
-        return m_info.bmiHeader.biHeight;
+        return m_height;
+    }
+
+    // getPixels
+    // ====================================================================== //
+    // For the present backends. The frame is always the full size, the
+    // rows are getWidth pixels apart, and the first one is the bottom of the
+    // screen.
+    // 
+    // @return
+    // The first pixel, 0x 00 RR GG BB.
+    inline const uint32_t * getPixels() const
+    {
+        return m_frameMemory;
     }
 
     // getStringPixelWidth
@@ -190,7 +419,8 @@ public:
     // * const Color & color color, struct containing the rgb color values
     inline void drawPoint(int x, int y, const Color & color)
     {
-        *(m_memory + x + y * m_info.bmiHeader.biWidth) = GET_RGB(color.r, color.g, color.b);
+        *(m_memory + x + y * m_width) = GET_RGB(color.r, color.g, color.b);
+        markDirty(x, y);
     }
     inline void drawPoint(Pair<int> v, const Color & color)
     {
@@ -209,8 +439,11 @@ public:
     // * const Color & color, struct containing the rgb color values
     inline void drawPointSafely(int x, int y, const Color & color)
     {
-        if (x > 0 && x < m_info.bmiHeader.biWidth && y > 0 && y < m_info.bmiHeader.biHeight)
-            *(m_memory + x + y * m_info.bmiHeader.biWidth) = GET_RGB(color.r, color.g, color.b);
+        if (x > 0 && x < m_width && y > 0 && y < m_height)
+        {
+            *(m_memory + x + y * m_width) = GET_RGB(color.r, color.g, color.b);
+            markDirty(x, y);
+        }
         ///else
         ///    throw ERROR_OUTSIDE_BUFFER_BOUNDS;
     }
@@ -415,9 +648,36 @@ public:
     // Draws a textbox object. It'll look like a string surrounded by a
     // rectangular box.
     // 
+    // With the retained UI on (see setRetainedUI), the text box is kept in
+    // a strip of its own and copied onto the buffer. It's only drawn again
+    // when its text, colors, scale, position or selection change.
+    // 
     // @params
-    // * TextBox textBox, text box to be drawn (has location and color info)
-    void drawTextBox(const TextBox textBox);
+    // * const TextBox & textBox, text box to be drawn (has location and
+    //                            color info)
+    void drawTextBox(const TextBox & textBox);
+
+    // setRetainedUI
+    // ====================================================================== //
+    // Turn the retained UI on or off. The output is the same either way. It's
+    // on to begin with.
+    // 
+    // @params
+    // * bool enabled, true to keep text boxes in strips between draws
+    inline void setRetainedUI(bool enabled)
+    {
+        m_retainedUI = enabled;
+    }
+
+    // getRetainedUI
+    // ====================================================================== //
+    // 
+    // @return
+    // True if text boxes are kept in strips between draws.
+    inline bool getRetainedUI() const
+    {
+        return m_retainedUI;
+    }
 
     // drawHeart
     // ====================================================================== //
@@ -451,12 +711,67 @@ public:
     // ====================================================================== //
     // Fills the global back buffer with the given color and sets all the 
     // values in the z buffer to the given float, default bein -1000000.
+    // 
+    // With dirty tile clearing on (see setDirtyTileClear), only the tiles
+    // drawn on since the last clear are cleared, if it's the same color and
+    // float as last time. With epoch depth on (see setEpochDepth), the z
+    // buffer isn't touched, the epoch just moves on.
     //
     // @params
     // * const Color & color = COLOR_BLACK, struct containing the rgb color value
     // * float w = -1000000, value the z buffer will be filled with
     void clear(const Color & color = COLOR_BLACK, float w = -1000000);
 
+    // setDirtyTileClear
+    // ====================================================================== //
+    // Turn dirty tile clearing on or off. Every write to the buffers marks
+    // the TILE_SIZE tile it's in, and clear only has to redo the marked
+    // tiles. Whole buffer clears skip the cache instead. The output is the
+    // same either way. It's on to begin with.
+    // 
+    // @params
+    // * bool enabled, true to only clear the tiles drawn on
+    inline void setDirtyTileClear(bool enabled)
+    {
+        m_dirtyTileClear = enabled;
+    }
+
+    // getDirtyTileClear
+    // ====================================================================== //
+    // 
+    // @return
+    // True if clear only clears the tiles drawn on since the last clear.
+    inline bool getDirtyTileClear() const
+    {
+        return m_dirtyTileClear;
+    }
+
+    // setEpochDepth
+    // ====================================================================== //
+    // Turn epoch depth on or off. Every z buffer value gets a byte saying
+    // which clear it was written after, and clear moves that epoch on
+    // instead of filling the z buffer. A value from an older epoch counts
+    // as the clear's float, so the z test comes out the same. The epochs
+    // only need resetting when the byte wraps, every 255 clears. It takes
+    // effect at the next clear. It's on to begin with.
+    // 
+    // @params
+    // * bool enabled, true to leave the z buffer alone when clearing
+    inline void setEpochDepth(bool enabled)
+    {
+        m_epochDepth = enabled;
+    }
+
+    // getEpochDepth
+    // ====================================================================== //
+    // 
+    // @return
+    // True if clear moves the depth epoch on instead of filling the z buffer.
+    inline bool getEpochDepth() const
+    {
+        return m_epochDepth;
+    }
+
     // drawPoint3D
     // ====================================================================== //
     // Draw a single pixel at the given 3D pixel coordinates. The coordinates
@@ -477,7 +792,8 @@ public:
     // The line is inclusive, so both coodinates are drawn. This means the
     // length of a line from (0, 0) to (3, 0) would be 4.
     // 
-    // Diagonal lines are drawn using the Bresenham's line algorithm.
+    // Lines are drawn with a DDA in 16.16 fixed point, one pixel per step
+    // along the longer axis, see drawLine3DEx.
     //
     // @params
     // * const Point & p0, starting point
@@ -516,19 +832,140 @@ public:
     // The color of the line will be iterpolated by the color of the three
     // points making up the triangle.
     // 
-    // Uses the Barycentric Algorithm.
+    // The algorithm used is picked with setTriangleRasterizer.
     // 
     // @params
     // * const Point & p0, a vertex of the triangle
     // * const Point & p1, another vertex of the triangle
     // * const Point & p2, the third vertex of the triangle
     // * const Triangle & t, triangle structure with pointers to three points
-    void drawTriangle3D(const Point & p0, const Point & p1, const Point & p2);
+    inline void drawTriangle3D(const Point & p0, const Point & p1, const Point & p2)
+    {
+        drawTriangle3D(p0, p1, p2, getDrawableTile());
+    }
     inline void drawTriangle3D(const Triangle & t)
     {
         drawTriangle3D(t.p0, t.p1, t.p2);
     }
 
+    // setTriangleRasterizer
+    // ====================================================================== //
+    // Pick the algorithm drawTriangle3D uses. This is mostly here to compare
+    // them.
+    // 
+    // @params
+    // * TriangleRasterizer rasterizer, the algorithm to use
+    inline void setTriangleRasterizer(TriangleRasterizer rasterizer)
+    {
+        m_triangleRasterizer = rasterizer;
+    }
+
+    // getTriangleRasterizer
+    // ====================================================================== //
+    // 
+    // @return
+    // The algorithm drawTriangle3D is using.
+    inline TriangleRasterizer getTriangleRasterizer() const
+    {
+        return m_triangleRasterizer;
+    }
+
+    // setSpanKernel
+    // ====================================================================== //
+    // Pick which kernel fills in the rows of triangles for the edge function
+    // rasterizer. The fastest one the CPU supports is picked to begin with.
+    // If the CPU can't run the one asked for, the fastest one it can run is
+    // used instead. They all give the same output.
+    // 
+    // @params
+    // * SpanKernel kernel, the kernel to use
+    void setSpanKernel(SpanKernel kernel);
+
+    // getSpanKernel
+    // ====================================================================== //
+    // 
+    // @return
+    // The kernel filling in the rows of triangles.
+    inline SpanKernel getSpanKernel() const
+    {
+        return m_spanKernel;
+    }
+
+    // setBinnedRasterization
+    // ====================================================================== //
+    // Turn binned rasterization on or off. When it's on, rasterizeGroup
+    // prepares the shapes on a pool of worker threads, sorts the primitives
+    // into per tile bins, and then draws the tiles on the worker threads.
+    // Every pixel belongs to one tile, so the color and z buffers don't need
+    // any locks. The worker threads get started the first time it's turned
+    // on. If there's only one processor the pool has no worker threads, and
+    // binning would just add the cost of sorting the primitives, so it stays
+    // off. Check getBinnedRasterization to see if it took.
+    // 
+    // @params
+    // * bool binned, true to draw groups tile by tile on multiple threads
+    void setBinnedRasterization(bool binned);
+
+    // getBinnedRasterization
+    // ====================================================================== //
+    // 
+    // @return
+    // True if rasterizeGroup is drawing tile by tile on multiple threads.
+    inline bool getBinnedRasterization() const
+    {
+        return m_binnedRasterization;
+    }
+
+    // setFrontToBack
+    // ====================================================================== //
+    // Turn front to back ordering on or off. When it's on, rasterizeGroup
+    // draws the entities nearest the camera first, so more of what's behind
+    // them fails the z test (or gets skipped by the hierarchical z buffer)
+    // instead of being drawn over. Entities around the camera, like the
+    // border, go after everything inside them. It's on to begin with.
+    // 
+    // @params
+    // * bool frontToBack, true to sort entities by depth before drawing
+    inline void setFrontToBack(bool frontToBack)
+    {
+        m_frontToBack = frontToBack;
+    }
+
+    // getFrontToBack
+    // ====================================================================== //
+    // 
+    // @return
+    // True if rasterizeGroup draws the nearest entities first.
+    inline bool getFrontToBack() const
+    {
+        return m_frontToBack;
+    }
+
+    // setHierarchicalZ
+    // ====================================================================== //
+    // Turn the hierarchical z buffer on or off. It keeps a depth for every
+    // HIZ_BLOCK_SIZE block and every TILE_SIZE tile that nothing drawn there
+    // is behind. The edge function rasterizer checks it to skip triangles,
+    // and the ends of rows, that would fail the z test everywhere. The
+    // output is the same either way. It's on to begin with.
+    // 
+    // @params
+    // * bool enabled, true to skip hidden triangles before filling them in
+    inline void setHierarchicalZ(bool enabled)
+    {
+        m_hierarchicalZ = enabled;
+    }
+
+    // getHierarchicalZ
+    // ====================================================================== //
+    // 
+    // @return
+    // True if the hierarchical z buffer is being used.
+    inline bool getHierarchicalZ() const
+    {
+        return m_hierarchicalZ;
+    }
+
     // drawPoints3D
     // ====================================================================== //
     // Draws all the given points. The coordinates are expected to be in
@@ -582,7 +1019,43 @@ public:
     // * const Array<Entity*> & entities, an array of entities
     void rasterizeGroup(const Camera & camera, const Array<Entity*> & entities);
 
+    // getRenderStats
+    // ====================================================================== //
+    // 
+    // @return
+    // What the 3D draw functions did since resetRenderStats.
+    inline const RenderStats & getRenderStats() const
+    {
+        return m_renderStats;
+    }
+
+    // resetRenderStats
+    // ====================================================================== //
+    // Set all the render stats back to zero, typically at the start of a
+    // frame.
+    inline void resetRenderStats()
+    {
+        m_renderStats = RenderStats();
+    }
+
 private:
+    // allocateFrame
+    // ====================================================================== //
+    // Allocate a zeroed frame and z buffer from allocatePages and set the
+    // full, scene, and current sizes. The scene starts out unscaled, with
+    // no memory of its own. The old buffers have to be freed first.
+    //
+    // @params
+    // * int width, width of the buffers
+    // * int height, height of the buffers
+    void allocateFrame(int width, int height);
+
+    // freeFrame
+    // ====================================================================== //
+    // Give the frame, scene, and z buffers back, before m_fullWidth and
+    // m_fullHeight change.
+    void freeFrame();
+
     // drawLineEx
     // ====================================================================== //
     // Draw a pixel wide line between the given pixel coordinates.
@@ -641,13 +1114,90 @@ private:
     // * int yScale = 1, a multiplier to increase the height of the character
     void drawCharacter(int x, int y, uint32_t character, const Color & color, int xScale = 1, int yScale = 1);
 
-    // selectCharacter
+    // blitCharacter
+    // ====================================================================== //
+    // Draws a glyph from the glyph atlas for xScale, a whole row of pixels at
+    // a time. Looks the same as drawCharacter with the glyph's mask.
+    //
+    // @params
+    // * int x, the x coordinate for the bottom left of the character
+    // * int y, the y coordinate for the bottom left of the character
+    // * int glyph, index of the glyph, see getGlyphIndex
+    // * const Color & color, struct containing the rgb color values
+    // * int xScale, a multiplier to increase the width of the character,
+    //               1 to GLYPH_ATLAS_MAX_SCALE
+    // * int yScale, a multiplier to increase the height of the character
+    void blitCharacter(int x, int y, int glyph, const Color & color, int xScale, int yScale);
+
+    // getGlyphAtlas
+    // ====================================================================== //
+    // Gets the glyph atlas for a scale, making it the first time it's asked
+    // for. Every glyph gets ASCII_HEIGHT rows of 64 bits, bottom row first.
+    // The lowest bit is the leftmost pixel, and every column of the glyph is
+    // already stretched to xScale bits.
+    //
+    // @params
+    // * int xScale, the scale the rows are stretched to,
+    //               1 to GLYPH_ATLAS_MAX_SCALE
+    //
+    // @return
+    // GLYPH_COUNT * ASCII_HEIGHT rows.
+    const uint64_t * getGlyphAtlas(int xScale);
+
+    // getTextBoxStrip
+    // ====================================================================== //
+    // Finds the strip for a text box, drawing it first if the text box has
+    // changed since it was drawn or doesn't have one. The oldest strip is
+    // reused once there are TEXT_BOX_STRIP_CACHE_SIZE of them.
+    // 
+    // @params
+    // * const TextBox & textBox, text box the strip is for
+    // 
+    // @return
+    // A strip that looks like the text box does now.
+    const TextBoxStrip & getTextBoxStrip(const TextBox & textBox);
+
+    // drawTextBoxStrip
+    // ====================================================================== //
+    // Draws a text box into a strip, the same pixels drawTextBox would draw
+    // straight onto the buffer. The strip is resized to fit.
+    // 
+    // @params
+    // * TextBoxStrip & strip, strip to draw into
+    // * const TextBox & textBox, text box being drawn
+    void drawTextBoxStrip(TextBoxStrip & strip, const TextBox & textBox);
+
+    // compositeTextBoxStrip
+    // ====================================================================== //
+    // Copies every pixel a strip has onto the buffer, skipping the same
+    // pixels drawPointSafely would.
+    // 
+    // @params
+    // * const TextBoxStrip & strip, strip being copied
+    void compositeTextBoxStrip(const TextBoxStrip & strip);
+
+    // getGlyphIndex
     // ====================================================================== //
-    // Used by the DrawSring functions. Contains a massive switch statement
-    // used to draw a given character.
     // 
-    // Since all the characters are in order. I should probably do this a
-    // nicer way.
+    // @params
+    // * char c, the character to be drawn
+    //
+    // @return
+    // The character's place in the glyph table, GLYPH_UNDEFINED if it
+    // doesn't have a glyph.
+    static inline int getGlyphIndex(char c)
+    {
+        if (c < ' ' || c > '~')
+        {
+            return GLYPH_UNDEFINED;
+        }
+        return c - ' ';
+    }
+
+    // selectCharacter
+    // ====================================================================== //
+    // Used by the DrawSring functions. Draws a given character and moves on
+    // to where the next one goes. New lines go back to initialX.
     // 
     // @params
     // * int initialX, the initial x (go back to this on new line)
@@ -681,7 +1231,7 @@ private:
     // drawPointWithZCheck
     // ====================================================================== //
     // Draw a single pixel at the given pixel coordinates.
-    // Makes sure that x and y are within the width and height of the buffer.
+    // Makes sure that x and y are within the given tile.
     // Uses the z coordinate and the z buffer to determine if pixel is drawn.
     // 
     // @params
@@ -689,15 +1239,31 @@ private:
     // * int y, y coordinate
     // * float z, z coordinate
     // * const Color & color, struct containing the rgb color values
-    inline void drawPointWithZCheck(int x, int y, float z, const Color & color)
+    // * const Tile & tile, pixels outside this aren't drawn
+    inline void drawPointWithZCheck(int x, int y, float z, const Color & color, const Tile & tile)
     {
-        
-        if (x > borderOffset && x < m_info.bmiHeader.biWidth - borderOffset &&
-            y > borderOffset && y < m_info.bmiHeader.biHeight - borderOffset &&
-            z >= *(m_zBuffer + x + y * m_info.bmiHeader.biWidth))
+        if (x < tile.minX || x > tile.maxX ||
+            y < tile.minY || y > tile.maxY)
+        {
+            return;
+        }
+
+        int index = x + y * m_width;
+        float oldZ = m_zBuffer[index];
+        if (m_depthEpochs && m_depthEpochs[index] != m_depthEpoch)
         {
-            *(m_memory + x + y * m_info.bmiHeader.biWidth) = GET_RGB(color.r, color.g, color.b);
-            *(m_zBuffer + x + y * m_info.bmiHeader.biWidth) = z;
+            oldZ = m_clearDepth;
+        }
+
+        if (z >= oldZ)
+        {
+            m_memory[index] = GET_RGB(color.r, color.g, color.b);
+            m_zBuffer[index] = z;
+            if (m_depthEpochs)
+            {
+                m_depthEpochs[index] = m_depthEpoch;
+            }
+            markDirty(x, y);
         }
     }
 
@@ -712,146 +1278,650 @@ private:
     // The line is exclusive, so the last coodinate isn't drawn. This means
     // the length of a line from (0, 0) to (3, 0) would be 3.
     // 
-    // Diagonal lines are drawn using the Bresenham's line algorithm.
+    // Lines are drawn with a DDA, one pixel per step along the longer axis,
+    // and only the steps inside the tile are walked.
     //
     // @params
     // * const Point & p0, starting point
     // * const Point & p1, ending point
-    void drawLine3DEx(const Point & p0, const Point & p1);
+    // * const Tile & tile, pixels outside this aren't drawn
+    void drawLine3DEx(const Point & p0, const Point & p1, const Tile & tile);
+
+    // getDrawableTile
+    // ====================================================================== //
+    // 
+    // @return
+    // A tile covering every pixel the 3D functions are allowed to draw on,
+    // everything inside the border.
+    inline Tile getDrawableTile() const
+    {
+        return Tile(
+            borderOffset + 1,
+            borderOffset + 1,
+            m_width - borderOffset - 1,
+            m_height - borderOffset - 1);
+    }
+
+    // getTile
+    // ====================================================================== //
+    // 
+    // @params
+    // * unsigned index, index of a tile in the tile grid, row by row
+    // 
+    // @return
+    // The part of the tile at the given index that can be drawn on.
+    inline Tile getTile(unsigned index) const
+    {
+        Tile drawable = getDrawableTile();
+        int column = index % m_tileColumns;
+        int row = index / m_tileColumns;
+        return Tile(
+            MAX(column * TILE_SIZE, drawable.minX),
+            MAX(row * TILE_SIZE, drawable.minY),
+            MIN((column + 1) * TILE_SIZE - 1, drawable.maxX),
+            MIN((row + 1) * TILE_SIZE - 1, drawable.maxY));
+    }
+
+    // drawPoint3D, drawLine3D, drawTriangleOutline3D, drawTriangle3D
+    // ====================================================================== //
+    // Same as the public versions, but nothing outside the given tile gets
+    // drawn.
+    // 
+    // @params
+    // * const Point & p0, p1, p2, the points making up the primitive
+    // * const Tile & tile, pixels outside this aren't drawn
+    void drawPoint3D(const Point & point, const Tile & tile);
+    void drawLine3D(const Point & p0, const Point & p1, const Tile & tile);
+    void drawTriangleOutline3D(const Point & p0, const Point & p1, const Point & p2, const Tile & tile);
+    inline void drawTriangle3D(const Point & p0, const Point & p1, const Point & p2, const Tile & tile)
+    {
+        if (m_triangleRasterizer == TR_EDGE_FUNCTION)
+        {
+            drawTriangle3DEdgeFunction(p0, p1, p2, tile);
+        }
+        else
+        {
+            drawTriangle3DBarycentric(p0, p1, p2, tile);
+        }
+    }
+
+    // getPixelCoordinates
+    // ====================================================================== //
+    // Map a point in Image space, typically ranging from -1 to 1, onto the
+    // pixel it lands on. The shorter side of the buffer is centered on the
+    // longer side, so the image isn't stretched.
+    // 
+    // @params
+    // * const Point & p, point in Image space
+    // * int & x, set to the pixel's x coordinate
+    // * int & y, set to the pixel's y coordinate
+    inline void getPixelCoordinates(const Point & p, int & x, int & y) const
+    {
+        int borderHeight = m_height - borderOffset * 2;
+        int borderWidth = m_width - borderOffset * 2;
+
+        if (borderWidth >= borderHeight)
+        {
+            x = borderOffset + (long long)((p.x + 1) / 2 * borderWidth);
+            y = borderOffset + (long long)((p.y + 1) / 2 * borderWidth) - (borderWidth - borderHeight) / 2;
+        }
+        else
+        {
+            x = borderOffset + (long long)((p.x + 1) / 2 * borderHeight) - (borderHeight - borderWidth) / 2;
+            y = borderOffset + (long long)((p.y + 1) / 2 * borderHeight);
+        }
+    }
+
+    // getSubpixelCoordinates
+    // ====================================================================== //
+    // Same as getPixelCoordinates, but in 1/SUBPIXEL_SCALE of a pixel and
+    // rounded instead of truncated. Pixel x covers [x, x + 1) times
+    // SUBPIXEL_SCALE and is sampled in the middle.
+    // 
+    // @params
+    // * const Point & p, point in Image space
+    // * int & x, set to the x coordinate in subpixels
+    // * int & y, set to the y coordinate in subpixels
+    inline void getSubpixelCoordinates(const Point & p, int & x, int & y) const
+    {
+        int borderHeight = m_height - borderOffset * 2;
+        int borderWidth = m_width - borderOffset * 2;
+
+        if (borderWidth >= borderHeight)
+        {
+            x = (int)((p.x + 1) / 2 * borderWidth * SUBPIXEL_SCALE + 0.5f);
+            y = (int)((p.y + 1) / 2 * borderWidth * SUBPIXEL_SCALE + 0.5f) - (borderWidth - borderHeight) / 2 * SUBPIXEL_SCALE;
+        }
+        else
+        {
+            x = (int)((p.x + 1) / 2 * borderHeight * SUBPIXEL_SCALE + 0.5f) - (borderHeight - borderWidth) / 2 * SUBPIXEL_SCALE;
+            y = (int)((p.y + 1) / 2 * borderHeight * SUBPIXEL_SCALE + 0.5f);
+        }
+        x += borderOffset * SUBPIXEL_SCALE;
+        y += borderOffset * SUBPIXEL_SCALE;
+    }
+
+    // drawTriangle3DBarycentric
+    // ====================================================================== //
+    // drawTriangle3D using the Barycentric Algorithm. Every pixel in the
+    // triangle's bounding box gets its own cross products and its own three
+    // triangle areas.
+    // 
+    // @params
+    // * const Point & p0, a vertex of the triangle
+    // * const Point & p1, another vertex of the triangle
+    // * const Point & p2, the third vertex of the triangle
+    // * const Tile & tile, pixels outside this aren't drawn
+    void drawTriangle3DBarycentric(const Point & p0, const Point & p1, const Point & p2, const Tile & tile);
+
+    // drawTriangle3DEdgeFunction
+    // ====================================================================== //
+    // drawTriangle3D using edge functions. The edge functions, z, and color
+    // gradients are set up once per triangle. The edge functions are then
+    // stepped by a constant amount per pixel and per row, and z and color
+    // are a multiply and add away from the values at p0.
+    // 
+    // The vertices are snapped to subpixels (see getSubpixelCoordinates) and
+    // a pixel is covered if its center is inside the triangle. A center
+    // landing exactly on an edge only counts for top and left edges (see
+    // isTopLeftEdge), so triangles sharing an edge never both draw a pixel
+    // and never leave a crack between them.
+    // 
+    // The covered columns of each row are worked out from the edge
+    // functions, and the row is handed to the span kernel (see
+    // setSpanKernel) for the z test and the writes.
+    // 
+    // With the hierarchical z buffer on (see setHierarchicalZ), the whole
+    // triangle and then the ends of each row are checked against it first,
+    // and blocks the triangle covers get their depth raised afterwards.
+    // 
+    // @params
+    // * const Point & p0, a vertex of the triangle
+    // * const Point & p1, another vertex of the triangle
+    // * const Point & p2, the third vertex of the triangle
+    // * const Tile & tile, pixels outside this aren't drawn
+    void drawTriangle3DEdgeFunction(const Point & p0, const Point & p1, const Point & p2, const Tile & tile);
+
+    // narrowSpan
+    // ====================================================================== //
+    // Shrink [first, last] to the columns where an edge function,
+    // e + column * step, is not negative. The span ends up empty
+    // (first > last) if there aren't any.
+    // 
+    // @params
+    // * int64_t e, edge function at column 0
+    // * int64_t step, change in the edge function per column
+    // * int & first, first column of the span
+    // * int & last, last column of the span
+    static inline void narrowSpan(int64_t e, int64_t step, int & first, int & last)
+    {
+        if (step > 0)
+        {
+            if (e < 0)
+            {
+                first = (int)MAX(first, (-e + step - 1) / step);
+            }
+        }
+        else if (step < 0)
+        {
+            if (e < 0)
+            {
+                last = -1;
+            }
+            else
+            {
+                last = (int)MIN(last, e / -step);
+            }
+        }
+        else if (e < 0)
+        {
+            last = -1;
+        }
+    }
+
+    // getDepthSortKey
+    // ====================================================================== //
+    // 
+    // @params
+    // * const Entity * entity, entity being sorted
+    // * unsigned index, where the entity is in the array being sorted
+    // * const Camera & camera, camera the entity is drawn with
+    // * const Matrix & cameraTransform, world space to camera space
+    // 
+    // @return
+    // The entity's depth in front of the camera. An entity the camera is
+    // inside of gets the depth of its far side instead.
+    static DepthSortKey getDepthSortKey(const Entity * entity, unsigned index, const Camera & camera, const Matrix & cameraTransform);
+
+    // sortByDepth
+    // ====================================================================== //
+    // Merge sort the keys, nearest first. Entities at the same depth stay in
+    // the order they were given in.
+    // 
+    // @params
+    // * Array<DepthSortKey> & keys, gets sorted
+    static void sortByDepth(Array<DepthSortKey> & keys);
+
+    // markDirty
+    // ====================================================================== //
+    // Mark the tile a pixel is in as drawn on, so the next clear clears it.
+    // 
+    // @params
+    // * int x, y, the pixel that was written
+    inline void markDirty(int x, int y)
+    {
+        m_dirtyTiles[x / TILE_SIZE + (y / TILE_SIZE) * m_dirtyTileColumns] = true;
+    }
+
+    // resizeDirtyTiles
+    // ====================================================================== //
+    // Make the dirty tile flags fit the scene and the frame. The next clear
+    // clears everything.
+    void resizeDirtyTiles();
+
+    // setDrawTarget
+    // ====================================================================== //
+    // Point m_memory, m_width, m_height, and the dirty tiles at the scene or
+    // the frame. While the scene is scaled, the frame's dirty tiles are only
+    // there for the 2D drawing to mark. Nothing reads them, the stretch in
+    // endScene covers the whole frame.
+    // 
+    // @params
+    // * bool scene, true for the scene, false for the frame
+    void setDrawTarget(bool scene);
+
+    // stretchScene
+    // ====================================================================== //
+    // Stretch the scaled scene over the whole frame, nearest pixel.
+    void stretchScene();
+
+    // setResolutionScale
+    // ====================================================================== //
+    // Draw the scene at a fraction of the full width and height. Its rows
+    // are packed at the start of m_sceneMemory and the z buffer.
+    // 
+    // @params
+    // * float scale, fraction of the full size, no more than 1
+    void setResolutionScale(float scale);
+
+    // resetDepthEpochs
+    // ====================================================================== //
+    // Set every depth epoch to 0, which is never the current one, so the
+    // whole z buffer counts as cleared.
+    void resetDepthEpochs();
+
+    // fillRow
+    // ====================================================================== //
+    // fillRowSSE2 if the span kernel uses SIMD, fillRowScalar if not.
+    // 
+    // @params
+    // * uint32_t * row, uint32_t value, int count, bool stream, see fillRowSSE2
+    inline void fillRow(uint32_t * row, uint32_t value, int count, bool stream)
+    {
+        if (m_spanKernel == SK_SCALAR)
+        {
+            fillRowScalar(row, value, count);
+        }
+        else
+        {
+            fillRowSSE2(row, value, count, stream);
+        }
+    }
+
+    // resizeHierarchicalZ
+    // ====================================================================== //
+    // Make the hierarchical z buffer fit the current buffer size. Every depth
+    // is set low enough that nothing is behind it.
+    void resizeHierarchicalZ();
+
+    // clearHierarchicalZ
+    // ====================================================================== //
+    // Set every block and tile depth, after the z buffer was set to it.
+    // 
+    // @params
+    // * float w, depth the z buffer was cleared to
+    void clearHierarchicalZ(float w);
+
+    // getHiZTile
+    // ====================================================================== //
+    // Brings the tile's depth up to the lowest of its blocks first if any of
+    // them changed.
+    // 
+    // @params
+    // * int column, row, the tile's place in the tile grid
+    // 
+    // @return
+    // A depth nothing drawn in the tile is behind.
+    float getHiZTile(int column, int row);
+
+    // isOccluded
+    // ====================================================================== //
+    // Check a rectangle of pixels against the hierarchical z buffer, tiles
+    // first and then the blocks of any tile that doesn't settle it.
+    // 
+    // @params
+    // * int minX, minY, maxX, maxY, the rectangle, bounds are inclusive
+    // * float z, nearest depth anything in the rectangle could have
+    // 
+    // @return
+    // true if z is behind every pixel in the rectangle.
+    bool isOccluded(int minX, int minY, int maxX, int maxY, float z);
+
+    // isTopLeftEdge
+    // ====================================================================== //
+    // Top-left fill rule. The edge goes from one vertex to the next with the
+    // triangle wound counterclockwise (y up). Left edges go down, and a top
+    // edge is flat and goes left. Flipping the edge's direction always flips
+    // the answer, so of two triangles sharing an edge exactly one owns it.
+    // 
+    // @params
+    // * int dx, dy, the edge's direction
+    // 
+    // @return
+    // true if pixel centers right on this edge are inside the triangle.
+    static inline bool isTopLeftEdge(int dx, int dy)
+    {
+        return dy < 0 || (dy == 0 && dx < 0);
+    }
 
 
     // ====================================================================== //
     // vvv                        Rasterization!                          vvv //
     // ---------------------------------------------------------------------- //
 
-    // applySimpleLighting
+    // cullEntity
     // ====================================================================== //
-    // Apply a simple lighting algorithm with the given point representing
-    // the light source.
+    // Test an entity's draw radius against the view frustum. Entities
+    // without a draw radius yet, or drawing their normals (which can stick
+    // out past it), are never culled.
     // 
     // @params
-    // * const Point & source, light source
-    // * float ambiant, constant multiplyer to add light in general
-    // * float diffuse, constant multiplier relying on surface normal and
-    //                  light source location
-    // * Shape & shape, shape the lighting is applied to
-    void applySimpleLighting(const Point & source, float ambiant, float diffuse, Shape & shape) const;
+    // * const Frustum & frustum, view frustum in world space
+    // * const Entity * entity, entity being tested
+    // 
+    // @return
+    // Where the entity is compared to the frustum.
+    FrustumTest cullEntity(const Frustum & frustum, const Entity * entity);
 
-    // applySimpleDistanceShading
+    // prepareEntity
+    // ====================================================================== //
+    // Build the shape, in Image space and ready to be drawn, of an entity.
+    // 
+    // Works straight off the entity's frame, or one of its detail frames
+    // when it's small on screen (see getDetailFrame). Frame points are
+    // transformed at most once, into the vertex cache. The lines and
+    // triangles the draw properties ask for are then put together from the
+    // cached vertices by their index, with lighting applied as each triangle
+    // is put together. Last comes clipping.
+    // 
+    // Backfaces are culled in the entity's own space, by putting the camera
+    // there and checking it against the frame's planes. When only triangles
+    // get drawn, the points that just belong to backfaces are never
+    // transformed.
+    // 
+    // Clipping is done in clip space, so it also takes care of anything
+    // behind the camera.
+    // 
+    // @params
+    // * const Entity * entity, entity being drawn
+    // * bool insideFrustum, true to skip clipping, the entity is on screen
+    // * const Matrix & cameraTransform, world space to camera space
+    // * const Matrix & viewingTransform, camera space to clip space
+    // * Array<TransformedVertex> & vertices, vertex cache, gets overwritten
+    // * Shape & shape, gets filled with the entity's shape in Image space
+    void prepareEntity(const Entity * entity, bool insideFrustum, const Matrix & cameraTransform, const Matrix & viewingTransform, Array<TransformedVertex> & vertices, Shape & shape) const;
+
+    // getDetailFrame
     // ====================================================================== //
-    // Make points that are farther from the origin darker.
+    // Pick the frame to draw an entity with, from how big its draw radius
+    // is on screen. Every subdivision halves the length of the edges, which
+    // start out at about sqrt(2) times the radius, so this is the least
+    // subdivided frame with edges no longer than DETAIL_EDGE_PIXELS.
     // 
     // @params
-    // * Shape & shape, shape getting shaded
-    void applySimpleDistanceShading(Shape & shape) const;
+    // * const Entity * entity, entity being drawn
+    // * const Matrix & cameraTransform, world space to camera space
+    // 
+    // @return
+    // One of the entity's detail frames, or its frame.
+    const Frame & getDetailFrame(const Entity * entity, const Matrix & cameraTransform) const;
 
-    // cullBackfaces
+    // transformVertex
     // ====================================================================== //
-    // Remove triangles that have a surface normal facing away from the
-    // camera.
+    // Takes a point straight to clip space with one matrix multiply. The
+    // viewing transform leaves x and y alone and puts -z in w, so the camera
+    // space point is read back out of the clip space one.
     // 
-    // @param
-    // * Shape & shape, shape being culled
-    void cullBackfaces(Shape & shape) const;
+    // @params
+    // * const Point & point, point in the entity's own space
+    // * const Matrix & objectToClip, entity space to clip space
+    // * bool distanceShading, false if the entity has distance shading off
+    // 
+    // @return
+    // The point in camera and clip space, and its distance shading.
+    static TransformedVertex transformVertex(const Point & point, const Matrix & objectToClip, bool distanceShading);
 
-    // moveOffCameraLocation
+    // getTransformedVertex
     // ====================================================================== //
-    // After applying the camera transform, some points might end up with a z
-    // value of zero. Then when the viewing transform is applied, you get a w
-    // value that is 0. After this, when converting back to 3d you end up 
-    // dividing by zero and get undefined values for x, y, and z.
+    // Get a frame point out of the vertex cache, transforming it first if
+    // that hasn't happened yet.
     // 
-    // This function slightly moves points at z = 0 onto z = -0.001.
+    // @params
+    // * const Point * point, the frame point, somewhere in frame.points
+    // * const Point * firstPoint, start of frame.points
+    // * const Matrix & objectToClip, entity space to clip space
+    // * bool distanceShading, false if the entity has distance shading off
+    // * Array<TransformedVertex> & vertices, vertex cache, one per frame point
     // 
-    // @param
-    // * Shape & shape, structure holding the points
-    void moveOffCameraLocation(Shape & shape) const;
+    // @return
+    // The point in camera and clip space, and its distance shading.
+    static inline const TransformedVertex & getTransformedVertex(const Point * point, const Point * firstPoint, const Matrix & objectToClip, bool distanceShading, Array<TransformedVertex> & vertices)
+    {
+        TransformedVertex & vertex = vertices[point - firstPoint];
+        if (!vertex.transformed)
+        {
+            vertex = transformVertex(*point, objectToClip, distanceShading);
+        }
+        return vertex;
+    }
 
-    // clipBehindCamera
+    // drawShape
     // ====================================================================== //
-    // Applied in camera space (after camera transform), this removes all the
-    // points, clips lines, and clips triangles, behind the camera point.
+    // Draw the parts of a prepared shape that the draw properties ask for.
     // 
-    // This is so they don't flip infront of the camera when the viewing
-    // transformed is applied and the point are in image space.
+    // @params
+    // * const Shape & shape, shape in Image space
+    // * uint8_t drawProperties, the entity's draw properties
+    // * const Tile & tile, pixels outside this aren't drawn
+    void drawShape(const Shape & shape, uint8_t drawProperties, const Tile & tile);
+
+    // binShape
+    // ====================================================================== //
+    // Add the primitives of a prepared shape to the bins of every tile their
+    // bounding boxes touch. Primitives are added in the same order drawShape
+    // would draw them, so each tile ends up looking the same as if
+    // everything was drawn in order on one thread.
     // 
-    // Bounds are exclusive, points at z == 0 arn't clipped.
+    // @params
+    // * unsigned shapeIndex, index of the shape in m_groupShapes
+    // * const Shape & shape, shape in Image space
+    // * uint8_t drawProperties, the entity's draw properties
+    void binShape(unsigned shapeIndex, const Shape & shape, uint8_t drawProperties);
+
+    // binPrimitive
+    // ====================================================================== //
+    // Add a primitive to the bins of every tile a pixel bounding box
+    // touches.
     // 
-    // @param
-    // * Shape & shape, structure holding the points
-    void clipBehindCamera(Shape & shape) const;
+    // @params
+    // * const BinnedPrimitive & primitive, what's being binned
+    // * int minX, int minY, int maxX, int maxY, pixel bounding box
+    void binPrimitive(const BinnedPrimitive & primitive, int minX, int minY, int maxX, int maxY);
+
+    // updateTileGrid
+    // ====================================================================== //
+    // Make sure there's a bin for every tile, in case the buffer changed
+    // size. Then empty all the bins.
+    void updateTileGrid();
 
-    // clipLeft
+    // prepareShapeJob
     // ====================================================================== //
-    // Applied in image space (after the viewing transform), this removes
-    // points, clips lines, and clips trianges, that are outside and to the
-    // left of the viewing frustrum.
+    // WorkerJob that calls prepareEntity on one entity from m_groupEntities.
     // 
-    // Bounds are exclusive, points at x == -1 arn't clipped.
+    // @params
+    // * void * data, the ScreenBuffer
+    // * unsigned index, index of the entity
+    // * unsigned thread, picks the vertex cache from m_workerVertexCaches
+    static void prepareShapeJob(void * data, unsigned index, unsigned thread);
+
+    // rasterizeTileJob
+    // ====================================================================== //
+    // WorkerJob that draws everything in one tile's bin.
     // 
-    // @param
-    // * Shape & shape, structure holding the points
-    void clipLeft(Shape & shape) const;
+    // @params
+    // * void * data, the ScreenBuffer
+    // * unsigned index, index of the tile
+    // * unsigned thread, not used
+    static void rasterizeTileJob(void * data, unsigned index, unsigned thread);
 
-    // clipRight
+    // applySimpleLighting
     // ====================================================================== //
-    // Applied in image space (after the viewing transform), this removes
-    // points, clips lines, and clips trianges, that are outside and to the 
-    // right of the viewing frustrum.
+    // Apply a simple lighting algorithm, with the light at the camera, to
+    // one vertex of a triangle.
     // 
-    // Boudns are exclusive, points at x == 1 arn't clipped.
+    // Every point on a triangle is the same distance along its normal, so
+    // the normal dotted with the direction to the camera only needs the
+    // triangle's facing (see getFacing) and the vertex's inverse distance.
     // 
-    // @param
-    // * Shape & shape, structure holding the points
-    void clipRight(Shape & shape) const;
+    // @params
+    // * float ambiant, constant multiplyer to add light in general
+    // * float diffuse, constant multiplier relying on surface normal and
+    //                  light source location
+    // * float facing, the triangle's facing
+    // * const TransformedVertex & vertex, the vertex being lit
+    // 
+    // @return
+    // The vertex's color after lighting, without distance shading.
+    static Color applySimpleLighting(float ambiant, float diffuse, float facing, const TransformedVertex & vertex);
 
-    // clipBottom
+    // getFacing
     // ====================================================================== //
-    // Applied in image space (after the viewing transform), this removes
-    // points, clips lines, and clips trianges, that are outside and below
-    // the viewing frustrum.
+    // How far the camera is in front of a triangle, along its unit normal.
+    // It's a backface if this isn't positive.
     // 
-    // Boudns are exclusive, points at y == -1 arn't clipped.
+    // @params
+    // * const Vector & normal, unit normal of the triangle in camera space
+    // * const Point & p0, any vertex of the triangle in camera space
     // 
-    // @param
-    // * Shape & shape, structure holding the points
-    void clipBottom(Shape & shape) const;
+    // @return
+    // The distance from the triangle's plane to the camera, negative if
+    // the camera is behind it.
+    static inline float getFacing(const Vector & normal, const Point & p0)
+    {
+        // the camera is at the origin
+        return -(normal.x * p0.x + normal.y * p0.y + normal.z * p0.z);
+    }
 
-    // clipTop
+    // getCameraSpaceNormal
     // ====================================================================== //
-    // Applied in image space (after the viewing transform), this removes
-    // points, clips lines, and clips trianges, that are outside and above
-    // the viewing frustrum.
+    // Works out a triangle's unit normal from its camera space vertices,
+    // for frames that don't have their normals calculated.
     // 
-    // Boudns are exclusive, points at y == 1 arn't clipped.
+    // @params
+    // * const Point & p0, p1, p2, the triangle in camera space
     // 
-    // @param
-    // * Shape & shape, structure holding the points
-    void clipTop(Shape & shape) const;
+    // @return
+    // The same normal as Triangle::getNormal.
+    static Vector getCameraSpaceNormal(const Point & p0, const Point & p1, const Point & p2);
 
-    // clipFar
+    // clipToFrustum
     // ====================================================================== //
-    // Applied in image space (after the viewing transform), this removes
-    // points, clips lines, and clips trianges, that are in behind of the
-    // viewing frustrum's far plane.
+    // Applied in clip space (after the viewing transform, before to3D), this
+    // removes points, clips lines, and clips triangles, that are outside the
+    // viewing frustum. All six planes are done in one pass.
+    // 
+    // Every vertex gets an outcode. Primitives with all outcodes at zero are
+    // inside and are left alone. Primitives with a bit set in all their
+    // outcodes are outside that plane and are removed. Only the rest get
+    // clipped, and only against the planes in their outcodes.
     // 
-    // Boudns are exclusive, points at z == -1 arn't clipped.
+    // Bounds are inclusive, points on a plane aren't clipped.
     // 
     // @param
     // * Shape & shape, structure holding the points
-    void clipFar(Shape & shape) const;
+    void clipToFrustum(Shape & shape) const;
+
+    // clipPolygon
+    // ====================================================================== //
+    // Clip a convex polygon against the frustum planes in the given outcode,
+    // one plane after the other (Sutherland-Hodgman).
+    // 
+    // @params
+    // * Point * polygon, vertices in order, room for CLIP_POLYGON_SIZE
+    // * int count, number of vertices in the polygon
+    // * uint8_t outcode, planes to clip against
+    // 
+    // @return
+    // The number of vertices left. Less than 3 if nothing is left.
+    static int clipPolygon(Point * polygon, int count, uint8_t outcode);
 
-    // clipNear
+    // getClipIntersection
     // ====================================================================== //
-    // Applied in image space (after the viewing transform), this removes
-    // points, clips lines, and clips trianges, that are in front of the
-    // viewing frustrum's near plane.
+    // Get the point where the edge between two points crosses a plane.
+    // Always going from the inside point to the outside point means an edge
+    // shared by two triangles gets cut at exactly the same spot.
     // 
-    // Boudns are exclusive, points at z == 1 arn't clipped.
+    // @params
+    // * const Point & inside, end of the edge inside the plane
+    // * const Point & outside, end of the edge outside the plane
+    // * float insideDistance, getClipDistance of the inside point
+    // * float outsideDistance, getClipDistance of the outside point
     // 
-    // @param
-    // * Shape & shape, structure holding the points
-    void clipNear(Shape & shape) const;
+    // @return
+    // The point on the plane, with w and color interpolated too.
+    static Point getClipIntersection(const Point & inside, const Point & outside, float insideDistance, float outsideDistance);
+
+    // getClipDistance
+    // ====================================================================== //
+    // 
+    // @params
+    // * const Point & p, a point in clip space
+    // * int plane, index of the plane, the bit number of its outcode
+    // 
+    // @return
+    // How far inside the plane the point is, negative if it's outside.
+    static inline float getClipDistance(const Point & p, int plane)
+    {
+        switch (plane)
+        {
+        case 0:  return p.w + p.x;
+        case 1:  return p.w - p.x;
+        case 2:  return p.w + p.y;
+        case 3:  return p.w - p.y;
+        case 4:  return p.w + p.z;
+        default: return p.w - p.z;
+        }
+    }
+
+    // getOutcode
+    // ====================================================================== //
+    // 
+    // @params
+    // * const Point & p, a point in clip space
+    // 
+    // @return
+    // The OUTCODE_ bits for the planes the point is outside of.
+    static inline uint8_t getOutcode(const Point & p)
+    {
+        uint8_t outcode = 0;
+        if (p.x < -p.w) outcode |= OUTCODE_LEFT;
+        if (p.x > p.w)  outcode |= OUTCODE_RIGHT;
+        if (p.y < -p.w) outcode |= OUTCODE_BOTTOM;
+        if (p.y > p.w)  outcode |= OUTCODE_TOP;
+        if (p.z < -p.w) outcode |= OUTCODE_FAR;
+        if (p.z > p.w)  outcode |= OUTCODE_NEAR;
+        return outcode;
+    }
 
 
     // ====================================================================== //
@@ -940,33 +2010,112 @@ private:
     Pair<int> getCubicBezierPoint(float t, Pair<int> v0, Pair<int> v1, Pair<int> v2, Pair<int> v3);
     
 private:
-    // The BITMAPINFO struct defines dimensions and color information for a DIB
-    BITMAPINFO m_info;
-    // .  BITMAPINFOHEADER bmiHeader;
-    //     .  DWORD            biSize;
-    //     .  LONG             biWidth;
-    //     .  LONG             biHeight;
-    //     .  WORD             biPlanes;
-    //     .  WORD             biBitCount;
-    //     .  DWORD            biCompression;
-    //     .  DWORD            biSizeImage;
-    //     .  LONG             biXPelsPerMeter;
-    //     .  LONG             biYPelsPerMeter;
-    //     .  DWORD            biClrUsed;
-    //     .  DWORD            biClrImportant;
-    // .  RGBQUAD          bmiColors[1];
-    //     .  BYTE             rgbBlue;
-    //     .  BYTE             rgbGreen;
-    //     .  BYTE             rgbRed;
-    //     .  BYTE             rgbReserved;
+    // Size of the color and z buffers being drawn to, smaller than the
+    // memory while drawing a scaled scene
+    long m_width;
+    long m_height;
 
     // A pixel in memory looks like 0x 00 RR GG BB
     // NOTE: This is a little Endian Architecture so the first byte is blue
+    // m_memory is whichever of the frame and the scene is being drawn to.
+    // The frame is the full size, and what getPixels gives out. The scene
+    // is 0 until the resolution scale first goes under 1. All of them start
+    // on a page boundary.
     uint32_t * m_memory;
+    uint32_t * m_frameMemory;
+    uint32_t * m_sceneMemory;
     
     // Used to determine which pixel two draw when objects overlap
     float * m_zBuffer;
 
     // Pixel boarder around the 3D drawing space seperating it from the buffer edge
     unsigned borderOffset;
+
+    // Algorithm drawTriangle3D uses
+    TriangleRasterizer m_triangleRasterizer;
+
+    // What the 3D draw functions have done since resetRenderStats
+    RenderStats m_renderStats;
+
+    // Draw rasterizeGroup's entities nearest first
+    bool m_frontToBack;
+
+    // Hierarchical z buffer, a depth for every block and every tile that
+    // nothing drawn there is behind. Depths only go up between clears, so
+    // an old depth is still safe to use, it just might not be the tightest.
+    bool m_hierarchicalZ;
+    int m_hiZBlockColumns;
+    int m_hiZBlockRows;
+    float * m_hiZBlocks;
+    int m_hiZTileColumns;
+    int m_hiZTileRows;
+    float * m_hiZTiles;
+    bool * m_hiZTileChanged; // one of the tile's blocks went up
+
+    // Dirty tile clearing, a flag for every tile drawn on since the last
+    // clear and what that clear was
+    bool m_dirtyTileClear;
+    int m_dirtyTileColumns;
+    int m_dirtyTileRows;
+    bool * m_dirtyTiles;      // the scene's or the frame's, see setDrawTarget
+    bool * m_sceneDirtyTiles;
+    bool * m_frameDirtyTiles; // 0 unless the scene is scaled
+    bool m_clearEverything; // something touched pixels without marking them
+    uint32_t m_clearColor;
+    float m_clearDepth;
+
+    // Epoch depth, which clear every z buffer value was written after. Any
+    // value not from the current epoch counts as m_clearDepth. The epochs
+    // are only there while it's on.
+    bool m_epochDepth;
+    uint8_t * m_depthEpochs;
+    uint8_t m_depthEpoch;
+
+    // Kernel filling the rows of triangles
+    SpanKernel m_spanKernel;
+    SpanKernelFunction m_fillSpan;
+
+    // Dynamic resolution, the full size is what the memory was made for
+    bool m_dynamicResolution;
+    int m_fullWidth;
+    int m_fullHeight;
+    int m_sceneWidth;
+    int m_sceneHeight;
+    bool m_drawingScene; // between beginScene and endScene
+    float m_resolutionScale;
+    float m_minResolutionScale;
+    float m_maxResolutionScale;
+    float m_targetFrameTime;
+    float m_frameTimeTotal;
+    int m_frameTimeCount;
+
+    // Retained UI, a strip for each text box drawn recently
+    bool m_retainedUI;
+    Array<TextBoxStrip*> m_textBoxStrips;
+    int m_nextTextBoxStrip; // strip reused once there's no room for more
+
+    // Glyph atlases for every xScale that's been used, 0 for the rest
+    uint64_t * m_glyphAtlases[GLYPH_ATLAS_MAX_SCALE + 1];
+
+    // Binned rasterization, the threads and a bin for every tile
+    bool m_binnedRasterization;
+    WorkerPool * m_workerPool;
+    int m_tileColumns;
+    int m_tileRows;
+    Array<BinnedPrimitive> * m_tileBins;
+
+    // Transformed frame points of the entity being prepared, when it's
+    // done on this thread
+    Array<TransformedVertex> m_vertexCache;
+
+    // The same for prepareShapeJob, one per thread in the worker pool so
+    // they get reused from frame to frame too
+    Array<TransformedVertex> * m_workerVertexCaches;
+
+    // What the worker jobs are working on durring rasterizeGroup
+    Array<Entity*> * m_groupEntities;
+    Array<Shape> * m_groupShapes;
+    Array<bool> * m_groupInsideFrustum;
+    Matrix m_groupCameraTransform;
+    Matrix m_groupViewingTransform;
 };
\ No newline at end of file
@@ -10,6 +10,9 @@
 
 
 // -------------------------------------------------------------------------- //
+// Other compilers bring these in with the SIMD intrinsic headers, and their
+// 64 bit types don't always match the ones below.
+#if defined(_MSC_VER)
 typedef signed char        int8_t;
 typedef short              int16_t;
 typedef int                int32_t;
@@ -17,4 +20,7 @@ typedef long long          int64_t;
 typedef unsigned char      uint8_t; // usefull for pixel specific stuff
 typedef unsigned short     uint16_t;
 typedef unsigned int       uint32_t;
-typedef unsigned long long uint64_t;
\ No newline at end of file
+typedef unsigned long long uint64_t;
+#else
+#include <stdint.h>
+#endif
@@ -0,0 +1,408 @@
+/* ==========================================================================
+   >File: SpanKernels.cpp
+   >Date: 20180713
+   >Author: Vik Pandher
+   >Details: Inner loops that fill a horizontal run of pixels in a triangle.
+             There's a plain version and SSE2/AVX2 versions that do 4 or 8
+             pixels at a time. They all give the exact same output. Also the
+             loops that clear and fade whole rows of the buffers.
+   ========================================================================== */
+
+#include "SpanKernels.h"
+#include "MathUtilities.h"
+#include "ColorUtilities.h"
+#include <emmintrin.h>
+#include <immintrin.h>
+
+// MSVC lets any function use any intrinsic, other compilers need to be told
+// which functions are allowed to use AVX2.
+#if defined(_MSC_VER)
+    #include <intrin.h>
+    #define AVX2_FUNCTION
+#else
+    #include <cpuid.h>
+    #define AVX2_FUNCTION __attribute__((target("avx2")))
+#endif
+
+
+
+/* --------------------------------------------------------------------------
+   NOTES:
+   For the kernels to match exactly, every one of them has to do the same
+   float operations in the same order:
+   value = start + column * step, then clamp color to [0, 255], then
+   truncate. So no fused multiply-adds in the SIMD versions.
+   -------------------------------------------------------------------------- */
+
+// countBits
+// ========================================================================== //
+// 
+// @params
+// * int mask, a movemask of lanes
+// 
+// @return
+// The number of bits set in the mask.
+static inline int countBits(int mask)
+{
+    int count = 0;
+    while (mask)
+    {
+        mask &= mask - 1;
+        count++;
+    }
+    return count;
+}
+
+
+int fillSpanScalar(const Span & span)
+{
+    int written = 0;
+    float column = span.column;
+    for (int i = 0; i < span.count; i++)
+    {
+        float z = span.z + column * span.zStep;
+        float oldZ = span.depth[i];
+        if (span.epoch && span.epoch[i] != span.currentEpoch)
+        {
+            oldZ = span.clearDepth;
+        }
+
+        if (z >= oldZ)
+        {
+            float r = span.r + column * span.rStep;
+            float g = span.g + column * span.gStep;
+            float b = span.b + column * span.bStep;
+            r = MIN(MAX(r, 0.0f), 255.0f);
+            g = MIN(MAX(g, 0.0f), 255.0f);
+            b = MIN(MAX(b, 0.0f), 255.0f);
+            span.pixel[i] = GET_RGB((uint32_t)r, (uint32_t)g, (uint32_t)b);
+            span.depth[i] = z;
+            if (span.epoch)
+            {
+                span.epoch[i] = span.currentEpoch;
+            }
+            written++;
+        }
+        column += 1;
+    }
+    return written;
+}
+
+
+int fillSpanSSE2(const Span & span)
+{
+    __m128 lanes = _mm_set_ps(3, 2, 1, 0);
+    __m128 zero = _mm_set1_ps(0.0f);
+    __m128 full = _mm_set1_ps(255.0f);
+    __m128 zStart = _mm_set1_ps(span.z);
+    __m128 rStart = _mm_set1_ps(span.r);
+    __m128 gStart = _mm_set1_ps(span.g);
+    __m128 bStart = _mm_set1_ps(span.b);
+    __m128 zStep = _mm_set1_ps(span.zStep);
+    __m128 rStep = _mm_set1_ps(span.rStep);
+    __m128 gStep = _mm_set1_ps(span.gStep);
+    __m128 bStep = _mm_set1_ps(span.bStep);
+    __m128 clearDepth = _mm_set1_ps(span.clearDepth);
+    __m128i currentEpoch = _mm_set1_epi32(span.currentEpoch);
+    uint32_t epochBytes = 0;
+
+    int written = 0;
+    int i = 0;
+    for (; i + 4 <= span.count; i += 4)
+    {
+        __m128 column = _mm_add_ps(_mm_set1_ps(span.column + i), lanes);
+        __m128 z = _mm_add_ps(zStart, _mm_mul_ps(column, zStep));
+        __m128 storedZ = _mm_loadu_ps(span.depth + i);
+        __m128 oldZ = storedZ;
+        if (span.epoch)
+        {
+            // one epoch byte per 32 bit lane, depths from old epochs count
+            // as cleared
+            const uint8_t * e = span.epoch + i;
+            epochBytes = e[0] | (e[1] << 8) | (e[2] << 16) | (e[3] << 24);
+            __m128i epochs = _mm_cvtsi32_si128(epochBytes);
+            epochs = _mm_unpacklo_epi16(_mm_unpacklo_epi8(epochs, _mm_setzero_si128()), _mm_setzero_si128());
+            __m128 current = _mm_castsi128_ps(_mm_cmpeq_epi32(epochs, currentEpoch));
+            oldZ = _mm_or_ps(_mm_and_ps(current, oldZ), _mm_andnot_ps(current, clearDepth));
+        }
+
+        __m128 pass = _mm_cmpge_ps(z, oldZ);
+        int passBits = _mm_movemask_ps(pass);
+        if (passBits == 0)
+        {
+            continue;
+        }
+        written += countBits(passBits);
+        if (span.epoch)
+        {
+            // pass lanes squeezed down to a byte each
+            __m128i passBytes = _mm_castps_si128(pass);
+            passBytes = _mm_packs_epi16(_mm_packs_epi32(passBytes, passBytes), passBytes);
+            uint32_t passMask = (uint32_t)_mm_cvtsi128_si32(passBytes);
+            epochBytes = (epochBytes & ~passMask) | (span.currentEpoch * 0x01010101u & passMask);
+
+            uint8_t * e = span.epoch + i;
+            e[0] = (uint8_t)epochBytes;
+            e[1] = (uint8_t)(epochBytes >> 8);
+            e[2] = (uint8_t)(epochBytes >> 16);
+            e[3] = (uint8_t)(epochBytes >> 24);
+        }
+
+        __m128 r = _mm_min_ps(_mm_max_ps(_mm_add_ps(rStart, _mm_mul_ps(column, rStep)), zero), full);
+        __m128 g = _mm_min_ps(_mm_max_ps(_mm_add_ps(gStart, _mm_mul_ps(column, gStep)), zero), full);
+        __m128 b = _mm_min_ps(_mm_max_ps(_mm_add_ps(bStart, _mm_mul_ps(column, bStep)), zero), full);
+        __m128i color = _mm_or_si128(
+            _mm_or_si128(_mm_slli_epi32(_mm_cvttps_epi32(r), 16), _mm_slli_epi32(_mm_cvttps_epi32(g), 8)),
+            _mm_cvttps_epi32(b));
+
+        // keep the old values where the z test failed
+        __m128i passMask = _mm_castps_si128(pass);
+        __m128i oldColor = _mm_loadu_si128((__m128i *)(span.pixel + i));
+        color = _mm_or_si128(_mm_and_si128(passMask, color), _mm_andnot_si128(passMask, oldColor));
+        z = _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, storedZ));
+
+        _mm_storeu_si128((__m128i *)(span.pixel + i), color);
+        _mm_storeu_ps(span.depth + i, z);
+    }
+
+    if (i < span.count)
+    {
+        Span rest = span;
+        rest.pixel += i;
+        rest.depth += i;
+        if (rest.epoch) rest.epoch += i;
+        rest.count -= i;
+        rest.column += i;
+        written += fillSpanScalar(rest);
+    }
+    return written;
+}
+
+
+AVX2_FUNCTION int fillSpanAVX2(const Span & span)
+{
+    __m256 lanes = _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0);
+    __m256 zero = _mm256_set1_ps(0.0f);
+    __m256 full = _mm256_set1_ps(255.0f);
+    __m256 zStart = _mm256_set1_ps(span.z);
+    __m256 rStart = _mm256_set1_ps(span.r);
+    __m256 gStart = _mm256_set1_ps(span.g);
+    __m256 bStart = _mm256_set1_ps(span.b);
+    __m256 zStep = _mm256_set1_ps(span.zStep);
+    __m256 rStep = _mm256_set1_ps(span.rStep);
+    __m256 gStep = _mm256_set1_ps(span.gStep);
+    __m256 bStep = _mm256_set1_ps(span.bStep);
+    __m256 clearDepth = _mm256_set1_ps(span.clearDepth);
+    __m256i currentEpoch = _mm256_set1_epi32(span.currentEpoch);
+    __m128i currentEpochBytes = _mm_set1_epi8((char)span.currentEpoch);
+    __m128i epochBytes = _mm_setzero_si128();
+
+    int written = 0;
+    int i = 0;
+    for (; i + 8 <= span.count; i += 8)
+    {
+        __m256 column = _mm256_add_ps(_mm256_set1_ps(span.column + i), lanes);
+        __m256 z = _mm256_add_ps(zStart, _mm256_mul_ps(column, zStep));
+        __m256 storedZ = _mm256_loadu_ps(span.depth + i);
+        __m256 oldZ = storedZ;
+        if (span.epoch)
+        {
+            // one epoch byte per 32 bit lane, depths from old epochs count
+            // as cleared
+            epochBytes = _mm_loadl_epi64((__m128i *)(span.epoch + i));
+            __m256i epochs = _mm256_cvtepu8_epi32(epochBytes);
+            __m256 current = _mm256_castsi256_ps(_mm256_cmpeq_epi32(epochs, currentEpoch));
+            oldZ = _mm256_blendv_ps(clearDepth, oldZ, current);
+        }
+
+        __m256 pass = _mm256_cmp_ps(z, oldZ, _CMP_GE_OQ);
+        int passBits = _mm256_movemask_ps(pass);
+        if (passBits == 0)
+        {
+            continue;
+        }
+        written += countBits(passBits);
+        if (span.epoch)
+        {
+            // pass lanes squeezed down to a byte each
+            __m256i passLanes = _mm256_castps_si256(pass);
+            __m128i passBytes = _mm_packs_epi32(_mm256_castsi256_si128(passLanes), _mm256_extracti128_si256(passLanes, 1));
+            passBytes = _mm_packs_epi16(passBytes, passBytes);
+            epochBytes = _mm_or_si128(_mm_and_si128(passBytes, currentEpochBytes), _mm_andnot_si128(passBytes, epochBytes));
+            _mm_storel_epi64((__m128i *)(span.epoch + i), epochBytes);
+        }
+
+        __m256 r = _mm256_min_ps(_mm256_max_ps(_mm256_add_ps(rStart, _mm256_mul_ps(column, rStep)), zero), full);
+        __m256 g = _mm256_min_ps(_mm256_max_ps(_mm256_add_ps(gStart, _mm256_mul_ps(column, gStep)), zero), full);
+        __m256 b = _mm256_min_ps(_mm256_max_ps(_mm256_add_ps(bStart, _mm256_mul_ps(column, bStep)), zero), full);
+        __m256i color = _mm256_or_si256(
+            _mm256_or_si256(_mm256_slli_epi32(_mm256_cvttps_epi32(r), 16), _mm256_slli_epi32(_mm256_cvttps_epi32(g), 8)),
+            _mm256_cvttps_epi32(b));
+
+        // keep the old values where the z test failed
+        __m256i oldColor = _mm256_loadu_si256((__m256i *)(span.pixel + i));
+        color = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(oldColor), _mm256_castsi256_ps(color), pass));
+        z = _mm256_blendv_ps(storedZ, z, pass);
+
+        _mm256_storeu_si256((__m256i *)(span.pixel + i), color);
+        _mm256_storeu_ps(span.depth + i, z);
+    }
+
+    if (i < span.count)
+    {
+        Span rest = span;
+        rest.pixel += i;
+        rest.depth += i;
+        if (rest.epoch) rest.epoch += i;
+        rest.count -= i;
+        rest.column += i;
+        written += fillSpanSSE2(rest);
+    }
+    return written;
+}
+
+
+void fillRowScalar(uint32_t * row, uint32_t value, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        row[i] = value;
+    }
+}
+
+
+void fillRowSSE2(uint32_t * row, uint32_t value, int count, bool stream)
+{
+    // single values until the row is 16 byte aligned
+    int i = 0;
+    for (; i < count && ((size_t)(row + i) & 15); i++)
+    {
+        row[i] = value;
+    }
+
+    __m128i values = _mm_set1_epi32((int)value);
+    if (stream)
+    {
+        for (; i + 4 <= count; i += 4)
+        {
+            _mm_stream_si128((__m128i *)(row + i), values);
+        }
+
+        // make sure the streamed stores land before anything reads them
+        _mm_sfence();
+    }
+    else
+    {
+        for (; i + 4 <= count; i += 4)
+        {
+            _mm_store_si128((__m128i *)(row + i), values);
+        }
+    }
+
+    for (; i < count; i++)
+    {
+        row[i] = value;
+    }
+}
+
+
+void fadeRowScalar(uint32_t * row, int count, unsigned f)
+{
+    for (int i = 0; i < count; i++)
+    {
+        Color faded = Color(row[i]) / f;
+        row[i] = GET_RGB(faded.r, faded.g, faded.b);
+    }
+}
+
+
+void fadeRowSSE2(uint32_t * row, int count, unsigned f)
+{
+    // (v * (65536 / f + 1)) >> 16 is v / f for every v and f below 256, but
+    // the reciprocal doesn't fit in 16 bits for f = 1
+    if (f < 2 || f > 255)
+    {
+        fadeRowScalar(row, count, f);
+        return;
+    }
+
+    __m128i zero = _mm_setzero_si128();
+    __m128i reciprocal = _mm_set1_epi16((short)(65536 / f + 1));
+    __m128i rgbMask = _mm_set1_epi32(0x00ffffff);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i pixels = _mm_loadu_si128((__m128i *)(row + i));
+
+        // each channel gets its own 16 bit lane for the multiply
+        __m128i low = _mm_mulhi_epu16(_mm_unpacklo_epi8(pixels, zero), reciprocal);
+        __m128i high = _mm_mulhi_epu16(_mm_unpackhi_epi8(pixels, zero), reciprocal);
+
+        // the padding byte is always 0, like GET_RGB makes it
+        pixels = _mm_and_si128(_mm_packus_epi16(low, high), rgbMask);
+        _mm_storeu_si128((__m128i *)(row + i), pixels);
+    }
+
+    fadeRowScalar(row + i, count - i, f);
+}
+
+
+SpanKernelFunction getSpanKernelFunction(SpanKernel kernel)
+{
+    switch (kernel)
+    {
+    case SK_AVX2: return fillSpanAVX2;
+    case SK_SSE2: return fillSpanSSE2;
+    default:      return fillSpanScalar;
+    }
+}
+
+
+SpanKernel getBestSpanKernel()
+{
+    unsigned info[4] = { 0 }; // eax, ebx, ecx, edx
+
+#if defined(_MSC_VER)
+    __cpuid((int *)info, 0);
+#else
+    __cpuid(0, info[0], info[1], info[2], info[3]);
+#endif
+    unsigned highestLeaf = info[0];
+
+#if defined(_MSC_VER)
+    __cpuid((int *)info, 1);
+#else
+    __cpuid(1, info[0], info[1], info[2], info[3]);
+#endif
+    bool sse2 = (info[3] & (1 << 26)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+
+    bool avx2 = false;
+    if (highestLeaf >= 7 && osxsave && avx)
+    {
+        // the OS has to be saving the xmm and ymm registers
+        unsigned long long xcr0;
+#if defined(_MSC_VER)
+        xcr0 = _xgetbv(0);
+#else
+        unsigned xcr0Low, xcr0High;
+        __asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+        xcr0 = ((unsigned long long)xcr0High << 32) | xcr0Low;
+#endif
+        if ((xcr0 & 6) == 6)
+        {
+#if defined(_MSC_VER)
+            __cpuidex((int *)info, 7, 0);
+#else
+            __cpuid_count(7, 0, info[0], info[1], info[2], info[3]);
+#endif
+            avx2 = (info[1] & (1 << 5)) != 0;
+        }
+    }
+
+    if (avx2) return SK_AVX2;
+    if (sse2) return SK_SSE2;
+    return SK_SCALAR;
+}
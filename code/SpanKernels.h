@@ -0,0 +1,147 @@
+/* ==========================================================================
+   >File: SpanKernels.h
+   >Date: 20180713
+   >Author: Vik Pandher
+   >Details: Inner loops that fill a horizontal run of pixels in a triangle.
+             There's a plain version and SSE2/AVX2 versions that do 4 or 8
+             pixels at a time. They all give the exact same output.
+   ========================================================================== */
+
+#pragma once
+#include "SizedIntegers.h"
+
+
+
+// Which kernel fills the spans
+enum SpanKernel
+{
+    SK_SCALAR, // one pixel at a time, works everywhere
+    SK_SSE2,   // 4 pixels at a time
+    SK_AVX2    // 8 pixels at a time
+};
+
+
+// A horizontal run of pixels inside a triangle, all on one row. Every pixel
+// in it is covered, only the z test is left to do.
+//
+// z and color at a pixel are (value + column * step), where column is the
+// number of columns between the pixel and the triangle's first vertex.
+//
+// If epoch isn't 0, a depth only counts if its epoch is currentEpoch. Any
+// other depth was written before the last clear, so clearDepth is used
+// instead. Pixels that pass the z test get their epoch set.
+struct Span
+{
+    uint32_t * pixel; // first pixel in the span
+    float * depth;    // z buffer value of the first pixel
+    uint8_t * epoch;  // epoch of the first pixel's depth, or 0
+    int count;        // how many pixels are in the span
+    float column;     // column of the first pixel, counting from p0
+
+    uint8_t currentEpoch; // epoch of the depths written since the last clear
+    float clearDepth;     // what a depth from an older epoch counts as
+
+    // values at column 0 of this row
+    float z, r, g, b;
+
+    // change per column
+    float zStep, rStep, gStep, bStep;
+};
+
+
+// Function that fills a span and returns how many pixels passed the z test
+typedef int(*SpanKernelFunction)(const Span & span);
+
+
+// fillSpanScalar
+// ========================================================================== //
+// Fill a span one pixel at a time. The SIMD kernels do exactly the same math
+// in lanes, so this gives the same output as them.
+// 
+// @params
+// * const Span & span, the pixels being filled
+// 
+// @return
+// The number of pixels written.
+int fillSpanScalar(const Span & span);
+
+
+// fillSpanSSE2
+// ========================================================================== //
+// Fill a span 4 pixels at a time. The leftover pixels are done by
+// fillSpanScalar. Only call this if the CPU supports SSE2.
+// 
+// @params
+// * const Span & span, the pixels being filled
+// 
+// @return
+// The number of pixels written.
+int fillSpanSSE2(const Span & span);
+
+
+// fillSpanAVX2
+// ========================================================================== //
+// Fill a span 8 pixels at a time. The leftover pixels are done by
+// fillSpanScalar. Only call this if the CPU and OS support AVX2.
+// 
+// @params
+// * const Span & span, the pixels being filled
+// 
+// @return
+// The number of pixels written.
+int fillSpanAVX2(const Span & span);
+
+
+// fillRowScalar, fillRowSSE2
+// ========================================================================== //
+// Set every 32 bit value in a row to the same thing. Used to clear the color
+// and z buffers. The SSE2 version writes 16 bytes at a time, and can use
+// non-temporal stores that go straight to memory without reading the old
+// contents into the cache first. That's faster for buffers too big to stay
+// in the cache anyway. Only call the SSE2 version if the CPU supports SSE2.
+// 
+// @params
+// * uint32_t * row, first value in the row
+// * uint32_t value, what to set them to
+// * int count, how many values are in the row
+// * bool stream, true to use non-temporal stores
+void fillRowScalar(uint32_t * row, uint32_t value, int count);
+void fillRowSSE2(uint32_t * row, uint32_t value, int count, bool stream);
+
+
+// fadeRowScalar, fadeRowSSE2
+// ========================================================================== //
+// Divide every channel of every pixel in a row by f, the same as
+// Color(pixel) / f. The SSE2 version does 4 pixels at a time by multiplying
+// with a 16 bit reciprocal, which gives the exact same result for channel
+// values and divisors up to 255. Only call the SSE2 version if the CPU
+// supports SSE2.
+// 
+// @params
+// * uint32_t * row, first pixel in the row
+// * int count, how many pixels are in the row
+// * unsigned f, what to divide by
+void fadeRowScalar(uint32_t * row, int count, unsigned f);
+void fadeRowSSE2(uint32_t * row, int count, unsigned f);
+
+
+// getSpanKernelFunction
+// ========================================================================== //
+// 
+// @params
+// * SpanKernel kernel, the kernel wanted
+// 
+// @return
+// The function for the given kernel.
+SpanKernelFunction getSpanKernelFunction(SpanKernel kernel);
+
+
+// getBestSpanKernel
+// ========================================================================== //
+// Ask the CPU, using CPUID, which instructions it supports. For AVX2 the OS
+// also has to save the upper halves of the registers, which is checked with
+// XGETBV.
+// 
+// @return
+// The fastest kernel this computer can run.
+SpanKernel getBestSpanKernel();
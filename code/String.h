@@ -7,7 +7,6 @@
 
 #pragma once
 #include "Array.h"
-#include "MemoryManager.h"
 
 
 
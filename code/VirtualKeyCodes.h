@@ -0,0 +1,121 @@
+/* ==========================================================================
+   >File: VirtualKeyCodes.h
+   >Date: 20180713
+   >Author: Vik Pandher
+   >Details: The Windows virtual key codes the game uses, for platforms
+             without windows.h. Same values, so key bindings mean the same
+             thing everywhere.
+   ========================================================================== */
+
+#pragma once
+
+
+
+// Mouse buttons
+// -------------------------------------------------------------------------- //
+#define VK_LBUTTON      0x01
+#define VK_RBUTTON      0x02
+#define VK_CANCEL       0x03
+#define VK_MBUTTON      0x04
+#define VK_XBUTTON1     0x05
+#define VK_XBUTTON2     0x06
+
+// Control keys
+// -------------------------------------------------------------------------- //
+#define VK_BACK         0x08
+#define VK_TAB          0x09
+#define VK_CLEAR        0x0C
+#define VK_RETURN       0x0D
+#define VK_SHIFT        0x10
+#define VK_CONTROL      0x11
+#define VK_MENU         0x12
+#define VK_PAUSE        0x13
+#define VK_CAPITAL      0x14
+#define VK_ESCAPE       0x1B
+#define VK_SPACE        0x20
+#define VK_PRIOR        0x21
+#define VK_NEXT         0x22
+#define VK_END          0x23
+#define VK_HOME         0x24
+#define VK_LEFT         0x25
+#define VK_UP           0x26
+#define VK_RIGHT        0x27
+#define VK_DOWN         0x28
+#define VK_SELECT       0x29
+#define VK_PRINT        0x2A
+#define VK_EXECUTE      0x2B
+#define VK_SNAPSHOT     0x2C
+#define VK_INSERT       0x2D
+#define VK_DELETE       0x2E
+#define VK_HELP         0x2F
+
+// '0' through '9' and 'A' through 'Z' are their ASCII values
+
+// Number pad
+// -------------------------------------------------------------------------- //
+#define VK_NUMPAD0      0x60
+#define VK_NUMPAD1      0x61
+#define VK_NUMPAD2      0x62
+#define VK_NUMPAD3      0x63
+#define VK_NUMPAD4      0x64
+#define VK_NUMPAD5      0x65
+#define VK_NUMPAD6      0x66
+#define VK_NUMPAD7      0x67
+#define VK_NUMPAD8      0x68
+#define VK_NUMPAD9      0x69
+#define VK_MULTIPLY     0x6A
+#define VK_ADD          0x6B
+#define VK_SEPARATOR    0x6C
+#define VK_SUBTRACT     0x6D
+#define VK_DECIMAL      0x6E
+#define VK_DIVIDE       0x6F
+
+// Function keys
+// -------------------------------------------------------------------------- //
+#define VK_F1           0x70
+#define VK_F2           0x71
+#define VK_F3           0x72
+#define VK_F4           0x73
+#define VK_F5           0x74
+#define VK_F6           0x75
+#define VK_F7           0x76
+#define VK_F8           0x77
+#define VK_F9           0x78
+#define VK_F10          0x79
+#define VK_F11          0x7A
+#define VK_F12          0x7B
+#define VK_F13          0x7C
+#define VK_F14          0x7D
+#define VK_F15          0x7E
+#define VK_F16          0x7F
+#define VK_F17          0x80
+#define VK_F18          0x81
+#define VK_F19          0x82
+#define VK_F20          0x83
+#define VK_F21          0x84
+#define VK_F22          0x85
+#define VK_F23          0x86
+#define VK_F24          0x87
+
+// Locks and left/right modifiers
+// -------------------------------------------------------------------------- //
+#define VK_NUMLOCK      0x90
+#define VK_SCROLL       0x91
+#define VK_LSHIFT       0xA0
+#define VK_RSHIFT       0xA1
+#define VK_LCONTROL     0xA2
+#define VK_RCONTROL     0xA3
+
+// Punctuation, US keyboard
+// -------------------------------------------------------------------------- //
+#define VK_OEM_1        0xBA // ;:
+#define VK_OEM_PLUS     0xBB // =+
+#define VK_OEM_COMMA    0xBC // ,<
+#define VK_OEM_MINUS    0xBD // -_
+#define VK_OEM_PERIOD   0xBE // .>
+#define VK_OEM_2        0xBF // /?
+#define VK_OEM_3        0xC0 // `~
+#define VK_OEM_4        0xDB // [{
+#define VK_OEM_5        0xDC // \|
+#define VK_OEM_6        0xDD // ]}
+#define VK_OEM_7        0xDE // '"
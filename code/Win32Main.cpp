@@ -33,7 +33,8 @@
 
 
 #include "Game.h"
-// ^ includes "ScreenBuffer.h"
+// ^ includes "ScreenBuffer.h" and "Platform.h"
+#include "FrameCapture.h"
 
 
 
@@ -45,8 +46,8 @@
 // -------------------------------------------------------------------------- //
 int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow);
 LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
+DWORD WINAPI SimulationMain(LPVOID parameter);
 void SizeWindowToAspectRatio(int edge, RECT *dragRect, float aspectRatio);
-const char * GetErrorString(int value);
 
 
 /* --------------------------------------------------------------------------
@@ -54,10 +55,11 @@ const char * GetErrorString(int value);
    static global variables are translation unit specific.
    -------------------------------------------------------------------------- */
 
-// Used to to indicate if the application is running
-static bool s_running;
+// Used to to indicate if the application is running, the simulation thread
+// checks it too
+static volatile bool s_running;
 
-// The ScreenBuffer, holds bitmap info and memory
+// The ScreenBuffer, holds the pixels and the z buffer
 ScreenBuffer * g_screenBuffer;
 
 // Fixing the dimensions helps with debugging alot because its easyer to 
@@ -68,6 +70,48 @@ static const bool FIXED_DIMENSIONS = true;
 static const int BUFFER_WIDTH = 240; // 320; // 480;
 static const int BUFFER_HEIGHT = 160; // 240; // 360;
 
+// Split the screen into tiles and draw them on multiple threads. Only
+// takes effect with more than one processor, see setBinnedRasterization.
+static const bool BINNED_RASTERIZATION = true;
+
+// Draw the 3D at a lower resolution when frames take too long, and stretch
+// it over the window. The menus and HUD stay at the full resolution. Keeps
+// the frame rate steady when there's a lot on screen.
+static const bool DYNAMIC_RESOLUTION = true;
+static const float TARGET_DRAW_MILLISECONDS = 8;
+static const float MIN_RESOLUTION_SCALE = 0.5;
+
+// Record every frame shown to FRAME_CAPTURE_PATH, written on a thread of its
+// own. Frames get dropped from the recording if the disk can't keep up.
+static const bool FRAME_CAPTURE = false;
+static const char * FRAME_CAPTURE_PATH = "capture";
+static const FrameCaptureFormat FRAME_CAPTURE_FORMAT = FRAME_CAPTURE_QOI;
+static FrameCapture s_frameCapture;
+
+// The game updates on its own thread, and hands what it looks like over to
+// this one through three render snapshots. One is being captured, one is
+// being drawn, and the last one is the newest captured, waiting to be drawn.
+// They get swapped around through s_readySnapshot, which holds the index of
+// the waiting one, with SNAPSHOT_FRESH set if it hasn't been picked up yet.
+// Neither thread ever has to wait for the other to finish with one.
+static RenderSnapshot s_renderSnapshots[3];
+static LONG s_captureSnapshot = 0; // only touched by the simulation thread
+static LONG s_drawSnapshot = 1;    // only touched by the main thread
+static volatile LONG s_readySnapshot = 2;
+static const LONG SNAPSHOT_FRESH = 4;
+
+// The sequence number of the snapshot being drawn. Entities taken out of the
+// game are only deleted once nothing older will be drawn.
+static volatile LONG s_drawingSequence;
+
+// set when a snapshot is ready, to wake up the main thread. WindowProc gets
+// the keys on the main thread and queues them with queueKeyEvent, which
+// wakes up the simulation thread.
+static HANDLE s_snapshotReadyEvent;
+
+// microseconds between updates, currently 20ups // 16667 == 60ups
+static const long long UPDATE_MICROSECONDS = 50000;
+
 // Window aspect ratio, width / height, determined after using AdjustWindowRectEx
 // to find the window size for the desired client size
 static float s_windowAspectRatio;
@@ -185,9 +229,37 @@ int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
         g_screenBuffer = new ScreenBuffer(BUFFER_WIDTH, BUFFER_HEIGHT);
     }
 
+    if (BINNED_RASTERIZATION)
+    {
+        g_screenBuffer->setBinnedRasterization(true);
+    }
+
+    if (DYNAMIC_RESOLUTION)
+    {
+        g_screenBuffer->setDynamicResolution(true, TARGET_DRAW_MILLISECONDS, MIN_RESOLUTION_SCALE);
+    }
+
     // Will Contain message information from a thread's message queue.
     MSG message;
 
+    // The timer, the key event queue, and presenting to the window
+    initializePlatform();
+    setPresentWindow(hwnd);
+
+    if (FRAME_CAPTURE)
+    {
+        try
+        {
+            s_frameCapture.start(FRAME_CAPTURE_PATH, FRAME_CAPTURE_FORMAT);
+        }
+        catch (int x)
+        {
+            OutputDebugString("FrameCapture::start() exception: ");
+            OutputDebugString(getErrorString(x));
+            OutputDebugString("\n");
+        }
+    }
+
     // Flag for the main animation loop
     s_running = true;
 
@@ -200,17 +272,17 @@ int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
     catch (int x)
     {
         OutputDebugString("initialize() exception: ");
-        OutputDebugString(GetErrorString(x));
+        OutputDebugString(getErrorString(x));
         OutputDebugString("\n");
     }
 
-    // Consistant Timing 
-    LARGE_INTEGER startTime, currentTime, elapsedMicroseconds;
-
-    LARGE_INTEGER frequency;
-
-    QueryPerformanceFrequency(&frequency);
-    QueryPerformanceCounter(&startTime);
+    // Start the game updating on its own thread
+    s_snapshotReadyEvent = CreateEvent(0, FALSE, FALSE, 0);
+    HANDLE simulationThread = CreateThread(0, 0, SimulationMain, 0, 0, 0);
+    if (!simulationThread)
+    {
+        return 0; // Maybe I'll handle errors one day
+    }
 
     // ---------------------------------------------------------------------- //
     // MAIN LOOP MAIN LOOP MAIN LOOP MAIN LOOP MAIN LOOP MAIN LOOP MAIN LOOP  //
@@ -218,28 +290,6 @@ int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
 
     while (s_running)
     {
-        QueryPerformanceCounter(&currentTime);
-        elapsedMicroseconds.QuadPart = currentTime.QuadPart - startTime.QuadPart;
-
-        elapsedMicroseconds.QuadPart *= 1000000;
-        elapsedMicroseconds.QuadPart /= frequency.QuadPart;
-        // ups == updates per second
-        if (elapsedMicroseconds.QuadPart >= 50000) // currently 20ups // 16667 == 60ups
-        {
-            try
-            {
-                update();
-                startTime = currentTime;
-            }
-            catch (int x)
-            {
-                OutputDebugString("update() exception: ");
-                OutputDebugString(GetErrorString(x));
-                OutputDebugString("\n");
-            }
-        }
-        
-        
         // Go through the thread message queue.        
         // Unlike GetMessage, the PeekMessage function does not wait for a
         // message to be posted before returning. So it won't block
@@ -257,37 +307,151 @@ int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
             DispatchMessage(&message);
         }
 
+        // Trade the snapshot that was drawn last for the newest one, if the
+        // simulation thread has captured one since
+        if (s_readySnapshot & SNAPSHOT_FRESH)
+        {
+            s_drawSnapshot = InterlockedExchange(&s_readySnapshot, s_drawSnapshot) & ~SNAPSHOT_FRESH;
+            InterlockedExchange(&s_drawingSequence, (LONG)s_renderSnapshots[s_drawSnapshot].sequence);
+        }
+
+        bool drawn = true;
+        int64_t drawStartTime = getPlatformMicroseconds();
         try
         {
-            draw();
-            ///update();
+            drawn = draw(s_renderSnapshots[s_drawSnapshot]);
         }
         catch (int x)
         {
             OutputDebugString("draw() exception: ");
-            OutputDebugString(GetErrorString(x));
+            OutputDebugString(getErrorString(x));
             OutputDebugString("\n");
         }
-        
-        // get the handle to a display device context, need it to draw
-        HDC deviceContext = GetDC(hwnd);
-        
-        // Retrieve the coordinates of a window's client area, the area excluding
-        // the title bar, toolbars, status bar, scroll bars.
-        RECT clientRect;
-        GetClientRect(hwnd, &clientRect);
-        
-        g_screenBuffer->paintWindow(deviceContext, clientRect);
-        
-        // NEEED to remember to release the device context (else memory gets packed)
-        ReleaseDC(hwnd, deviceContext);
+
+        // Nothing new to show, so give the CPU back until there's a new
+        // snapshot or a message. WM_PAINT still repaints the window if it
+        // needs it.
+        if (!drawn)
+        {
+            MsgWaitForMultipleObjects(1, &s_snapshotReadyEvent, FALSE, INFINITE, QS_ALLINPUT);
+            continue;
+        }
+        int64_t drawEndTime = getPlatformMicroseconds();
+
+        presentFrame(*g_screenBuffer);
+        s_frameCapture.capture(*g_screenBuffer);
+
+        // The frame's been shown, so it's safe for the buffer to change size
+        float drawMilliseconds = (float)(drawEndTime - drawStartTime) / 1000;
+        g_screenBuffer->addFrameTime(drawMilliseconds);
     }
 
+    // The game can't be left updating while everything gets torn down
+    wakeKeyEventWaiters();
+    WaitForSingleObject(simulationThread, INFINITE);
+    CloseHandle(simulationThread);
+    s_frameCapture.stop();
+    shutdownPlatform();
+
     // return the exit code
     return message.wParam;
 } // WinMain
 
 
+// SimulationMain
+// ========================================================================== //
+// Where the simulation thread lives. Hands the queued keys to the game,
+// updates it on time, and captures a render snapshot whenever something
+// changed. Runs until s_running is cleared.
+// 
+// @params
+// * LPVOID parameter, unused
+DWORD WINAPI SimulationMain(LPVOID parameter)
+{
+    int64_t nextUpdateTime = getPlatformMicroseconds();
+    int64_t currentTime;
+
+    Array<KeyEvent> keyEvents;
+
+    while (s_running)
+    {
+        // Take everything WindowProc has queued so far
+        takeKeyEvents(keyEvents);
+
+        for (int i = 0; i < keyEvents.size(); i++)
+        {
+            try
+            {
+                if (keyEvents[i].down)
+                {
+                    keyDown(keyEvents[i].key);
+                }
+                else
+                {
+                    keyUp(keyEvents[i].key);
+                }
+            }
+            catch (int x)
+            {
+                OutputDebugString("keyDown()/keyUp() exception: ");
+                OutputDebugString(getErrorString(x));
+                OutputDebugString("\n");
+            }
+        }
+
+        currentTime = getPlatformMicroseconds();
+        if (currentTime >= nextUpdateTime)
+        {
+            try
+            {
+                update();
+            }
+            catch (int x)
+            {
+                OutputDebugString("update() exception: ");
+                OutputDebugString(getErrorString(x));
+                OutputDebugString("\n");
+            }
+
+            // Stay on schedule when waking up a little late, but don't try to
+            // catch up after falling way behind, like in the debugger
+            nextUpdateTime += UPDATE_MICROSECONDS;
+            if (nextUpdateTime < currentTime)
+            {
+                nextUpdateTime = currentTime + UPDATE_MICROSECONDS;
+            }
+        }
+
+        bool captured = false;
+        try
+        {
+            captured = captureRenderSnapshot(s_renderSnapshots[s_captureSnapshot]);
+        }
+        catch (int x)
+        {
+            OutputDebugString("captureRenderSnapshot() exception: ");
+            OutputDebugString(getErrorString(x));
+            OutputDebugString("\n");
+        }
+
+        if (captured)
+        {
+            // The last waiting snapshot wasn't picked up in time, so it gets
+            // captured over next
+            s_captureSnapshot = InterlockedExchange(&s_readySnapshot, s_captureSnapshot | SNAPSHOT_FRESH) & ~SNAPSHOT_FRESH;
+            SetEvent(s_snapshotReadyEvent);
+        }
+
+        deleteRetiredEntities(s_drawingSequence);
+
+        // Sleep until the next update, or until a key comes in
+        waitForKeyEvent(nextUpdateTime - getPlatformMicroseconds());
+    }
+
+    return 0;
+} // SimulationMain
+
+
 // WindowProc
 // ========================================================================== //
 // An application-defined function that processes messages sent to a window.
@@ -359,7 +523,7 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
     {
         /// // Check if the key was up before. (key down message repeats while down)
         /// if ((lParam & (1 << 30)) == 0)
-        keyDown(wParam);
+        queueKeyEvent(wParam, true);
         break;
     }
 
@@ -369,7 +533,7 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
     // keyboard focus.
     case WM_KEYUP:
     {
-        keyUp(wParam);
+        queueKeyEvent(wParam, false);
         break;
     }
 
@@ -398,16 +562,11 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
         // Holds information for an application used to paint
         PAINTSTRUCT paintStruct;
          
-        // Prep the specified window for painting (fills paintStruct) and get
-        // the handle to a display device context for the specified window.
-        HDC deviceContext = BeginPaint(hwnd, &paintStruct);
-        
-        // Retrieve the coordinates of a window's client area, the area excluding
-        // the title bar, toolbars, status bar, scroll bars.
-        RECT clientRect;
-        GetClientRect(hwnd, &clientRect);
+        // Prep the specified window for painting (fills paintStruct), which
+        // marks it as painted. presentFrame gets its own device context.
+        BeginPaint(hwnd, &paintStruct);
         
-        g_screenBuffer->paintWindow(deviceContext, clientRect);
+        presentFrame(*g_screenBuffer);
         
         // End of painting in the specified window
         EndPaint(hwnd, &paintStruct);
@@ -427,7 +586,7 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             int clientWidth = clientRect.right - clientRect.left;
             int clientHeight = clientRect.bottom - clientRect.top;
             // Resize the backbuffer
-            if(g_screenBuffer) g_screenBuffer->resizeDIBSection(clientWidth, clientHeight);
+            if(g_screenBuffer) g_screenBuffer->resize(clientWidth, clientHeight);
         }
         break;
     }
@@ -541,41 +700,6 @@ void SizeWindowToAspectRatio(int edge, RECT *dragRect, float aspectRatio)
 } // SizeWindowToAspectRatio
 
 
-// GetErrorString
-// ========================================================================== //
-// Debugging...
-const char * GetErrorString(int value)
-{
-    switch (value)
-    {
-    case ERROR_OUTSIDE_ARRAY_BOUNDS:
-    {
-        return "ERROR_OUTSIDE_ARRAY_BOUNDS";
-    }
-    case ERROR_MEMORY_UNAVAILABLE:
-    {
-        return "ERROR_MEMORY_UNAVAILABLE";
-    }
-    case ERROR_OUTSIDE_BUFFER_BOUNDS:
-    {
-        return "ERROR_OUTSIDE_BUFFER_BOUNDS";
-    }
-    case ERROR_NEGATIVE_INPUT:
-    {
-        return "ERROR_NEGATIVE_INPUT";
-    }
-    case ERROR_INPUT_OUT_OF_BOUNDS:
-    {
-        return "ERROR_INPUT_OUT_OF_BOUNDS";
-    }
-    default:
-    {
-        return  "ERROR_???";
-    }
-    }
-}
-
-
 // Nolonger using SetTimer. It's not accurate.
 /// /*
 ///  * NOTE !!!
@@ -621,7 +745,7 @@ const char * GetErrorString(int value)
 ///     catch (int x)
 ///     {
 ///         OutputDebugString("update() exception: ");
-///         OutputDebugString(GetErrorString(x));
+///         OutputDebugString(getErrorString(x));
 ///         OutputDebugString("\n");
 ///     }
 /// } // TimerProc
\ No newline at end of file
@@ -0,0 +1,141 @@
+/* ==========================================================================
+   >File: Win32Platform.cpp
+   >Date: 20180713
+   >Author: Vik Pandher
+   >Details: The Windows version of Platform.h.
+   ========================================================================== */
+
+#include "Platform.h"
+#include "Win32Present.h"
+
+
+
+// QueryPerformanceCounter ticks per second, it doesn't change while running
+static LARGE_INTEGER s_frequency;
+
+// Key events waiting to be taken, and set whenever one is queued
+static Array<KeyEvent> s_keyEvents;
+static CRITICAL_SECTION s_keyEventLock;
+static HANDLE s_keyQueuedEvent;
+
+// Where presentFrame draws
+static Win32Present s_present;
+static HWND s_presentWindow;
+
+
+void initializePlatform()
+{
+    QueryPerformanceFrequency(&s_frequency);
+
+    InitializeCriticalSection(&s_keyEventLock);
+    s_keyQueuedEvent = CreateEvent(0, FALSE, FALSE, 0);
+    if (!s_keyQueuedEvent)
+    {
+        throw ERROR_THREAD_UNAVAILABLE;
+    }
+}
+
+
+void shutdownPlatform()
+{
+    CloseHandle(s_keyQueuedEvent);
+    DeleteCriticalSection(&s_keyEventLock);
+}
+
+
+int64_t getPlatformMicroseconds()
+{
+    LARGE_INTEGER currentTime;
+    QueryPerformanceCounter(&currentTime);
+
+    // split up so the multiply can't overflow
+    int64_t seconds = currentTime.QuadPart / s_frequency.QuadPart;
+    int64_t ticks = currentTime.QuadPart % s_frequency.QuadPart;
+    return seconds * 1000000 + ticks * 1000000 / s_frequency.QuadPart;
+}
+
+
+void queueKeyEvent(uint8_t key, bool down)
+{
+    KeyEvent keyEvent;
+    keyEvent.key = key;
+    keyEvent.down = down;
+
+    EnterCriticalSection(&s_keyEventLock);
+    s_keyEvents += keyEvent;
+    LeaveCriticalSection(&s_keyEventLock);
+
+    SetEvent(s_keyQueuedEvent);
+}
+
+
+void takeKeyEvents(Array<KeyEvent> & keyEvents)
+{
+    EnterCriticalSection(&s_keyEventLock);
+    keyEvents = s_keyEvents;
+    s_keyEvents.clear();
+    LeaveCriticalSection(&s_keyEventLock);
+}
+
+
+void waitForKeyEvent(int64_t microseconds)
+{
+    if (microseconds > 0)
+    {
+        WaitForSingleObject(s_keyQueuedEvent, (DWORD)(microseconds / 1000));
+    }
+}
+
+
+void wakeKeyEventWaiters()
+{
+    SetEvent(s_keyQueuedEvent);
+}
+
+
+void * allocatePages(size_t size)
+{
+    // VirtualAlloc gives back whole pages, already zeroed
+    void * memory = VirtualAlloc(
+        0,                // lpAddress, we don't care where the memory is
+        size,             // dwSize, size of the region in bytes
+        MEM_COMMIT,       // flAllocationType
+        PAGE_READWRITE);  // flProtect
+    if (!memory)
+    {
+        throw ERROR_MEMORY_UNAVAILABLE;
+    }
+    return memory;
+}
+
+
+void freePages(void * memory, size_t size)
+{
+    if (memory)
+    {
+        VirtualFree(memory, 0, MEM_RELEASE);
+    }
+}
+
+
+void presentFrame(const ScreenBuffer & screenBuffer)
+{
+    // get the handle to a display device context, need it to draw
+    HDC deviceContext = GetDC(s_presentWindow);
+
+    // Retrieve the coordinates of a window's client area, the area excluding
+    // the title bar, toolbars, status bar, scroll bars.
+    RECT clientRect;
+    GetClientRect(s_presentWindow, &clientRect);
+
+    s_present.paintWindow(screenBuffer, deviceContext, clientRect);
+
+    // NEEED to remember to release the device context (else memory gets packed)
+    ReleaseDC(s_presentWindow, deviceContext);
+}
+
+
+void setPresentWindow(HWND window)
+{
+    s_presentWindow = window;
+}
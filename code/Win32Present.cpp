@@ -0,0 +1,72 @@
+/* ==========================================================================
+   >File: Win32Present.cpp
+   >Date: 20180713
+   >Author: Vik Pandher
+   >Details: Shows a ScreenBuffer in a window, by handing its pixels to GDI
+             as a Device Independent Bitmap.
+   ========================================================================== */
+
+#include "Win32Present.h"
+
+
+
+// public:
+
+Win32Present::Win32Present()
+{
+    ZeroMemory(&m_info, sizeof(m_info));
+    m_info.bmiHeader.biSize = sizeof(m_info.bmiHeader);
+    m_info.bmiHeader.biPlanes = 1;
+
+    // 8 bits red, 8 green, 8 blue, and a padding byte.
+    // Why the padding byte? To avoid unaligned accessing penalties.
+    m_info.bmiHeader.biBitCount = 32;
+    m_info.bmiHeader.biCompression = BI_RGB;
+}
+
+
+void Win32Present::paintWindow(const ScreenBuffer & screenBuffer, HDC deviceContext, RECT destRect, float aspectRatio /*= 0*/)
+{
+    // positive height, the screen buffer is a bottom-up DIB
+    int srcWidth = screenBuffer.getWidth();
+    int srcHeight = screenBuffer.getHeight();
+    m_info.bmiHeader.biWidth = srcWidth;
+    m_info.bmiHeader.biHeight = srcHeight;
+
+    // This function copies the color data for a rectangle of pixels in a DIB,
+    // JPEG, or PNG image to the specified destination rectangle. Scaling it 
+    // if need be.
+    // NOTE: The origin of a bottom-up DIB is the lower-left corner;
+    //       the origin of a top-down DIB is the upper-left corner.
+    int destWidth = destRect.right - destRect.left;
+    int destHeight = destRect.bottom - destRect.top;
+    int destX = 0;
+    int destY = 0;
+
+    if (aspectRatio != 0)
+    {
+        int newDestWidth = destHeight * aspectRatio;
+        int newDestHeight = destWidth / aspectRatio;
+        if (newDestWidth > destWidth) newDestWidth = destWidth;
+        if (newDestHeight > destHeight) newDestHeight = destHeight;
+        if (newDestWidth < destWidth) destX = (destWidth - newDestWidth) / 2;
+        if (newDestHeight < destHeight) destY = (destHeight - newDestHeight) / 2;
+        destWidth = newDestWidth;
+        destHeight = newDestHeight;
+    }
+
+    StretchDIBits(
+        deviceContext,              // hdc
+        destX,                      // destX
+        destY,                      // destY
+        destWidth,                  // destWidth
+        destHeight,                 // destHeight
+        0,                          // srcX
+        0,                          // srcY
+        srcWidth,                   // srcWidth
+        srcHeight,                  // srcHeight
+        screenBuffer.getPixels(),   // *lpBits
+        &m_info,                    // *lpBitsInfo
+        DIB_RGB_COLORS,             // iUsage
+        SRCCOPY);                   // dwRop
+}
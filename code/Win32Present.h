@@ -0,0 +1,62 @@
+/* ==========================================================================
+   >File: Win32Present.h
+   >Date: 20180713
+   >Author: Vik Pandher
+   >Details: Shows a ScreenBuffer in a window, by handing its pixels to GDI
+             as a Device Independent Bitmap.
+   ========================================================================== */
+
+#pragma once
+#include <windows.h>
+#include "ScreenBuffer.h"
+
+
+
+// The Win32 present backend. The screen buffer's memory is already laid out
+// like a bottom-up 32 bit DIB, so nothing gets copied, StretchDIBits reads
+// it straight from the screen buffer.
+class Win32Present
+{
+public:
+    // Win32Present
+    // ====================================================================== //
+    // Fill in the parts of the BITMAPINFO that never change.
+    Win32Present();
+
+    // paintWindow
+    // ====================================================================== //
+    // Apply the screen buffer onto the given device context, stretching it
+    // over the destination if it's a different size.
+    // The screen buffer is bottom-up and the origin is the lower-left corner.
+    //
+    // If an aspectRatio is provided, StretchDIBits will print to an area
+    // that conforms to it.
+    //
+    // @params
+    // * const ScreenBuffer & screenBuffer, what's shown
+    // * HDC deviceContext, pretty self explanitory
+    // * RECT destRect, rect containing the destination width and height
+    // * float aspectRatio = 0, the destination aspect ratio (width / height)
+    void paintWindow(const ScreenBuffer & screenBuffer, HDC deviceContext, RECT destRect, float aspectRatio = 0);
+
+private:
+    // The BITMAPINFO struct defines dimensions and color information for a DIB
+    BITMAPINFO m_info;
+    // .  BITMAPINFOHEADER bmiHeader;
+    //     .  DWORD            biSize;
+    //     .  LONG             biWidth;
+    //     .  LONG             biHeight;
+    //     .  WORD             biPlanes;
+    //     .  WORD             biBitCount;
+    //     .  DWORD            biCompression;
+    //     .  DWORD            biSizeImage;
+    //     .  LONG             biXPelsPerMeter;
+    //     .  LONG             biYPelsPerMeter;
+    //     .  DWORD            biClrUsed;
+    //     .  DWORD            biClrImportant;
+    // .  RGBQUAD          bmiColors[1];
+    //     .  BYTE             rgbBlue;
+    //     .  BYTE             rgbGreen;
+    //     .  BYTE             rgbRed;
+    //     .  BYTE             rgbReserved;
+};
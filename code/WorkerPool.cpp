@@ -0,0 +1,219 @@
+/* ==========================================================================
+   >File: WorkerPool.cpp
+   >Date: 20180713
+   >Author: Vik Pandher
+   >Details: A handful of threads that split up a job. A job is a function
+             that gets called once for every index from 0 to some count.
+   ========================================================================== */
+
+#include "WorkerPool.h"
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+
+
+// public:
+
+WorkerPool::WorkerPool(unsigned threadCount /*= 0*/) :
+    m_job(0),
+    m_data(0),
+    m_count(0),
+    m_nextIndex(0),
+    m_workersLeft(0),
+    m_quit(0),
+    m_startedThreads(0)
+{
+#if defined(_WIN32)
+    if (threadCount == 0)
+    {
+        SYSTEM_INFO systemInfo;
+        GetSystemInfo(&systemInfo);
+        threadCount = systemInfo.dwNumberOfProcessors > 1 ? systemInfo.dwNumberOfProcessors - 1 : 0;
+    }
+    m_threadCount = threadCount;
+
+    m_wakeSemaphore = CreateSemaphore(0, 0, 0x7FFFFFFF, 0);
+    m_doneEvent = CreateEvent(0, FALSE, FALSE, 0);
+    if (!m_wakeSemaphore || !m_doneEvent)
+    {
+        throw ERROR_THREAD_UNAVAILABLE;
+    }
+
+    m_threads = new HANDLE[m_threadCount > 0 ? m_threadCount : 1];
+    for (unsigned i = 0; i < m_threadCount; i++)
+    {
+        m_threads[i] = CreateThread(0, 0, workerMain, this, 0, 0);
+        if (!m_threads[i])
+        {
+            // run with however many threads did start
+            m_threadCount = i;
+            break;
+        }
+    }
+#else
+    if (threadCount == 0)
+    {
+        long processors = sysconf(_SC_NPROCESSORS_ONLN);
+        threadCount = processors > 1 ? processors - 1 : 0;
+    }
+    m_threadCount = threadCount;
+
+    if (sem_init(&m_wakeSemaphore, 0, 0) != 0 || sem_init(&m_doneSemaphore, 0, 0) != 0)
+    {
+        throw ERROR_THREAD_UNAVAILABLE;
+    }
+
+    m_threads = new pthread_t[m_threadCount > 0 ? m_threadCount : 1];
+    for (unsigned i = 0; i < m_threadCount; i++)
+    {
+        if (pthread_create(&m_threads[i], 0, workerMain, this) != 0)
+        {
+            // run with however many threads did start
+            m_threadCount = i;
+            break;
+        }
+    }
+#endif
+}
+
+
+WorkerPool::~WorkerPool()
+{
+    atomicExchange(&m_quit, 1);
+    wake();
+
+#if defined(_WIN32)
+    for (unsigned i = 0; i < m_threadCount; i++)
+    {
+        WaitForSingleObject(m_threads[i], INFINITE);
+        CloseHandle(m_threads[i]);
+    }
+    delete[] m_threads;
+
+    CloseHandle(m_wakeSemaphore);
+    CloseHandle(m_doneEvent);
+#else
+    for (unsigned i = 0; i < m_threadCount; i++)
+    {
+        pthread_join(m_threads[i], 0);
+    }
+    delete[] m_threads;
+
+    sem_destroy(&m_wakeSemaphore);
+    sem_destroy(&m_doneSemaphore);
+#endif
+}
+
+
+void WorkerPool::run(WorkerJob job, void * data, unsigned count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    // no point waking anyone up for a single index
+    if (m_threadCount == 0 || count == 1)
+    {
+        for (unsigned i = 0; i < count; i++)
+        {
+            job(data, i, 0);
+        }
+        return;
+    }
+
+    m_job = job;
+    m_data = data;
+    m_count = count;
+    m_nextIndex = 0;
+
+    // the atomic write makes sure the job is visible before anyone wakes
+    atomicExchange(&m_workersLeft, m_threadCount);
+    wake();
+
+    doWork(0);
+#if defined(_WIN32)
+    WaitForSingleObject(m_doneEvent, INFINITE);
+#else
+    while (sem_wait(&m_doneSemaphore) != 0)
+    {
+        // interrupted by a signal, keep waiting
+    }
+#endif
+}
+
+
+// private:
+
+#if defined(_WIN32)
+DWORD WINAPI WorkerPool::workerMain(LPVOID parameter)
+{
+    ((WorkerPool *)parameter)->workerLoop();
+    return 0;
+}
+#else
+void * WorkerPool::workerMain(void * parameter)
+{
+    ((WorkerPool *)parameter)->workerLoop();
+    return 0;
+}
+#endif
+
+
+void WorkerPool::workerLoop()
+{
+    // the calling thread is 0, so workers count up from 1
+    unsigned thread = atomicIncrement(&m_startedThreads);
+
+    while (true)
+    {
+#if defined(_WIN32)
+        WaitForSingleObject(m_wakeSemaphore, INFINITE);
+#else
+        if (sem_wait(&m_wakeSemaphore) != 0)
+        {
+            // interrupted by a signal, go back to sleep
+            continue;
+        }
+#endif
+        if (m_quit)
+        {
+            break;
+        }
+        doWork(thread);
+
+        if (atomicDecrement(&m_workersLeft) == 0)
+        {
+#if defined(_WIN32)
+            SetEvent(m_doneEvent);
+#else
+            sem_post(&m_doneSemaphore);
+#endif
+        }
+    }
+}
+
+
+void WorkerPool::wake()
+{
+#if defined(_WIN32)
+    ReleaseSemaphore(m_wakeSemaphore, m_threadCount, 0);
+#else
+    for (unsigned i = 0; i < m_threadCount; i++)
+    {
+        sem_post(&m_wakeSemaphore);
+    }
+#endif
+}
+
+
+void WorkerPool::doWork(unsigned thread)
+{
+    long index = atomicIncrement(&m_nextIndex) - 1;
+    while (index < m_count)
+    {
+        m_job(m_data, index, thread);
+        index = atomicIncrement(&m_nextIndex) - 1;
+    }
+}
@@ -0,0 +1,139 @@
+/* ==========================================================================
+   >File: WorkerPool.h
+   >Date: 20180713
+   >Author: Vik Pandher
+   >Details: A handful of threads that split up a job. A job is a function
+             that gets called once for every index from 0 to some count.
+   ========================================================================== */
+
+#pragma once
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <semaphore.h>
+#endif
+#include "ErrorCodes.h"
+#include "Atomics.h"
+
+
+
+// A job gets called once per index. Every call gets the same data pointer.
+// thread is 0 on the calling thread and 1 to getThreadCount() - 1 on the
+// workers, so a job can keep scratch memory per thread.
+typedef void(*WorkerJob)(void * data, unsigned index, unsigned thread);
+
+
+// Keeps some threads asleep until there's work for them. When a job is run,
+// the threads and the calling thread grab indices until there are none left.
+// Indices can be done in any order and on any thread, so jobs need to make
+// sure different indices don't write to the same memory.
+class WorkerPool
+{
+public:
+    // WorkerPool
+    // ====================================================================== //
+    // Start up the worker threads. They sleep until run is called.
+    // 
+    // @params
+    // * unsigned threadCount = 0, number of worker threads. If 0, one less
+    //                             then the number of processors is used,
+    //                             since the calling thread helps out too.
+    WorkerPool(unsigned threadCount = 0);
+
+    // ~WorkerPool
+    // ====================================================================== //
+    // Wake up the threads, tell them to quit, and wait till they do.
+    ~WorkerPool();
+
+    // run
+    // ====================================================================== //
+    // Call the job for every index from 0 to count - 1, using the worker
+    // threads and the calling thread. Doesn't return until every index is
+    // done.
+    // 
+    // @params
+    // * WorkerJob job, function called once per index
+    // * void * data, passed into every job call
+    // * unsigned count, number of indices
+    void run(WorkerJob job, void * data, unsigned count);
+
+    // getThreadCount
+    // ====================================================================== //
+    // 
+    // @return
+    // The number of threads that can work on a job, including the caller.
+    inline unsigned getThreadCount() const
+    {
+        return m_threadCount + 1;
+    }
+
+private:
+    // workerMain
+    // ====================================================================== //
+    // Where the worker threads start, it just calls workerLoop.
+    // 
+    // @params
+    // * parameter, pointer to the WorkerPool
+#if defined(_WIN32)
+    static DWORD WINAPI workerMain(LPVOID parameter);
+#else
+    static void * workerMain(void * parameter);
+#endif
+
+    // workerLoop
+    // ====================================================================== //
+    // Where the worker threads live. Take a thread number, then sleep, help
+    // with the job, repeat.
+    void workerLoop();
+
+    // wake
+    // ====================================================================== //
+    // Wake up every worker thread once.
+    void wake();
+
+    // doWork
+    // ====================================================================== //
+    // Grab indices from the current job and do them until there are none
+    // left.
+    // 
+    // @params
+    // * unsigned thread, number of the thread doing the work, passed to the
+    //                    job
+    void doWork(unsigned thread);
+
+private:
+    unsigned m_threadCount;
+
+#if defined(_WIN32)
+    HANDLE * m_threads;
+
+    // released once per thread to wake them up for a job
+    HANDLE m_wakeSemaphore;
+
+    // set when the last woken thread is done with a job
+    HANDLE m_doneEvent;
+#else
+    pthread_t * m_threads;
+    sem_t m_wakeSemaphore;
+
+    // posted once when the last woken thread is done with a job
+    sem_t m_doneSemaphore;
+#endif
+
+    // the current job
+    WorkerJob m_job;
+    void * m_data;
+    long m_count;
+    volatile long m_nextIndex;
+
+    // Threads that still need to finish the current job. Every thread is
+    // woken for every job and run waits for all of them, so no thread can
+    // still be looking at a job once run returns.
+    volatile long m_workersLeft;
+
+    volatile long m_quit;
+
+    // worker threads that have taken a thread number so far
+    volatile long m_startedThreads;
+};